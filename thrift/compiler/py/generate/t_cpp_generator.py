@@ -152,7 +152,8 @@ class CppGenerator(t_generator.Generator):
             btype = ttype.as_base_type
             bname = self._base_type_name(btype.base)
             if arg and ttype.is_string:
-                return self._reference_name(bname, unique)
+                return self._reference_name(
+                    self._cpp_type_name(ttype, bname), unique)
             return self._cpp_type_name(ttype, bname)
         # Check for a custom overloaded C++ name
         if ttype.is_container:
@@ -250,6 +251,15 @@ class CppGenerator(t_generator.Generator):
     def _has_isset(self, f):
         return not self._is_reference(f) and f.req != e_req.required
 
+    def _is_lazy(self, f, obj, pointers=False):
+        'Whether a field of obj is stored undecoded until first accessed.'
+        if (pointers or self.flag_compatibility or obj.is_union or
+                self._is_reference(f) or
+                not self._has_cpp_annotation(f, 'lazy')):
+            return False
+        t = self._get_true_type(f.type)
+        return t.is_struct or t.is_xception or t.is_container
+
     # noncopyable is a hack to support gcc < 4.8, where declaring a constructor
     # as defaulted tries to generate it, even though it should be deleted.
     def _is_copyable_struct(self, ttype):
@@ -1031,10 +1041,7 @@ class CppGenerator(t_generator.Generator):
                 ctx = 'nullptr'
             out('folly::IOBufQueue queue = serializeException("{0}", &prot, {1}, {2}, '
                 'x);'.format(functionname, seqid, ctx))
-            out('queue.append(apache::thrift::transport::THeader::transform('
-                'queue.move(), '
-                '{0}->getTransforms(), '
-                '{0}->getMinCompressBytes()));'.format(reqCtx))
+            out('{0}->transformReply(queue);'.format(reqCtx))
             if is_in_eb:
                 out('req->sendReply(queue.move());')
             else:
@@ -1135,6 +1142,37 @@ class CppGenerator(t_generator.Generator):
         out('iface_->{0}({1});'.format(self._get_async_func_name(function),
                                      ", ".join(args)))
 
+    def _generate_find_method(self, service):
+        '''Maps a method name to its index in service.functions, or -1.
+
+        The names are known at generation time, so instead of hashing the
+        name at runtime we switch on its length and first character and
+        compare against the (usually single) remaining candidate.'''
+        by_length = {}
+        for i, function in enumerate(service.functions):
+            by_length.setdefault(len(function.name), []).append(
+                (i, function.name))
+        with out().defn('int32_t {name}(folly::StringPiece fname)',
+                        name='findMethod',
+                        modifiers='static'):
+            switch = out('switch(fname.size())').scope
+            for length in sorted(by_length):
+                with switch.case(str(length)):
+                    by_char = {}
+                    for i, name in by_length[length]:
+                        by_char.setdefault(name[0], []).append((i, name))
+                    cswitch = out('switch(fname[0])').scope
+                    for c in sorted(by_char):
+                        with cswitch.case("'{0}'".format(c)):
+                            for i, name in by_char[c]:
+                                with out(('if (memcmp(fname.data() + 1, ' +
+                                          '"{0}", {1}) == 0)').format(
+                                              name[1:], length - 1)):
+                                    out('return {0};'.format(i))
+                    cswitch.release()
+            switch.release()
+            out('return -1;')
+
     def _generate_processor(self, service, s):
         if not service.extends:
             class_signature = 'class {0} : '.format(
@@ -1163,7 +1201,7 @@ class CppGenerator(t_generator.Generator):
                         'apache::thrift::concurrency::ThreadManager* tm)',
                         name='process',
                         modifiers='virtual'):
-                out('std::string fname;')
+                out('folly::fbstring fname;')
                 out('apache::thrift::MessageType mtype;')
                 out('int32_t protoSeqId = 0;')
                 switch = out('switch(protType)').scope
@@ -1199,10 +1237,17 @@ class CppGenerator(t_generator.Generator):
                                 service, '"invalid message arguments"',
                                 "process", "protoSeqId", False, out(),
                                 'context', False)
-                        out('auto pfn = {0}ProcessMap_.find(fname);'.format(
-                                shortprot))
-                        with out('if (pfn == {0}ProcessMap_.end())'.format(
-                                shortprot)):
+                        fswitch = out('switch(findMethod(fname))').scope
+                        for i, function in enumerate(service.functions):
+                            with fswitch.case(str(i), nobreak=True):
+                                out(('{0}<apache::thrift::{1}Reader, ' +
+                                   'apache::thrift::{1}Writer>(' +
+                                   'std::move(req), std::move(buf), ' +
+                                   'std::move(iprot), context, eb, tm);')
+                                   .format(self._get_handler_function_name(
+                                       function), protname))
+                                out('return;')
+                        with fswitch.case('default', nobreak=True):
                             if not service.extends:
                                 out('const std::string exMsg = ' +
                                   'folly::stringPrintf(' +
@@ -1219,9 +1264,7 @@ class CppGenerator(t_generator.Generator):
                                   'AsyncProcessor::process(std::move(req), ' +
                                   'std::move(buf), protType, context, eb, tm);')
                             out('return;')
-                        out('(this->*(pfn->second))(std::move(req), ' +
-                          'std::move(buf), std::move(iprot), context, eb, tm);')
-                        out('return;')
+                        fswitch.release()
                 with switch.case('default'):
                     out('LOG(ERROR) << "invalid protType: " << protType;')
                     out('return;')
@@ -1231,7 +1274,7 @@ class CppGenerator(t_generator.Generator):
                     'const apache::thrift::transport::THeader* header)',
                         name='isOnewayMethod',
                         modifiers='virtual'):
-                out('std::string fname;')
+                out('folly::fbstring fname;')
                 out('apache::thrift::MessageType mtype;')
                 out('int32_t protoSeqId = 0;')
                 out('apache::thrift::protocol::PROTOCOL_TYPES protType = ' +
@@ -1247,8 +1290,15 @@ class CppGenerator(t_generator.Generator):
                         with out('try'):
                             out('iprot.readMessageBegin(fname, mtype,' +
                                   ' protoSeqId);')
-                            out('auto it = onewayMethods.find(fname);')
-                            out('return it != onewayMethods.end();')
+                            oneways = [str(i) for i, function
+                                       in enumerate(service.functions)
+                                       if function.oneway]
+                            if oneways:
+                                out('int32_t index = findMethod(fname);')
+                                out('return ' + ' || '.join(
+                                    'index == ' + i for i in oneways) + ';')
+                            else:
+                                out('return false;')
                             with out().catch('const apache::thrift::'
                                              'TException& ex'):
                                 out('LOG(ERROR) << "received invalid message' +
@@ -1260,42 +1310,7 @@ class CppGenerator(t_generator.Generator):
                 out('return false;')
 
             out().label('private:')
-            oneways = out().defn('std::unordered_set<std::string> {name}',
-                                 name='onewayMethods',
-                                 modifiers='static')
-            oneways.epilogue = ';\n'
-            with oneways:
-                out(',\n'.join('"' + function.name + '"'
-                        for function in service.functions if function.oneway))
-            for shortprot, protname, prottype in self.protocols:
-                out(('typedef void ({0}::*{1}ProcessFunction)(std::unique_ptr' +
-                   '<apache::thrift::ResponseChannel::Request> req, ').format(
-                           service.name + "AsyncProcessor", shortprot) +
-                  'std::unique_ptr<folly::IOBuf> buf, ' +
-                  'std::unique_ptr<apache::thrift::{0}Reader> iprot, '.format(
-                          protname) +
-                  'apache::thrift::Cpp2RequestContext* context, ' +
-                  'apache::thrift::async::TEventBase* eb, ' +
-                  'apache::thrift::concurrency::ThreadManager* tm' + ');')
-                out('typedef std::unordered_map<std::string, ' +
-                  '{0}ProcessFunction>'.format(shortprot) +
-                  ' {0}ProcessMap;'.format(shortprot))
-                map_type = '{0}::{1}ProcessMap'.format(
-                    service.name + "AsyncProcessor",
-                    shortprot)
-                map_name = '{0}ProcessMap_'.format(shortprot)
-                process_map = out().defn(map_type + ' {name}',
-                                         name=map_name,
-                                         modifiers='static')
-                process_map.epilogue = ';'
-
-                with process_map:
-                    out(',\n'.join('{"' + function.name + '", &' +
-                        service.name + 'AsyncProcessor::' +
-                        self._get_handler_function_name(function) +
-                        '<apache::thrift::{0}Reader, '
-                        'apache::thrift::{0}Writer>}}'.format(protname)
-                            for function in service.functions))
+            self._generate_find_method(service)
             for function in service.functions:
                 loadname = '"{0}.{1}"'.format(service.name, function.name)
                 if not self._is_processed_in_eb(function):
@@ -1411,11 +1426,7 @@ class CppGenerator(t_generator.Generator):
                             out('auto queue = serializeResponse('
                               '"{0}", &prot, protoSeqId, ctx.get(),'
                               ' result);'.format(function.name))
-                            out('queue.append('
-                                'apache::thrift::transport::THeader::transform('
-                                'queue.move(), '
-                                '{0}->getTransforms(), '
-                                '{0}->getMinCompressBytes()));'.format('reqCtx'))
+                            out('reqCtx->transformReply(queue);')
                             out('return req->sendReply(queue.move());')
                     with out().defn(
                         'template <class ProtocolIn_, class ProtocolOut_>\n' +
@@ -1460,11 +1471,7 @@ class CppGenerator(t_generator.Generator):
                             out('auto queue = serializeResponse('
                                 '"{0}", &prot, protoSeqId, ctx.get(),'
                                 ' result);'.format(function.name))
-                            out('queue.append('
-                                'apache::thrift::transport::THeader::transform('
-                                'queue.move(), '
-                                '{0}->getTransforms(), '
-                                '{0}->getMinCompressBytes()));'.format('reqCtx'))
+                            out('reqCtx->transformReply(queue);')
                             out('return req->sendReply(queue.move());')
 
 
@@ -2385,7 +2392,9 @@ class CppGenerator(t_generator.Generator):
                             t = self._get_true_type(member.type)
                             name = member.name + \
                                 self._type_access_suffix(member.type)
-                            if t.is_base_type or t.is_enum:
+                            if self._is_lazy(member, obj, pointers):
+                                out('{0}.clear();'.format(name))
+                            elif t.is_base_type or t.is_enum:
                                 dval = self._member_default_value(
                                         member, explicit=True)
                                 out('{0} = {1};'.format(name, dval))
@@ -2430,6 +2439,10 @@ class CppGenerator(t_generator.Generator):
 
         # Declare all fields.
         for member in members:
+            if self._is_lazy(member, obj, pointers):
+                s1('apache::thrift::LazyField< {0}> {1};'.format(
+                    self._type_name(member.type), member.name))
+                continue
             s1(self._declare_field(
                 member,
                 pointers and not member.type.is_xception,
@@ -2491,6 +2504,9 @@ class CppGenerator(t_generator.Generator):
                             check = "apache::thrift::StringTraits<{0}>::" \
                                 "isEqual({1}, rhs.{1})".format(
                                 self._type_name(ctype), m.name)
+                        if self._is_lazy(m, obj, pointers):
+                            check = "(get_{0}() == rhs.get_{0}())".format(
+                                m.name)
                         if m.req != e_req.optional or not self._has_isset(m):
                             with out('if (!({0}))'.format(
                                     check)):
@@ -2521,9 +2537,11 @@ class CppGenerator(t_generator.Generator):
                             default='return false;')
                     else:
                         for m in members:
+                            f = ('get_{0}()' if self._is_lazy(m, obj, pointers)
+                                 else '{0}').format(m.name)
                             with out('if (!({0} == rhs.{0}))'
-                                    .format(m.name)):
-                                out('return {0} < rhs.{0};'.format(m.name))
+                                    .format(f)):
+                                out('return {0} < rhs.{0};'.format(f))
                         out('return false;')
             else:
                 struct('bool operator < (const {0}& rhs) const;'
@@ -2567,6 +2585,10 @@ class CppGenerator(t_generator.Generator):
             struct()
             struct('Type getType() const { return type_; }')
 
+        for member in members:
+            if self._is_lazy(member, obj, pointers):
+                self._generate_lazy_field_accessors(struct, member)
+
         if read or write:
             struct()
         if read:
@@ -2721,7 +2743,10 @@ class CppGenerator(t_generator.Generator):
                     s4(field_prefix + 'set_{0}();'.format(field.name))
                     field_prefix += 'mutable_'
                     field_suffix = '()'
-                if pointers and not field.type.is_xception:
+                if self._is_lazy(field, obj, pointers):
+                    s4('xfer += {0}{1}.readSerialized(iprot, ftype);'.format(
+                        field_prefix, field.name))
+                elif pointers and not field.type.is_xception:
                     # This is only used for read pargs, so a const-cast is okay
                     # since the struct is exposed in generated code only.
                     self._generate_deserialize_field(
@@ -2790,6 +2815,47 @@ class CppGenerator(t_generator.Generator):
         s('return xfer;')
         s.release()  # the function
 
+    def _generate_lazy_field_accessors(self, struct, field):
+        'Generates the decode-on-access accessors of a (cpp.lazy) field.'
+        tname = self._type_name(field.type)
+        reader = '__lazy_read_' + field.name
+        loader = '__lazy_load_' + field.name
+
+        struct()
+        with struct.defn('const {0}& {{name}}() const'.format(tname),
+                         name='get_' + field.name):
+            out('{0}.load({1});'.format(field.name, loader))
+            out('return {0}.value();'.format(field.name))
+        with struct.defn('{0}& {{name}}()'.format(tname),
+                         name='mutable_' + field.name):
+            out('{0}.load({1});'.format(field.name, loader))
+            out('return {0}.value();'.format(field.name))
+
+        struct.label('private:')
+        with struct.defn('template <class Protocol_>\n'
+                         'uint32_t {{name}}(Protocol_* iprot, {0}& value)'
+                         .format(tname),
+                         name=reader, modifiers='static',
+                         output=self._out_tcc):
+            out('uint32_t xfer = 0;')
+            self._generate_deserialize_type(out(), field.type, 'value')
+            out('return xfer;')
+        with struct.defn('void {{name}}(apache::thrift::ProtocolType type, '
+                         'const folly::IOBuf* buf, {0}& value)'.format(tname),
+                         name=loader, modifiers='static'):
+            switch = out('switch (type)').scope
+            for shortprot, protname, prottype in self.protocols:
+                with switch.case('apache::thrift::protocol::' + prottype):
+                    out('apache::thrift::{0}Reader reader;'.format(protname))
+                    out('reader.setInput(buf);')
+                    out('{0}(&reader, value);'.format(reader))
+            with switch.case('default', nobreak=True):
+                out('using apache::thrift::TProtocolException;')
+                out('throw TProtocolException('
+                    'TProtocolException::NOT_IMPLEMENTED);')
+            switch.release()
+        struct.label('public:')
+
     def _generate_deserialize_field(self, scope, field, prefix='', suffix=''):
         'Deserializes a field of any type.'
         name = prefix + field.name + self._type_access_suffix(field.type) + \
@@ -2899,6 +2965,12 @@ class CppGenerator(t_generator.Generator):
             s(txt)
             if not use_push:
                 s('{0}.resize({1});'.format(prefix, size))
+                if self._is_integral_list(cont):
+                    # Protocols decode lists of integers in bulk
+                    s('xfer += iprot->readIntegralList({0}.data(), {1});'
+                      .format(prefix, size))
+                    s('xfer += iprot->readListEnd();')
+                    return
         # For loop iterates over elements
         i = self.tmp('_i')
         s('uint32_t {0};'.format(i))
@@ -2918,6 +2990,19 @@ class CppGenerator(t_generator.Generator):
         elif cont.is_list:
             s('xfer += iprot->readListEnd();')
 
+    def _is_integral_list(self, cont):
+        'Whether cont is a list whose elements are plain i16, i32 or i64'
+        elem = cont.as_list.elem_type
+        t = self._get_true_type(elem)
+        if not t.is_base_type:
+            return False
+        base = t.as_base_type.base
+        if base not in (frontend.t_base.i16, frontend.t_base.i32,
+                        frontend.t_base.i64):
+            return False
+        # A cpp.type annotation changes the C++ element type
+        return self._type_name(t) == self._base_type_name(base)
+
     def _generate_deserialize_map_element(self, scope, tmap, prefix):
         'Generates code to deserialize a map'
         key = self.tmp('_key')
@@ -3022,7 +3107,13 @@ class CppGenerator(t_generator.Generator):
             if obj.is_union:
                 field_prefix += 'get_'
                 field_suffix = '()'
-            if pointers and not field.type.is_xception:
+            if self._is_lazy(field, obj, pointers):
+                self._generate_serialize_lazy_field(
+                    s1, field, this,
+                    method="serializedSize",
+                    struct_method=method,
+                    binary_method=method)
+            elif pointers and not field.type.is_xception:
                 self._generate_serialize_field(
                     s1, field,
                     '(*const_cast<{0}*>('.format(
@@ -3054,6 +3145,9 @@ class CppGenerator(t_generator.Generator):
     def _try_terse_write(self, field, this, s, pointers):
         'Generates a terse write predicate for unspecified field, if possible'
         t = self._get_true_type(field.type)
+        # Checking a lazy field for emptiness would decode it.
+        if self._has_cpp_annotation(field, 'lazy'):
+            return s
         # Not possible for void/struct/exception.
         if t.is_void or t.is_struct or t.is_xception:
             return s
@@ -3157,7 +3251,9 @@ class CppGenerator(t_generator.Generator):
             if obj.is_union:
                 field_prefix += 'get_'
                 field_suffix = '()'
-            if pointers and not field.type.is_xception:
+            if self._is_lazy(field, obj, pointers):
+                self._generate_serialize_lazy_field(s1, field, this)
+            elif pointers and not field.type.is_xception:
                 self._generate_serialize_field(
                     s1, field,
                     '(*const_cast<{0}*>('.format(
@@ -3184,6 +3280,28 @@ class CppGenerator(t_generator.Generator):
         s('return xfer;')
         s.release()  # the function
 
+    def _generate_serialize_lazy_field(self, scope, tfield, this,
+                                       method='write',
+                                       struct_method=None,
+                                       binary_method=None):
+        'Copies undecoded bytes through when the protocols match.'
+        name = '{0}->{1}'.format(this, tfield.name)
+        with scope('if ({0}.isSerialized() && '
+                   '{0}.getProtocolType() == prot_->protocolType())'
+                   .format(name)):
+            if method == 'write':
+                out('xfer += prot_->writeSerializedData('
+                    '{0}.getSerialized());'.format(name))
+            else:
+                out('xfer += prot_->serializedSizeSerializedData('
+                    '{0}.getSerialized());'.format(name))
+        with scope.sameLine('else'):
+            self._generate_serialize_field(out(), tfield,
+                                           this + '->get_', '()',
+                                           method=method,
+                                           struct_method=struct_method,
+                                           binary_method=binary_method)
+
     def _generate_serialize_field(self, scope, tfield, prefix='', suffix='',
                                   method='write',
                                   struct_method=None,
@@ -3375,6 +3493,10 @@ class CppGenerator(t_generator.Generator):
 
     def _generate_frozen_layout(self, obj, s):
         fields = sorted(obj.as_struct.members, key=lambda field: field.key)
+        for f in fields:
+            if self._is_lazy(f, obj):
+                raise CompilerError('frozen2 does not support (cpp.lazy) '
+                                    'field {0}.{1}'.format(obj.name, f.name))
         type_name = self._type_name(obj)
 
         def visitFields(fmt, fieldFmt, **kwargs):
@@ -3693,6 +3815,7 @@ class CppGenerator(t_generator.Generator):
             s('#include <thrift/lib/cpp2/protocol/{0}.h>'.format(b))
         s('#include <thrift/lib/cpp2/protocol/DebugProtocol.h>')
         s('#include <thrift/lib/cpp2/protocol/VirtualProtocol.h>')
+        s('#include <thrift/lib/cpp2/LazyField.h>')
         s('#include <thrift/lib/cpp/protocol/TProtocol.h>')
         if not self.flag_bootstrap:
             s('#include <thrift/lib/cpp/TApplicationException.h>')
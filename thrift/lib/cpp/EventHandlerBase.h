@@ -21,6 +21,7 @@
 #include <vector>
 #include <memory>
 #include <thrift/lib/cpp/concurrency/Mutex.h>
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
 #include <thrift/lib/cpp/protocol/TProtocolTypes.h>
 #include <thrift/lib/cpp/transport/TSocketAddress.h>
 #include <thrift/lib/cpp/server/TConnectionContext.h>
@@ -171,7 +172,7 @@ class TProcessorContextFreer {
   const char* method_;
 };
 
-class ContextStack {
+class ContextStack : public concurrency::PoolAllocated {
   friend class EventHandlerBase;
 
  public:
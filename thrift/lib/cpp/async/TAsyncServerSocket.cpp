@@ -132,6 +132,7 @@ TAsyncServerSocket::TAsyncServerSocket(TEventBase* eventBase)
     backoffTimeout_(nullptr),
     callbacks_(),
     keepAliveEnabled_(true),
+    reusePortEnabled_(false),
     closeOnExec_(true),
     shutdownSocketSet_(nullptr) {
 }
@@ -371,6 +372,52 @@ void TAsyncServerSocket::bind(uint16_t port) {
   }
 }
 
+void TAsyncServerSocket::bind(
+    const std::vector<folly::SocketAddress>& addresses) {
+  assert(eventBase_ == nullptr || eventBase_->isInEventBaseThread());
+
+  if (sockets_.size() > 0) {
+    throw TTransportException(TTransportException::ALREADY_OPEN,
+                              "cannot bind multiple addresses on a "
+                              "TAsyncServerSocket that already has a socket");
+  }
+  if (addresses.empty()) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "no addresses to bind async server socket to");
+  }
+
+  for (const auto& address : addresses) {
+    int fd = createSocket(address.getFamily());
+
+    if (address.getFamily() == AF_INET6) {
+      int v6only = 1;
+      if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY,
+                     &v6only, sizeof(v6only)) != 0) {
+        ::close(fd);
+        throw TTransportException(TTransportException::NOT_OPEN,
+                                  "failed to set IPV6_V6ONLY on async server "
+                                  "socket",
+                                  errno);
+      }
+    }
+
+    sockaddr_storage addrStorage;
+    address.getAddress(&addrStorage);
+    sockaddr* saddr = reinterpret_cast<sockaddr*>(&addrStorage);
+    if (::bind(fd, saddr, address.getActualSize()) != 0) {
+      ::close(fd);
+      throw TTransportException(TTransportException::COULD_NOT_BIND,
+                                "failed to bind to async server socket: " +
+                                address.describe(),
+                                errno);
+    }
+
+    sockets_.push_back(
+      ServerEventHandler(eventBase_, fd, this, address.getFamily()));
+    sockets_.back().changeHandlerFD(fd);
+  }
+}
+
 void TAsyncServerSocket::listen(int backlog) {
   assert(eventBase_ == nullptr || eventBase_->isInEventBaseThread());
 
@@ -570,6 +617,21 @@ void TAsyncServerSocket::setupSocket(int fd) {
             strerror(errno));
   }
 
+  // Set reuseport to allow sibling sockets bound to the same address
+  if (reusePortEnabled_) {
+#ifdef SO_REUSEPORT
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "failed to set SO_REUSEPORT on async server "
+                                "socket",
+                                errno);
+    }
+#else
+    throw TTransportException(TTransportException::NOT_SUPPORTED,
+                              "SO_REUSEPORT is not supported on this system");
+#endif
+  }
+
   // Set keepalive as desired
   int zero = 0;
   if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE,
@@ -262,6 +262,18 @@ class TAsyncServerSocket : public TDelayedDestruction {
    */
   virtual void bind(uint16_t port);
 
+  /**
+   * Bind one listening socket to each of the specified addresses.
+   *
+   * This is typically used to create a sibling of an already bound socket
+   * (see getAddresses()) when SO_REUSEPORT is enabled.
+   *
+   * This must be called from the primary TEventBase thread.
+   *
+   * Throws TTransportException on error.
+   */
+  void bind(const std::vector<folly::SocketAddress>& addresses);
+
   /**
    * Get the local address to which the socket is bound.
    *
@@ -515,6 +527,25 @@ class TAsyncServerSocket : public TDelayedDestruction {
     return keepAliveEnabled_;
   }
 
+  /**
+   * Set whether or not SO_REUSEPORT should be enabled on the server socket,
+   * allowing several listening sockets to be bound to the same address.  The
+   * kernel then load balances incoming connections across them.  By default,
+   * SO_REUSEPORT is disabled.
+   *
+   * This must be called before bind() to have any effect.
+   */
+  void setReusePortEnabled(bool enabled) {
+    reusePortEnabled_ = enabled;
+  }
+
+  /**
+   * Get whether or not SO_REUSEPORT is enabled on the server socket.
+   */
+  bool getReusePortEnabled() const {
+    return reusePortEnabled_;
+  }
+
   /**
    * Set whether or not the socket should close during exec() (FD_CLOEXEC). By
    * default, this is enabled
@@ -680,6 +711,7 @@ class TAsyncServerSocket : public TDelayedDestruction {
   BackoffTimeout *backoffTimeout_;
   std::vector<CallbackInfo> callbacks_;
   bool keepAliveEnabled_;
+  bool reusePortEnabled_;
   bool closeOnExec_;
   folly::ShutdownSocketSet* shutdownSocketSet_;
 };
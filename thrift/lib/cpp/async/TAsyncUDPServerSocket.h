@@ -72,6 +72,8 @@ class TAsyncUDPServerSocket : private TAsyncUDPSocket::ReadCallback {
   explicit TAsyncUDPServerSocket(TEventBase* evb, size_t sz = 1500)
       : evb_(evb),
         packetSize_(sz),
+        readBatch_(0),
+        gro_(false),
         nextListener_(0) {
   }
 
@@ -86,6 +88,28 @@ class TAsyncUDPServerSocket : private TAsyncUDPSocket::ReadCallback {
 
     socket_ = folly::make_unique<TAsyncUDPSocket>(evb_);
     socket_->bind(address);
+    if (readBatch_ > 0) {
+      socket_->setReadBatch(readBatch_, packetSize_);
+    }
+    if (gro_ && !socket_->setGRO(true)) {
+      LOG(WARNING) << "UDP server socket: GRO not supported";
+    }
+  }
+
+  /**
+   * Read up to `batchSize` packets per system call; see
+   * TAsyncUDPSocket::setReadBatch(). Takes effect at bind().
+   */
+  void setReadBatch(size_t batchSize) {
+    readBatch_ = batchSize;
+  }
+
+  /**
+   * Let the kernel coalesce packets from the same client; see
+   * TAsyncUDPSocket::setGRO(). Takes effect at bind().
+   */
+  void setGRO(bool enabled) {
+    gro_ = enabled;
   }
 
   folly::SocketAddress address() const {
@@ -134,8 +158,25 @@ class TAsyncUDPServerSocket : private TAsyncUDPSocket::ReadCallback {
                        size_t len,
                        bool truncated) noexcept {
     buf_.postallocate(len);
-    auto data = buf_.split(len);
+    dispatch(clientAddress, buf_.split(len), truncated);
+  }
+
+  bool onDatagram(const folly::SocketAddress& clientAddress,
+                  folly::ByteRange data,
+                  bool truncated) noexcept {
+    if (data.size() > packetSize_) {
+      data = data.subpiece(0, packetSize_);
+      truncated = true;
+    }
+    dispatch(clientAddress,
+             folly::IOBuf::copyBuffer(data.data(), data.size()),
+             truncated);
+    return true;
+  }
 
+  void dispatch(const folly::SocketAddress& clientAddress,
+                std::unique_ptr<folly::IOBuf> data,
+                bool truncated) noexcept {
     if (listeners_.empty()) {
       LOG(WARNING) << "UDP server socket dropping packet, "
                    << "no listener registered";
@@ -181,6 +222,8 @@ class TAsyncUDPServerSocket : private TAsyncUDPSocket::ReadCallback {
 
   TEventBase* const evb_;
   const size_t packetSize_;
+  size_t readBatch_;
+  bool gro_;
 
   std::unique_ptr<TAsyncUDPSocket> socket_;
 
@@ -21,15 +21,122 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <vector>
+
+// Not yet in every libc's headers
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
 using apache::thrift::transport::TTransportException;
 
 namespace apache { namespace thrift { namespace async {
 
+namespace {
+
+// Largest datagram GRO may hand us
+const size_t kMaxGROBuffer = 65535;
+// sendmmsg() and sendmsg() limits
+const size_t kMaxBatch = 1024;
+
+/**
+ * Appends the non-empty buffers of a chain to vec, returning how many.
+ */
+size_t appendIov(const folly::IOBuf* head, std::vector<iovec>& vec) {
+  size_t count = 0;
+  const folly::IOBuf* next = head;
+  do {
+    if (next->length() != 0) {
+      iovec iov;
+      iov.iov_base = const_cast<uint8_t*>(next->data());
+      iov.iov_len = next->length();
+      vec.push_back(iov);
+      ++count;
+    }
+    next = next->next();
+  } while (next != head);
+  return count;
+}
+
+}
+
+struct TAsyncUDPSocket::ReadRing {
+  ReadRing(size_t batchSize, size_t bufferSize)
+      : bufferSize(bufferSize),
+        buffers(new uint8_t[batchSize * bufferSize]),
+        msgs(batchSize),
+        iovs(batchSize),
+        addrs(batchSize),
+        controls(batchSize) {
+    for (size_t i = 0; i < batchSize; ++i) {
+      iovs[i].iov_base = buffers.get() + i * bufferSize;
+      iovs[i].iov_len = bufferSize;
+    }
+  }
+
+  // Resets the headers clobbered by the previous ::recvmmsg
+  void reset() {
+    for (size_t i = 0; i < msgs.size(); ++i) {
+      auto& hdr = msgs[i].msg_hdr;
+      memset(&hdr, 0, sizeof(hdr));
+      hdr.msg_name = &addrs[i];
+      hdr.msg_namelen = sizeof(addrs[i]);
+      hdr.msg_iov = &iovs[i];
+      hdr.msg_iovlen = 1;
+      hdr.msg_control = controls[i].data;
+      hdr.msg_controllen = sizeof(controls[i].data);
+      msgs[i].msg_len = 0;
+    }
+  }
+
+  struct Control {
+    char data[CMSG_SPACE(sizeof(int))];
+  };
+
+  const size_t bufferSize;
+  std::unique_ptr<uint8_t[]> buffers;
+  std::vector<mmsghdr> msgs;
+  std::vector<iovec> iovs;
+  std::vector<sockaddr_storage> addrs;
+  std::vector<Control> controls;
+};
+
+bool TAsyncUDPSocket::ReadCallback::onDatagram(
+    const folly::SocketAddress& client,
+    folly::ByteRange data,
+    bool truncated) noexcept {
+  void* buf{nullptr};
+  size_t len{0};
+  getReadBuffer(&buf, &len);
+  if (buf == nullptr || len == 0) {
+    return false;
+  }
+  if (data.size() > len) {
+    truncated = true;
+    data = data.subpiece(0, len);
+  }
+  memcpy(buf, data.data(), data.size());
+  onDataAvailable(client, data.size(), truncated);
+  return true;
+}
+
 TAsyncUDPSocket::TAsyncUDPSocket(TEventBase* evb)
     : TEventHandler(CHECK_NOTNULL(evb)),
       eventBase_(evb),
       fd_(-1),
-      readCallback_(nullptr) {
+      readCallback_(nullptr),
+      deliveringBatch_(false),
+      gro_(false),
+      reusePort_(false) {
   DCHECK(evb->isInEventBaseThread());
 }
 
@@ -69,6 +176,17 @@ void TAsyncUDPSocket::bind(const folly::SocketAddress& address) {
                               errno);
   }
 
+  if (reusePort_ &&
+      setsockopt(socket,
+                 SOL_SOCKET,
+                 SO_REUSEPORT,
+                 &value,
+                 sizeof(value)) != 0) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "failed to put socket in reuse port mode",
+                              errno);
+  }
+
   // bind to the address
   sockaddr_storage addrStorage;
   address.getAddress(&addrStorage);
@@ -109,19 +227,142 @@ ssize_t TAsyncUDPSocket::write(const folly::SocketAddress& address,
                                const std::unique_ptr<folly::IOBuf>& buf) {
   CHECK_NE(-1, fd_) << "Socket not yet bound";
 
-  // XXX: Use `sendmsg` instead of coalescing here
-  buf->coalesce();
+  if (buf->countChainElements() > kMaxBatch) {
+    buf->coalesce();
+  }
+  std::vector<iovec> vec;
+  appendIov(buf.get(), vec);
 
   sockaddr_storage addrStorage;
   address.getAddress(&addrStorage);
-  sockaddr* saddr = reinterpret_cast<sockaddr*>(&addrStorage);
 
-  return ::sendto(fd_,
-                  buf->data(),
-                  buf->length(),
-                  MSG_DONTWAIT,
-                  saddr,
-                  address.getActualSize());
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &addrStorage;
+  msg.msg_namelen = address.getActualSize();
+  msg.msg_iov = vec.data();
+  msg.msg_iovlen = vec.size();
+
+  return ::sendmsg(fd_, &msg, MSG_DONTWAIT);
+}
+
+int TAsyncUDPSocket::writeMany(const folly::SocketAddress& address,
+                               const std::unique_ptr<folly::IOBuf>* bufs,
+                               size_t count) {
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+
+  sockaddr_storage addrStorage;
+  address.getAddress(&addrStorage);
+
+  size_t sent = 0;
+  while (sent < count) {
+    size_t batch = std::min(count - sent, kMaxBatch);
+    // Fill iovecs first, as pushing may move them
+    std::vector<iovec> vec;
+    std::vector<size_t> iovCounts(batch);
+    for (size_t i = 0; i < batch; ++i) {
+      auto& buf = bufs[sent + i];
+      if (buf->countChainElements() > kMaxBatch) {
+        buf->coalesce();
+      }
+      iovCounts[i] = appendIov(buf.get(), vec);
+    }
+
+    std::vector<mmsghdr> msgs(batch);
+    size_t iov = 0;
+    for (size_t i = 0; i < batch; ++i) {
+      auto& hdr = msgs[i].msg_hdr;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      hdr.msg_name = &addrStorage;
+      hdr.msg_namelen = address.getActualSize();
+      hdr.msg_iov = vec.data() + iov;
+      hdr.msg_iovlen = iovCounts[i];
+      iov += iovCounts[i];
+    }
+
+    int ret = ::sendmmsg(fd_, msgs.data(), batch, MSG_DONTWAIT);
+    if (ret < 0) {
+      return sent ? sent : -1;
+    }
+    sent += ret;
+    if (size_t(ret) < batch) {
+      break;
+    }
+  }
+  return sent;
+}
+
+ssize_t TAsyncUDPSocket::writeGSO(const folly::SocketAddress& address,
+                                  const std::unique_ptr<folly::IOBuf>& buf,
+                                  uint16_t segmentSize) {
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+
+  if (buf->countChainElements() > kMaxBatch) {
+    buf->coalesce();
+  }
+  std::vector<iovec> vec;
+  appendIov(buf.get(), vec);
+
+  sockaddr_storage addrStorage;
+  address.getAddress(&addrStorage);
+
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  memset(control, 0, sizeof(control));
+
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &addrStorage;
+  msg.msg_namelen = address.getActualSize();
+  msg.msg_iov = vec.data();
+  msg.msg_iovlen = vec.size();
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = IPPROTO_UDP;
+  cm->cmsg_type = UDP_SEGMENT;
+  cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  memcpy(CMSG_DATA(cm), &segmentSize, sizeof(segmentSize));
+
+  return ::sendmsg(fd_, &msg, MSG_DONTWAIT);
+}
+
+bool TAsyncUDPSocket::isGSOSupported() const {
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+
+  int value = 0;
+  socklen_t len = sizeof(value);
+  return ::getsockopt(fd_, IPPROTO_UDP, UDP_SEGMENT, &value, &len) == 0;
+}
+
+void TAsyncUDPSocket::setReadBatch(size_t batchSize, size_t bufferSize) {
+  // The rest of the batch being delivered is still in the old ring
+  if (deliveringBatch_ && !retiredRing_) {
+    retiredRing_ = std::move(readRing_);
+  }
+  if (batchSize == 0) {
+    CHECK(!gro_) << "GRO needs batched reads";
+    readRing_.reset();
+    return;
+  }
+  if (gro_) {
+    bufferSize = std::max(bufferSize, kMaxGROBuffer);
+  }
+  readRing_.reset(new ReadRing(batchSize, bufferSize));
+}
+
+bool TAsyncUDPSocket::setGRO(bool enabled) {
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+
+  int value = enabled;
+  if (::setsockopt(fd_, IPPROTO_UDP, UDP_GRO, &value, sizeof(value)) != 0) {
+    return !enabled;
+  }
+  gro_ = enabled;
+  if (gro_ && (!readRing_ || readRing_->bufferSize < kMaxGROBuffer)) {
+    setReadBatch(readRing_ ? readRing_->msgs.size() : 16);
+  }
+  return true;
 }
 
 void TAsyncUDPSocket::resumeRead(ReadCallback* cob) {
@@ -173,21 +414,17 @@ void TAsyncUDPSocket::handlerReady(uint16_t events) noexcept {
 }
 
 void TAsyncUDPSocket::handleRead() noexcept {
+  if (readRing_) {
+    handleReadBatch();
+    return;
+  }
+
   void* buf{nullptr};
   size_t len{0};
 
   readCallback_->getReadBuffer(&buf, &len);
   if (buf == nullptr || len == 0) {
-    TTransportException ex(
-        TTransportException::BAD_ARGS,
-        "TAsyncUDPSocket::getReadBuffer() returned empty buffer");
-
-
-    auto cob = readCallback_;
-    readCallback_ = nullptr;
-
-    cob->onReadError(ex);
-    updateRegistration();
+    emptyReadBuffer();
     return;
   }
 
@@ -216,19 +453,86 @@ void TAsyncUDPSocket::handleRead() noexcept {
       return;
     }
 
-    TTransportException ex(TTransportException::INTERNAL_ERROR,
-                           "::recvfrom() failed",
-                           errno);
+    readError("::recvfrom() failed", errno);
+  }
+}
 
-    // In case of UDP we can continue reading from the socket
-    // even if the current request fails. We notify the user
-    // so that he can do some logging/stats collection if he wants.
-    auto cob = readCallback_;
-    readCallback_ = nullptr;
+void TAsyncUDPSocket::handleReadBatch() noexcept {
+  auto& ring = *readRing_;
+  ring.reset();
 
-    cob->onReadError(ex);
-    updateRegistration();
+  int count = ::recvmmsg(fd_, ring.msgs.data(), ring.msgs.size(),
+                         MSG_DONTWAIT, nullptr);
+  if (count < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      // No data could be read without blocking the socket
+      return;
+    }
+    readError("::recvmmsg() failed", errno);
+    return;
   }
+
+  // The callback may pause reading or close the socket, or change the read
+  // batch, which keeps this ring until the loop is done with it
+  deliveringBatch_ = true;
+  for (int i = 0; i < count && readCallback_; ++i) {
+    auto& hdr = ring.msgs[i].msg_hdr;
+    size_t len = ring.msgs[i].msg_len;
+    bool truncated = hdr.msg_flags & MSG_TRUNC;
+    clientAddress_.setFromSockaddr(
+      reinterpret_cast<sockaddr*>(hdr.msg_name), hdr.msg_namelen);
+
+    // GRO reports the size of the datagrams it coalesced
+    size_t segmentSize = len;
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+      if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO) {
+        int gsoSize;
+        memcpy(&gsoSize, CMSG_DATA(cm), sizeof(gsoSize));
+        if (gsoSize > 0) {
+          segmentSize = gsoSize;
+        }
+      }
+    }
+
+    auto data = reinterpret_cast<const uint8_t*>(ring.iovs[i].iov_base);
+    for (size_t offset = 0; offset < len && readCallback_;
+         offset += segmentSize) {
+      if (!readCallback_->onDatagram(
+            clientAddress_,
+            folly::ByteRange(data + offset,
+                             std::min(segmentSize, len - offset)),
+            truncated)) {
+        emptyReadBuffer();
+      }
+    }
+  }
+  deliveringBatch_ = false;
+  retiredRing_.reset();
+}
+
+void TAsyncUDPSocket::readError(const char* what, int err) noexcept {
+  TTransportException ex(TTransportException::INTERNAL_ERROR, what, err);
+
+  // In case of UDP we can continue reading from the socket
+  // even if the current request fails. We notify the user
+  // so that he can do some logging/stats collection if he wants.
+  auto cob = readCallback_;
+  readCallback_ = nullptr;
+
+  cob->onReadError(ex);
+  updateRegistration();
+}
+
+void TAsyncUDPSocket::emptyReadBuffer() noexcept {
+  TTransportException ex(
+      TTransportException::BAD_ARGS,
+      "TAsyncUDPSocket::getReadBuffer() returned empty buffer");
+
+  auto cob = readCallback_;
+  readCallback_ = nullptr;
+
+  cob->onReadError(ex);
+  updateRegistration();
 }
 
 bool TAsyncUDPSocket::updateRegistration() noexcept {
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <folly/io/IOBuf.h>
+#include <folly/Range.h>
 #include <folly/ScopeGuard.h>
 #include <thrift/lib/cpp/async/TEventHandler.h>
 #include <thrift/lib/cpp/async/TEventBase.h>
@@ -58,6 +59,22 @@ class TAsyncUDPSocket : public TEventHandler {
                                  size_t len,
                                  bool truncated) noexcept = 0;
 
+    /**
+     * Invoked for every datagram read when the socket reads in batches (see
+     * setReadBatch()), instead of getReadBuffer() and onDataAvailable().
+     * `data` is in the socket's buffers and only valid during the call.
+     *
+     * The default copies `data` into the getReadBuffer() buffer and calls
+     * onDataAvailable(), so existing callbacks work with batching unchanged.
+     *
+     * Returns false if getReadBuffer() returned an empty buffer: the socket
+     * then stops reading and reports BAD_ARGS to onReadError(), as it does
+     * without batching.
+     */
+    virtual bool onDatagram(const folly::SocketAddress& client,
+                            folly::ByteRange data,
+                            bool truncated) noexcept;
+
     /**
      * Invoked when there is an error reading from the socket.
      *
@@ -108,12 +125,61 @@ class TAsyncUDPSocket : public TEventHandler {
   void setFD(int fd, FDOwnership ownership);
 
   /**
-   * Send the data in buffer to destination. Returns the return code from
-   * ::sendto.
+   * Set SO_REUSEPORT on the socket bind() creates, so that several sockets
+   * can bind the same address and the kernel spreads senders over them.
+   */
+  void setReusePort(bool reusePort) {
+    reusePort_ = reusePort;
+  }
+
+  /**
+   * Send the data in buffer to destination, gathering the buffers of the
+   * chain without coalescing them. Returns the return code from ::sendmsg.
    */
   ssize_t write(const folly::SocketAddress& address,
                 const std::unique_ptr<folly::IOBuf>& buf);
 
+  /**
+   * Send each of the `count` chains in `bufs` as its own datagram to
+   * destination, in as few ::sendmmsg calls as possible. Returns the number of
+   * datagrams sent, which is less than `count` if the socket buffer filled
+   * up, or -1 with errno set if none was.
+   */
+  int writeMany(const folly::SocketAddress& address,
+                const std::unique_ptr<folly::IOBuf>* bufs,
+                size_t count);
+
+  /**
+   * Send buffer as datagrams of `segmentSize` bytes each (the last one may be
+   * shorter) with a single ::sendmsg, leaving the segmentation to the kernel
+   * or the NIC (UDP GSO). Returns the return code from ::sendmsg, which fails
+   * with EIO or ENOPROTOOPT where GSO is unsupported; see isGSOSupported().
+   */
+  ssize_t writeGSO(const folly::SocketAddress& address,
+                   const std::unique_ptr<folly::IOBuf>& buf,
+                   uint16_t segmentSize);
+
+  /**
+   * Whether the kernel supports UDP GSO on this socket.
+   */
+  bool isGSOSupported() const;
+
+  /**
+   * Read up to `batchSize` datagrams per ::recvmmsg call, into a ring of
+   * buffers of `bufferSize` bytes owned by the socket, and pass them to
+   * ReadCallback::onDatagram(). A `batchSize` of 0 goes back to reading one
+   * datagram per ::recvfrom into the callback's buffer.
+   */
+  void setReadBatch(size_t batchSize, size_t bufferSize = 2048);
+
+  /**
+   * Let the kernel coalesce consecutive datagrams from the same sender (UDP
+   * GRO). They are split again before reaching ReadCallback::onDatagram().
+   * Enables batched reads if needed, with buffers large enough for coalesced
+   * datagrams. Returns false if the kernel does not support it.
+   */
+  bool setGRO(bool enabled);
+
   /**
    * Start reading datagrams
    */
@@ -144,8 +210,14 @@ class TAsyncUDPSocket : public TEventHandler {
   void handlerReady(uint16_t events) noexcept;
 
   void handleRead() noexcept;
+  void handleReadBatch() noexcept;
+  void readError(const char* what, int err) noexcept;
+  void emptyReadBuffer() noexcept;
   bool updateRegistration() noexcept;
 
+  // Buffers and headers for ::recvmmsg
+  struct ReadRing;
+
   TEventBase* eventBase_;
   folly::SocketAddress localAddress_;
 
@@ -157,6 +229,15 @@ class TAsyncUDPSocket : public TEventHandler {
 
   // Non-null only when we are reading
   ReadCallback* readCallback_;
+
+  // Non-null when reading in batches
+  std::unique_ptr<ReadRing> readRing_;
+  // Ring replaced by a callback while its batch is delivered, freed after
+  std::unique_ptr<ReadRing> retiredRing_;
+  bool deliveringBatch_;
+  bool gro_;
+
+  bool reusePort_;
 };
 
 }}}
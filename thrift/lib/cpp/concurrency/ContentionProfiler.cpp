@@ -0,0 +1,280 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/concurrency/ContentionProfiler.h>
+
+#include <thrift/lib/cpp/concurrency/SpinLock.h>
+
+#include <folly/Demangle.h>
+#include <folly/ThreadLocal.h>
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace apache { namespace thrift { namespace concurrency {
+
+std::atomic<uint32_t> contentionSampleRate{0};
+__thread uint32_t contentionCountdown = 0;
+__thread const char* contentionTag = nullptr;
+
+namespace {
+
+const size_t kBuckets = ContentionSite::kBuckets;
+
+size_t bucket(int64_t usec) {
+  if (usec <= 0) {
+    return 0;
+  }
+  return std::min<size_t>(64 - __builtin_clzll(usec), kBuckets - 1);
+}
+
+// Upper bound of the bucket that holds the given fraction of the samples
+uint64_t percentile(const uint64_t* histogram, uint64_t count, double p) {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, uint64_t(count * p + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    seen += histogram[i];
+    if (seen >= rank) {
+      return uint64_t(1) << i;
+    }
+  }
+  return uint64_t(1) << (kBuckets - 1);
+}
+
+// A thread's sites are keyed by their tag or address; string literals and
+// code never share an address.
+typedef std::unordered_map<const void*, ContentionSite> SiteTable;
+
+// Merged sites are keyed by the contents of their tag instead, since each
+// translation unit may have its own copy of a literal
+typedef std::map<std::pair<const void*, std::string>, ContentionSite>
+  MergedSites;
+
+void mergeInto(MergedSites& table, const ContentionSite& site) {
+  auto key = site.tag ? std::make_pair(static_cast<const void*>(nullptr),
+                                       std::string(site.tag))
+                      : std::make_pair(site.address, std::string());
+  auto it = table.find(key);
+  if (it == table.end()) {
+    table.emplace(key, site);
+  } else {
+    it->second.merge(site);
+  }
+}
+
+// The sites of threads that have exited
+std::mutex retiredMutex;
+MergedSites& retiredSites() {
+  static auto sites = new MergedSites();
+  return *sites;
+}
+
+class ThreadProfile {
+ public:
+  ~ThreadProfile() {
+    std::lock_guard<std::mutex> g(retiredMutex);
+    for (const auto& entry : sites_) {
+      mergeInto(retiredSites(), entry.second);
+    }
+  }
+
+  void add(const void* address, const char* tag,
+           int64_t waitUsec, int64_t holdUsec) {
+    const void* key = tag ? static_cast<const void*>(tag) : address;
+    SpinLockGuard g(lock_);
+    auto& site = sites_[key];
+    if (site.samples == 0 && site.holds == 0) {
+      site.address = tag ? nullptr : address;
+      site.tag = tag;
+    }
+    site.add(waitUsec, holdUsec);
+  }
+
+  void collect(MergedSites& table) {
+    SpinLockGuard g(lock_);
+    for (const auto& entry : sites_) {
+      mergeInto(table, entry.second);
+    }
+  }
+
+  void reset() {
+    SpinLockGuard g(lock_);
+    sites_.clear();
+  }
+
+ private:
+  SpinLock lock_;
+  SiteTable sites_;
+};
+
+struct ThreadProfileTag {};
+typedef folly::ThreadLocal<ThreadProfile, ThreadProfileTag> ThreadProfiles;
+
+ThreadProfiles& threadProfile() {
+  static auto profile = new ThreadProfiles();
+  return *profile;
+}
+
+} // anonymous namespace
+
+ContentionSite::ContentionSite()
+  : address(nullptr),
+    tag(nullptr),
+    samples(0),
+    totalWaitUsec(0),
+    maxWaitUsec(0),
+    holds(0),
+    totalHoldUsec(0),
+    maxHoldUsec(0) {
+  memset(waitHistogram, 0, sizeof(waitHistogram));
+  memset(holdHistogram, 0, sizeof(holdHistogram));
+}
+
+void ContentionSite::add(int64_t waitUsec, int64_t holdUsec) {
+  uint64_t wait = std::max<int64_t>(waitUsec, 0);
+  ++samples;
+  totalWaitUsec += wait;
+  maxWaitUsec = std::max(maxWaitUsec, wait);
+  ++waitHistogram[bucket(wait)];
+  if (holdUsec >= 0) {
+    ++holds;
+    totalHoldUsec += holdUsec;
+    maxHoldUsec = std::max<uint64_t>(maxHoldUsec, holdUsec);
+    ++holdHistogram[bucket(holdUsec)];
+  }
+}
+
+void ContentionSite::merge(const ContentionSite& other) {
+  samples += other.samples;
+  totalWaitUsec += other.totalWaitUsec;
+  maxWaitUsec = std::max(maxWaitUsec, other.maxWaitUsec);
+  holds += other.holds;
+  totalHoldUsec += other.totalHoldUsec;
+  maxHoldUsec = std::max(maxHoldUsec, other.maxHoldUsec);
+  for (size_t i = 0; i < kBuckets; ++i) {
+    waitHistogram[i] += other.waitHistogram[i];
+    holdHistogram[i] += other.holdHistogram[i];
+  }
+}
+
+std::string ContentionSite::name() const {
+  if (tag) {
+    return tag;
+  }
+  char buf[64];
+  Dl_info info;
+  if (address && dladdr(address, &info) != 0) {
+    if (info.dli_sname) {
+      snprintf(buf, sizeof(buf), "+0x%lx",
+               (unsigned long)((const char*)address -
+                               (const char*)info.dli_saddr));
+      return folly::demangle(info.dli_sname).toStdString() + buf;
+    }
+    if (info.dli_fname) {
+      snprintf(buf, sizeof(buf), "+0x%lx",
+               (unsigned long)((const char*)address -
+                               (const char*)info.dli_fbase));
+      return std::string(info.dli_fname) + buf;
+    }
+  }
+  snprintf(buf, sizeof(buf), "%p", address);
+  return buf;
+}
+
+void enableContentionProfiling(uint32_t sampleRate) {
+  contentionSampleRate.store(sampleRate);
+}
+
+void recordContention(const void* address,
+                      const char* tag,
+                      int64_t waitUsec,
+                      int64_t holdUsec) {
+  threadProfile()->add(address, tag, waitUsec, holdUsec);
+}
+
+std::vector<ContentionSite> getContentionProfile() {
+  MergedSites table;
+  {
+    std::lock_guard<std::mutex> g(retiredMutex);
+    table = retiredSites();
+  }
+  for (auto& profile : threadProfile().accessAllThreads()) {
+    profile.collect(table);
+  }
+
+  std::vector<ContentionSite> sites;
+  sites.reserve(table.size());
+  for (const auto& entry : table) {
+    sites.push_back(entry.second);
+  }
+  std::sort(sites.begin(), sites.end(),
+            [](const ContentionSite& a, const ContentionSite& b) {
+              return a.totalWaitUsec > b.totalWaitUsec;
+            });
+  return sites;
+}
+
+std::string getContentionReport(size_t topN) {
+  auto sites = getContentionProfile();
+  char line[256];
+  snprintf(line, sizeof(line),
+           "Lock contention: top %zu of %zu sites by total wait, in usec\n"
+           "%10s %12s %8s %8s %10s %10s %8s %8s %10s  %s\n",
+           std::min(topN, sites.size()), sites.size(),
+           "samples", "wait", "p50", "p99", "max", "holds", "p50", "p99",
+           "max", "site");
+  std::string report = line;
+  for (size_t i = 0; i < sites.size() && i < topN; ++i) {
+    const auto& s = sites[i];
+    snprintf(line, sizeof(line),
+             "%10lu %12lu %8lu %8lu %10lu %10lu %8lu %8lu %10lu  ",
+             (unsigned long)s.samples,
+             (unsigned long)s.totalWaitUsec,
+             (unsigned long)percentile(s.waitHistogram, s.samples, 0.5),
+             (unsigned long)percentile(s.waitHistogram, s.samples, 0.99),
+             (unsigned long)s.maxWaitUsec,
+             (unsigned long)s.holds,
+             (unsigned long)percentile(s.holdHistogram, s.holds, 0.5),
+             (unsigned long)percentile(s.holdHistogram, s.holds, 0.99),
+             (unsigned long)s.maxHoldUsec);
+    report += line;
+    report += s.name();
+    report += '\n';
+  }
+  return report;
+}
+
+void resetContentionProfile() {
+  {
+    std::lock_guard<std::mutex> g(retiredMutex);
+    retiredSites().clear();
+  }
+  for (auto& profile : threadProfile().accessAllThreads()) {
+    profile.reset();
+  }
+}
+
+}}} // apache::thrift::concurrency
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace apache { namespace thrift { namespace concurrency {
+
+/**
+ * Lock contention profile, attributed to the code that takes the locks.
+ *
+ * Once enabled, one in sampleRate blocking acquisitions of each thread's
+ * Mutex, ReadWriteMutex, Monitor and ProfiledMutex locks is timed: how long
+ * it waited for the lock and, unless the lock is shared, how long it held
+ * it.  A Monitor's wait ends the hold, since the mutex is released while
+ * waiting.
+ *
+ * A sample belongs to the innermost ContentionTag of its thread when it
+ * locked if there is one, or else to the return address of the call that
+ * locked.  Tags with the same contents are one site.  Samples are
+ * added to per-site histograms in a table of the thread's own, so recording
+ * only waits for a report that is reading that table; getContentionProfile()
+ * and getContentionReport() merge the tables.
+ *
+ * Unlike enableMutexProfiling(), this only costs a thread local countdown
+ * per acquisition while enabled, and a load of the rate while disabled.
+ */
+struct ContentionSite {
+  // Bucket 0 counts times under 1 usec, bucket i in [2^(i-1), 2^i) usec,
+  // and the last bucket everything longer
+  static const size_t kBuckets = 28;
+
+  ContentionSite();
+
+  // One of these is set
+  const void* address;
+  const char* tag;
+
+  uint64_t samples;
+  uint64_t totalWaitUsec;
+  uint64_t maxWaitUsec;
+  uint64_t waitHistogram[kBuckets];
+
+  // Samples of exclusive acquisitions that were released
+  uint64_t holds;
+  uint64_t totalHoldUsec;
+  uint64_t maxHoldUsec;
+  uint64_t holdHistogram[kBuckets];
+
+  void add(int64_t waitUsec, int64_t holdUsec);
+  void merge(const ContentionSite& other);
+
+  // The tag, or the function and offset of the address if it has a symbol
+  std::string name() const;
+};
+
+/**
+ * Starts sampling one in sampleRate acquisitions on every thread; 0 stops.
+ */
+void enableContentionProfiling(uint32_t sampleRate);
+
+/**
+ * The sites sampled since the last reset, most total wait first.
+ */
+std::vector<ContentionSite> getContentionProfile();
+
+/**
+ * A table of the topN sites of getContentionProfile(), with wait and hold
+ * time percentiles.
+ */
+std::string getContentionReport(size_t topN = 20);
+
+void resetContentionProfile();
+
+/**
+ * Attributes the contention of the locks this thread takes during its
+ * lifetime to tag, a string literal, instead of their call sites.  Tags
+ * nest; the innermost one wins.
+ */
+class ContentionTag {
+ public:
+  explicit ContentionTag(const char* tag);
+  ~ContentionTag();
+
+ private:
+  ContentionTag(const ContentionTag&);
+  ContentionTag& operator=(const ContentionTag&);
+
+  const char* previous_;
+};
+
+// Used by the profiled locks
+extern std::atomic<uint32_t> contentionSampleRate;
+extern __thread uint32_t contentionCountdown;
+extern __thread const char* contentionTag;
+
+inline ContentionTag::ContentionTag(const char* tag)
+  : previous_(contentionTag) {
+  contentionTag = tag;
+}
+
+inline ContentionTag::~ContentionTag() {
+  contentionTag = previous_;
+}
+
+inline bool sampleContention() {
+  uint32_t rate = contentionSampleRate.load(std::memory_order_relaxed);
+  if (rate == 0) {
+    return false;
+  }
+  if (contentionCountdown > 1) {
+    --contentionCountdown;
+    return false;
+  }
+  contentionCountdown = rate;
+  return true;
+}
+
+/**
+ * Adds a sample for address, or for tag if not null: the thread's tag when
+ * the lock was taken.  holdUsec is negative if the hold was not timed.
+ */
+void recordContention(const void* address, const char* tag,
+                      int64_t waitUsec, int64_t holdUsec);
+
+}}} // apache::thrift::concurrency
@@ -66,7 +66,7 @@ class Monitor::Impl {
   ~Impl() { cleanup(); }
 
   Mutex& mutex() { return *mutex_; }
-  void lock() { mutex().lock(); }
+  void lock(const void* site) { mutex().lockAt(site); }
   void unlock() { mutex().unlock(); }
 
   /**
@@ -118,6 +118,8 @@ class Monitor::Impl {
       reinterpret_cast<pthread_mutex_t*>(mutex_->getUnderlyingImpl());
     assert(mutexImpl);
 
+    // The wait releases the mutex
+    mutex_->endHold();
     return pthread_cond_timedwait(&pthread_cond_,
                                   mutexImpl,
                                   abstime);
@@ -135,6 +137,8 @@ class Monitor::Impl {
     pthread_mutex_t* mutexImpl =
       reinterpret_cast<pthread_mutex_t*>(mutex_->getUnderlyingImpl());
     assert(mutexImpl);
+
+    mutex_->endHold();
     return pthread_cond_wait(&pthread_cond_, mutexImpl);
   }
 
@@ -193,7 +197,7 @@ Monitor::~Monitor() { delete impl_; }
 
 Mutex& Monitor::mutex() const { return impl_->mutex(); }
 
-void Monitor::lock() const { impl_->lock(); }
+void Monitor::lock() const { impl_->lock(__builtin_return_address(0)); }
 
 void Monitor::unlock() const { impl_->unlock(); }
 
@@ -110,8 +110,10 @@ class Monitor : boost::noncopyable {
 
 class Synchronized {
  public:
- explicit Synchronized(const Monitor* monitor) : g(monitor->mutex()) { }
- explicit Synchronized(const Monitor& monitor) : g(monitor.mutex()) { }
+ THRIFT_GUARD_INLINE explicit Synchronized(const Monitor* monitor)
+   : g(monitor->mutex()) { }
+ THRIFT_GUARD_INLINE explicit Synchronized(const Monitor& monitor)
+   : g(monitor.mutex()) { }
 
  private:
   Guard g;
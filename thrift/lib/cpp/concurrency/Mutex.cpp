@@ -48,31 +48,42 @@ void* Mutex::getUnderlyingImpl() const {
   return impl_->getImpl().getUnderlyingImpl();
 }
 
-void Mutex::lock() const { impl_->lock(); }
+void Mutex::lock() const { impl_->lock(__builtin_return_address(0)); }
+
+void Mutex::lockAt(const void* site) const { impl_->lock(site); }
 
 bool Mutex::trylock() const { return impl_->try_lock(); }
 
 bool Mutex::timedlock(int64_t ms) const {
-  return impl_->try_lock_for(std::chrono::milliseconds {ms});
+  return impl_->try_lock_for(std::chrono::milliseconds {ms},
+                             __builtin_return_address(0));
 }
 
 void Mutex::unlock() const { impl_->unlock(); }
 
 bool Mutex::isLocked() const { return impl_->getImpl().isLocked(); }
 
+void Mutex::endHold() const { impl_->endHold(); }
+
 ReadWriteMutex::ReadWriteMutex()
   : impl_(std::make_shared<ProfiledPthreadRWMutex>()) {}
 
-void ReadWriteMutex::acquireRead() const { impl_->lock_shared(); }
+void ReadWriteMutex::acquireRead() const {
+  impl_->lock_shared(__builtin_return_address(0));
+}
 
-void ReadWriteMutex::acquireWrite() const { impl_->lock(); }
+void ReadWriteMutex::acquireWrite() const {
+  impl_->lock(__builtin_return_address(0));
+}
 
 bool ReadWriteMutex::timedRead(int64_t milliseconds) const {
-  return impl_->try_lock_shared_for(std::chrono::milliseconds {milliseconds});
+  return impl_->try_lock_shared_for(std::chrono::milliseconds {milliseconds},
+                                    __builtin_return_address(0));
 }
 
 bool ReadWriteMutex::timedWrite(int64_t milliseconds) const {
-  return impl_->try_lock_for(std::chrono::milliseconds {milliseconds});
+  return impl_->try_lock_for(std::chrono::milliseconds {milliseconds},
+                             __builtin_return_address(0));
 }
 
 bool ReadWriteMutex::attemptRead() const { return impl_->try_lock_shared(); }
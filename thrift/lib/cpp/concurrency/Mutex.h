@@ -63,6 +63,17 @@ class Mutex {
 
   void* getUnderlyingImpl() const;
 
+  /**
+   * Locks on behalf of site, which the contention profiler attributes the
+   * sample to instead of the caller.  For wrappers such as Monitor.
+   */
+  void lockAt(const void* site) const;
+
+  /**
+   * Ends the profiled hold of the lock before a condition wait releases it.
+   */
+  void endHold() const;
+
   static int DEFAULT_INITIALIZER;
   static int RECURSIVE_INITIALIZER;
 
@@ -119,9 +130,14 @@ private:
   mutable volatile bool writerWaiting_;
 };
 
+// The guards lock in their caller's code even without optimization, since
+// the contention profiler attributes samples to the caller of lock()
+#define THRIFT_GUARD_INLINE inline __attribute__((__always_inline__))
+
 class Guard : boost::noncopyable {
  public:
-  explicit Guard(const Mutex& value, int64_t timeout = 0) : mutex_(&value) {
+  THRIFT_GUARD_INLINE explicit Guard(const Mutex& value, int64_t timeout = 0)
+    : mutex_(&value) {
     if (timeout == 0) {
       value.lock();
     } else if (timeout < 0) {
@@ -174,8 +190,9 @@ enum RWGuardType {
 
 class RWGuard : boost::noncopyable {
   public:
-  explicit RWGuard(const ReadWriteMutex& value, bool write = false,
-                   int64_t timeout=0)
+  THRIFT_GUARD_INLINE explicit RWGuard(const ReadWriteMutex& value,
+                                       bool write = false,
+                                       int64_t timeout=0)
          : rw_mutex_(value), locked_(true) {
       if (write) {
         if (timeout) {
@@ -192,7 +209,9 @@ class RWGuard : boost::noncopyable {
       }
     }
 
-    RWGuard(const ReadWriteMutex& value, RWGuardType type, int64_t timeout = 0)
+    THRIFT_GUARD_INLINE RWGuard(const ReadWriteMutex& value,
+                                RWGuardType type,
+                                int64_t timeout = 0)
          : rw_mutex_(value), locked_(true) {
       if (type == RW_WRITE) {
         if (timeout) {
@@ -31,10 +31,12 @@ class NumaThreadFactory : public PosixThreadFactory {
   // setNode node.
   explicit NumaThreadFactory(int setNode = -1,
                              int stackSize
-                             = PosixThreadFactory::kDefaultStackSizeMB)
+                             = PosixThreadFactory::kDefaultStackSizeMB,
+                             PosixThreadFactory::PRIORITY priority
+                             = PosixThreadFactory::kDefaultPriority)
       : PosixThreadFactory(
           PosixThreadFactory::kDefaultPolicy,
-          PosixThreadFactory::kDefaultPriority,
+          priority,
           stackSize),
         setNode_(setNode) {}
 
@@ -50,6 +52,13 @@ class NumaThreadFactory : public PosixThreadFactory {
   // this thread is bound to.
   static int getNumaNode();
 
+  // Get the node the calling thread was bound to by a NumaThreadFactory,
+  // ignoring any node set in the request context.  Returns -1 if the
+  // thread is not bound to a node.
+  static int getThreadNumaNode() {
+    return node_;
+  }
+
   // Sets the threadlocal descrbing which node this thrad
   // is bound to.  *Does not actually call numa bind*,
   // but NumaThreadManager calls will always run requests on
@@ -18,6 +18,7 @@
 
 #include <mutex>
 #include <signal.h>
+#include <thrift/lib/cpp/concurrency/ContentionProfiler.h>
 #include <thrift/lib/cpp/concurrency/Util.h>
 #include <utility>
 
@@ -54,34 +55,77 @@ extern MutexWaitCallback mutexProfilingCallback;
 extern sig_atomic_t mutexProfilingCounter;
 
 #ifndef THRIFT_NO_CONTENTION_PROFILING
+// The locking methods are not inlined so that their return address is the
+// call site that the contention profiler attributes samples to
+#define PROFILE_MUTEX_NOINLINE __attribute__((__noinline__))
+
 #define PROFILE_MUTEX_START_LOCK() \
-    auto _lock_startTime = maybeGetProfilingStartTime();
+    auto _lock_startTime = maybeGetProfilingStartTime(); \
+    auto _contention_startTime = maybeGetContentionStartTime(_lock_startTime);
+
+#define PROFILE_MUTEX_SITE(site) \
+    ((site) ? (site) : __builtin_return_address(0))
 
-#define PROFILE_MUTEX_NOT_LOCKED() \
+#define PROFILE_MUTEX_NOT_LOCKED(site) \
   do { \
-    if (_lock_startTime > 0) { \
+    if (_lock_startTime > 0 || _contention_startTime > 0) { \
       int64_t endTime = Util::currentTimeUsec(); \
-      (*mutexProfilingCallback)(this, (endTime - _lock_startTime)); \
+      if (_lock_startTime > 0) { \
+        (*mutexProfilingCallback)(this, (endTime - _lock_startTime)); \
+      } \
+      if (_contention_startTime > 0) { \
+        recordContention(PROFILE_MUTEX_SITE(site), contentionTag, \
+                         endTime - _contention_startTime, -1); \
+      } \
     } \
   } while (0)
 
-#define PROFILE_MUTEX_LOCKED() \
+#define PROFILE_MUTEX_LOCKED(site) \
   do { \
     this->profileTime_ = _lock_startTime; \
-    if (this->profileTime_ > 0) { \
-      this->profileTime_ = Util::currentTimeUsec() - this->profileTime_; \
+    if (this->profileTime_ > 0 || _contention_startTime > 0) { \
+      int64_t endTime = Util::currentTimeUsec(); \
+      if (this->profileTime_ > 0) { \
+        this->profileTime_ = endTime - this->profileTime_; \
+      } \
+      if (_contention_startTime > 0) { \
+        this->profileSite_ = PROFILE_MUTEX_SITE(site); \
+        this->profileTag_ = contentionTag; \
+        this->profileWaitTime_ = endTime - _contention_startTime; \
+        this->profileLockedAt_ = endTime; \
+      } \
+    } \
+  } while (0)
+
+// Ends the hold of a sampled acquisition, while the lock is still held
+#define PROFILE_MUTEX_END_HOLD() \
+  const void* _hold_site = this->profileSite_; \
+  const char* _hold_tag = this->profileTag_; \
+  int64_t _hold_waitTime = this->profileWaitTime_; \
+  int64_t _hold_time = -1; \
+  if (this->profileLockedAt_ > 0) { \
+    _hold_time = Util::currentTimeUsec() - this->profileLockedAt_; \
+    this->profileLockedAt_ = 0; \
+  }
+
+#define PROFILE_MUTEX_HOLD_ENDED() \
+  do { \
+    if (_hold_time >= 0) { \
+      recordContention(_hold_site, _hold_tag, _hold_waitTime, _hold_time); \
     } \
   } while (0)
 
 #define PROFILE_MUTEX_START_UNLOCK() \
   int64_t _temp_profileTime = this->profileTime_; \
-  this->profileTime_ = 0;
+  this->profileTime_ = 0; \
+  PROFILE_MUTEX_END_HOLD();
 
 #define PROFILE_MUTEX_UNLOCKED() \
   do { \
     if (_temp_profileTime > 0) { \
       (*mutexProfilingCallback)(this, _temp_profileTime); \
     } \
+    PROFILE_MUTEX_HOLD_ENDED(); \
   } while (0)
 
 inline int64_t maybeGetProfilingStartTime() {
@@ -108,24 +152,40 @@ inline int64_t maybeGetProfilingStartTime() {
   return 0;
 }
 
+// Whether to sample this acquisition for the contention profiler, which
+// shares the legacy sample's start time if there is one
+inline int64_t maybeGetContentionStartTime(int64_t legacyStartTime) {
+  if (!sampleContention()) {
+    return 0;
+  }
+  return legacyStartTime > 0 ? legacyStartTime : Util::currentTimeUsec();
+}
+
 #else
+#  define PROFILE_MUTEX_NOINLINE
 #  define PROFILE_MUTEX_START_LOCK()
-#  define PROFILE_MUTEX_NOT_LOCKED()
-#  define PROFILE_MUTEX_LOCKED()
+#  define PROFILE_MUTEX_NOT_LOCKED(site)
+#  define PROFILE_MUTEX_LOCKED(site)
+#  define PROFILE_MUTEX_END_HOLD()
+#  define PROFILE_MUTEX_HOLD_ENDED()
 #  define PROFILE_MUTEX_START_UNLOCK()
 #  define PROFILE_MUTEX_UNLOCKED()
 #endif // THRIFT_NO_CONTENTION_PROFILING
 
+/**
+ * The locking methods take the call site to attribute contention samples
+ * to; by default it is their caller.
+ */
 template <class T>
 class ProfiledMutex {
  public:
   template <class... Args>
   explicit ProfiledMutex(Args&&... args)
     : impl_(std::forward<Args>(args)...) {}
-  void lock() {
+  PROFILE_MUTEX_NOINLINE void lock(const void* site = nullptr) {
     PROFILE_MUTEX_START_LOCK();
     impl_.lock();
-    PROFILE_MUTEX_LOCKED();
+    PROFILE_MUTEX_LOCKED(site);
   }
 
   bool try_lock() {
@@ -138,6 +198,15 @@ class ProfiledMutex {
     PROFILE_MUTEX_UNLOCKED();
   }
 
+  /**
+   * Ends the sampled hold, if any, of the lock.  For condition waits, which
+   * release the lock without unlock().
+   */
+  void endHold() {
+    PROFILE_MUTEX_END_HOLD();
+    PROFILE_MUTEX_HOLD_ENDED();
+  }
+
   T& getImpl() {
     return impl_;
   }
@@ -145,7 +214,13 @@ class ProfiledMutex {
  protected:
   T impl_;
 #ifndef THRIFT_NO_CONTENTION_PROFILING
-  mutable int64_t profileTime_;
+  mutable int64_t profileTime_{0};
+  // The contention sample of the current holder, with the tag it was
+  // locked under; profileLockedAt_ is 0 if it is not sampled
+  const void* profileSite_{nullptr};
+  const char* profileTag_{nullptr};
+  int64_t profileWaitTime_{0};
+  int64_t profileLockedAt_{0};
 #endif
 };
 
@@ -157,41 +232,47 @@ class ProfiledTimedMutex : public ProfiledMutex<T> {
     : ProfiledMutex<T>(std::forward<Args>(args)...) {}
 
   template<class Rep, class Period>
-  bool try_lock_for(const std::chrono::duration<Rep,Period>& timeout_duration) {
+  PROFILE_MUTEX_NOINLINE bool try_lock_for(
+      const std::chrono::duration<Rep,Period>& timeout_duration,
+      const void* site = nullptr) {
     PROFILE_MUTEX_START_LOCK();
     if (this->impl_.try_lock_for(timeout_duration)) {
-      PROFILE_MUTEX_LOCKED();
+      PROFILE_MUTEX_LOCKED(site);
       return true;
     }
 
-    PROFILE_MUTEX_NOT_LOCKED();
+    PROFILE_MUTEX_NOT_LOCKED(site);
     return false;
   }
 
   template<class Clock, class Duration>
-  bool try_lock_until(
-      const std::chrono::time_point<Clock,Duration>& timeout_time) {
+  PROFILE_MUTEX_NOINLINE bool try_lock_until(
+      const std::chrono::time_point<Clock,Duration>& timeout_time,
+      const void* site = nullptr) {
     PROFILE_MUTEX_START_LOCK();
     if (this->impl_.try_lock_until(timeout_time)) {
-      PROFILE_MUTEX_LOCKED();
+      PROFILE_MUTEX_LOCKED(site);
       return true;
     }
 
-    PROFILE_MUTEX_NOT_LOCKED();
+    PROFILE_MUTEX_NOT_LOCKED(site);
     return false;
   }
 };
 
+/**
+ * Shared acquisitions are sampled for their wait only.
+ */
 template <class T>
 class ProfiledSharedTimedMutex : public ProfiledTimedMutex<T> {
  public:
   template <class... Args>
   explicit ProfiledSharedTimedMutex(Args&&... args)
     : ProfiledTimedMutex<T>(std::forward<Args>(args)...) {}
-  void lock_shared() {
+  PROFILE_MUTEX_NOINLINE void lock_shared(const void* site = nullptr) {
     PROFILE_MUTEX_START_LOCK();
     this->impl_.lock_shared();
-    PROFILE_MUTEX_NOT_LOCKED();
+    PROFILE_MUTEX_NOT_LOCKED(site);
   }
 
   bool try_lock_shared() {
@@ -199,20 +280,22 @@ class ProfiledSharedTimedMutex : public ProfiledTimedMutex<T> {
   }
 
   template<class Rep, class Period>
-  bool try_lock_shared_for(
-      const std::chrono::duration<Rep,Period>& timeout_duration) {
+  PROFILE_MUTEX_NOINLINE bool try_lock_shared_for(
+      const std::chrono::duration<Rep,Period>& timeout_duration,
+      const void* site = nullptr) {
     PROFILE_MUTEX_START_LOCK();
     bool rc = this->impl_.try_lock_shared_for(timeout_duration);
-    PROFILE_MUTEX_NOT_LOCKED();
+    PROFILE_MUTEX_NOT_LOCKED(site);
     return rc;
   }
 
   template<class Clock, class Duration>
-  bool try_lock_shared_until(
-      const std::chrono::time_point<Clock,Duration>& timeout_time) {
+  PROFILE_MUTEX_NOINLINE bool try_lock_shared_until(
+      const std::chrono::time_point<Clock,Duration>& timeout_time,
+      const void* site = nullptr) {
     PROFILE_MUTEX_START_LOCK();
-    bool rc = this->impl_.try_lock_shared_for(timeout_time);
-    PROFILE_MUTEX_NOT_LOCKED();
+    bool rc = this->impl_.try_lock_shared_until(timeout_time);
+    PROFILE_MUTEX_NOT_LOCKED(site);
     return rc;
   }
 
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
+
+#include <thrift/lib/cpp/concurrency/SpinLock.h>
+
+#include <folly/ThreadLocal.h>
+
+#include <new>
+
+namespace apache { namespace thrift { namespace concurrency {
+
+std::atomic<bool> ThreadCachedPool::enabled_{true};
+
+namespace {
+
+typedef ThreadCachedPool Pool;
+
+// Free blocks are at least kGranularity bytes, which leaves room for the
+// links of both the per-thread list and the list of batches.
+struct FreeBlock {
+  FreeBlock* next;
+  // Only meaningful on the first block of a batch in a CentralList
+  FreeBlock* nextBatch;
+  size_t batchLength;
+};
+
+static_assert(sizeof(FreeBlock) <= Pool::kGranularity,
+              "Free block header must fit in the smallest size class");
+
+struct FreeList {
+  FreeBlock* head{nullptr};
+  size_t length{0};
+
+  void push(void* p) {
+    auto block = static_cast<FreeBlock*>(p);
+    block->next = head;
+    head = block;
+    ++length;
+  }
+
+  void* pop() {
+    auto block = head;
+    head = block->next;
+    --length;
+    return block;
+  }
+
+  // Detach up to n blocks from the front of the list
+  FreeBlock* popBatch(size_t n, size_t* count) {
+    auto first = head;
+    FreeBlock* last = nullptr;
+    size_t taken = 0;
+    while (head && taken < n) {
+      last = head;
+      head = head->next;
+      ++taken;
+    }
+    if (last) {
+      last->next = nullptr;
+    }
+    length -= taken;
+    *count = taken;
+    return first;
+  }
+};
+
+// Batches of free blocks shared by all threads, one per size class.
+class CentralList {
+ public:
+  // Beyond this many batches blocks are returned to the system allocator
+  static const size_t kMaxBatches = 64;
+
+  void put(FreeBlock* batch, size_t length) {
+    {
+      SpinLockGuard g(lock_);
+      if (numBatches_ < kMaxBatches) {
+        batch->nextBatch = batches_;
+        batch->batchLength = length;
+        batches_ = batch;
+        ++numBatches_;
+        return;
+      }
+    }
+    while (batch) {
+      auto next = batch->next;
+      ::operator delete(batch);
+      batch = next;
+    }
+  }
+
+  FreeBlock* take(size_t* length) {
+    SpinLockGuard g(lock_);
+    auto batch = batches_;
+    if (batch) {
+      batches_ = batch->nextBatch;
+      --numBatches_;
+      *length = batch->batchLength;
+    }
+    return batch;
+  }
+
+ private:
+  SpinLock lock_;
+  FreeBlock* batches_{nullptr};
+  size_t numBatches_{0};
+};
+
+CentralList* centralLists() {
+  // Leaked, so that blocks freed during static destruction have a home
+  static auto lists = new CentralList[Pool::kNumClasses];
+  return lists;
+}
+
+// Counts for threads that have exited
+std::atomic<uint64_t> deadHits{0};
+std::atomic<uint64_t> deadMisses{0};
+
+class ThreadCache {
+ public:
+  ~ThreadCache() {
+    auto central = centralLists();
+    for (size_t i = 0; i < Pool::kNumClasses; ++i) {
+      while (lists_[i].length > 0) {
+        size_t count;
+        auto batch = lists_[i].popBatch(Pool::kBatchSize, &count);
+        central[i].put(batch, count);
+      }
+    }
+    deadHits += hits_.load(std::memory_order_relaxed);
+    deadMisses += misses_.load(std::memory_order_relaxed);
+  }
+
+  void* allocate(size_t cls) {
+    auto& list = lists_[cls];
+    if (list.length == 0) {
+      size_t count;
+      auto batch = centralLists()[cls].take(&count);
+      if (batch) {
+        list.head = batch;
+        list.length = count;
+      }
+    }
+    if (list.length > 0) {
+      bump(hits_);
+      return list.pop();
+    }
+    bump(misses_);
+    return ::operator new((cls + 1) * Pool::kGranularity);
+  }
+
+  void deallocate(void* p, size_t cls) {
+    auto& list = lists_[cls];
+    list.push(p);
+    if (list.length > Pool::kMaxCached) {
+      size_t count;
+      auto batch = list.popBatch(Pool::kBatchSize, &count);
+      centralLists()[cls].put(batch, count);
+    }
+  }
+
+  uint64_t hits() const {
+    return hits_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t misses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Only the owning thread writes, so a plain load/store is enough
+  static void bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  FreeList lists_[Pool::kNumClasses];
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+struct ThreadCacheTag {};
+
+folly::ThreadLocal<ThreadCache, ThreadCacheTag>& threadCache() {
+  static auto cache = new folly::ThreadLocal<ThreadCache, ThreadCacheTag>();
+  return *cache;
+}
+
+} // anonymous namespace
+
+void* ThreadCachedPool::allocate(size_t size) {
+  if (size == 0) {
+    size = 1;
+  }
+  if (size > kMaxSize) {
+    return ::operator new(size);
+  }
+  // Always hand out the full size class, so that the block can be cached
+  // later even if it is freed while the pool is disabled or vice versa.
+  auto cls = sizeClass(size);
+  if (!getEnabled()) {
+    return ::operator new((cls + 1) * kGranularity);
+  }
+  return threadCache()->allocate(cls);
+}
+
+void ThreadCachedPool::deallocate(void* p, size_t size) {
+  if (!p) {
+    return;
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  if (size > kMaxSize || !getEnabled()) {
+    ::operator delete(p);
+    return;
+  }
+  threadCache()->deallocate(p, sizeClass(size));
+}
+
+ThreadCachedPool::Stats ThreadCachedPool::getStats() {
+  Stats stats;
+  stats.hits = deadHits.load();
+  stats.misses = deadMisses.load();
+  for (const auto& cache : threadCache().accessAllThreads()) {
+    stats.hits += cache.hits();
+    stats.misses += cache.misses();
+  }
+  return stats;
+}
+
+}}} // apache::thrift::concurrency
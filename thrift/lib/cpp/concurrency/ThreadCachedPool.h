@@ -0,0 +1,104 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_CONCURRENCY_THREADCACHEDPOOL_H_
+#define THRIFT_CONCURRENCY_THREADCACHEDPOOL_H_ 1
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace apache { namespace thrift { namespace concurrency {
+
+/**
+ * ThreadCachedPool is a small-object allocator for the objects created on
+ * every request (requests, context stacks, handler callbacks).
+ *
+ * Sizes are rounded up to a multiple of kGranularity.  Each thread keeps a
+ * free list per size class, so allocate/deallocate on the same thread never
+ * touch shared state.  Objects are frequently freed on a different thread
+ * than the one that allocated them (e.g. allocated on a ThreadManager thread
+ * and destroyed in the event base); when a thread's list grows past
+ * kMaxCached the surplus is handed to a shared list in batches, where
+ * threads that run dry pick it up again.  A thread's cache is returned to the
+ * shared list when the thread exits.
+ *
+ * Every block is a separate ::operator new allocation of its rounded size,
+ * so memory from the pool may always be released with ::operator delete and
+ * the pool can be disabled at runtime with setEnabled(false).
+ *
+ * Sizes above kMaxSize bypass the pool.
+ */
+class ThreadCachedPool {
+ public:
+  static const size_t kGranularity = 64;
+  static const size_t kMaxSize = 512;
+  static const size_t kNumClasses = kMaxSize / kGranularity;
+  // Blocks kept by each thread per size class before spilling
+  static const size_t kMaxCached = 256;
+  // Blocks moved between a thread and the shared list at once
+  static const size_t kBatchSize = 32;
+
+  struct Stats {
+    uint64_t hits;    // allocations served from a thread cache
+    uint64_t misses;  // allocations that called ::operator new
+  };
+
+  static void* allocate(size_t size);
+  static void deallocate(void* p, size_t size);
+
+  /**
+   * Enable or disable pooling.  Objects allocated either way may be freed
+   * either way.  Intended for benchmarks.
+   */
+  static void setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  static bool getEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  static Stats getStats();
+
+ private:
+  static size_t sizeClass(size_t size) {
+    return (size - 1) / kGranularity;
+  }
+
+  static std::atomic<bool> enabled_;
+};
+
+/**
+ * Base class that routes operator new/delete of a class (and of everything
+ * derived from it) through ThreadCachedPool.  Classes deleted through a base
+ * pointer must have a virtual destructor, so that the sized operator delete
+ * sees the size of the most derived type.
+ */
+class PoolAllocated {
+ public:
+  static void* operator new(size_t size) {
+    return ThreadCachedPool::allocate(size);
+  }
+
+  static void operator delete(void* p, size_t size) {
+    ThreadCachedPool::deallocate(p, size);
+  }
+};
+
+}}} // apache::thrift::concurrency
+
+#endif // #ifndef THRIFT_CONCURRENCY_THREADCACHEDPOOL_H_
@@ -16,6 +16,7 @@
 
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 
+#include <thrift/lib/cpp/concurrency/ContentionProfiler.h>
 #include <thrift/lib/cpp/concurrency/Exception.h>
 #include <thrift/lib/cpp/concurrency/Monitor.h>
 #include <thrift/lib/cpp/concurrency/Thread.h>
@@ -153,6 +154,7 @@ void ThreadManager::ImplT<SemType>::addWorker(size_t value) {
                                             ThreadFactory::ATTACHED);
     {
       // We need to increment idle count
+      ContentionTag tag("ThreadManager::addWorker");
       Guard g(mutex_);
       if (state_ != STARTED) {
         throw IllegalStateException("ThreadManager::addWorker(): "
@@ -181,6 +183,7 @@ template <typename SemType>
 void ThreadManager::ImplT<SemType>::workerStarted(Worker<SemType>* worker) {
   InitCallback initCallback;
   {
+    ContentionTag tag("ThreadManager::workerStarted");
     Guard g(mutex_);
     assert(idleCount_ > 0);
     --idleCount_;
@@ -201,6 +204,7 @@ void ThreadManager::ImplT<SemType>::workerStarted(Worker<SemType>* worker) {
 
 template <typename SemType>
 void ThreadManager::ImplT<SemType>::workerExiting(Worker<SemType>* worker) {
+  ContentionTag tag("ThreadManager::workerExiting");
   Guard g(mutex_);
 
   shared_ptr<Thread> thread = worker->thread();
@@ -232,6 +236,7 @@ void ThreadManager::ImplT<SemType>::start() {
 
 template <typename SemType>
 void ThreadManager::ImplT<SemType>::stopImpl(bool joinArg) {
+  ContentionTag tag("ThreadManager::stop");
   Guard g(mutex_);
 
   if (state_ == ThreadManager::UNINITIALIZED) {
@@ -350,6 +355,7 @@ void ThreadManager::ImplT<SemType>::add(shared_ptr<Runnable> value,
   }
 
   if (pendingTaskCountMax_ > 0 && (tasks_.size() >= pendingTaskCountMax_)) {
+    ContentionTag tag("ThreadManager::add");
     Guard g(mutex_, timeout);
 
     if (!g) {
@@ -398,6 +404,7 @@ void ThreadManager::ImplT<SemType>::remove(shared_ptr<Runnable> task) {
 
 template <typename SemType>
 std::shared_ptr<Runnable> ThreadManager::ImplT<SemType>::removeNextPending() {
+  ContentionTag tag("ThreadManager::removeNextPending");
   Guard g(mutex_);
   if (state_ != ThreadManager::STARTED) {
     throw IllegalStateException("ThreadManager::Impl::removeNextPending "
@@ -447,6 +454,7 @@ ThreadManager::Task* ThreadManager::ImplT<SemType>::waitOnTask() {
   }
 
   // Otherwise, no tasks on the horizon, so go sleep
+  ContentionTag tag("ThreadManager::waitOnTask");
   Guard g(mutex_);
   if (shouldStop()) {
     // check again because it might have changed by the time we got the mutex
@@ -477,6 +485,7 @@ template <typename SemType>
 void ThreadManager::ImplT<SemType>::maybeNotifyMaxMonitor(bool shouldLock) {
   if (pendingTaskCountMax_ != 0 && tasks_.size() < pendingTaskCountMax_) {
     if (shouldLock) {
+      ContentionTag tag("ThreadManager::maybeNotifyMaxMonitor");
       Guard g(mutex_);
       maxMonitor_.notify();
     } else {
@@ -490,6 +499,7 @@ template <typename SemType>
 void ThreadManager::ImplT<SemType>::taskExpired(Task* task) {
   ExpireCallback expireCallback;
   {
+    ContentionTag tag("ThreadManager::taskExpired");
     Guard g(mutex_);
     expiredCount_++;
     expireCallback = expireCallback_;
@@ -623,6 +633,17 @@ public:
     }
   }
 
+  // Use the given managers, and the given number of threads for each, to
+  // run tasks of each priority.
+  explicit PriorityImplT(std::array<
+                           std::pair<unique_ptr<ThreadManager>, size_t>,
+                           N_PRIORITIES> managers) {
+    for (int i = 0; i < N_PRIORITIES; i++) {
+      managers_[i] = std::move(managers[i].first);
+      counts_[i] = managers[i].second;
+    }
+  }
+
   virtual void start() {
     Guard g(mutex_);
     for (int i = 0; i < N_PRIORITIES; i++) {
@@ -0,0 +1,663 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkStealingThreadManager.h"
+
+#include <folly/Conv.h>
+#include <folly/Logging.h>
+#include <thrift/lib/cpp/TLogging.h>
+#include <thrift/lib/cpp/concurrency/NumaThreadManager.h>
+#include <thrift/lib/cpp/concurrency/ThreadManager-impl.h>
+
+namespace apache { namespace thrift { namespace concurrency {
+
+__thread WorkStealingThreadManager::WorkQueue*
+  WorkStealingThreadManager::localQueue_{nullptr};
+__thread WorkStealingThreadManager*
+  WorkStealingThreadManager::localManager_{nullptr};
+__thread size_t WorkStealingThreadManager::nextQueue_{0};
+
+class WorkStealingThreadManager::Worker : public Runnable {
+ public:
+  explicit Worker(WorkStealingThreadManager* manager)
+    : queue_(nullptr)
+    , manager_(manager) {}
+
+  void run() {
+    manager_->workerStarted(this);
+
+    while (true) {
+      Task* task = manager_->waitOnTask(queue_);
+
+      // A nullptr task means that this thread is supposed to exit
+      if (!task) {
+        manager_->workerExiting(this);
+        return;
+      }
+
+      manager_->runTask(task);
+    }
+  }
+
+  WorkQueue* queue_;
+
+ private:
+  WorkStealingThreadManager* manager_;
+};
+
+WorkStealingThreadManager::Task* WorkStealingThreadManager::WorkQueue::pop() {
+  folly::MSLGuard g(lock);
+  if (tasks.empty()) {
+    return nullptr;
+  }
+  Task* task = tasks.front();
+  tasks.pop_front();
+  size.store(tasks.size(), std::memory_order_relaxed);
+  return task;
+}
+
+WorkStealingThreadManager::WorkStealingThreadManager(
+    size_t pendingTaskCountMax,
+    bool enableTaskStats,
+    size_t maxWorkers)
+  : pendingTaskCountMax_(pendingTaskCountMax)
+  , enableTaskStats_(enableTaskStats)
+  , maxWorkers_(maxWorkers)
+  , queues_(new std::atomic<WorkQueue*>[maxWorkers])
+  , numQueues_(0)
+  , state_(ThreadManager::UNINITIALIZED)
+  , workerCount_(0)
+  , idleCount_(0)
+  , workersToStop_(0)
+  , expiredCount_(0)
+  , statsLock_{0}
+  , waitingTimeUs_(0)
+  , executingTimeUs_(0)
+  , numTasks_(0)
+  , codelEnabled_(FLAGS_codel_enabled)
+  , threadFactory_(std::make_shared<NumaThreadFactory>())
+  , namePrefixCounter_(0)
+  , maxMonitor_(&mutex_)
+  , deadWorkerMonitor_(&mutex_) {
+  RequestContext::getStaticContext();
+  for (size_t n = 0; n < maxWorkers_; ++n) {
+    queues_[n].store(nullptr);
+  }
+}
+
+WorkStealingThreadManager::~WorkStealingThreadManager() {
+  stop();
+  for (size_t n = 0; n < numQueues_; ++n) {
+    delete queues_[n].load();
+  }
+}
+
+void WorkStealingThreadManager::start() {
+  Guard g(mutex_);
+  if (state_ == ThreadManager::UNINITIALIZED) {
+    if (threadFactory_ == nullptr) {
+      throw InvalidArgumentException();
+    }
+    state_ = ThreadManager::STARTED;
+  }
+}
+
+void WorkStealingThreadManager::addWorker(size_t value) {
+  for (size_t ix = 0; ix < value; ix++) {
+    auto worker = std::make_shared<Worker>(this);
+    auto thread = threadFactory_->newThread(worker, ThreadFactory::ATTACHED);
+    {
+      Guard g(mutex_);
+      if (state_ != ThreadManager::STARTED) {
+        throw IllegalStateException("WorkStealingThreadManager::addWorker(): "
+                                    "ThreadManager not running");
+      }
+      if (workerCount_ >= maxWorkers_) {
+        throw InvalidArgumentException();
+      }
+      // The queue is claimed here rather than by the worker thread, so that
+      // tasks added before the thread runs are already spread onto it
+      worker->queue_ = claimQueue();
+      ++workerCount_;
+    }
+
+    try {
+      thread->start();
+    } catch (...) {
+      Guard g(mutex_);
+      releaseQueue(worker->queue_);
+      --workerCount_;
+      throw;
+    }
+  }
+}
+
+void WorkStealingThreadManager::removeWorker(size_t value) {
+  Guard g(mutex_);
+  if (value > workerCount_) {
+    throw InvalidArgumentException();
+  }
+
+  // Ask threads to exit ASAP
+  workersToStop_ += value;
+  for (size_t n = 0; n < value; ++n) {
+    waitSem_.post();
+  }
+
+  // Wait for the specified number of threads to exit
+  for (size_t n = 0; n < value; ++n) {
+    while (deadWorkers_.empty()) {
+      deadWorkerMonitor_.wait();
+    }
+
+    std::shared_ptr<Thread> thread = deadWorkers_.front();
+    deadWorkers_.pop_front();
+    thread->join();
+  }
+}
+
+void WorkStealingThreadManager::stopImpl(bool joinArg) {
+  Guard g(mutex_);
+
+  if (state_ != ThreadManager::STARTED) {
+    // Either never started, or another stopImpl() call already waited for
+    // all of the workers to exit.
+    return;
+  }
+
+  size_t workers = workerCount_;
+  if (joinArg) {
+    // Workers exit once they can no longer find any tasks to run
+    state_ = ThreadManager::JOINING;
+  } else {
+    state_ = ThreadManager::STOPPING;
+    workersToStop_ += workers;
+  }
+  for (size_t n = 0; n < workers; ++n) {
+    waitSem_.post();
+  }
+
+  for (size_t n = 0; n < workers; ++n) {
+    while (deadWorkers_.empty()) {
+      deadWorkerMonitor_.wait();
+    }
+
+    std::shared_ptr<Thread> thread = deadWorkers_.front();
+    deadWorkers_.pop_front();
+    thread->join();
+  }
+
+  // Discard any tasks that were not run
+  for (size_t n = 0; n < numQueues_; ++n) {
+    WorkQueue* queue = queues_[n].load();
+    while (Task* task = queue->pop()) {
+      delete task;
+    }
+  }
+
+  workersToStop_ = 0;
+  state_ = ThreadManager::STOPPED;
+}
+
+WorkStealingThreadManager::WorkQueue* WorkStealingThreadManager::claimQueue() {
+  assert(mutex_.isLocked());
+
+  // Reuse the queue of a worker that exited; any tasks left on it become
+  // ours
+  size_t numQueues = numQueues_;
+  for (size_t n = 0; n < numQueues; ++n) {
+    WorkQueue* queue = queues_[n].load();
+    if (!queue->active) {
+      queue->active = true;
+      return queue;
+    }
+  }
+
+  assert(numQueues < maxWorkers_);
+  WorkQueue* queue = new WorkQueue();
+  queue->active = true;
+  queues_[numQueues].store(queue);
+  numQueues_.store(numQueues + 1);
+  return queue;
+}
+
+void WorkStealingThreadManager::releaseQueue(WorkQueue* queue) {
+  assert(mutex_.isLocked());
+  queue->active = false;
+
+  // Make sure that any tasks left behind are picked up by another worker
+  if (queue->size.load() > 0 && idleCount_ > 0) {
+    waitSem_.post();
+  }
+}
+
+void WorkStealingThreadManager::workerStarted(Worker* worker) {
+  worker->queue_->node = NumaThreadFactory::getThreadNumaNode();
+  localQueue_ = worker->queue_;
+  localManager_ = this;
+
+  InitCallback initCallback;
+  {
+    Guard g(mutex_);
+    initCallback = initCallback_;
+    if (!namePrefix_.empty()) {
+      worker->thread()->setName(folly::to<std::string>(namePrefix_, "-",
+                                                       ++namePrefixCounter_));
+    }
+  }
+
+  if (initCallback) {
+    initCallback();
+  }
+}
+
+void WorkStealingThreadManager::workerExiting(Worker* worker) {
+  localQueue_ = nullptr;
+  localManager_ = nullptr;
+
+  Guard g(mutex_);
+  releaseQueue(worker->queue_);
+  --workerCount_;
+  deadWorkers_.push_back(worker->thread());
+  deadWorkerMonitor_.notify();
+}
+
+bool WorkStealingThreadManager::canSleep() const {
+  return localManager_ != this;
+}
+
+size_t WorkStealingThreadManager::pendingTaskCount() const {
+  size_t count = 0;
+  size_t numQueues = numQueues_.load(std::memory_order_acquire);
+  for (size_t n = 0; n < numQueues; ++n) {
+    count += queues_[n].load()->size.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+size_t WorkStealingThreadManager::totalTaskCount() const {
+  size_t busy = workerCount_ - std::min<size_t>(idleCount_, workerCount_);
+  return pendingTaskCount() + busy;
+}
+
+WorkStealingThreadManager::WorkQueue*
+WorkStealingThreadManager::pickQueue(bool numa) {
+  // Tasks added by a worker stay on that worker's queue
+  if (localManager_ == this) {
+    return localQueue_;
+  }
+
+  size_t numQueues = numQueues_.load(std::memory_order_acquire);
+  if (numQueues == 0) {
+    return nullptr;
+  }
+
+  int node = numa ? NumaThreadFactory::getNumaNode()
+                  : NumaThreadFactory::getThreadNumaNode();
+
+  // Round-robin over the active queues on the preferred node, falling back
+  // to any active queue.  nextQueue_ is thread local so that producers do
+  // not share a counter.
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t n = 0; n < numQueues; ++n) {
+      size_t index = (nextQueue_ + n) % numQueues;
+      WorkQueue* queue = queues_[index].load(std::memory_order_relaxed);
+      if (!queue->active.load(std::memory_order_relaxed)) {
+        continue;
+      }
+      if (pass == 0 && node != -1 &&
+          queue->node.load(std::memory_order_relaxed) != node) {
+        continue;
+      }
+      nextQueue_ = index + 1;
+      return queue;
+    }
+  }
+
+  // No workers are running; leave the task for the next one to start
+  return queues_[0].load();
+}
+
+void WorkStealingThreadManager::add(std::shared_ptr<Runnable> value,
+                                    int64_t timeout,
+                                    int64_t expiration,
+                                    bool cancellable,
+                                    bool numa) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException("WorkStealingThreadManager::add "
+                                "ThreadManager not started");
+  }
+
+  if (pendingTaskCountMax_ > 0 &&
+      pendingTaskCount() >= pendingTaskCountMax_) {
+    Guard g(mutex_, timeout);
+
+    if (!g) {
+      throw TimedOutException();
+    }
+    if (canSleep() && timeout >= 0) {
+      while (pendingTaskCount() >= pendingTaskCountMax_) {
+        // This is thread safe because the mutex is shared between monitors.
+        maxMonitor_.wait(timeout);
+      }
+    } else {
+      throw TooManyPendingTasksException();
+    }
+  }
+
+  WorkQueue* queue = pickQueue(numa);
+  if (!queue) {
+    Guard g(mutex_);
+    if (numQueues_ == 0) {
+      claimQueue()->active = false;
+    }
+    queue = queues_[0].load();
+  }
+
+  Task* task = new ThreadManager::Task(std::move(value),
+                                       std::chrono::milliseconds{expiration});
+  {
+    folly::MSLGuard g(queue->lock);
+    queue->tasks.push_back(task);
+    queue->size.store(queue->tasks.size(), std::memory_order_relaxed);
+  }
+
+  // Pairs with the increment of idleCount_ in waitOnTask(): either we see
+  // the idle worker and wake it, or it sees our task when it rescans.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (idleCount_.load(std::memory_order_relaxed) > 0) {
+    waitSem_.post();
+  }
+}
+
+std::shared_ptr<Runnable> WorkStealingThreadManager::removeNextPending() {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException("WorkStealingThreadManager::removeNextPending "
+                                "ThreadManager not started");
+  }
+
+  Task* task = findTask(nullptr);
+  if (!task) {
+    return std::shared_ptr<Runnable>();
+  }
+  std::shared_ptr<Runnable> r = task->getRunnable();
+  delete task;
+  maybeNotifyMaxMonitor();
+  return r;
+}
+
+WorkStealingThreadManager::Task*
+WorkStealingThreadManager::findTask(WorkQueue* local) {
+  if (local) {
+    if (Task* task = local->pop()) {
+      return task;
+    }
+  }
+
+  size_t numQueues = numQueues_.load(std::memory_order_acquire);
+  if (numQueues == 0) {
+    return nullptr;
+  }
+
+  // Steal from workers on our own node first, then from everyone else.
+  // Start at a different place in each thread so that thieves don't all
+  // go after the same victim.
+  int node = local ? local->node.load(std::memory_order_relaxed) : -1;
+  size_t start = nextQueue_++;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t n = 0; n < numQueues; ++n) {
+      WorkQueue* queue = queues_[(start + n) % numQueues].load(
+        std::memory_order_relaxed);
+      if (queue == local) {
+        continue;
+      }
+      bool sameNode = queue->node.load(std::memory_order_relaxed) == node;
+      if ((pass == 0) != sameNode) {
+        continue;
+      }
+      if (queue->size.load(std::memory_order_relaxed) == 0) {
+        continue;
+      }
+      if (Task* task = queue->pop()) {
+        return task;
+      }
+    }
+  }
+  return nullptr;
+}
+
+bool WorkStealingThreadManager::shouldStop() {
+  // in normal cases, only do a read (prevents cache line bounces)
+  if (workersToStop_ <= 0) {
+    return false;
+  }
+  // modify only if needed
+  if (workersToStop_-- > 0) {
+    return true;
+  } else {
+    workersToStop_++;
+    return false;
+  }
+}
+
+WorkStealingThreadManager::Task*
+WorkStealingThreadManager::waitOnTask(WorkQueue* local) {
+  while (true) {
+    if (shouldStop()) {
+      return nullptr;
+    }
+
+    if (Task* task = findTask(local)) {
+      maybeNotifyMaxMonitor();
+      return task;
+    }
+
+    // Nothing to run.  Announce that we are idle, then look once more in
+    // case a task was added before the producer could see us.
+    ++idleCount_;
+    if (Task* task = findTask(local)) {
+      --idleCount_;
+      maybeNotifyMaxMonitor();
+      return task;
+    }
+    if (state_ == ThreadManager::JOINING) {
+      // No new tasks can be added while joining, and there is nothing left
+      // to steal
+      --idleCount_;
+      return nullptr;
+    }
+    waitSem_.wait();
+    --idleCount_;
+  }
+}
+
+void WorkStealingThreadManager::runTask(Task* task) {
+  // Getting the current time is moderately expensive,
+  // so only get the time if we actually need it.
+  SystemClockTimePoint startTime;
+  if (task->canExpire() || task->statsEnabled()) {
+    startTime = SystemClock::now();
+
+    // Codel auto-expire time algorithm
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+      startTime - task->getQueueBeginTime());
+
+    if (codel_.overloaded(delay)) {
+      if (codelCallback_) {
+        codelCallback_(task->getRunnable());
+      }
+      if (codelEnabled_) {
+        FB_LOG_EVERY_MS(WARNING, 10000) << "Queueing delay timeout";
+
+        taskExpired(task);
+        delete task;
+        return;
+      }
+    }
+  }
+
+  // Check if the task is expired
+  if (task->canExpire() &&
+      task->getExpireTime() <= startTime) {
+    taskExpired(task);
+    delete task;
+    return;
+  }
+
+  try {
+    task->run();
+  } catch(const std::exception& ex) {
+    T_ERROR("WorkStealingThreadManager: worker task threw unhandled "
+            "%s exception: %s", typeid(ex).name(), ex.what());
+  } catch(...) {
+    T_ERROR("WorkStealingThreadManager: worker task threw unhandled "
+            "non-exception object");
+  }
+
+  if (task->statsEnabled()) {
+    reportTaskStats(task->getQueueBeginTime(), startTime, SystemClock::now());
+  }
+  delete task;
+}
+
+void WorkStealingThreadManager::maybeNotifyMaxMonitor() {
+  if (pendingTaskCountMax_ != 0 &&
+      pendingTaskCount() < pendingTaskCountMax_) {
+    Guard g(mutex_);
+    maxMonitor_.notify();
+  }
+}
+
+void WorkStealingThreadManager::taskExpired(Task* task) {
+  ExpireCallback expireCallback;
+  {
+    Guard g(mutex_);
+    expiredCount_++;
+    expireCallback = expireCallback_;
+  }
+
+  if (expireCallback) {
+    // Expired callback should _not_ be called holding mutex_
+    expireCallback(task->getRunnable());
+  }
+}
+
+void WorkStealingThreadManager::getStats(int64_t& waitTimeUs,
+                                         int64_t& runTimeUs,
+                                         int64_t maxItems) {
+  folly::MSLGuard g(statsLock_);
+  if (numTasks_) {
+    if (numTasks_ >= maxItems) {
+      waitingTimeUs_ /= numTasks_;
+      executingTimeUs_ /= numTasks_;
+      numTasks_ = 1;
+    }
+    waitTimeUs = waitingTimeUs_ / numTasks_;
+    runTimeUs = executingTimeUs_ / numTasks_;
+  } else {
+    waitTimeUs = 0;
+    runTimeUs = 0;
+  }
+}
+
+void WorkStealingThreadManager::reportTaskStats(
+    const SystemClockTimePoint& queueBegin,
+    const SystemClockTimePoint& workBegin,
+    const SystemClockTimePoint& workEnd) {
+  int64_t waitTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+      workBegin - queueBegin).count();
+  int64_t runTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+      workEnd - workBegin).count();
+  if (enableTaskStats_) {
+    folly::MSLGuard g(statsLock_);
+    waitingTimeUs_ += waitTimeUs;
+    executingTimeUs_ += runTimeUs;
+    ++numTasks_;
+  }
+
+  // Optimistic check lock free
+  if (observer_) {
+    // Hold lock to ensure that observer_ does not get deleted.
+    folly::RWSpinLock::ReadHolder g(observerLock_);
+    if (observer_) {
+      observer_->addStats(namePrefix_, queueBegin, workBegin, workEnd);
+    }
+  }
+}
+
+namespace {
+
+class SimpleWorkStealingThreadManager : public WorkStealingThreadManager {
+ public:
+  SimpleWorkStealingThreadManager(size_t workerCount,
+                                  size_t pendingTaskCountMax,
+                                  bool enableTaskStats)
+    : WorkStealingThreadManager(pendingTaskCountMax, enableTaskStats)
+    , workerCount_(workerCount) {}
+
+  void start() {
+    if (state() == STARTED) {
+      return;
+    }
+    WorkStealingThreadManager::start();
+    addWorker(workerCount_);
+  }
+
+ private:
+  const size_t workerCount_;
+};
+
+}
+
+std::shared_ptr<ThreadManager>
+WorkStealingThreadManager::newWorkStealingThreadManager(
+    size_t count,
+    size_t pendingTaskCountMax,
+    bool enableTaskStats) {
+  return std::make_shared<SimpleWorkStealingThreadManager>(
+    count, pendingTaskCountMax, enableTaskStats);
+}
+
+std::shared_ptr<PriorityThreadManager>
+WorkStealingThreadManager::newPriorityWorkStealingThreadManager(
+    std::array<size_t, N_PRIORITIES> counts,
+    bool enableTaskStats) {
+  // Same thread priorities as PriorityThreadManager::newPriorityThreadManager
+  static const PosixThreadFactory::PRIORITY threadPriorities[N_PRIORITIES] = {
+    PosixThreadFactory::HIGHER,   // HIGH_IMPORTANT
+    PosixThreadFactory::HIGH,     // HIGH
+    PosixThreadFactory::HIGH,     // IMPORTANT
+    PosixThreadFactory::NORMAL,   // NORMAL
+    PosixThreadFactory::LOW       // BEST_EFFORT
+  };
+
+  std::array<std::pair<std::unique_ptr<ThreadManager>, size_t>, N_PRIORITIES>
+    managers;
+  for (int i = 0; i < N_PRIORITIES; i++) {
+    std::unique_ptr<ThreadManager> m(
+      new WorkStealingThreadManager(0, enableTaskStats));
+    m->threadFactory(std::make_shared<NumaThreadFactory>(
+      -1, PosixThreadFactory::kDefaultStackSizeMB, threadPriorities[i]));
+    managers[i] = std::make_pair(std::move(m), counts[i]);
+  }
+  // At least one NORMAL thread, as in newPriorityThreadManager()
+  managers[NORMAL].second = std::max<size_t>(managers[NORMAL].second, 1);
+
+  return std::make_shared<PriorityThreadManager::PriorityImplT<folly::LifoSem>>(
+    std::move(managers));
+}
+
+}}}
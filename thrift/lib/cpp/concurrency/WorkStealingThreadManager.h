@@ -0,0 +1,257 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include <folly/SmallLocks.h>
+#include <folly/LifoSem.h>
+#include <thrift/lib/cpp/concurrency/Exception.h>
+#include <thrift/lib/cpp/concurrency/Monitor.h>
+#include <thrift/lib/cpp/concurrency/ThreadManager.h>
+
+namespace apache { namespace thrift { namespace concurrency {
+
+// ThreadManager that gives every worker thread its own task queue, instead
+// of sending every task through one shared queue.
+//
+// Tasks added from a worker thread go on that worker's queue.  Tasks added
+// from other threads are spread across the worker queues, preferring
+// workers on the adding thread's NUMA node.  A worker whose queue is empty
+// steals tasks from other workers, first from workers on its own NUMA node
+// and only then from workers on remote nodes.  Nodes are discovered the same
+// way as NumaThreadManager does, so workers are only grouped by node when
+// they are created by a NumaThreadFactory (the default) and NUMA is enabled.
+//
+// Tasks are not strictly run in the order they were added: each queue is
+// FIFO, but there is no ordering between queues.
+//
+// Priorities are supported by running one WorkStealingThreadManager per
+// priority; see newPriorityWorkStealingThreadManager().
+class WorkStealingThreadManager : public ThreadManager {
+ public:
+  // maxWorkers is the largest number of worker threads that may exist at
+  // once.
+  explicit WorkStealingThreadManager(size_t pendingTaskCountMax = 0,
+                                     bool enableTaskStats = false,
+                                     size_t maxWorkers = kDefaultMaxWorkers);
+
+  ~WorkStealingThreadManager();
+
+  static const size_t kDefaultMaxWorkers = 1024;
+
+  // Creates a WorkStealingThreadManager that starts count workers when it is
+  // started, like ThreadManager::newSimpleThreadManager().
+  static std::shared_ptr<ThreadManager>
+    newWorkStealingThreadManager(size_t count = 4,
+                                 size_t pendingTaskCountMax = 0,
+                                 bool enableTaskStats = false);
+
+  // Creates a PriorityThreadManager that uses a WorkStealingThreadManager
+  // with counts[X] threads for priority X.
+  static std::shared_ptr<PriorityThreadManager>
+    newPriorityWorkStealingThreadManager(
+      std::array<size_t, N_PRIORITIES> counts,
+      bool enableTaskStats = false);
+
+  void start();
+
+  void stop() {
+    stopImpl(false);
+  }
+
+  void join() {
+    stopImpl(true);
+  }
+
+  const STATE state() const {
+    return state_;
+  }
+
+  std::shared_ptr<ThreadFactory> threadFactory() const {
+    Guard g(mutex_);
+    return threadFactory_;
+  }
+
+  void threadFactory(std::shared_ptr<ThreadFactory> value) {
+    Guard g(mutex_);
+    threadFactory_ = value;
+  }
+
+  std::string getNamePrefix() const {
+    Guard g(mutex_);
+    return namePrefix_;
+  }
+
+  void setNamePrefix(const std::string& name) {
+    Guard g(mutex_);
+    namePrefix_ = name;
+  }
+
+  void addWorker(size_t value = 1);
+
+  void removeWorker(size_t value = 1);
+
+  size_t idleWorkerCount() const {
+    return idleCount_;
+  }
+
+  size_t workerCount() const {
+    return workerCount_;
+  }
+
+  // Sums the sizes of all of the worker queues.  This is O(number of
+  // workers), but only reads per-queue counters that are local to each
+  // worker.
+  size_t pendingTaskCount() const;
+
+  size_t totalTaskCount() const;
+
+  size_t pendingTaskCountMax() const {
+    return pendingTaskCountMax_;
+  }
+
+  size_t expiredTaskCount() {
+    Guard g(mutex_);
+    size_t result = expiredCount_;
+    expiredCount_ = 0;
+    return result;
+  }
+
+  void add(std::shared_ptr<Runnable> task,
+           int64_t timeout = 0LL,
+           int64_t expiration = 0LL,
+           bool cancellable = false,
+           bool numa = false);
+
+  void remove(std::shared_ptr<Runnable> task) {
+    throw IllegalStateException("Not implemented");
+  }
+
+  std::shared_ptr<Runnable> removeNextPending();
+
+  void setExpireCallback(ExpireCallback expireCallback) {
+    expireCallback_ = expireCallback;
+  }
+
+  void setCodelCallback(ExpireCallback expireCallback) {
+    codelCallback_ = expireCallback;
+  }
+
+  void setThreadInitCallback(InitCallback initCallback) {
+    initCallback_ = initCallback;
+  }
+
+  void getStats(int64_t& waitTimeUs, int64_t& runTimeUs, int64_t maxItems);
+
+  void enableCodel(bool enabled) {
+    codelEnabled_ = enabled || FLAGS_codel_enabled;
+  }
+
+  folly::wangle::Codel* getCodel() {
+    return &codel_;
+  }
+
+ private:
+  class Worker;
+
+  struct WorkQueue {
+    WorkQueue() : node(-1), active(false), size(0) {
+      lock.init();
+    }
+
+    Task* pop();
+
+    std::atomic<int> node;
+    // Whether a worker currently owns this queue.  Queues of workers that
+    // have exited are kept, and their tasks stolen, until a new worker
+    // takes the queue over.
+    std::atomic<bool> active;
+    std::atomic<size_t> size;
+    folly::MicroSpinLock lock;
+    std::deque<Task*> tasks;
+    // Keep queues that are allocated next to each other from sharing a
+    // cache line
+    char padding[64];
+  };
+
+  WorkQueue* claimQueue();
+  void releaseQueue(WorkQueue* queue);
+  WorkQueue* pickQueue(bool numa);
+  Task* findTask(WorkQueue* local);
+  Task* waitOnTask(WorkQueue* local);
+  bool shouldStop();
+  bool canSleep() const;
+  void workerStarted(Worker* worker);
+  void workerExiting(Worker* worker);
+  void runTask(Task* task);
+  void taskExpired(Task* task);
+  void reportTaskStats(const SystemClockTimePoint& queueBegin,
+                       const SystemClockTimePoint& workBegin,
+                       const SystemClockTimePoint& workEnd);
+  void maybeNotifyMaxMonitor();
+  void stopImpl(bool joinArg);
+
+  // The queue owned by the current thread, if it is a worker
+  static __thread WorkQueue* localQueue_;
+  static __thread WorkStealingThreadManager* localManager_;
+  // Where the current thread starts looking for a queue to add to
+  static __thread size_t nextQueue_;
+
+  const size_t pendingTaskCountMax_;
+  const bool enableTaskStats_;
+  const size_t maxWorkers_;
+
+  std::unique_ptr<std::atomic<WorkQueue*>[]> queues_;
+  std::atomic<size_t> numQueues_;
+
+  std::atomic<STATE> state_;
+  std::atomic<size_t> workerCount_;
+  std::atomic<size_t> idleCount_;
+  std::atomic<int> workersToStop_;
+  size_t expiredCount_;
+
+  folly::MicroSpinLock statsLock_;
+  int64_t waitingTimeUs_;
+  int64_t executingTimeUs_;
+  int64_t numTasks_;
+
+  ExpireCallback expireCallback_;
+  ExpireCallback codelCallback_;
+  InitCallback initCallback_;
+
+  folly::wangle::Codel codel_;
+  bool codelEnabled_;
+
+  std::shared_ptr<ThreadFactory> threadFactory_;
+  std::string namePrefix_;
+  uint32_t namePrefixCounter_;
+
+  mutable Mutex mutex_;
+  // maxMonitor_ is signalled when the number of pending tasks drops below
+  // pendingTaskCountMax_
+  Monitor maxMonitor_;
+  // deadWorkerMonitor_ is signaled whenever a worker thread exits
+  Monitor deadWorkerMonitor_;
+  std::deque<std::shared_ptr<Thread>> deadWorkers_;
+  folly::LifoSem waitSem_;
+};
+
+}}}
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/concurrency/ContentionProfiler.h>
+#include <thrift/lib/cpp/concurrency/Monitor.h>
+#include <thrift/lib/cpp/concurrency/Mutex.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace apache::thrift::concurrency;
+
+namespace {
+
+class ContentionProfilerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    resetContentionProfile();
+    enableContentionProfiling(1);
+  }
+
+  void TearDown() override {
+    enableContentionProfiling(0);
+    resetContentionProfile();
+  }
+};
+
+const ContentionSite* findTag(const vector<ContentionSite>& sites,
+                              const char* tag) {
+  for (const auto& site : sites) {
+    if (site.tag && strcmp(site.tag, tag) == 0) {
+      return &site;
+    }
+  }
+  return nullptr;
+}
+
+// Holds mutex for holdUsec on another thread, and returns once it is locked
+thread holdLocked(const Mutex& mutex, int holdUsec) {
+  auto locked = make_shared<atomic<bool>>(false);
+  thread t([&mutex, holdUsec, locked] {
+    Guard g(mutex);
+    *locked = true;
+    usleep(holdUsec);
+  });
+  while (!*locked) {
+    usleep(100);
+  }
+  return t;
+}
+
+// Each locks at a single call site of its own, at any optimization level
+__attribute__((__noinline__)) void guardOnce(const Mutex& mutex) {
+  Guard g(mutex);
+}
+
+__attribute__((__noinline__)) void guardAgain(const Mutex& mutex) {
+  Guard g(mutex);
+}
+
+__attribute__((__noinline__)) void writeGuardOnce(const ReadWriteMutex& rw) {
+  RWGuard g(rw, RW_WRITE);
+}
+
+__attribute__((__noinline__)) void synchronizeOnce(const Monitor& monitor) {
+  Synchronized s(monitor);
+}
+
+}
+
+TEST_F(ContentionProfilerTest, TaggedWaitAndHold) {
+  Mutex mutex;
+  auto holder = holdLocked(mutex, 20000);
+  {
+    ContentionTag tag("test::contended");
+    Guard g(mutex);
+    usleep(5000);
+  }
+  holder.join();
+
+  auto sites = getContentionProfile();
+  auto site = findTag(sites, "test::contended");
+  ASSERT_NE(nullptr, site);
+  EXPECT_EQ(1, site->samples);
+  EXPECT_GE(site->totalWaitUsec, 10000);
+  EXPECT_EQ(1, site->holds);
+  EXPECT_GE(site->maxHoldUsec, 5000);
+  // The holder's sample is attributed to its call site
+  EXPECT_EQ(2, sites.size());
+  EXPECT_EQ(site, &sites[0]);
+}
+
+TEST_F(ContentionProfilerTest, CallSites) {
+  Mutex mutex;
+  for (int i = 0; i < 10; ++i) {
+    guardOnce(mutex);
+  }
+  guardAgain(mutex);
+  auto sites = getContentionProfile();
+  ASSERT_EQ(2, sites.size());
+  EXPECT_EQ(nullptr, sites[0].tag);
+  EXPECT_NE(nullptr, sites[0].address);
+  EXPECT_NE(sites[0].address, sites[1].address);
+  EXPECT_EQ(10, max(sites[0].samples, sites[1].samples));
+  EXPECT_EQ(1, min(sites[0].samples, sites[1].samples));
+}
+
+// The guards are inlined, so each of their callers is a site of its own
+// rather than all of them sharing a site in the guard's constructor
+TEST_F(ContentionProfilerTest, GuardCallSites) {
+  Mutex mutex;
+  ReadWriteMutex rw;
+  Monitor monitor;
+  guardOnce(mutex);
+  guardAgain(mutex);
+  writeGuardOnce(rw);
+  synchronizeOnce(monitor);
+  auto sites = getContentionProfile();
+  ASSERT_EQ(4, sites.size());
+  for (size_t i = 0; i < sites.size(); ++i) {
+    EXPECT_EQ(1, sites[i].samples);
+    for (size_t j = 0; j < i; ++j) {
+      EXPECT_NE(sites[i].address, sites[j].address);
+    }
+  }
+}
+
+// A sample belongs to the tag it was locked under, wherever it is released
+TEST_F(ContentionProfilerTest, TagAtLockTime) {
+  Mutex mutex;
+  {
+    ContentionTag tag("test::locked_inside");
+    mutex.lock();
+  }
+  mutex.unlock();
+
+  mutex.lock();
+  {
+    ContentionTag tag("test::released_inside");
+    mutex.unlock();
+  }
+  auto sites = getContentionProfile();
+  auto inside = findTag(sites, "test::locked_inside");
+  ASSERT_NE(nullptr, inside);
+  EXPECT_EQ(1, inside->samples);
+  EXPECT_EQ(1, inside->holds);
+  EXPECT_EQ(nullptr, findTag(sites, "test::released_inside"));
+  ASSERT_EQ(2, sites.size());
+}
+
+// The same tag from different literals is one site
+TEST_F(ContentionProfilerTest, TagContents) {
+  static const char first[] = "test::same";
+  static const char second[] = "test::same";
+  ASSERT_NE(static_cast<const void*>(first),
+            static_cast<const void*>(second));
+  Mutex mutex;
+  {
+    ContentionTag tag(first);
+    Guard g(mutex);
+  }
+  thread([&] {
+    ContentionTag tag(second);
+    Guard g(mutex);
+  }).join();
+  auto sites = getContentionProfile();
+  ASSERT_EQ(1, sites.size());
+  EXPECT_STREQ("test::same", sites[0].tag);
+  EXPECT_EQ(2, sites[0].samples);
+}
+
+TEST_F(ContentionProfilerTest, SampleRate) {
+  enableContentionProfiling(4);
+  ReadWriteMutex mutex;
+  ContentionTag tag("test::sampled");
+  for (int i = 0; i < 100; ++i) {
+    RWGuard g(mutex, RW_READ);
+  }
+  auto sites = getContentionProfile();
+  auto site = findTag(sites, "test::sampled");
+  ASSERT_NE(nullptr, site);
+  EXPECT_EQ(25, site->samples);
+  // Shared acquisitions have no hold
+  EXPECT_EQ(0, site->holds);
+}
+
+TEST_F(ContentionProfilerTest, MonitorWaitEndsHold) {
+  Monitor monitor;
+  {
+    ContentionTag tag("test::monitor");
+    Synchronized s(monitor);
+    monitor.waitForTimeRelative(50);
+  }
+  auto sites = getContentionProfile();
+  auto site = findTag(sites, "test::monitor");
+  ASSERT_NE(nullptr, site);
+  EXPECT_EQ(1, site->holds);
+  EXPECT_LT(site->maxHoldUsec, 40000);
+}
+
+TEST_F(ContentionProfilerTest, ExitedThreads) {
+  thread([] {
+    Mutex mutex;
+    ContentionTag tag("test::exited");
+    Guard g(mutex);
+  }).join();
+  auto sites = getContentionProfile();
+  EXPECT_NE(nullptr, findTag(sites, "test::exited"));
+
+  resetContentionProfile();
+  EXPECT_TRUE(getContentionProfile().empty());
+}
+
+TEST_F(ContentionProfilerTest, Report) {
+  Mutex mutex;
+  {
+    ContentionTag tag("test::report");
+    Guard g(mutex);
+  }
+  {
+    Guard g(mutex);
+  }
+  auto report = getContentionReport(1);
+  EXPECT_NE(string::npos, report.find("top 1 of 2 sites"));
+  EXPECT_EQ(3, count(report.begin(), report.end(), '\n'));
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
+
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace apache::thrift::concurrency;
+
+namespace {
+
+class Pooled : public PoolAllocated {
+ public:
+  virtual ~Pooled() {}
+  char data[100];
+};
+
+class PooledDerived : public Pooled {
+ public:
+  char more[300];
+};
+
+}
+
+TEST(ThreadCachedPoolTest, ReusesOnSameThread) {
+  auto p = new Pooled;
+  delete p;
+  auto q = new Pooled;
+  EXPECT_EQ(p, q);
+  delete q;
+}
+
+TEST(ThreadCachedPoolTest, DerivedUsesOwnSizeClass) {
+  Pooled* base = new Pooled;
+  Pooled* derived = new PooledDerived;
+  delete base;
+  delete derived;
+  // Each goes back to its own size class
+  auto d2 = new PooledDerived;
+  EXPECT_EQ(derived, d2);
+  auto b2 = new Pooled;
+  EXPECT_EQ(base, b2);
+  delete d2;
+  delete b2;
+}
+
+TEST(ThreadCachedPoolTest, CrossThreadReturn) {
+  const size_t kCount = ThreadCachedPool::kMaxCached * 4;
+  std::vector<Pooled*> objs;
+  std::thread producer([&]() {
+    for (size_t i = 0; i < kCount; ++i) {
+      objs.push_back(new Pooled);
+    }
+  });
+  producer.join();
+
+  std::thread consumer([&]() {
+    for (auto p : objs) {
+      delete p;
+    }
+    // The consumer spilled its surplus to the shared list
+    auto before = ThreadCachedPool::getStats();
+    std::vector<Pooled*> again;
+    for (size_t i = 0; i < kCount; ++i) {
+      again.push_back(new Pooled);
+    }
+    auto after = ThreadCachedPool::getStats();
+    EXPECT_EQ(kCount, after.hits - before.hits);
+    for (auto p : again) {
+      delete p;
+    }
+  });
+  consumer.join();
+}
+
+TEST(ThreadCachedPoolTest, ToggleWhileLive) {
+  ThreadCachedPool::setEnabled(false);
+  auto unpooled = new Pooled;
+  ThreadCachedPool::setEnabled(true);
+  auto pooled = new Pooled;
+  delete unpooled;
+  ThreadCachedPool::setEnabled(false);
+  delete pooled;
+  ThreadCachedPool::setEnabled(true);
+}
+
+TEST(ThreadCachedPoolTest, LargeBypassesPool) {
+  auto p = ThreadCachedPool::allocate(ThreadCachedPool::kMaxSize + 1);
+  ThreadCachedPool::deallocate(p, ThreadCachedPool::kMaxSize + 1);
+}
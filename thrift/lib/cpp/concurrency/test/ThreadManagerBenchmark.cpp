@@ -0,0 +1,116 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <thrift/lib/cpp/concurrency/FunctionRunner.h>
+#include <thrift/lib/cpp/concurrency/PosixThreadFactory.h>
+#include <thrift/lib/cpp/concurrency/ThreadManager.h>
+#include <thrift/lib/cpp/concurrency/WorkStealingThreadManager.h>
+
+#include <thread>
+#include <vector>
+#include <gflags/gflags.h>
+
+#include <folly/Benchmark.h>
+
+DEFINE_int32(num_workers, 16, "Number of ThreadManager worker threads");
+
+using namespace apache::thrift::concurrency;
+
+/*
+ * Measure the cost of pushing trivial tasks through a ThreadManager when
+ * many threads are adding tasks at once.  Each iteration is one task; the
+ * time includes waiting for all of the tasks to finish.
+ */
+void addFromProducers(int64_t iters,
+                      int64_t numProducers,
+                      std::shared_ptr<ThreadManager> threadManager) {
+  std::vector<std::thread> producers;
+  BENCHMARK_SUSPEND {
+    threadManager->start();
+  }
+
+  for (int64_t p = 0; p < numProducers; ++p) {
+    int64_t count = iters / numProducers + (p < iters % numProducers ? 1 : 0);
+    producers.emplace_back([=]() {
+      // One Runnable per producer, so that producers don't contend on
+      // its reference count
+      auto task = FunctionRunner::create([]() {});
+      for (int64_t n = 0; n < count; ++n) {
+        while (true) {
+          try {
+            threadManager->add(task);
+            break;
+          } catch (const TooManyPendingTasksException&) {
+            // The shared queue is bounded; let the workers catch up
+            std::this_thread::yield();
+          }
+        }
+      }
+    });
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  threadManager->join();
+
+  BENCHMARK_SUSPEND {
+    threadManager.reset();
+  }
+}
+
+void shared_queue(int64_t iters, int64_t numProducers) {
+  std::shared_ptr<ThreadManager> threadManager;
+  BENCHMARK_SUSPEND {
+    threadManager = ThreadManager::newSimpleThreadManager(FLAGS_num_workers);
+    threadManager->threadFactory(std::make_shared<PosixThreadFactory>());
+  }
+  addFromProducers(iters, numProducers, std::move(threadManager));
+}
+
+void work_stealing(int64_t iters, int64_t numProducers) {
+  std::shared_ptr<ThreadManager> threadManager;
+  BENCHMARK_SUSPEND {
+    threadManager = WorkStealingThreadManager::newWorkStealingThreadManager(
+      FLAGS_num_workers);
+  }
+  addFromProducers(iters, numProducers, std::move(threadManager));
+}
+
+BENCHMARK_PARAM(shared_queue, 1)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 1)
+BENCHMARK_DRAW_LINE()
+BENCHMARK_PARAM(shared_queue, 2)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 2)
+BENCHMARK_DRAW_LINE()
+BENCHMARK_PARAM(shared_queue, 4)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 4)
+BENCHMARK_DRAW_LINE()
+BENCHMARK_PARAM(shared_queue, 8)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 8)
+BENCHMARK_DRAW_LINE()
+BENCHMARK_PARAM(shared_queue, 16)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 16)
+BENCHMARK_DRAW_LINE()
+BENCHMARK_PARAM(shared_queue, 32)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 32)
+BENCHMARK_DRAW_LINE()
+BENCHMARK_PARAM(shared_queue, 64)
+BENCHMARK_RELATIVE_PARAM(work_stealing, 64)
+
+int main(int argc, char *argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  folly::runBenchmarks();
+  return 0;
+}
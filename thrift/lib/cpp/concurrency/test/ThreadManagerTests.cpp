@@ -29,6 +29,7 @@
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 #include <thrift/lib/cpp/concurrency/NumaThreadManager.h>
 #include <thrift/lib/cpp/concurrency/Util.h>
+#include <thrift/lib/cpp/concurrency/WorkStealingThreadManager.h>
 
 #include <folly/experimental/wangle/concurrent/Codel.h>
 #include <folly/Synchronized.h>
@@ -617,6 +618,226 @@ BOOST_AUTO_TEST_CASE(AddRemoveWorker) {
   BOOST_CHECK_EQUAL(currentTaskObjects, 0);
 }
 
+// Run lots of tasks that re-add themselves from worker threads, so they
+// stay on the local queues, while other workers steal them.
+BOOST_AUTO_TEST_CASE(WorkStealingTest) {
+  int64_t numTasks = 100000;
+  size_t numWorkers = 16;
+  int64_t numParallelTasks = 200;
+
+  std::shared_ptr<ThreadManager> threadManager =
+    WorkStealingThreadManager::newWorkStealingThreadManager(numWorkers);
+  threadManager->start();
+  BOOST_CHECK_EQUAL(threadManager->workerCount(), numWorkers);
+
+  Monitor monitor;
+  int64_t currentTaskObjects = 0;
+  int64_t count = numTasks;
+
+  boost::mt19937 rng;
+  boost::uniform_int<> taskTimeoutDist(1, 300);
+  for (int64_t n = 0; n < numParallelTasks; ++n) {
+    int64_t taskTimeoutUs = taskTimeoutDist(rng);
+    std::shared_ptr<AddRemoveTask> task(new AddRemoveTask(
+          taskTimeoutUs, threadManager, &monitor, &count,
+          &currentTaskObjects));
+    threadManager->add(task);
+  }
+
+  {
+    Synchronized s(monitor);
+    while (count > 0) {
+      monitor.wait();
+    }
+  }
+
+  // Removing workers must not lose the tasks left on their queues.  Block
+  // every worker, queue tasks on all of them, then remove half of the
+  // workers as soon as they are released.
+  size_t numQueued = 1000;
+  Monitor bmonitor;
+  bool blocked = true;
+  size_t remaining = numWorkers + numQueued;
+  for (size_t n = 0; n < numWorkers; ++n) {
+    std::shared_ptr<BlockTask> blocker(new BlockTask(&monitor, &bmonitor,
+                                                     &blocked, &remaining));
+    threadManager->add(blocker);
+    REQUIRE_EQUAL_TIMEOUT(blocker->started_, true);
+  }
+
+  std::vector<std::shared_ptr<BlockTask>> tasks;
+  for (size_t n = 0; n < numQueued; ++n) {
+    std::shared_ptr<BlockTask> task(new BlockTask(&monitor, &bmonitor,
+                                                  &blocked, &remaining));
+    tasks.push_back(task);
+    threadManager->add(task);
+  }
+  BOOST_CHECK_EQUAL(threadManager->pendingTaskCount(), numQueued);
+
+  {
+    Synchronized s(bmonitor);
+    blocked = false;
+    bmonitor.notifyAll();
+  }
+  threadManager->removeWorker(numWorkers / 2);
+  BOOST_CHECK_EQUAL(threadManager->workerCount(), numWorkers / 2);
+
+  threadManager->join();
+  BOOST_CHECK_EQUAL(threadManager->pendingTaskCount(), 0);
+  BOOST_CHECK_EQUAL(threadManager->workerCount(), 0);
+  BOOST_CHECK_EQUAL(currentTaskObjects, 0);
+  // Every blocker and queued task ran
+  BOOST_CHECK_EQUAL(remaining, 0);
+  size_t ran = 0;
+  for (const auto& task : tasks) {
+    if (task->started_) {
+      ++ran;
+    }
+  }
+  BOOST_CHECK_EQUAL(ran, numQueued);
+}
+
+// Tasks queued behind a blocked worker for longer than their expiration
+// must be expired instead of run.
+BOOST_AUTO_TEST_CASE(WorkStealingExpireTest) {
+  size_t numTasks = 10;
+  int64_t expirationTimeMs = 50;
+
+  std::shared_ptr<ThreadManager> threadManager =
+    WorkStealingThreadManager::newWorkStealingThreadManager(1);
+  Monitor monitor;
+  size_t activeTasks = numTasks + 1;
+  threadManager->setExpireCallback(
+      std::bind(expireTestCallback, std::placeholders::_1,
+                     &monitor, &activeTasks));
+  threadManager->start();
+
+  Monitor bmonitor;
+  bool blocked = true;
+  std::shared_ptr<BlockTask> blocker(new BlockTask(&monitor, &bmonitor,
+                                                   &blocked, &activeTasks));
+  threadManager->add(blocker);
+  REQUIRE_EQUAL_TIMEOUT(blocker->started_, true);
+
+  std::vector<std::shared_ptr<BlockTask>> tasks;
+  for (size_t n = 0; n < numTasks; ++n) {
+    std::shared_ptr<BlockTask> task(new BlockTask(&monitor, &bmonitor,
+                                                  &blocked, &activeTasks));
+    tasks.push_back(task);
+    threadManager->add(task, 0, expirationTimeMs);
+  }
+  BOOST_CHECK_EQUAL(threadManager->pendingTaskCount(), numTasks);
+
+  usleep(expirationTimeMs * Util::US_PER_MS * 1.10);
+
+  {
+    Synchronized s(bmonitor);
+    blocked = false;
+    bmonitor.notifyAll();
+  }
+  {
+    Synchronized s(monitor);
+    while (activeTasks != 0) {
+      monitor.wait();
+    }
+  }
+
+  for (const auto& task : tasks) {
+    BOOST_CHECK(!task->started_);
+  }
+  BOOST_CHECK_EQUAL(threadManager->expiredTaskCount(), numTasks);
+  BOOST_CHECK_EQUAL(threadManager->pendingTaskCount(), 0);
+  threadManager->join();
+}
+
+// Keep a single worker busy long enough for Codel to see a full interval
+// of queueing delays above its target, and check that it then drops tasks
+// through the codel and expire callbacks.
+BOOST_AUTO_TEST_CASE(WorkStealingCodelTest) {
+  size_t numTasks = 100;
+  int64_t taskTimeMs = 5;
+
+  std::shared_ptr<ThreadManager> threadManager =
+    WorkStealingThreadManager::newWorkStealingThreadManager(1);
+  std::atomic<size_t> codelCount(0);
+  std::atomic<size_t> expireCount(0);
+  threadManager->setCodelCallback([&](std::shared_ptr<Runnable>) {
+      ++codelCount;
+    });
+  threadManager->setExpireCallback([&](std::shared_ptr<Runnable>) {
+      ++expireCount;
+    });
+  threadManager->enableCodel(true);
+  threadManager->start();
+
+  Monitor monitor;
+  size_t tasksLeft = numTasks;
+  for (size_t n = 0; n < numTasks; ++n) {
+    threadManager->add(std::make_shared<LoadTask>(&monitor, &tasksLeft,
+                                                  taskTimeMs));
+  }
+  threadManager->join();
+
+  size_t ran = numTasks - tasksLeft;
+  size_t dropped = expireCount;
+  BOOST_TEST_MESSAGE("ran: " << ran << " dropped: " << dropped);
+  BOOST_CHECK_GT(ran, 0);
+  BOOST_CHECK_GT(dropped, 0);
+  BOOST_CHECK_EQUAL(codelCount.load(), dropped);
+  BOOST_CHECK_EQUAL(ran + dropped, numTasks);
+  BOOST_CHECK_EQUAL(threadManager->expiredTaskCount(), dropped);
+}
+
+// Each priority gets its own workers, so a task of another priority still
+// runs while every NORMAL worker is blocked.
+BOOST_AUTO_TEST_CASE(PriorityWorkStealingTest) {
+  std::shared_ptr<PriorityThreadManager> threadManager =
+    WorkStealingThreadManager::newPriorityWorkStealingThreadManager(
+      {{1, 1, 1, 2, 1}});
+  threadManager->start();
+  BOOST_CHECK_EQUAL(threadManager->workerCount(), 6);
+
+  Monitor monitor;
+  Monitor bmonitor;
+  bool blocked = true;
+  size_t normalLeft = 2;
+  std::vector<std::shared_ptr<BlockTask>> normalTasks;
+  for (size_t n = 0; n < normalLeft; ++n) {
+    std::shared_ptr<BlockTask> task(new BlockTask(&monitor, &bmonitor,
+                                                  &blocked, &normalLeft));
+    normalTasks.push_back(task);
+    threadManager->add(NORMAL, task);
+  }
+  for (const auto& task : normalTasks) {
+    REQUIRE_EQUAL_TIMEOUT(task->started_, true);
+  }
+
+  size_t otherLeft = N_PRIORITIES - 1;
+  for (int i = 0; i < N_PRIORITIES; ++i) {
+    if (i == NORMAL) {
+      continue;
+    }
+    threadManager->add(static_cast<PRIORITY>(i),
+                       std::make_shared<LoadTask>(&monitor, &otherLeft, 1));
+  }
+  {
+    Synchronized s(monitor);
+    while (otherLeft != 0) {
+      monitor.wait();
+    }
+    BOOST_CHECK_EQUAL(normalLeft, 2);
+  }
+
+  {
+    Synchronized s(bmonitor);
+    blocked = false;
+    bmonitor.notifyAll();
+  }
+  threadManager->join();
+  BOOST_CHECK_EQUAL(normalLeft, 0);
+  BOOST_CHECK_EQUAL(threadManager->workerCount(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(NeverStartedTest) {
   // Test destroying a ThreadManager that was never started.
   // This ensures that calling stop() on an unstarted ThreadManager works
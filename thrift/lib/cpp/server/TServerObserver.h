@@ -82,6 +82,28 @@ class TServerObserver {
 
   virtual void callCompleted(const CallTimestamps& runtimes) {}
 
+  // A compression policy picked a transform (THeader::TRANSFORMS, NONE for
+  // no compression) for a message of size bytes
+  virtual void compressionChosen(uint16_t transform, uint32_t size) {}
+
+  // A message of size bytes was compressed to compressedSize bytes by
+  // transform, taking encodeNsec nanoseconds
+  virtual void compressionSampled(uint16_t transform,
+                                  uint32_t size,
+                                  uint32_t compressedSize,
+                                  uint64_t encodeNsec) {}
+
+  // A oneway request sent as a UDP datagram was dropped unprocessed: it was
+  // larger than the server's max datagram size, or not a oneway THeader
+  // message.  Datagrams shed under load get serverOverloaded() instead.
+  virtual void datagramTruncated() {}
+
+  virtual void datagramMalformed() {}
+
+  // count datagrams from one client never arrived (or arrived out of order),
+  // going by the gaps in its sequence numbers
+  virtual void datagramsLost(uint32_t count) {}
+
   // The observer has to specify a sample rate for callCompleted notifications
   inline uint32_t getSampleRate() const {
     return sampleRate_;
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/ssl/SSLSessionCache.h>
+
+#include <glog/logging.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using apache::thrift::concurrency::ProfiledMutex;
+
+namespace apache { namespace thrift { namespace ssl {
+
+typedef std::lock_guard<ProfiledMutex<std::mutex>> Guard;
+
+int SSLSessionCache::exDataIndex_ = -1;
+
+namespace {
+
+std::once_flag exDataIndexOnce;
+
+}
+
+SSLSessionCache::SSLSessionCache(const Options& options)
+    : options_(options) {
+  std::call_once(exDataIndexOnce, [] {
+    exDataIndex_ = SSL_CTX_get_ex_new_index(
+      0, (void*)"SSLSessionCache index", nullptr, nullptr, nullptr);
+  });
+  rotateTicketKeys();
+}
+
+SSLSessionCache::~SSLSessionCache() {}
+
+void SSLSessionCache::attach(SSL_CTX* ctx) {
+  SSL_CTX_set_ex_data(ctx, exDataIndex_, this);
+
+  SSL_CTX_set_session_cache_mode(
+    ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_set_timeout(ctx, options_.timeout.count());
+  if (!options_.sessionIdContext.empty()) {
+    SSL_CTX_set_session_id_context(
+      ctx,
+      reinterpret_cast<const unsigned char*>(options_.sessionIdContext.data()),
+      std::min<size_t>(options_.sessionIdContext.size(),
+                       SSL_MAX_SID_CTX_LENGTH));
+  }
+  SSL_CTX_sess_set_new_cb(ctx, &SSLSessionCache::newSessionCallback);
+  SSL_CTX_sess_set_get_cb(ctx, &SSLSessionCache::getSessionCallback);
+  SSL_CTX_sess_set_remove_cb(ctx, &SSLSessionCache::removeSessionCallback);
+
+#ifdef SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB
+  if (options_.tickets) {
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, &SSLSessionCache::ticketCallback);
+  } else {
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+  }
+#endif
+}
+
+void SSLSessionCache::setTicketKeys(const std::vector<std::string>& keys) {
+  if (keys.empty()) {
+    throw std::invalid_argument("SSLSessionCache: no ticket keys");
+  }
+  std::vector<TicketKey> ticketKeys(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (keys[i].size() != kTicketKeyLength) {
+      throw std::invalid_argument("SSLSessionCache: bad ticket key length");
+    }
+    memcpy(&ticketKeys[i], keys[i].data(), kTicketKeyLength);
+  }
+
+  Guard g(mutex_);
+  ticketKeys_.swap(ticketKeys);
+}
+
+void SSLSessionCache::rotateTicketKeys() {
+  TicketKey key;
+  static_assert(sizeof(key) == kTicketKeyLength, "unexpected padding");
+  if (RAND_bytes(reinterpret_cast<unsigned char*>(&key), sizeof(key)) != 1) {
+    LOG(FATAL) << "SSLSessionCache: RAND_bytes failed";
+  }
+
+  Guard g(mutex_);
+  ticketKeys_.insert(ticketKeys_.begin(), key);
+  if (ticketKeys_.size() > kMaxTicketKeys) {
+    ticketKeys_.resize(kMaxTicketKeys);
+  }
+}
+
+std::vector<std::string> SSLSessionCache::getTicketKeys() const {
+  std::vector<std::string> keys;
+  Guard g(mutex_);
+  for (const auto& key : ticketKeys_) {
+    keys.emplace_back(reinterpret_cast<const char*>(&key), sizeof(key));
+  }
+  return keys;
+}
+
+size_t SSLSessionCache::size() const {
+  Guard g(mutex_);
+  return sessions_.size();
+}
+
+SSLSessionCache::Stats SSLSessionCache::getStats() const {
+  Guard g(mutex_);
+  return stats_;
+}
+
+SSLSessionCache* SSLSessionCache::fromCtx(SSL_CTX* ctx) {
+  if (!ctx || exDataIndex_ < 0) {
+    return nullptr;
+  }
+  return static_cast<SSLSessionCache*>(SSL_CTX_get_ex_data(ctx, exDataIndex_));
+}
+
+int SSLSessionCache::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  auto cache = fromCtx(SSL_get_SSL_CTX(ssl));
+  if (cache) {
+    cache->store(session);
+  }
+  // We did not keep a reference to session
+  return 0;
+}
+
+SSL_SESSION* SSLSessionCache::getSessionCallback(SSL* ssl,
+                                                 SessionIdByte* id,
+                                                 int idLength,
+                                                 int* copy) {
+  // The returned session is new, OpenSSL can own it without a copy
+  *copy = 0;
+  auto cache = fromCtx(SSL_get_SSL_CTX(ssl));
+  if (!cache) {
+    return nullptr;
+  }
+  return cache->lookup(std::string(reinterpret_cast<const char*>(id),
+                                   idLength));
+}
+
+void SSLSessionCache::removeSessionCallback(SSL_CTX* ctx,
+                                            SSL_SESSION* session) {
+  auto cache = fromCtx(ctx);
+  if (cache) {
+    unsigned int idLength;
+    const unsigned char* id = SSL_SESSION_get_id(session, &idLength);
+    cache->remove(std::string(reinterpret_cast<const char*>(id), idLength));
+  }
+}
+
+int SSLSessionCache::ticketCallback(SSL* ssl,
+                                    unsigned char* keyName,
+                                    unsigned char* iv,
+                                    EVP_CIPHER_CTX* cipherCtx,
+                                    HMAC_CTX* hmacCtx,
+                                    int encrypt) {
+  auto cache = fromCtx(SSL_get_SSL_CTX(ssl));
+  if (!cache) {
+    // Neither issue nor accept tickets
+    return encrypt ? -1 : 0;
+  }
+  return cache->ticketKey(keyName, iv, cipherCtx, hmacCtx, encrypt);
+}
+
+void SSLSessionCache::store(SSL_SESSION* session) {
+  unsigned int idLength;
+  const unsigned char* id = SSL_SESSION_get_id(session, &idLength);
+  int length = i2d_SSL_SESSION(session, nullptr);
+  if (idLength == 0 || length <= 0) {
+    return;
+  }
+  Entry entry;
+  entry.id.assign(reinterpret_cast<const char*>(id), idLength);
+  entry.session.resize(length);
+  unsigned char* p = reinterpret_cast<unsigned char*>(&entry.session[0]);
+  i2d_SSL_SESSION(session, &p);
+  entry.expires = std::chrono::steady_clock::now() + options_.timeout;
+
+  Guard g(mutex_);
+  auto it = sessions_.find(entry.id);
+  if (it != sessions_.end()) {
+    lru_.erase(it->second);
+    sessions_.erase(it);
+  }
+  lru_.push_front(std::move(entry));
+  sessions_[lru_.front().id] = lru_.begin();
+  ++stats_.stored;
+  while (sessions_.size() > options_.maxSessions) {
+    sessions_.erase(lru_.back().id);
+    lru_.pop_back();
+    ++stats_.evicted;
+  }
+}
+
+SSL_SESSION* SSLSessionCache::lookup(const std::string& id) {
+  std::string serialized;
+  {
+    Guard g(mutex_);
+    auto it = sessions_.find(id);
+    if (it == sessions_.end() ||
+        it->second->expires < std::chrono::steady_clock::now()) {
+      if (it != sessions_.end()) {
+        lru_.erase(it->second);
+        sessions_.erase(it);
+      }
+      ++stats_.misses;
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    serialized = it->second->session;
+    ++stats_.hits;
+  }
+
+  // Deserialize outside the lock
+  auto p = reinterpret_cast<const unsigned char*>(serialized.data());
+  return d2i_SSL_SESSION(nullptr, &p, serialized.size());
+}
+
+void SSLSessionCache::remove(const std::string& id) {
+  Guard g(mutex_);
+  auto it = sessions_.find(id);
+  if (it != sessions_.end()) {
+    lru_.erase(it->second);
+    sessions_.erase(it);
+  }
+}
+
+int SSLSessionCache::ticketKey(unsigned char* keyName,
+                               unsigned char* iv,
+                               EVP_CIPHER_CTX* cipherCtx,
+                               HMAC_CTX* hmacCtx,
+                               int encrypt) {
+  TicketKey key;
+  bool current = true;
+  if (encrypt) {
+    if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+      return -1;
+    }
+    Guard g(mutex_);
+    key = ticketKeys_.front();
+    ++stats_.ticketsIssued;
+  } else {
+    Guard g(mutex_);
+    size_t i = 0;
+    while (i < ticketKeys_.size() &&
+           memcmp(ticketKeys_[i].name, keyName, sizeof(key.name)) != 0) {
+      ++i;
+    }
+    if (i == ticketKeys_.size()) {
+      ++stats_.ticketsRejected;
+      return 0;
+    }
+    key = ticketKeys_[i];
+    current = (i == 0);
+    ++stats_.ticketsAccepted;
+  }
+
+  if (encrypt) {
+    memcpy(keyName, key.name, sizeof(key.name));
+    EVP_EncryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr, key.aesKey, iv);
+  } else {
+    EVP_DecryptInit_ex(cipherCtx, EVP_aes_128_cbc(), nullptr, key.aesKey, iv);
+  }
+  HMAC_Init_ex(hmacCtx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(),
+               nullptr);
+  // 2 asks OpenSSL to issue a new ticket under the current key
+  return current ? 1 : 2;
+}
+
+}}} // apache::thrift::ssl
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <thrift/lib/cpp/concurrency/ProfiledMutex.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace apache { namespace thrift { namespace ssl {
+
+/**
+ * Server side TLS session resumption state, shared by every thread that
+ * accepts connections with the SSL_CTXs it is attached to.
+ *
+ * Sessions are kept, serialized, in one LRU map instead of OpenSSL's
+ * internal cache, so a client resuming by session id succeeds whichever
+ * thread accepts its reconnect, even if the threads use different SSL_CTXs.
+ *
+ * Session tickets are encrypted with the first of the ticket keys and
+ * accepted with any of them; tickets under an older key are renewed.
+ * Processes serving the same clients should share their keys with
+ * setTicketKeys(), and call it or rotateTicketKeys() periodically.
+ * Without either call the cache starts with one random key.
+ */
+class SSLSessionCache {
+ public:
+  struct Options {
+    Options()
+      : maxSessions(20480)
+      , timeout(3600)
+      , tickets(true)
+      , sessionIdContext("thrift") {}
+
+    size_t maxSessions;
+    std::chrono::seconds timeout;
+    // Whether to issue and accept session tickets
+    bool tickets;
+    // Resumption with client certificates requires a session id context
+    std::string sessionIdContext;
+  };
+
+  struct Stats {
+    Stats() : hits(0), misses(0), stored(0), evicted(0),
+              ticketsIssued(0), ticketsAccepted(0), ticketsRejected(0) {}
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stored;
+    uint64_t evicted;
+    uint64_t ticketsIssued;
+    uint64_t ticketsAccepted;
+    // Tickets under an unknown key, resumed with a full handshake instead
+    uint64_t ticketsRejected;
+  };
+
+  // A ticket key is a 16 byte name, a 16 byte HMAC key and a 16 byte AES key
+  static const size_t kTicketKeyLength = 48;
+  // rotateTicketKeys() keeps this many keys
+  static const size_t kMaxTicketKeys = 3;
+
+  explicit SSLSessionCache(const Options& options = Options());
+  ~SSLSessionCache();
+
+  /**
+   * Makes ctx use this cache.  The cache must outlive every SSL object
+   * created from ctx.
+   */
+  void attach(SSL_CTX* ctx);
+
+  /**
+   * Replaces the ticket keys; keys[0] encrypts new tickets.  Throws
+   * std::invalid_argument if keys is empty or a key is not
+   * kTicketKeyLength bytes long.
+   */
+  void setTicketKeys(const std::vector<std::string>& keys);
+
+  /**
+   * Starts encrypting with a new random key, still accepting tickets under
+   * the kMaxTicketKeys - 1 previous ones.
+   */
+  void rotateTicketKeys();
+
+  std::vector<std::string> getTicketKeys() const;
+
+  size_t size() const;
+
+  Stats getStats() const;
+
+ private:
+  struct TicketKey {
+    unsigned char name[16];
+    unsigned char hmacKey[16];
+    unsigned char aesKey[16];
+  };
+
+  struct Entry {
+    std::string id;
+    std::string session;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  typedef const unsigned char SessionIdByte;
+#else
+  typedef unsigned char SessionIdByte;
+#endif
+
+  static SSLSessionCache* fromCtx(SSL_CTX* ctx);
+  static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+  static SSL_SESSION* getSessionCallback(SSL* ssl,
+                                         SessionIdByte* id,
+                                         int idLength,
+                                         int* copy);
+  static void removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session);
+  static int ticketCallback(SSL* ssl,
+                            unsigned char* keyName,
+                            unsigned char* iv,
+                            EVP_CIPHER_CTX* cipherCtx,
+                            HMAC_CTX* hmacCtx,
+                            int encrypt);
+
+  void store(SSL_SESSION* session);
+  SSL_SESSION* lookup(const std::string& id);
+  void remove(const std::string& id);
+  int ticketKey(unsigned char* keyName,
+                unsigned char* iv,
+                EVP_CIPHER_CTX* cipherCtx,
+                HMAC_CTX* hmacCtx,
+                int encrypt);
+
+  static int exDataIndex_;
+
+  Options options_;
+
+  mutable apache::thrift::concurrency::ProfiledMutex<std::mutex> mutex_;
+  // Most recently used first
+  std::list<Entry> lru_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> sessions_;
+  std::vector<TicketKey> ticketKeys_;
+  Stats stats_;
+};
+
+}}} // apache::thrift::ssl
@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <thrift/lib/cpp/test/loadgen/HdrHistogram.h>
+
+using apache::thrift::loadgen::HdrHistogram;
+
+TEST(HdrHistogram, Empty) {
+  HdrHistogram h(1000000);
+  EXPECT_EQ(0, h.getTotalCount());
+  EXPECT_EQ(0, h.getPercentileEstimate(0.5));
+}
+
+TEST(HdrHistogram, SmallValuesAreExact) {
+  HdrHistogram h(1000000);
+  for (uint64_t v = 1; v <= 1000; ++v) {
+    h.addValue(v);
+  }
+  EXPECT_EQ(1000, h.getTotalCount());
+  EXPECT_EQ(1, h.getPercentileEstimate(0.0));
+  EXPECT_EQ(500, h.getPercentileEstimate(0.5));
+  EXPECT_EQ(990, h.getPercentileEstimate(0.99));
+  EXPECT_EQ(1000, h.getPercentileEstimate(1.0));
+}
+
+TEST(HdrHistogram, PercentilesWithinPrecision) {
+  const uint64_t kMax = 3600ULL * 1000 * 1000;
+  for (int digits = 1; digits <= 4; ++digits) {
+    HdrHistogram h(kMax, digits);
+    // Values spread over several powers of ten
+    const uint64_t kCount = 50000;
+    for (uint64_t n = 1; n <= kCount; ++n) {
+      h.addValue(n * n);
+    }
+    EXPECT_EQ(kCount, h.getTotalCount());
+
+    double error = pow(10, -digits);
+    for (double pct : {0.1, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+      uint64_t n = static_cast<uint64_t>(ceil(pct * kCount));
+      uint64_t expected = n * n;
+      uint64_t estimate = h.getPercentileEstimate(pct);
+      // The estimate is the top of the expected value's bucket
+      EXPECT_GE(estimate, expected) << digits << " " << pct;
+      EXPECT_LE(estimate, expected * (1 + error)) << digits << " " << pct;
+    }
+  }
+}
+
+TEST(HdrHistogram, ClampsToMax) {
+  HdrHistogram h(10000);
+  h.addValue(5);
+  h.addValue(1000000, 3);
+  EXPECT_EQ(4, h.getTotalCount());
+  EXPECT_EQ(5, h.getPercentileEstimate(0.25));
+  EXPECT_EQ(10000, h.getPercentileEstimate(0.5));
+  EXPECT_EQ(10000, h.getPercentileEstimate(1.0));
+}
+
+TEST(HdrHistogram, MergeAndSubtract) {
+  HdrHistogram all(1000000);
+  HdrHistogram low(1000000);
+  HdrHistogram high(1000000);
+  for (uint64_t v = 1; v <= 200000; v += 7) {
+    all.addValue(v);
+    (v < 50000 ? low : high).addValue(v);
+  }
+
+  HdrHistogram merged(1000000);
+  merged.merge(low);
+  merged.merge(high);
+  EXPECT_EQ(all.getTotalCount(), merged.getTotalCount());
+  for (double pct : {0.0, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 1.0}) {
+    EXPECT_EQ(all.getPercentileEstimate(pct),
+              merged.getPercentileEstimate(pct)) << pct;
+  }
+
+  merged.subtract(low);
+  EXPECT_EQ(high.getTotalCount(), merged.getTotalCount());
+  for (double pct : {0.0, 0.5, 1.0}) {
+    EXPECT_EQ(high.getPercentileEstimate(pct),
+              merged.getPercentileEstimate(pct)) << pct;
+  }
+
+  merged.clear();
+  EXPECT_EQ(0, merged.getTotalCount());
+  EXPECT_EQ(0, merged.getPercentileEstimate(1.0));
+}
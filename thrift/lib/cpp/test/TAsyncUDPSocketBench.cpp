@@ -0,0 +1,168 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <thrift/lib/cpp/async/TAsyncUDPSocket.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+
+#include <vector>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <folly/Benchmark.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/IOBuf.h>
+
+using namespace std;
+using namespace folly;
+using namespace apache::thrift::async;
+
+using apache::thrift::transport::TTransportException;
+
+// Datagrams per iteration; kept under the default receive buffer
+const size_t kBatch = 32;
+const size_t kPacketSize = 1200;
+
+namespace {
+
+/**
+ * Counts datagrams, ending the loop after every kBatch of them.
+ */
+class Sink : public TAsyncUDPSocket::ReadCallback {
+ public:
+  explicit Sink(TEventBase* evb) : evb_(evb), count_(0) {}
+
+  void getReadBuffer(void** buf, size_t* len) noexcept {
+    *buf = buf_;
+    *len = sizeof(buf_);
+  }
+
+  void onDataAvailable(const SocketAddress&, size_t, bool) noexcept {
+    if (++count_ % kBatch == 0) {
+      evb_->terminateLoopSoon();
+    }
+  }
+
+  bool onDatagram(const SocketAddress&, ByteRange, bool) noexcept {
+    if (++count_ % kBatch == 0) {
+      evb_->terminateLoopSoon();
+    }
+    return true;
+  }
+
+  void onReadError(const TTransportException& ex) noexcept {
+    LOG(FATAL) << ex.what();
+  }
+
+  void onReadClosed() noexcept {}
+
+ private:
+  TEventBase* evb_;
+  size_t count_;
+  char buf_[2048];
+};
+
+struct Loopback {
+  Loopback() : server(&evb), client(&evb) {
+    server.bind(SocketAddress("127.0.0.1", 0));
+    client.bind(SocketAddress("127.0.0.1", 0));
+    for (size_t i = 0; i < kBatch; ++i) {
+      bufs.push_back(IOBuf::create(kPacketSize));
+      bufs.back()->append(kPacketSize);
+      memset(bufs.back()->writableData(), 'x', kPacketSize);
+    }
+  }
+
+  TEventBase evb;
+  TAsyncUDPSocket server;
+  TAsyncUDPSocket client;
+  vector<unique_ptr<IOBuf>> bufs;
+};
+
+void sendEach(Loopback& lb) {
+  for (auto& buf : lb.bufs) {
+    lb.client.write(lb.server.address(), buf);
+  }
+}
+
+void sendMany(Loopback& lb) {
+  lb.client.writeMany(lb.server.address(), lb.bufs.data(), lb.bufs.size());
+}
+
+void receive(size_t iters, size_t readBatch) {
+  BenchmarkSuspender braces;
+  Loopback lb;
+  Sink sink(&lb.evb);
+  lb.server.setReadBatch(readBatch);
+  lb.server.resumeRead(&sink);
+  while (iters--) {
+    sendMany(lb);
+    braces.dismiss();
+    lb.evb.loop();
+    braces.rehire();
+  }
+}
+
+}
+
+BENCHMARK(TAsyncUDPSocket_write, iters) {
+  BenchmarkSuspender braces;
+  Loopback lb;
+  braces.dismiss();
+  while (iters--) {
+    sendEach(lb);
+  }
+}
+
+BENCHMARK_RELATIVE(TAsyncUDPSocket_writeMany, iters) {
+  BenchmarkSuspender braces;
+  Loopback lb;
+  braces.dismiss();
+  while (iters--) {
+    sendMany(lb);
+  }
+}
+
+BENCHMARK_RELATIVE(TAsyncUDPSocket_writeGSO, iters) {
+  BenchmarkSuspender braces;
+  Loopback lb;
+  if (!lb.client.isGSOSupported()) {
+    return;
+  }
+  auto buf = IOBuf::create(kBatch * kPacketSize);
+  buf->append(kBatch * kPacketSize);
+  memset(buf->writableData(), 'x', buf->length());
+  braces.dismiss();
+  while (iters--) {
+    lb.client.writeGSO(lb.server.address(), buf, kPacketSize);
+  }
+}
+
+BENCHMARK_DRAW_LINE()
+
+BENCHMARK(TAsyncUDPSocket_recvfrom, iters) {
+  receive(iters, 0);
+}
+
+BENCHMARK_RELATIVE(TAsyncUDPSocket_recvmmsg, iters) {
+  receive(iters, kBatch);
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  runBenchmarks();
+  return 0;
+}
@@ -25,6 +25,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
+#include <functional>
 #include <thread>
 using namespace boost;
 
@@ -306,6 +307,167 @@ BOOST_AUTO_TEST_CASE(PingPong) {
   serverThread.join();
 }
 
+class UDPCollector : public TAsyncUDPSocket::ReadCallback {
+ public:
+  UDPCollector(TEventBase* evb, size_t expected)
+      : evb_(evb), expected_(expected) {
+  }
+
+  void getReadBuffer(void** buf, size_t* len) noexcept {
+    *buf = buf_;
+    *len = sizeof(buf_);
+  }
+
+  void onDataAvailable(const folly::SocketAddress& client,
+                       size_t len,
+                       bool truncated) noexcept {
+    BOOST_CHECK(!truncated);
+    msgs.emplace_back(buf_, len);
+    if (onMessage) {
+      onMessage();
+    }
+    if (msgs.size() == expected_) {
+      evb_->terminateLoopSoon();
+    }
+  }
+
+  void onReadError(const TTransportException& ex) noexcept {
+    BOOST_FAIL(ex.what());
+  }
+
+  void onReadClosed() noexcept {
+  }
+
+  std::vector<std::string> msgs;
+  // Called after each message is collected
+  std::function<void()> onMessage;
+
+ private:
+  TEventBase* const evb_;
+  const size_t expected_;
+  char buf_[1024];
+};
+
+void sendMessages(TAsyncUDPSocket* client, const folly::SocketAddress& server,
+                  size_t count) {
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+  for (size_t i = 0; i < count; ++i) {
+    bufs.push_back(IOBuf::copyBuffer(folly::to<std::string>("MSG ", i)));
+  }
+  BOOST_CHECK_EQUAL(count, client->writeMany(server, bufs.data(), count));
+}
+
+BOOST_AUTO_TEST_CASE(BatchedReadWrite) {
+  TEventBase evb;
+  const size_t kCount = 50;
+
+  TAsyncUDPSocket server(&evb);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  server.setReadBatch(8);
+  UDPCollector collector(&evb, kCount);
+  server.resumeRead(&collector);
+
+  TAsyncUDPSocket client(&evb);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  // Chains, so write() and writeMany() gather them
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+  for (size_t i = 0; i < kCount; ++i) {
+    auto buf = IOBuf::copyBuffer("MSG ");
+    buf->prependChain(IOBuf::copyBuffer(folly::to<std::string>(i)));
+    bufs.push_back(std::move(buf));
+  }
+  BOOST_CHECK_EQUAL(4 + 1, client.write(server.address(), bufs[0]));
+  BOOST_CHECK_EQUAL(kCount - 1,
+                    client.writeMany(server.address(), &bufs[1], kCount - 1));
+
+  evb.loop();
+
+  BOOST_REQUIRE_EQUAL(kCount, collector.msgs.size());
+  for (size_t i = 0; i < kCount; ++i) {
+    BOOST_CHECK_EQUAL(folly::to<std::string>("MSG ", i), collector.msgs[i]);
+  }
+  server.pauseRead();
+}
+
+BOOST_AUTO_TEST_CASE(BatchReconfiguredByCallback) {
+  TEventBase evb;
+  const size_t kCount = 50;
+
+  TAsyncUDPSocket server(&evb);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  server.setReadBatch(16);
+  UDPCollector collector(&evb, kCount);
+  // Replace the ring while its batch is being delivered, alternating sizes
+  size_t batch = 16;
+  collector.onMessage = [&] {
+    batch = batch == 16 ? 4 : 16;
+    server.setReadBatch(batch);
+  };
+  server.resumeRead(&collector);
+
+  TAsyncUDPSocket client(&evb);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  sendMessages(&client, server.address(), kCount);
+
+  evb.loop();
+
+  BOOST_REQUIRE_EQUAL(kCount, collector.msgs.size());
+  for (size_t i = 0; i < kCount; ++i) {
+    BOOST_CHECK_EQUAL(folly::to<std::string>("MSG ", i), collector.msgs[i]);
+  }
+  server.pauseRead();
+}
+
+class EmptyBufferCallback : public TAsyncUDPSocket::ReadCallback {
+ public:
+  explicit EmptyBufferCallback(TEventBase* evb) : evb_(evb) {}
+
+  void getReadBuffer(void** buf, size_t* len) noexcept {
+    *buf = nullptr;
+    *len = 0;
+  }
+
+  void onDataAvailable(const folly::SocketAddress& client,
+                       size_t len,
+                       bool truncated) noexcept {
+    BOOST_FAIL("no buffer to read into");
+  }
+
+  void onReadError(const TTransportException& ex) noexcept {
+    errors.push_back(ex.getType());
+    evb_->terminateLoopSoon();
+  }
+
+  void onReadClosed() noexcept {
+  }
+
+  std::vector<TTransportException::TTransportExceptionType> errors;
+
+ private:
+  TEventBase* const evb_;
+};
+
+BOOST_AUTO_TEST_CASE(BatchEmptyReadBuffer) {
+  TEventBase evb;
+
+  TAsyncUDPSocket server(&evb);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  server.setReadBatch(8);
+  EmptyBufferCallback callback(&evb);
+  server.resumeRead(&callback);
+
+  TAsyncUDPSocket client(&evb);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  sendMessages(&client, server.address(), 4);
+
+  evb.loop();
+
+  // Reported once, as without batching, and reading stops
+  BOOST_REQUIRE_EQUAL(1, callback.errors.size());
+  BOOST_CHECK_EQUAL(TTransportException::BAD_ARGS, callback.errors[0]);
+}
+
 unit_test::test_suite* init_unit_test_suite(int argc, char* argv[]) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <thrift/lib/cpp/TProcessor.h>
+#include <thrift/lib/cpp/protocol/TBinaryProtocol.h>
+#include <thrift/lib/cpp/transport/TBufferTransports.h>
+#include <thrift/lib/cpp/transport/TFileTransport.h>
+
+#include <string>
+#include <sys/stat.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <folly/Benchmark.h>
+#include <folly/Hash.h>
+
+using namespace std;
+using namespace folly;
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+
+DEFINE_string(replay_log, "/tmp/TFileProcessorBench.log",
+              "Synthetic log to replay, written first if it is missing");
+DEFINE_int32(replay_log_mb, 4096, "Size of the synthetic log");
+DEFINE_int32(replay_threads, 8, "Threads for the parallel replays");
+
+const uint32_t kChunkSize = 16 * 1024 * 1024;
+const size_t kPayloadSize = 200;
+
+namespace {
+
+/**
+ * Parses each event as a request without doing anything with it.
+ */
+class ParseProcessor : public TProcessor {
+ public:
+  bool process(shared_ptr<TProtocol> in,
+               shared_ptr<TProtocol>,
+               TConnectionContext*) override {
+    string name;
+    TMessageType type;
+    int32_t seqid;
+    in->readMessageBegin(name, type, seqid);
+    in->skip(T_STRUCT);
+    in->readMessageEnd();
+    in->getTransport()->readEnd();
+    return true;
+  }
+};
+
+/**
+ * Writes log calls with a key field and a string payload until the log
+ * has FLAGS_replay_log_mb.
+ */
+void writeLog() {
+  struct stat info;
+  uint64_t size = uint64_t(FLAGS_replay_log_mb) << 20;
+  if (stat(FLAGS_replay_log.c_str(), &info) == 0 &&
+      uint64_t(info.st_size) >= size) {
+    return;
+  }
+  unlink(FLAGS_replay_log.c_str());
+
+  TFileTransport log(FLAGS_replay_log);
+  log.setChunkSize(kChunkSize);
+  log.setGroupCommit(true);
+  auto buffer = make_shared<TMemoryBuffer>();
+  TBinaryProtocol protocol(buffer);
+  string payload(kPayloadSize, 'x');
+  for (int32_t seqid = 0; size > 0; ++seqid) {
+    buffer->resetBuffer();
+    protocol.writeMessageBegin("log", T_CALL, seqid);
+    protocol.writeStructBegin("log_args");
+    protocol.writeFieldBegin("key", T_I64, 1);
+    protocol.writeI64(seqid % 10007);
+    protocol.writeFieldEnd();
+    protocol.writeFieldBegin("payload", T_STRING, 2);
+    protocol.writeString(payload);
+    protocol.writeFieldEnd();
+    protocol.writeFieldStop();
+    protocol.writeStructEnd();
+    protocol.writeMessageEnd();
+
+    uint8_t* event;
+    uint32_t length;
+    buffer->getBuffer(&event, &length);
+    log.write(event, length);
+    size -= min<uint64_t>(size, length + 4);
+  }
+  log.flush();
+}
+
+TFileProcessor makeProcessor() {
+  return TFileProcessor(make_shared<ParseProcessor>(),
+                        make_shared<TBinaryProtocolFactory>(),
+                        make_shared<TFileTransport>(FLAGS_replay_log, true));
+}
+
+TFileProcessor::ParallelOptions parallelOptions() {
+  TFileProcessor::ParallelOptions options;
+  options.numThreads = FLAGS_replay_threads;
+  options.chunkSize = kChunkSize;
+  return options;
+}
+
+}
+
+BENCHMARK(TFileProcessor_process, iters) {
+  while (iters--) {
+    makeProcessor().process(0, false);
+  }
+}
+
+BENCHMARK_RELATIVE(TFileProcessor_processParallel, iters) {
+  auto options = parallelOptions();
+  while (iters--) {
+    makeProcessor().processParallel(FLAGS_replay_log, options);
+  }
+}
+
+BENCHMARK_RELATIVE(TFileProcessor_processParallel_keyed, iters) {
+  auto options = parallelOptions();
+  // The key's value follows the 15 byte message header and the field header
+  options.key = [](const uint8_t* event, uint32_t size) {
+    return size < 26 ? 0 : hash::fnv64_buf(event + 18, 8);
+  };
+  while (iters--) {
+    makeProcessor().processParallel(FLAGS_replay_log, options);
+  }
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  writeLog();
+  runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef THRIFT_TEST_LOADGEN_ARRIVALSCHEDULE_H_
+#define THRIFT_TEST_LOADGEN_ARRIVALSCHEDULE_H_ 1
+
+#include <thrift/lib/cpp/test/loadgen/RNG.h>
+#include <thrift/lib/cpp/concurrency/Util.h>
+
+#include <math.h>
+
+namespace apache { namespace thrift { namespace loadgen {
+
+/**
+ * ArrivalSchedule computes the intended start times for an open-loop load
+ * generator.
+ *
+ * IntervalTimer only starts the next operation once the previous one has
+ * finished, so a slow response silently delays all of the requests queued
+ * up behind it and they never show up in the latency statistics
+ * ("coordinated omission").  An ArrivalSchedule instead fixes the time at
+ * which every operation should be sent in advance, independently of when
+ * responses arrive.  Latency should then be measured from the intended start
+ * time returned by next(), not from the time the request was actually sent.
+ *
+ * Arrivals may either be evenly spaced, or follow a Poisson process with
+ * exponentially distributed inter-arrival times.
+ *
+ * An ArrivalSchedule is not thread-safe; each worker should use its own.
+ */
+class ArrivalSchedule {
+ public:
+  enum Distribution {
+    FIXED,
+    POISSON
+  };
+
+  /**
+   * Create a new ArrivalSchedule
+   *
+   * @param ratePerSec    The average number of arrivals per second.
+   * @param distribution  How arrivals are spaced.
+   */
+  ArrivalSchedule(double ratePerSec, Distribution distribution)
+    : intervalUsec_(static_cast<double>(concurrency::Util::US_PER_S) /
+                    ratePerSec)
+    , distribution_(distribution)
+    , nextUsec_(0) {}
+
+  /**
+   * Start the schedule.  The first arrival happens immediately.
+   */
+  void start() {
+    nextUsec_ = concurrency::Util::currentTimeUsec();
+  }
+
+  /**
+   * Get the intended start time of the next arrival, in microseconds,
+   * without consuming it.
+   */
+  int64_t peek() const {
+    return static_cast<int64_t>(nextUsec_);
+  }
+
+  /**
+   * Consume the next arrival.
+   *
+   * @return Returns the intended start time of the arrival, in microseconds.
+   */
+  int64_t next() {
+    int64_t intended = peek();
+    if (distribution_ == POISSON) {
+      // 1 - getReal() is in (0, 1], so the log is always finite
+      nextUsec_ += -log(1.0 - RNG::getReal()) * intervalUsec_;
+    } else {
+      nextUsec_ += intervalUsec_;
+    }
+    return intended;
+  }
+
+ private:
+  double intervalUsec_;
+  Distribution distribution_;
+  double nextUsec_;
+};
+
+}}} // apache::thrift::loadgen
+
+#endif // THRIFT_TEST_LOADGEN_ARRIVALSCHEDULE_H_
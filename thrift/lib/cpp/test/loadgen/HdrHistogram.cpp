@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <thrift/lib/cpp/test/loadgen/HdrHistogram.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <math.h>
+
+namespace apache { namespace thrift { namespace loadgen {
+
+namespace {
+
+uint32_t highestBit(uint64_t value) {
+  return 63 - __builtin_clzll(value);
+}
+
+}
+
+HdrHistogram::HdrHistogram(uint64_t maxValue, int significantDigits)
+  : maxValue_(std::max<uint64_t>(maxValue, 1))
+  , totalCount_(0) {
+  CHECK(significantDigits >= 1 && significantDigits <= 5);
+
+  // Enough sub-buckets per power of two to distinguish values that differ
+  // by one part in 10^significantDigits
+  uint64_t largestExact = 2 * static_cast<uint64_t>(
+      pow(10, significantDigits));
+  subBucketBits_ = highestBit(largestExact - 1) + 1;
+  subBucketCount_ = 1ULL << subBucketBits_;
+  subBucketHalfCount_ = subBucketCount_ / 2;
+
+  counts_.resize(getIndex(maxValue_) + 1, 0);
+}
+
+size_t HdrHistogram::getIndex(uint64_t value) const {
+  if (value < subBucketCount_) {
+    // Values below subBucketCount_ are tracked exactly
+    return value;
+  }
+
+  // Above that, each power of two gets subBucketHalfCount_ buckets
+  uint32_t shift = highestBit(value) - (subBucketBits_ - 1);
+  uint64_t subBucket = value >> shift;
+  return subBucketCount_ + (shift - 1) * subBucketHalfCount_ +
+    (subBucket - subBucketHalfCount_);
+}
+
+uint64_t HdrHistogram::getHighestEquivalentValue(size_t index) const {
+  if (index < subBucketCount_) {
+    return index;
+  }
+
+  uint64_t offset = index - subBucketCount_;
+  uint32_t shift = offset / subBucketHalfCount_ + 1;
+  uint64_t subBucket = offset % subBucketHalfCount_ + subBucketHalfCount_;
+  return (subBucket << shift) + (1ULL << shift) - 1;
+}
+
+void HdrHistogram::addValue(uint64_t value, uint64_t count) {
+  if (value > maxValue_) {
+    value = maxValue_;
+  }
+  counts_[getIndex(value)] += count;
+  totalCount_ += count;
+}
+
+void HdrHistogram::clear() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  totalCount_ = 0;
+}
+
+void HdrHistogram::merge(const HdrHistogram& other) {
+  CHECK_EQ(counts_.size(), other.counts_.size());
+  for (size_t n = 0; n < counts_.size(); ++n) {
+    counts_[n] += other.counts_[n];
+  }
+  totalCount_ += other.totalCount_;
+}
+
+void HdrHistogram::subtract(const HdrHistogram& other) {
+  CHECK_EQ(counts_.size(), other.counts_.size());
+  for (size_t n = 0; n < counts_.size(); ++n) {
+    counts_[n] -= other.counts_[n];
+  }
+  totalCount_ -= other.totalCount_;
+}
+
+uint64_t HdrHistogram::getPercentileEstimate(double pct) const {
+  if (totalCount_ == 0) {
+    return 0;
+  }
+
+  pct = std::min(std::max(pct, 0.0), 1.0);
+  uint64_t target = std::max<uint64_t>(
+      static_cast<uint64_t>(ceil(pct * totalCount_)), 1);
+
+  uint64_t seen = 0;
+  for (size_t n = 0; n < counts_.size(); ++n) {
+    seen += counts_[n];
+    if (seen >= target) {
+      return std::min(getHighestEquivalentValue(n), maxValue_);
+    }
+  }
+  return maxValue_;
+}
+
+}}} // apache::thrift::loadgen
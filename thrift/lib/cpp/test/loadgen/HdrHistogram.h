@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef THRIFT_TEST_LOADGEN_HDRHISTOGRAM_H_
+#define THRIFT_TEST_LOADGEN_HDRHISTOGRAM_H_ 1
+
+#include <vector>
+#include <inttypes.h>
+#include <stddef.h>
+
+namespace apache { namespace thrift { namespace loadgen {
+
+/**
+ * A high dynamic range histogram for latency values.
+ *
+ * Unlike folly::Histogram, which uses a fixed number of equally sized
+ * buckets, HdrHistogram uses log-linear buckets: every power-of-two range is
+ * split into the same number of sub-buckets.  This keeps the relative error
+ * of any recorded value below 10^-significantDigits regardless of its
+ * magnitude, so both 50us and 5s latencies can be reported accurately from
+ * the same histogram.
+ *
+ * Values larger than the maximum trackable value are clamped to it.
+ */
+class HdrHistogram {
+ public:
+  /**
+   * Create a new HdrHistogram.
+   *
+   * @param maxValue           The largest value that can be tracked.
+   * @param significantDigits  The number of significant decimal digits to
+   *                           preserve, between 1 and 5.
+   */
+  explicit HdrHistogram(uint64_t maxValue, int significantDigits = 3);
+
+  void addValue(uint64_t value) {
+    addValue(value, 1);
+  }
+  void addValue(uint64_t value, uint64_t count);
+
+  void clear();
+
+  /**
+   * Add the counts from another histogram to this one.
+   *
+   * Both histograms must have been created with the same parameters.
+   */
+  void merge(const HdrHistogram& other);
+
+  /**
+   * Subtract the counts of another histogram from this one.
+   *
+   * The other histogram should be an earlier snapshot of this one.
+   */
+  void subtract(const HdrHistogram& other);
+
+  uint64_t getTotalCount() const {
+    return totalCount_;
+  }
+
+  uint64_t getMaxValue() const {
+    return maxValue_;
+  }
+
+  /**
+   * Get the value at the specified percentile.
+   *
+   * @param pct  The desired percentile, in the range [0.0, 1.0].
+   *
+   * @return Returns the highest value that is equivalent (within the
+   *         histogram's precision) to the value at the percentile, or 0 if
+   *         the histogram is empty.
+   */
+  uint64_t getPercentileEstimate(double pct) const;
+
+ private:
+  size_t getIndex(uint64_t value) const;
+  uint64_t getHighestEquivalentValue(size_t index) const;
+
+  uint64_t maxValue_;
+  uint32_t subBucketBits_;
+  uint64_t subBucketCount_;
+  uint64_t subBucketHalfCount_;
+  uint64_t totalCount_;
+  std::vector<uint64_t> counts_;
+};
+
+}}} // apache::thrift::loadgen
+
+#endif // THRIFT_TEST_LOADGEN_HDRHISTOGRAM_H_
@@ -20,10 +20,13 @@
 
 #include <thrift/lib/cpp/concurrency/Util.h>
 
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
 #include <math.h>
 
 DEFINE_int64(thriftLatencyBucketMax, 5000,
-    "Maximum latency bucket in ms.");
+    "Maximum latency tracked by the latency histogram, in ms.");
 
 namespace apache { namespace thrift { namespace loadgen {
 
@@ -32,13 +35,12 @@ namespace apache { namespace thrift { namespace loadgen {
  */
 
 LatencyScoreBoard::OpData::OpData()
-  : latDistHist_(50, 0, FLAGS_thriftLatencyBucketMax) {
+  : latDistHist_(FLAGS_thriftLatencyBucketMax *
+                 concurrency::Util::US_PER_MS) {
   zero();
 }
 
 void LatencyScoreBoard::OpData::addDataPoint(uint64_t latency) {
-  uint64_t oldCount = count_;
-  uint64_t oldUsecSum = usecSum_;
   ++count_;
   usecSum_ += latency;
   sumOfSquares_ += latency*latency;
@@ -79,9 +81,9 @@ double LatencyScoreBoard::OpData::getLatencyPct(double pct) const {
     return 0;
   }
   uint64_t pct_lat = latDistHist_.getPercentileEstimate(pct);
-  if (pct_lat > FLAGS_thriftLatencyBucketMax) {
+  if (pct_lat >= latDistHist_.getMaxValue()) {
     LOG(WARNING) << "Estimated percentile latency " << pct_lat
-                 << " ms is greater than the maximum bucket value "
+                 << " us reached the maximum tracked value of "
                  << FLAGS_thriftLatencyBucketMax << " ms.";
   }
   return pct_lat;
@@ -92,12 +94,12 @@ double LatencyScoreBoard::OpData::getLatencyPctSince(
   if (other->count_ >= count_) {
     return 0;
   }
-  folly::Histogram<uint64_t> tmp = latDistHist_;
+  HdrHistogram tmp = latDistHist_;
   tmp.subtract(other->latDistHist_);
   uint64_t pct_lat = tmp.getPercentileEstimate(pct);
-  if (pct_lat > FLAGS_thriftLatencyBucketMax) {
+  if (pct_lat >= latDistHist_.getMaxValue()) {
     LOG(WARNING) << "Estimated percentile latency " << pct_lat
-                 << " ms is greater than the maximum bucket value "
+                 << " us reached the maximum tracked value of "
                  << FLAGS_thriftLatencyBucketMax << " ms.";
   }
   return pct_lat;
@@ -147,6 +149,11 @@ void LatencyScoreBoard::opSucceeded(uint32_t opType) {
   data->addDataPoint(latency);
 }
 
+void LatencyScoreBoard::opSucceededWithLatency(uint32_t opType,
+                                               uint64_t latencyUsec) {
+  opData_.getOpData(opType)->addDataPoint(latencyUsec);
+}
+
 void LatencyScoreBoard::opFailed(uint32_t opType) {
 }
 
@@ -19,12 +19,10 @@
 #ifndef THRIFT_TEST_LOADGEN_LATENCYSCOREBOARD_H_
 #define THRIFT_TEST_LOADGEN_LATENCYSCOREBOARD_H_ 1
 
+#include <thrift/lib/cpp/test/loadgen/HdrHistogram.h>
 #include <thrift/lib/cpp/test/loadgen/ScoreBoard.h>
 #include <thrift/lib/cpp/test/loadgen/ScoreBoardOpVector.h>
 
-#include <folly/stats/Histogram.h>
-#include <folly/stats/Histogram-defs.h>
-
 namespace apache { namespace thrift { namespace loadgen {
 
 /**
@@ -35,6 +33,9 @@ namespace apache { namespace thrift { namespace loadgen {
  * add a small amount of overhead.  If you have extremely high performance
  * requirements, you could use QpsScoreBoard to track just the QPS rate and
  * eliminate the gettimeofday() calls.
+ *
+ * Latencies are recorded in an HdrHistogram, so percentiles stay accurate
+ * across the whole range from microseconds up to thriftLatencyBucketMax.
  */
 class LatencyScoreBoard : public ScoreBoard {
  public:
@@ -61,7 +62,7 @@ class LatencyScoreBoard : public ScoreBoard {
     uint64_t sumOfSquares_;
 
     // latency distribution histogram
-    folly::Histogram<uint64_t> latDistHist_;
+    HdrHistogram latDistHist_;
   };
 
   explicit LatencyScoreBoard(uint32_t numOpsHint)
@@ -70,6 +71,7 @@ class LatencyScoreBoard : public ScoreBoard {
 
   virtual void opStarted(uint32_t opType);
   virtual void opSucceeded(uint32_t opType);
+  virtual void opSucceededWithLatency(uint32_t opType, uint64_t latencyUsec);
   virtual void opFailed(uint32_t opType);
 
   /**
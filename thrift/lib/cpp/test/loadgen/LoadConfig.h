@@ -61,6 +61,26 @@ class LoadConfig {
     return 0;
   }
 
+  /**
+   * Whether workers that support it should run open-loop.
+   *
+   * An open-loop worker sends operations at the getDesiredQPS() rate
+   * regardless of how quickly responses come back, and measures latency from
+   * each operation's intended start time.  This avoids hiding server stalls
+   * from the latency statistics.  Has no effect when getDesiredQPS() is 0.
+   */
+  virtual bool useOpenLoop() const {
+    return false;
+  }
+
+  /**
+   * Whether open-loop arrivals should follow a Poisson process rather than
+   * being evenly spaced.
+   */
+  virtual bool usePoissonArrivals() const {
+    return false;
+  }
+
   /**
    * Get the max number of worker threads to run.
    *
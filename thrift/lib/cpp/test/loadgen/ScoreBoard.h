@@ -48,6 +48,19 @@ class ScoreBoard {
    */
   virtual void opSucceeded(uint32_t opType) = 0;
 
+  /**
+   * opSucceededWithLatency() is invoked instead of opStarted() and
+   * opSucceeded() by open-loop workers, which keep many operations
+   * outstanding and track their start times themselves.
+   *
+   * latencyUsec is measured from the time the operation was scheduled to be
+   * sent, not the time it was actually sent, so that delays caused by the
+   * client falling behind its schedule are still counted.
+   */
+  virtual void opSucceededWithLatency(uint32_t opType, uint64_t latencyUsec) {
+    opSucceeded(opType);
+  }
+
   /**
    * opFailed() is invoked if Worker::performOperation() throws an exception.
    */
@@ -34,9 +34,13 @@
 #ifdef THRIFT_HAVE_STRINGS_H
 #include <strings.h>
 #endif
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <thread>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 namespace apache { namespace thrift { namespace transport {
@@ -68,6 +72,49 @@ static int clock_gettime(int clk_id /*ignored*/, struct timespec *tp) {
 }
 #endif
 
+/**
+ * Single producer, single consumer byte ring holding one thread's events
+ * until the group commit writer thread writes them.
+ *
+ * Each event is stored as it goes to the file, a 4 byte length followed by
+ * the event, starting at a multiple of 4 bytes.  A length of 0 means the
+ * rest of the ring was skipped because the next event did not fit there.
+ */
+struct TFileTransport::WriterRing {
+  explicit WriterRing(uint32_t size)
+    : buffer(new uint8_t[size])
+    , mask(size - 1)
+    , head(0)
+    , tail(0)
+    , owned(true) {}
+
+  std::unique_ptr<uint8_t[]> buffer;
+  uint32_t mask;
+  // Written only by the owning thread
+  std::atomic<uint64_t> head;
+  char padding[64];
+  // Written only by the writer thread
+  std::atomic<uint64_t> tail;
+  // Cleared when the owning thread exits, so another thread can take over
+  std::atomic<bool> owned;
+};
+
+namespace {
+
+// Bytes an event takes in a WriterRing
+inline uint32_t recordSize(uint32_t eventLen) {
+  return (eventLen + 4 + 3) & ~3u;
+}
+
+// Source of the chunk padding written by the group commit writer
+const uint8_t kZeros[64 * 1024] = {};
+
+}
+
+void TFileTransport::RingManager::destroy(WriterRing* ring) {
+  ring->owned = false;
+}
+
 TFileTransport::TFileTransport(string path, bool readOnly)
   : readState_()
   , readBuff_(nullptr)
@@ -87,6 +134,16 @@ TFileTransport::TFileTransport(string path, bool readOnly)
   , enqueueBuffer_(nullptr)
   , closing_(false)
   , forceFlush_(false)
+  , groupCommit_(false)
+  , ringSize_(DEFAULT_RING_SIZE)
+  , writerIdle_(false)
+  , ringWaiters_(0)
+  , directIO_(false)
+  , directFd_(-1)
+  , directSourceFd_(-1)
+  , directBuffer_(nullptr)
+  , directBufferLen_(0)
+  , directOffset_(0)
   , filename_(path)
   , fd_(0)
   , bufferAndThreadInitialized_(false)
@@ -168,6 +225,8 @@ TFileTransport::~TFileTransport() {
     currentEvent_ = nullptr;
   }
 
+  closeDirectOutput();
+
   // close logfile
   if (fd_ > 0) {
     if(-1 == ::close(fd_)) {
@@ -196,8 +255,11 @@ bool TFileTransport::initBufferAndWriteThread() {
     }
   }
 
-  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
-  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+  // with group commit, events go to the threads' rings instead
+  if (!groupCommit_) {
+    dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+    enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+  }
   bufferAndThreadInitialized_ = true;
 
   return true;
@@ -229,6 +291,11 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
     return;
   }
 
+  if (groupCommit_) {
+    enqueueToRing(buf, eventLen);
+    return;
+  }
+
   eventInfo* toEnqueue = new eventInfo();
   toEnqueue->eventBuff_ = new uint8_t[eventLen + 4];
   // first 4 bytes is the event length
@@ -315,9 +382,7 @@ bool TFileTransport::swapEventBuffers(struct timespec* deadline) {
 }
 
 
-void TFileTransport::writerThread() {
-  bool hasIOError = false;
-
+bool TFileTransport::prepareWriterFile() {
   // open file if it is not open
   if(!fd_) {
     try {
@@ -326,24 +391,27 @@ void TFileTransport::writerThread() {
       int errno_copy = errno;
       GlobalOutput.perror("TFileTransport: writerThread() openLogFile() ", errno_copy);
       fd_ = 0;
-      hasIOError = true;
+      return false;
     }
   }
 
   // set the offset to the correct value (EOF)
-  if (!hasIOError) {
-    try {
-      seekToEnd();
-      // throw away any partial events
-      offset_ += readState_.lastDispatchPtr_;
-      ftruncate(fd_, offset_);
-      readState_.resetAllValues();
-    } catch (...) {
-      int errno_copy = errno;
-      GlobalOutput.perror("TFileTransport: writerThread() initialization ", errno_copy);
-      hasIOError = true;
-    }
+  try {
+    seekToEnd();
+    // throw away any partial events
+    offset_ += readState_.lastDispatchPtr_;
+    ftruncate(fd_, offset_);
+    readState_.resetAllValues();
+  } catch (...) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TFileTransport: writerThread() initialization ", errno_copy);
+    return false;
   }
+  return true;
+}
+
+void TFileTransport::writerThread() {
+  bool hasIOError = !prepareWriterFile();
 
   // Figure out the next time by which a flush must take place
   struct timespec ts_next_flush;
@@ -482,26 +550,233 @@ void TFileTransport::writerThread() {
     pthread_mutex_unlock(&mutex_);
 
     // determine if we need to perform an fsync
-    bool flush = false;
-    if (forced_flush || unflushed > flushMaxBytes_) {
-      flush = true;
-    } else {
-      struct timespec current_time;
-      clock_gettime(CLOCK_REALTIME, &current_time);
-      if (current_time.tv_sec > ts_next_flush.tv_sec ||
-          (current_time.tv_sec == ts_next_flush.tv_sec &&
-           current_time.tv_nsec > ts_next_flush.tv_nsec)) {
-        if (unflushed > 0) {
-          flush = true;
-        } else {
-          // If there is no new data since the last fsync,
-          // don't perform the fsync, but do reset the timer.
-          getNextFlushTime(&ts_next_flush);
-        }
+    if (shouldSync(forced_flush, unflushed, &ts_next_flush)) {
+      // sync (force flush) file to disk
+      fsync(fd_);
+      unflushed = 0;
+      getNextFlushTime(&ts_next_flush);
+
+      // notify anybody waiting for flush completion
+      if (forced_flush) {
+        pthread_mutex_lock(&mutex_);
+        forceFlush_ = false;
+        assert(enqueueBuffer_->isEmpty());
+        assert(dequeueBuffer_->isEmpty());
+        pthread_cond_broadcast(&flushed_);
+        pthread_mutex_unlock(&mutex_);
       }
     }
+  }
+}
+
+bool TFileTransport::shouldSync(bool forced, uint32_t unflushed,
+                                struct timespec* ts_next_flush) {
+  if (forced || unflushed > flushMaxBytes_) {
+    return true;
+  }
+  struct timespec current_time;
+  clock_gettime(CLOCK_REALTIME, &current_time);
+  if (current_time.tv_sec > ts_next_flush->tv_sec ||
+      (current_time.tv_sec == ts_next_flush->tv_sec &&
+       current_time.tv_nsec > ts_next_flush->tv_nsec)) {
+    if (unflushed > 0) {
+      return true;
+    }
+    // If there is no new data since the last fsync,
+    // don't perform the fsync, but do reset the timer.
+    getNextFlushTime(ts_next_flush);
+  }
+  return false;
+}
 
-    if (flush) {
+void TFileTransport::setGroupCommit(bool groupCommit) {
+  if (bufferAndThreadInitialized_) {
+    GlobalOutput("Cannot enable group commit after writer thread started");
+    return;
+  }
+  groupCommit_ = groupCommit;
+  if (groupCommit_ && !localRing_) {
+    localRing_.reset(new concurrency::ThreadLocal<WriterRing, RingManager>());
+  }
+}
+
+void TFileTransport::setDirectIO(bool directIO) {
+  if (bufferAndThreadInitialized_) {
+    GlobalOutput("Cannot change direct IO after writer thread started");
+    return;
+  }
+#ifndef O_DIRECT
+  if (directIO) {
+    GlobalOutput("TFileTransport: O_DIRECT is not supported");
+    return;
+  }
+#endif
+  directIO_ = directIO;
+}
+
+void TFileTransport::enqueueToRing(const uint8_t* buf, uint32_t eventLen) {
+  if (recordSize(eventLen) > ringSize_ / 2) {
+    T_ERROR("TFileTransport: event size(%u) > half the ring size(%u): skipping event", eventLen, ringSize_);
+    return;
+  }
+
+  WriterRing* ring = localRing_->getNoAlloc();
+  if (ring == nullptr) {
+    ring = registerRing();
+    if (ring == nullptr) {
+      return;
+    }
+  }
+
+  while (!pushToRing(ring, buf, eventLen)) {
+    // The writer thread is behind; wait until it drains some of the ring.
+    // ringWaiters_ is raised before checking again, so the writer either
+    // sees it after draining or this thread sees the room it made.
+    pthread_mutex_lock(&mutex_);
+    ++ringWaiters_;
+    bool pushed = pushToRing(ring, buf, eventLen);
+    if (!pushed && !closing_) {
+      pthread_cond_signal(&notEmpty_);
+      pthread_cond_wait(&notFull_, &mutex_);
+    }
+    --ringWaiters_;
+    pthread_mutex_unlock(&mutex_);
+    if (pushed) {
+      break;
+    }
+    if (closing_) {
+      return;
+    }
+  }
+
+  // Same handshake as above: the writer raises writerIdle_ before its last
+  // look at the rings
+  if (writerIdle_) {
+    pthread_mutex_lock(&mutex_);
+    pthread_cond_signal(&notEmpty_);
+    pthread_mutex_unlock(&mutex_);
+  }
+}
+
+TFileTransport::WriterRing* TFileTransport::registerRing() {
+  pthread_mutex_lock(&mutex_);
+
+  // make sure the writer thread is running
+  if (!bufferAndThreadInitialized_) {
+    if (!initBufferAndWriteThread()) {
+      pthread_mutex_unlock(&mutex_);
+      return nullptr;
+    }
+  }
+
+  // reuse the ring of a thread that exited; its events are still written
+  WriterRing* ring = nullptr;
+  for (auto& r : rings_) {
+    if (!r->owned) {
+      ring = r.get();
+      ring->owned = true;
+      break;
+    }
+  }
+  if (ring == nullptr) {
+    rings_.emplace_back(new WriterRing(ringSize_));
+    ring = rings_.back().get();
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  localRing_->set(ring);
+  return ring;
+}
+
+bool TFileTransport::pushToRing(WriterRing* ring,
+                                const uint8_t* buf,
+                                uint32_t eventLen) {
+  uint32_t size = ring->mask + 1;
+  uint32_t record = recordSize(eventLen);
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint32_t pos = head & ring->mask;
+  uint32_t skip = (size - pos < record) ? size - pos : 0;
+  if (head + skip + record - ring->tail > size) {
+    return false;
+  }
+
+  uint8_t* data = ring->buffer.get();
+  if (skip) {
+    uint32_t marker = 0;
+    memcpy(data + pos, &marker, 4);
+    pos = 0;
+  }
+  memcpy(data + pos, &eventLen, 4);
+  memcpy(data + pos + 4, buf, eventLen);
+  ring->head = head + skip + record;
+  return true;
+}
+
+void TFileTransport::groupCommitWriterThread() {
+  bool hasIOError = !prepareWriterFile();
+  if (!hasIOError && directIO_) {
+    hasIOError = !openDirectOutput();
+  }
+
+  struct timespec ts_next_flush;
+  getNextFlushTime(&ts_next_flush);
+  uint32_t unflushed = 0;
+
+  std::vector<WriterRing*> rings;
+  std::vector<uint64_t> ends;
+  std::vector<struct iovec> iov;
+
+  while (1) {
+    if (hasIOError) {
+      reopenAfterIOError();
+      hasIOError = false;
+      unflushed = 0;
+    }
+
+    // resetOutputFile() may have switched files
+    if (directIO_ && directSourceFd_ != fd_ && !openDirectOutput()) {
+      hasIOError = true;
+      continue;
+    }
+
+    // Everything written before a flush() was requested is in the rings
+    // by the time forceFlush_ is seen here
+    pthread_mutex_lock(&mutex_);
+    bool closing = closing_;
+    bool forced_flush = forceFlush_;
+    rings.clear();
+    for (auto& ring : rings_) {
+      rings.push_back(ring.get());
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    ends.clear();
+    for (auto ring : rings) {
+      ends.push_back(ring->head);
+    }
+
+    uint32_t written = 0;
+    if (!writeRings(rings, ends, iov, &written)) {
+      hasIOError = true;
+      continue;
+    }
+    unflushed += written;
+
+    // exit once a pass finds nothing more to write
+    if (closing && written == 0) {
+      fsync(fd_);
+      closeDirectOutput();
+      if (-1 == ::close(fd_)) {
+        int errno_copy = errno;
+        GlobalOutput.perror("TFileTransport: writerThread() ::close() ", errno_copy);
+      } else {
+        //fd successfully closed
+        fd_ = 0;
+      }
+      pthread_exit(nullptr);
+    }
+
+    if (shouldSync(forced_flush, unflushed, &ts_next_flush)) {
       // sync (force flush) file to disk
       fsync(fd_);
       unflushed = 0;
@@ -511,12 +786,281 @@ void TFileTransport::writerThread() {
       if (forced_flush) {
         pthread_mutex_lock(&mutex_);
         forceFlush_ = false;
-        assert(enqueueBuffer_->isEmpty());
-        assert(dequeueBuffer_->isEmpty());
         pthread_cond_broadcast(&flushed_);
         pthread_mutex_unlock(&mutex_);
       }
     }
+
+    // keep writing batches while there are events, otherwise wait for
+    // more or for the next timed flush
+    if (written == 0 && !forced_flush) {
+      pthread_mutex_lock(&mutex_);
+      writerIdle_ = true;
+      bool empty = true;
+      for (auto& ring : rings_) {
+        if (ring->head.load() != ring->tail.load()) {
+          empty = false;
+          break;
+        }
+      }
+      if (empty && !closing_ && !forceFlush_) {
+        pthread_cond_timedwait(&notEmpty_, &mutex_, &ts_next_flush);
+      }
+      writerIdle_ = false;
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+}
+
+bool TFileTransport::writeRings(const std::vector<WriterRing*>& rings,
+                                const std::vector<uint64_t>& ends,
+                                std::vector<struct iovec>& iov,
+                                uint32_t* written) {
+  // rings whose events up to the given position are in iov
+  std::vector<std::pair<WriterRing*, uint64_t>> consumed;
+  iov.clear();
+
+  for (size_t i = 0; i < rings.size(); ++i) {
+    WriterRing* ring = rings[i];
+    uint32_t size = ring->mask + 1;
+    uint64_t pos = ring->tail;
+    while (pos < ends[i]) {
+      uint8_t* record = ring->buffer.get() + (pos & ring->mask);
+      uint32_t eventLen;
+      memcpy(&eventLen, record, 4);
+      if (eventLen == 0) {
+        pos += size - (pos & ring->mask);
+        continue;
+      }
+      pos += recordSize(eventLen);
+      uint32_t eventSize = eventLen + 4;
+
+      // If chunking is required, then make sure that msg does not cross chunk boundary
+      if (chunkSize_ != 0) {
+        // event size must be less than chunk size
+        if (eventSize > chunkSize_) {
+          T_ERROR("TFileTransport: event size(%u) > chunk size(%u): skipping event", eventSize, chunkSize_);
+          continue;
+        }
+
+        // if adding this event will cross a chunk boundary, pad the chunk with zeros
+        if (offset_ / chunkSize_ != (offset_ + eventSize - 1) / chunkSize_) {
+          uint32_t padding = chunkSize_ - offset_ % chunkSize_;
+          offset_ += padding;
+          *written += padding;
+          while (padding > 0) {
+            uint32_t len = std::min<uint32_t>(padding, sizeof(kZeros));
+            iov.push_back({const_cast<uint8_t*>(kZeros), len});
+            padding -= len;
+          }
+        }
+      }
+
+      iov.push_back({record, eventSize});
+      offset_ += eventSize;
+      *written += eventSize;
+
+      if (iov.size() >= size_t(IOV_MAX)) {
+        consumed.emplace_back(ring, pos);
+        if (!writeBatch(iov, consumed)) {
+          return false;
+        }
+      }
+    }
+    consumed.emplace_back(ring, pos);
+  }
+
+  return writeBatch(iov, consumed);
+}
+
+bool TFileTransport::writeBatch(
+    std::vector<struct iovec>& iov,
+    std::vector<std::pair<WriterRing*, uint64_t>>& consumed) {
+  bool ok = iov.empty() || writeOut(iov.data(), iov.size());
+
+  // Events that could not be written are dropped, like in writerThread()
+  for (auto& c : consumed) {
+    c.first->tail = c.second;
+  }
+  iov.clear();
+  consumed.clear();
+
+  if (ringWaiters_ > 0) {
+    pthread_mutex_lock(&mutex_);
+    pthread_cond_broadcast(&notFull_);
+    pthread_mutex_unlock(&mutex_);
+  }
+  return ok;
+}
+
+bool TFileTransport::writeOut(struct iovec* iov, size_t count) {
+  if (directIO_) {
+    return writeDirect(iov, count);
+  }
+
+  while (count > 0) {
+    ssize_t rv = ::writev(fd_, iov, std::min<size_t>(count, IOV_MAX));
+    if (rv == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int errno_copy = errno;
+      GlobalOutput.perror("TFileTransport: error while writing events ", errno_copy);
+      return false;
+    }
+
+    // skip what was written
+    size_t done = rv;
+    while (count > 0 && done >= iov->iov_len) {
+      done -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (done > 0) {
+      iov->iov_base = (uint8_t*)iov->iov_base + done;
+      iov->iov_len -= done;
+    }
+  }
+  return true;
+}
+
+bool TFileTransport::writeDirect(const struct iovec* iov, size_t count) {
+  auto writeBlocks = [this](uint32_t len) {
+    uint32_t done = 0;
+    while (done < len) {
+      ssize_t rv = ::pwrite(directFd_, directBuffer_ + done, len - done,
+                            directOffset_ + done);
+      if (rv == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        int errno_copy = errno;
+        GlobalOutput.perror("TFileTransport: error while writing events with O_DIRECT ", errno_copy);
+        return false;
+      }
+      done += rv;
+    }
+    return true;
+  };
+
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t* data = (const uint8_t*)iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+    while (len > 0) {
+      size_t n = std::min<size_t>(len, DIRECT_BUFFER_SIZE - directBufferLen_);
+      memcpy(directBuffer_ + directBufferLen_, data, n);
+      directBufferLen_ += n;
+      data += n;
+      len -= n;
+      if (directBufferLen_ == DIRECT_BUFFER_SIZE) {
+        if (!writeBlocks(DIRECT_BUFFER_SIZE)) {
+          return false;
+        }
+        directOffset_ += DIRECT_BUFFER_SIZE;
+        directBufferLen_ = 0;
+      }
+    }
+  }
+
+  if (directBufferLen_ == 0) {
+    return true;
+  }
+
+  // Write the last partial block padded with zeros, then cut the padding
+  uint32_t full = directBufferLen_ & ~(DIRECT_IO_ALIGNMENT - 1);
+  uint32_t padded = (directBufferLen_ + DIRECT_IO_ALIGNMENT - 1) &
+    ~(DIRECT_IO_ALIGNMENT - 1);
+  memset(directBuffer_ + directBufferLen_, 0, padded - directBufferLen_);
+  if (!writeBlocks(padded)) {
+    return false;
+  }
+  if (padded != directBufferLen_ &&
+      -1 == ftruncate(fd_, directOffset_ + directBufferLen_)) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TFileTransport: writeDirect() ftruncate() ", errno_copy);
+    return false;
+  }
+
+  // keep the partial block, the next batch rewrites it
+  memmove(directBuffer_, directBuffer_ + full, directBufferLen_ - full);
+  directOffset_ += full;
+  directBufferLen_ -= full;
+  return true;
+}
+
+bool TFileTransport::openDirectOutput() {
+#ifdef O_DIRECT
+  closeDirectOutput();
+
+  void* buffer;
+  if (posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, DIRECT_BUFFER_SIZE) != 0) {
+    GlobalOutput("TFileTransport: cannot allocate the O_DIRECT buffer");
+    return false;
+  }
+  directBuffer_ = (uint8_t*)buffer;
+
+  directFd_ = ::open(filename_.c_str(), O_WRONLY | O_DIRECT);
+  if (directFd_ == -1) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TFileTransport: openDirectOutput() ::open() file: " + filename_, errno_copy);
+    return false;
+  }
+  directSourceFd_ = fd_;
+
+  // Writes start at the block holding offset_, so that block's data has to
+  // be rewritten along with the next events
+  directOffset_ = offset_ & ~off_t(DIRECT_IO_ALIGNMENT - 1);
+  directBufferLen_ = offset_ - directOffset_;
+  if (directBufferLen_ > 0 &&
+      ::pread(fd_, directBuffer_, directBufferLen_, directOffset_) !=
+        ssize_t(directBufferLen_)) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TFileTransport: openDirectOutput() ::pread() ", errno_copy);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TFileTransport::closeDirectOutput() {
+  if (directFd_ != -1) {
+    ::close(directFd_);
+    directFd_ = -1;
+  }
+  free(directBuffer_);
+  directBuffer_ = nullptr;
+  directBufferLen_ = 0;
+  directSourceFd_ = -1;
+}
+
+void TFileTransport::reopenAfterIOError() {
+  // If there is any IO error, for instance, the output file is unmounted or
+  // deleted, the batch was dropped.  Sleep for a short while, then try to
+  // reopen the file and start writing from the end.
+  while (1) {
+    T_ERROR("TFileTransport: writer thread going to sleep for %d microseconds due to IO errors", writerThreadIOErrorSleepTime_);
+    usleep(writerThreadIOErrorSleepTime_);
+    if (closing_) {
+      closeDirectOutput();
+      pthread_exit(nullptr);
+    }
+    if (fd_ > 0) {
+      ::close(fd_);
+      fd_ = 0;
+    }
+    try {
+      openLogFile();
+      seekToEnd();
+      offset_ = lseek(fd_, 0, SEEK_END);
+      if (!directIO_ || openDirectOutput()) {
+        T_LOG_OPER("TFileTransport: log file %s reopened by writer thread during error recovery", filename_.c_str());
+        return;
+      }
+    } catch (...) {
+    }
+    T_ERROR("TFileTransport: unable to reopen log file %s during error recovery", filename_.c_str());
   }
 }
 
@@ -973,6 +1517,184 @@ bool TFileTransportBuffer::isEmpty() {
   return writePoint_ == 0;
 }
 
+TMappedFileReader::TMappedFileReader(const string& path, uint32_t chunkSize)
+  : data_(nullptr)
+  , size_(0)
+  , chunkSize_(chunkSize) {
+  if (chunkSize_ == 0) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TMappedFileReader: chunk size is 0");
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TMappedFileReader: ::open() file: " + path, errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, path, errno_copy);
+  }
+
+  struct stat f_info;
+  if (fstat(fd, &f_info) == -1) {
+    int errno_copy = errno;
+    ::close(fd);
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedFileReader: fstat() " + path,
+                              errno_copy);
+  }
+  size_ = f_info.st_size;
+
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      int errno_copy = errno;
+      ::close(fd);
+      throw TTransportException(TTransportException::UNKNOWN,
+                                "TMappedFileReader: mmap() " + path,
+                                errno_copy);
+    }
+    // each thread reads its chunks from start to end
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = (const uint8_t*)data;
+  }
+  ::close(fd);
+}
+
+TMappedFileReader::~TMappedFileReader() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+/**
+ * Processes events from memory for one processParallel() thread.
+ */
+class TFileProcessor::Replayer {
+ public:
+  explicit Replayer(TFileProcessor* fileProcessor)
+    : processed(0)
+    , processor_(fileProcessor->processor_)
+    , buffer_(new TMemoryBuffer()) {
+    input_ = fileProcessor->inputProtocolFactory_->getProtocol(buffer_);
+    // replies are discarded, each thread into its own transport
+    output_ = fileProcessor->outputProtocolFactory_->getProtocol(
+      shared_ptr<TNullTransport>(new TNullTransport()));
+  }
+
+  void process(const uint8_t* event, uint32_t size) {
+    buffer_->resetBuffer(const_cast<uint8_t*>(event), size);
+    try {
+      processor_->process(input_, output_, nullptr);
+      ++processed;
+    } catch (TException &te) {
+      cerr << te.what() << endl;
+    }
+  }
+
+  uint64_t processed;
+
+ private:
+  shared_ptr<TProcessor> processor_;
+  shared_ptr<TMemoryBuffer> buffer_;
+  shared_ptr<TProtocol> input_;
+  shared_ptr<TProtocol> output_;
+};
+
+namespace {
+
+template <class F>
+void runOnThreads(uint32_t numThreads, const F& f) {
+  vector<std::thread> threads;
+  for (uint32_t i = 0; i < numThreads; ++i) {
+    threads.emplace_back(f, i);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void reportCorruptedChunk(uint32_t chunk) {
+  GlobalOutput.printf("TFileProcessor: corrupted event in chunk %u, "
+                      "skipping the rest of the chunk", chunk);
+}
+
+}
+
+uint64_t TFileProcessor::processParallel(const string& path,
+                                         const ParallelOptions& options) {
+  if (!dynamic_cast<TNullTransport*>(outputTransport_.get())) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TFileProcessor: processParallel() needs the "
+                              "default null output transport");
+  }
+
+  TMappedFileReader reader(path, options.chunkSize);
+  uint32_t numChunks = reader.getNumChunks();
+  uint32_t numThreads = std::max<uint32_t>(options.numThreads, 1);
+
+  vector<std::unique_ptr<Replayer>> replayers;
+  for (uint32_t i = 0; i < numThreads; ++i) {
+    replayers.emplace_back(new Replayer(this));
+  }
+
+  if (!options.key) {
+    std::atomic<uint32_t> nextChunk(0);
+    runOnThreads(numThreads, [&](uint32_t i) {
+      Replayer* replayer = replayers[i].get();
+      uint32_t chunk;
+      while ((chunk = nextChunk++) < numChunks) {
+        if (!reader.forEachEvent(chunk, [=](const uint8_t* event,
+                                            uint32_t size) {
+              replayer->process(event, size);
+            })) {
+          reportCorruptedChunk(chunk);
+        }
+      }
+    });
+  } else {
+    // Take a window of chunks at a time.  First sort the events of each
+    // chunk into one list per thread by key, on all threads; then each
+    // thread processes its lists in chunk order.
+    typedef std::pair<const uint8_t*, uint32_t> Event;
+    uint32_t window = numThreads * 2;
+    vector<vector<vector<Event>>> events(
+      window, vector<vector<Event>>(numThreads));
+
+    for (uint32_t first = 0; first < numChunks; first += window) {
+      uint32_t count = std::min(window, numChunks - first);
+
+      std::atomic<uint32_t> next(0);
+      runOnThreads(numThreads, [&](uint32_t) {
+        uint32_t i;
+        while ((i = next++) < count) {
+          auto& lists = events[i];
+          if (!reader.forEachEvent(first + i, [&](const uint8_t* event,
+                                                  uint32_t size) {
+                lists[options.key(event, size) % numThreads].emplace_back(
+                  event, size);
+              })) {
+            reportCorruptedChunk(first + i);
+          }
+        }
+      });
+
+      runOnThreads(numThreads, [&](uint32_t t) {
+        for (uint32_t i = 0; i < count; ++i) {
+          for (const auto& event : events[i][t]) {
+            replayers[t]->process(event.first, event.second);
+          }
+          events[i][t].clear();
+        }
+      });
+    }
+  }
+
+  uint64_t processed = 0;
+  for (const auto& replayer : replayers) {
+    processed += replayer->processed;
+  }
+  return processed;
+}
+
 TFileProcessor::TFileProcessor(shared_ptr<TProcessor> processor,
                                shared_ptr<TProtocolFactory> protocolFactory,
                                shared_ptr<TFileReaderTransport> inputTransport):
@@ -23,13 +23,21 @@
 #include <thrift/lib/cpp/transport/TTransport.h>
 #include <thrift/lib/cpp/Thrift.h>
 #include <thrift/lib/cpp/TProcessor.h>
+#include <thrift/lib/cpp/concurrency/ThreadLocal.h>
 
 #include <string>
 #include <stdio.h>
 
 #include <pthread.h>
+#include <sys/uio.h>
 #include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace apache { namespace thrift { namespace transport {
 
@@ -229,6 +237,56 @@ class TFileTransport : public TFileReaderTransport,
     return eventBufferSize_;
   }
 
+  /**
+   * Group commit: each thread that writes appends its events to a lock-free
+   * ring of its own instead of the shared event buffers, and the writer
+   * thread drains every ring with one writev() per batch.  Events written by
+   * one thread keep their order; events from different threads may be
+   * interleaved differently than they were written.  fsyncs are still
+   * batched by setFlushMaxBytes() and setFlushMaxUs().  The file format is
+   * unchanged.
+   *
+   * Must be set before the first write.
+   */
+  void setGroupCommit(bool groupCommit);
+  bool getGroupCommit() {
+    return groupCommit_;
+  }
+
+  /**
+   * Bytes in each thread's group commit ring, rounded up to a power of two.
+   * Events longer than half a ring are dropped.
+   */
+  void setRingSize(uint32_t ringSize) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change the ring size after writer thread started");
+      return;
+    }
+    if (ringSize) {
+      ringSize_ = DIRECT_IO_ALIGNMENT;
+      while (ringSize_ < ringSize) {
+        ringSize_ *= 2;
+      }
+    }
+  }
+  uint32_t getRingSize() {
+    return ringSize_;
+  }
+
+  /**
+   * With group commit, writes bypass the page cache (O_DIRECT).  The writer
+   * stages batches in an aligned buffer and writes whole
+   * DIRECT_IO_ALIGNMENT blocks, rewriting the last partial block with the
+   * next batch, so chunk boundaries stay block aligned as long as the chunk
+   * size is a multiple of DIRECT_IO_ALIGNMENT.
+   *
+   * Must be set before the first write.
+   */
+  void setDirectIO(bool directIO);
+  bool getDirectIO() {
+    return directIO_;
+  }
+
   void setFlushMaxUs(uint32_t flushMaxUs) {
     if (flushMaxUs) {
       flushMaxUs_ = flushMaxUs;
@@ -286,17 +344,54 @@ class TFileTransport : public TFileReaderTransport,
   }
 
  private:
+  // A thread's group commit ring
+  struct WriterRing;
+  // Frees a thread's ring for reuse when the thread exits
+  class RingManager {
+   public:
+    WriterRing* allocate() {
+      return nullptr;
+    }
+    void destroy(WriterRing* ring);
+    void replace(WriterRing*, WriterRing*) {}
+  };
+
   // helper functions for writing to a file
   void enqueueEvent(const uint8_t* buf, uint32_t eventLen);
   bool swapEventBuffers(struct timespec* deadline);
   bool initBufferAndWriteThread();
+  bool prepareWriterFile();
+
+  // helper functions for group commit
+  void enqueueToRing(const uint8_t* buf, uint32_t eventLen);
+  WriterRing* registerRing();
+  bool pushToRing(WriterRing* ring, const uint8_t* buf, uint32_t eventLen);
+  bool writeRings(const std::vector<WriterRing*>& rings,
+                  const std::vector<uint64_t>& ends,
+                  std::vector<struct iovec>& iov,
+                  uint32_t* written);
+  bool writeBatch(std::vector<struct iovec>& iov,
+                  std::vector<std::pair<WriterRing*, uint64_t>>& consumed);
+  bool writeOut(struct iovec* iov, size_t count);
+  bool writeDirect(const struct iovec* iov, size_t count);
+  bool openDirectOutput();
+  void closeDirectOutput();
+  void reopenAfterIOError();
 
   // control for writer thread
   static void* startWriterThread(void* ptr) {
-    (((TFileTransport*)ptr)->writerThread());
+    TFileTransport* transport = (TFileTransport*)ptr;
+    if (transport->groupCommit_) {
+      transport->groupCommitWriterThread();
+    } else {
+      transport->writerThread();
+    }
     return 0;
   }
   void writerThread();
+  void groupCommitWriterThread();
+  bool shouldSync(bool forced, uint32_t unflushed,
+                  struct timespec* ts_next_flush);
 
   // helper functions for reading from a file
   eventInfo* readEvent();
@@ -374,6 +469,32 @@ class TFileTransport : public TFileReaderTransport,
   // Mutex that is grabbed when enqueuing and swapping the read/write buffers
   pthread_mutex_t mutex_;
 
+  // group commit state
+  bool groupCommit_;
+  uint32_t ringSize_;
+  static const uint32_t DEFAULT_RING_SIZE = 1024 * 1024;
+  // Every ring handed out so far, guarded by mutex_
+  std::vector<std::unique_ptr<WriterRing>> rings_;
+  // Declared after rings_ so that its key is deleted first: a writer that
+  // exits later must not mark a freed ring as unowned
+  std::unique_ptr<concurrency::ThreadLocal<WriterRing, RingManager>> localRing_;
+  // Set while the writer thread waits on notEmpty_ for an empty set of rings
+  std::atomic<bool> writerIdle_;
+  // Threads waiting on notFull_ for room in their ring
+  std::atomic<uint32_t> ringWaiters_;
+
+  // O_DIRECT output, only used by the group commit writer thread
+  bool directIO_;
+  int directFd_;
+  // fd_ that directFd_ was opened for
+  int directSourceFd_;
+  // Bytes not yet written in full blocks, starting at directOffset_
+  uint8_t* directBuffer_;
+  uint32_t directBufferLen_;
+  off_t directOffset_;
+  static const uint32_t DIRECT_IO_ALIGNMENT = 4096;
+  static const uint32_t DIRECT_BUFFER_SIZE = 1024 * 1024;
+
   // File information
   std::string filename_;
   int fd_;
@@ -398,6 +519,68 @@ class TEOFException : public TTransportException {
     TTransportException(TTransportException::END_OF_FILE) {};
 };
 
+/**
+ * Read-only, memory mapped view of a file written by TFileTransport, for
+ * replaying it without copying events.
+ *
+ * TFileTransport never lets an event cross a chunk boundary, so each chunk
+ * can be read on its own, and different chunks by different threads.
+ * Events appended after construction are not seen.
+ */
+class TMappedFileReader {
+ public:
+  // Throws TTransportException if path cannot be opened or mapped
+  TMappedFileReader(const std::string& path, uint32_t chunkSize);
+  ~TMappedFileReader();
+
+  uint64_t getSize() const {
+    return size_;
+  }
+
+  uint32_t getChunkSize() const {
+    return chunkSize_;
+  }
+
+  uint32_t getNumChunks() const {
+    return size_ ? (size_ - 1) / chunkSize_ + 1 : 0;
+  }
+
+  /**
+   * Calls callback(const uint8_t* event, uint32_t size) for each event of
+   * chunk, in file order.  Returns false if it stopped at a corrupted event,
+   * one running past the end of the chunk or of the file.
+   */
+  template <class Callback>
+  bool forEachEvent(uint32_t chunk, Callback&& callback) const {
+    uint64_t pos = uint64_t(chunk) * chunkSize_;
+    uint64_t end = std::min<uint64_t>(pos + chunkSize_, size_);
+    // a size never crosses the chunk boundary either
+    while (pos + 4 <= end) {
+      uint32_t eventSize;
+      memcpy(&eventSize, data_ + pos, 4);
+      pos += 4;
+      // 0 length event indicates padding
+      if (eventSize == 0) {
+        continue;
+      }
+      if (eventSize > end - pos) {
+        return false;
+      }
+      callback(data_ + pos, eventSize);
+      pos += eventSize;
+    }
+    return true;
+  }
+
+ private:
+  TMappedFileReader(const TMappedFileReader&);
+  TMappedFileReader& operator=(const TMappedFileReader&);
+
+  const uint8_t* data_;
+  uint64_t size_;
+  uint32_t chunkSize_;
+};
+
 
 // wrapper class to process events from a file containing thrift events
 class TFileProcessor {
@@ -445,7 +628,37 @@ class TFileProcessor {
    */
   void processChunk();
 
+  struct ParallelOptions {
+    ParallelOptions()
+      : numThreads(4)
+      , chunkSize(16 * 1024 * 1024) {}
+
+    uint32_t numThreads;
+    // Chunk size the file was written with
+    uint32_t chunkSize;
+    // If set, events with the same key are processed in file order, all on
+    // the same thread.  Called on all the threads.
+    std::function<uint64_t(const uint8_t* event, uint32_t size)> key;
+  };
+
+  /**
+   * Processes every event of the file at path, mapping it into memory and
+   * handing its chunks to numThreads threads.  Without a key, events of
+   * different chunks are processed concurrently and in no particular order.
+   *
+   * The processor is shared by the threads.  Replies are discarded, so the
+   * output transport must be the default TNullTransport.  Events that fail
+   * to process are logged and skipped, and a corrupted event ends its chunk.
+   *
+   * @return number of events processed
+   * @throws TTransportException if an output transport was given
+   */
+  uint64_t processParallel(const std::string& path,
+                           const ParallelOptions& options = ParallelOptions());
+
  private:
+  class Replayer;
+
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocolFactory> inputProtocolFactory_;
   std::shared_ptr<TProtocolFactory> outputProtocolFactory_;
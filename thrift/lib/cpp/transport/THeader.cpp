@@ -23,21 +23,14 @@
 #include <thrift/lib/cpp/TApplicationException.h>
 #include <thrift/lib/cpp/protocol/TProtocolTypes.h>
 #include <thrift/lib/cpp/transport/TBufferTransports.h>
+#include <thrift/lib/cpp/transport/THeaderCodecs.h>
 #include <thrift/lib/cpp/util/VarintUtils.h>
 #include <thrift/lib/cpp/concurrency/Thread.h>
-#include "snappy.h"
-
-#ifdef HAVE_QUICKLZ
-extern "C" {
-#include "external/quicklz-1.5b/quicklz.h" // nolint
-}
-#endif
 
 #include <algorithm>
 #include <bitset>
 #include <cassert>
 #include <string>
-#include <zlib.h>
 
 using std::map;
 using std::shared_ptr;
@@ -59,9 +52,14 @@ const string THeader::ID_VERSION_HEADER = "id_version";
 const string THeader::ID_VERSION = "1";
 const string THeader::PRIORITY_HEADER = "thrift_priority";
 const string THeader::CLIENT_TIMEOUT_HEADER = "client_timeout";
+const string THeader::UNCOMPRESSED_SIZE_HEADER = "uncompressed_size";
+const string THeader::ACCEPT_TRANSFORMS_HEADER = "thrift_accept_transforms";
 
 string THeader::s_identity = "";
 
+// Largest frame whose read headers may point into the frame itself
+const uint32_t kMaxSharedFrameSize = 16384;
+
 void THeader::setSupportedClients(std::bitset<CLIENT_TYPES_LEN>
                                   const* clients) {
   if (clients) {
@@ -299,12 +297,12 @@ unique_ptr<IOBuf> THeader::removeHeader(IOBufQueue* queue,
 
       // auth client?
       clientType = THRIFT_HEADER_CLIENT_TYPE;
-      auto auth_header = getHeaders().find("thrift_auth");
-      if (auth_header != getHeaders().end()) {
-        if (auth_header->second == "1") {
+      auto auth_header = readHeaders_.find(THeaderMap::Key::AUTH);
+      if (auth_header) {
+        if (*auth_header == StringPiece("1")) {
           clientType = THRIFT_HEADER_SASL_CLIENT_TYPE;
         }
-        readHeaders_.erase(auth_header);
+        readHeaders_.erase(THeaderMap::Key::AUTH);
       }
     } else {
       clientType = THRIFT_UNKNOWN_CLIENT_TYPE;
@@ -362,9 +360,54 @@ void readInfoHeaders(RWPrivateCursor& c,
   }
 }
 
+/**
+ * Reads a string for a THeaderMap.  If the frame is retained by the map and
+ * the string is contiguous, returns a view into the frame; otherwise copies
+ * the string into *scratch and returns a view of that.
+ */
+StringPiece readStringPiece(RWPrivateCursor& c,
+                            bool viewFrame,
+                            string* scratch,
+                            bool* isView) {
+  uint32_t sz = readVarint<uint32_t>(c);
+  if (viewFrame && c.length() >= sz) {
+    StringPiece str(reinterpret_cast<const char*>(c.data()), sz);
+    c.skip(sz);
+    *isView = true;
+    return str;
+  }
+  scratch->resize(sz);
+  c.pull(&(*scratch)[0], sz);
+  *isView = false;
+  return *scratch;
+}
+
+void readInfoHeaders(RWPrivateCursor& c,
+                     THeaderMap& headers,
+                     bool viewFrame) {
+  // Process key-value headers
+  uint32_t numKVHeaders = readVarint<int32_t>(c);
+  string keyScratch, valueScratch;
+  // continue until we reach (paded) end of packet
+  while (numKVHeaders--) {
+    // format: key; value
+    // both: length (varint32); value (string)
+    bool keyIsView, valueIsView;
+    StringPiece key = readStringPiece(c, viewFrame, &keyScratch, &keyIsView);
+    StringPiece value =
+      readStringPiece(c, viewFrame, &valueScratch, &valueIsView);
+    // save to headers
+    if (keyIsView && valueIsView) {
+      headers.addView(key, value);
+    } else {
+      headers.set(key, value);
+    }
+  }
+}
+
 unique_ptr<IOBuf> THeader::readHeaderFormat(unique_ptr<IOBuf> buf) {
   readTrans_.clear(); // Clear out any previous transforms.
-  readHeaders_.clear(); // Clear out any previous headers.
+  clearReadHeaders(); // Clear out any previous headers.
 
   // magic(4), seqId(2), flags(2), headerSize(2)
   const uint8_t commonHeaderSize = 10;
@@ -400,6 +443,13 @@ unique_ptr<IOBuf> THeader::readHeaderFormat(unique_ptr<IOBuf> buf) {
     }
   }
 
+  // Small single-buffer frames are shared with readHeaders_, whose entries
+  // then point straight into the frame.  Larger frames are not kept alive
+  // just for their headers; those get copied.
+  bool viewFrame = !buf->isChained() && buf->length() <= kMaxSharedFrameSize;
+  bool retained = false;
+  bool persistentHeadersChanged = false;
+
   // Info headers
   while (data.data() != c.data()) {
     uint32_t infoId = readVarint<int32_t>(c);
@@ -414,17 +464,27 @@ unique_ptr<IOBuf> THeader::readHeaderFormat(unique_ptr<IOBuf> buf) {
     }
     switch (infoId) {
       case infoIdType::KEYVALUE:
-        readInfoHeaders(c, readHeaders_);
+        if (viewFrame && !retained) {
+          readHeaders_.retain(buf->cloneOne());
+          retained = true;
+        }
+        readInfoHeaders(c, readHeaders_, viewFrame);
         break;
       case infoIdType::PKEYVALUE:
         readInfoHeaders(c, persisReadHeaders_);
+        persistentHeadersChanged = true;
         break;
     }
   }
 
+  if (persistentHeadersChanged) {
+    updateAcceptedTransforms();
+  }
+
   // if persistent headers are not empty, merge together.
-  if (!persisReadHeaders_.empty())
-    readHeaders_.insert(persisReadHeaders_.begin(), persisReadHeaders_.end());
+  for (const auto& it : persisReadHeaders_) {
+    readHeaders_.setIfAbsent(it.first, it.second);
+  }
 
   if (verifyCallback_) {
     uint32_t bufLength = buf->computeChainDataLength();
@@ -459,7 +519,17 @@ unique_ptr<IOBuf> THeader::readHeaderFormat(unique_ptr<IOBuf> buf) {
   }
 
   // Untransform data section
-  buf = untransform(std::move(buf), readTrans_);
+  size_t sizeHint = 0;
+  auto hint = readHeaders_.find(THeaderMap::Key::UNCOMPRESSED_SIZE);
+  if (hint) {
+    try {
+      sizeHint = folly::to<size_t>(*hint);
+    } catch (const std::range_error&) {
+      // Only a hint; ignore it
+    }
+    readHeaders_.erase(THeaderMap::Key::UNCOMPRESSED_SIZE);
+  }
+  buf = untransform(std::move(buf), readTrans_, sizeHint, zstdDict_.get());
 
   if (protoId_ == T_JSON_PROTOCOL && clientType != THRIFT_HTTP_SERVER_TYPE) {
     throw TApplicationException(TApplicationException::UNSUPPORTED_CLIENT_TYPE,
@@ -469,110 +539,53 @@ unique_ptr<IOBuf> THeader::readHeaderFormat(unique_ptr<IOBuf> buf) {
   return std::move(buf);
 }
 
+void THeader::updateAcceptedTransforms() {
+  auto it = persisReadHeaders_.find(ACCEPT_TRANSFORMS_HEADER);
+  if (it == persisReadHeaders_.end()) {
+    return;
+  }
+  acceptedTrans_.clear();
+  vector<StringPiece> ids;
+  folly::split(',', it->second, ids);
+  for (auto id : ids) {
+    try {
+      auto transId = folly::to<uint16_t>(id);
+      // Only transforms we know how to apply
+      if (transId == ZLIB_TRANSFORM ||
+          transId == SNAPPY_TRANSFORM ||
+          transId == QLZ_TRANSFORM ||
+          transId == ZSTD_TRANSFORM ||
+          transId == LZ4_TRANSFORM) {
+        acceptedTrans_.push_back(transId);
+      }
+    } catch (const std::range_error&) {
+      // Ignore ids from the future
+    }
+  }
+}
+
 unique_ptr<IOBuf> THeader::untransform(
-  unique_ptr<IOBuf> buf, std::vector<uint16_t>& readTrans) {
+  unique_ptr<IOBuf> buf,
+  std::vector<uint16_t>& readTrans,
+  size_t sizeHint,
+  const ZstdDictionary* zstdDict) {
   for (vector<uint16_t>::const_reverse_iterator it = readTrans.rbegin();
        it != readTrans.rend(); ++it) {
     const uint16_t transId = *it;
+    // The hint is the size before any transform was applied, so it only
+    // describes the output of the last one undone
+    size_t hint = (it + 1 == readTrans.rend()) ? sizeHint : 0;
 
     if (transId == ZLIB_TRANSFORM) {
-      size_t bufSize = 1024;
-      unique_ptr<IOBuf> out;
-
-      z_stream stream;
-      int err;
-
-      // Setting these to 0 means use the default free/alloc functions
-      stream.zalloc = (alloc_func)0;
-      stream.zfree = (free_func)0;
-      stream.opaque = (voidpf)0;
-      err = inflateInit(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib inflate Init");
-      }
-      {
-        SCOPE_EXIT { err = inflateEnd(&stream); };
-        do {
-          if (nullptr == buf) {
-            throw TApplicationException(TApplicationException::MISSING_RESULT,
-                "Not enough zlib data in message");
-          }
-          stream.next_in = buf->writableData();
-          stream.avail_in = buf->length();
-          do {
-            unique_ptr<IOBuf> tmp(IOBuf::create(bufSize));
-
-            stream.next_out = tmp->writableData();
-            stream.avail_out = bufSize;
-            err = inflate(&stream, Z_NO_FLUSH);
-            if (err == Z_STREAM_ERROR ||
-                err == Z_DATA_ERROR ||
-                err == Z_MEM_ERROR) {
-              throw TApplicationException(TApplicationException::MISSING_RESULT,
-                  "Error while zlib inflate");
-            }
-            tmp->append(bufSize - stream.avail_out);
-            if (out) {
-              // Add buffer to end (circular list, same as prepend)
-              out->prependChain(std::move(tmp));
-            } else {
-              out = std::move(tmp);
-            }
-          } while (stream.avail_out == 0);
-          // try the next buffer
-          buf = buf->pop();
-        } while (err != Z_STREAM_END);
-      }
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib inflateEnd");
-      }
-      buf = std::move(out);
+      buf = codec::zlibUncompress(std::move(buf), hint);
     } else if (transId == SNAPPY_TRANSFORM) {
-      buf->coalesce(); // required for snappy uncompression
-      size_t uncompressed_sz;
-      bool result = snappy::GetUncompressedLength((char*)buf->data(),
-                                                  buf->length(),
-                                                  &uncompressed_sz);
-      unique_ptr<IOBuf> out(IOBuf::create(uncompressed_sz));
-      out->append(uncompressed_sz);
-
-      result = snappy::RawUncompress((char*)buf->data(), buf->length(),
-                                     (char*)out->writableData());
-      if (!result) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "snappy uncompress failure");
-      }
-
-      buf = std::move(out);
+      buf = codec::snappyUncompress(std::move(buf));
     } else if (transId == QLZ_TRANSFORM) {
-      buf->coalesce(); // probably needed for uncompression
-      const char *src = (const char *)buf->data();
-      size_t length = buf->length();
-#ifdef HAVE_QUICKLZ
-      // according to QLZ spec, the size info is stored in first 9 bytes
-      if (length < 9 || qlz_size_compressed(src) != length) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error in qlz decompress: bad size");
-      }
-
-      size_t uncompressed_sz = qlz_size_decompressed(src);
-      const unique_ptr<qlz_state_decompress> state(new qlz_state_decompress);
-
-      unique_ptr<IOBuf> out(IOBuf::create(uncompressed_sz));
-      out->append(uncompressed_sz);
-
-      bool success = (qlz_decompress(src,
-                                     out->writableData(),
-                                     state.get()) == uncompressed_sz);
-      if (!success) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error in qlz decompress");
-      }
-      buf = std::move(out);
-#endif
-
+      buf = codec::qlzUncompress(std::move(buf));
+    } else if (transId == LZ4_TRANSFORM) {
+      buf = codec::lz4Uncompress(std::move(buf));
+    } else if (transId == ZSTD_TRANSFORM) {
+      buf = codec::zstdUncompress(std::move(buf), zstdDict);
     } else {
       throw TApplicationException(TApplicationException::MISSING_RESULT,
                                 "Unknown transform");
@@ -585,136 +598,37 @@ unique_ptr<IOBuf> THeader::untransform(
 unique_ptr<IOBuf> THeader::transform(
   unique_ptr<IOBuf> buf,
   std::vector<uint16_t>& writeTrans,
-uint32_t minCompressBytes) {
+  uint32_t minCompressBytes,
+  const ZstdDictionary* zstdDict) {
   uint32_t dataSize = buf->computeChainDataLength();
 
   for (vector<uint16_t>::iterator it = writeTrans.begin();
        it != writeTrans.end(); ) {
     const uint16_t transId = *it;
 
-    if (transId == ZLIB_TRANSFORM) {
-      if (dataSize < minCompressBytes) {
-        it = writeTrans.erase(it);
-        continue;
-      }
-      size_t bufSize = 1024;
-      unique_ptr<IOBuf> out;
-
-      z_stream stream;
-      int err;
-
-      stream.next_in = (unsigned char*)buf->data();
-      stream.avail_in = buf->length();
-
-      stream.zalloc = (alloc_func)0;
-      stream.zfree = (free_func)0;
-      stream.opaque = (voidpf)0;
-      err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateInit");
-      }
-
-      // Loop until deflate() tells us it's done writing all output
-      while (err != Z_STREAM_END) {
-        // Create a new output chunk
-        unique_ptr<IOBuf> tmp(IOBuf::create(bufSize));
-        stream.next_out = tmp->writableData();
-        stream.avail_out = bufSize;
-
-        // Loop while the current output chunk still has space, call deflate to
-        // try and fill it
-        while (stream.avail_out > 0) {
-          // When providing the last bit of input data and thereafter, pass
-          // Z_FINISH to tell zlib it should flush out remaining compressed
-          // data and finish up with an end marker at the end of the output
-          // stream
-          int flush = (buf && buf->isChained()) ? Z_NO_FLUSH : Z_FINISH;
-          err = deflate(&stream, flush);
-          if (err == Z_STREAM_ERROR) {
-            throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                      "Error while zlib deflate");
-          }
-
-          if (stream.avail_in == 0) {
-            if (buf) {
-              buf = buf->pop();
-            }
-            if (!buf) {
-              // No more input chunks left
-              break;
-            }
-            // Prvoide the next input chunk to zlib
-            stream.next_in = (unsigned char*) buf->data();
-            stream.avail_in = buf->length();
-          }
-        }
-
-        // Tell the tmp IOBuf we wrote some data into it
-        tmp->append(bufSize - stream.avail_out);
-        if (out) {
-          // Add the IOBuf to the end of the chain
-          out->prependChain(std::move(tmp));
-        } else {
-          // This is the first IOBuf, so start the chain
-          out = std::move(tmp);
-        }
-      }
-
-      err = deflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateEnd");
-      }
+    if (transId != ZLIB_TRANSFORM &&
+        transId != SNAPPY_TRANSFORM &&
+        transId != QLZ_TRANSFORM &&
+        transId != LZ4_TRANSFORM &&
+        transId != ZSTD_TRANSFORM) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Unknown transform");
+    }
+    if (dataSize < minCompressBytes) {
+      it = writeTrans.erase(it);
+      continue;
+    }
 
-      buf = std::move(out);
+    if (transId == ZLIB_TRANSFORM) {
+      buf = codec::zlibCompress(std::move(buf));
     } else if (transId == SNAPPY_TRANSFORM) {
-      if (dataSize < minCompressBytes) {
-        it = writeTrans.erase(it);
-        continue;
-      }
-
-      buf->coalesce(); // required for snappy compression
-
-      // Check that we have enough space
-      size_t maxCompressedLength = snappy::MaxCompressedLength(buf->length());
-      unique_ptr<IOBuf> out(IOBuf::create(maxCompressedLength));
-
-      size_t compressed_sz;
-      snappy::RawCompress((char*)buf->data(), buf->length(),
-                          (char*)out->writableData(), &compressed_sz);
-      out->append(compressed_sz);
-      buf = std::move(out);
+      buf = codec::snappyCompress(std::move(buf));
     } else if (transId == QLZ_TRANSFORM) {
-      if (dataSize < minCompressBytes) {
-        it = writeTrans.erase(it);
-        continue;
-      }
-
-      // max is 400B greater than uncompressed size based on QuickLZ spec
-      size_t maxCompressedLength = buf->length() + 400;
-      unique_ptr<IOBuf> out(IOBuf::create(maxCompressedLength));
-
-#ifdef HAVE_QUICKLZ
-      const unique_ptr<qlz_state_compress> state(new qlz_state_compress);
-
-      const char *src = (const char *)buf->data();
-      char *dst = (char *)out->writableData();
-
-      size_t compressed_sz = qlz_compress(
-        src, dst, buf->length(), state.get());
-
-      if (compressed_sz > maxCompressedLength) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error in qlz compress");
-      }
-
-      out->append(compressed_sz);
-#endif
-      buf = std::move(out);
+      buf = codec::qlzCompress(std::move(buf));
+    } else if (transId == LZ4_TRANSFORM) {
+      buf = codec::lz4Compress(std::move(buf));
     } else {
-      throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                "Unknown transform");
+      buf = codec::zstdCompress(std::move(buf), zstdDict);
     }
     ++it;
   }
@@ -803,9 +717,11 @@ void THeader::clearPersistentHeaders() {
 }
 
 string THeader::getPeerIdentity() {
-  if (readHeaders_.find(IDENTITY_HEADER) != readHeaders_.end()) {
-    if (readHeaders_[ID_VERSION_HEADER] == ID_VERSION) {
-      return readHeaders_[IDENTITY_HEADER];
+  auto peerIdentity = readHeaders_.find(THeaderMap::Key::IDENTITY);
+  if (peerIdentity) {
+    auto version = readHeaders_.find(THeaderMap::Key::ID_VERSION);
+    if (version && *version == StringPiece(ID_VERSION)) {
+      return peerIdentity->str();
     }
   }
   return "";
@@ -824,7 +740,13 @@ unique_ptr<IOBuf> THeader::addHeader(unique_ptr<IOBuf> buf,
   if (clientType == THRIFT_HEADER_CLIENT_TYPE ||
       clientType == THRIFT_HEADER_SASL_CLIENT_TYPE) {
     if (transform) {
-      buf = THeader::transform(std::move(buf), writeTrans, minCompressBytes_);
+      size_t dataSize = buf->computeChainDataLength();
+      buf = THeader::transform(std::move(buf), writeTrans, minCompressBytes_,
+                               zstdDict_.get());
+      if (!writeTrans.empty()) {
+        // Lets the receiver size its output buffer up front
+        writeHeaders_[UNCOMPRESSED_SIZE_HEADER] = folly::to<string>(dataSize);
+      }
     }
   }
   size_t chainSize = buf->computeChainDataLength();
@@ -994,17 +916,16 @@ unique_ptr<IOBuf> THeader::addHeader(unique_ptr<IOBuf> buf,
 
 apache::thrift::concurrency::PriorityThreadManager::PRIORITY
 THeader::getCallPriority() {
-  const auto& map = getHeaders();
-  auto iter = map.find(PRIORITY_HEADER);
-  if (iter != map.end()) {
+  auto iter = readHeaders_.find(THeaderMap::Key::PRIORITY);
+  if (iter) {
     try {
-      unsigned prio = folly::to<unsigned>(iter->second);
+      unsigned prio = folly::to<unsigned>(*iter);
       if (prio < apache::thrift::concurrency::N_PRIORITIES) {
         return static_cast<apache::thrift::concurrency::PRIORITY>(prio);
       }
     }
     catch (const std::range_error&) {}
-    LOG(INFO) << "Bad method priority " << iter->second << ", using default";
+    LOG(INFO) << "Bad method priority " << *iter << ", using default";
   }
   // no priority
   return apache::thrift::concurrency::N_PRIORITIES;
@@ -1016,14 +937,13 @@ void THeader::setCallPriority(
 }
 
 std::chrono::milliseconds THeader::getClientTimeout() const {
-  const auto& map = getHeaders();
-  auto iter = map.find(CLIENT_TIMEOUT_HEADER);
-  if (iter != map.end()) {
+  auto iter = readHeaders_.find(THeaderMap::Key::CLIENT_TIMEOUT);
+  if (iter) {
     try {
-      int64_t timeout = folly::to<int64_t>(iter->second);
+      int64_t timeout = folly::to<int64_t>(*iter);
       return std::chrono::milliseconds(timeout);
     } catch (const std::range_error&) {}
-    LOG(INFO) << "Bad client timeout " << iter->second << ", using default";
+    LOG(INFO) << "Bad client timeout " << *iter << ", using default";
   }
 
   return std::chrono::milliseconds(0);
@@ -23,6 +23,8 @@
 #include <thrift/lib/cpp/protocol/TCompactProtocol.h>
 #include <thrift/lib/cpp/protocol/TProtocolTypes.h>
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
+#include <thrift/lib/cpp/transport/THeaderCodecs.h>
+#include <thrift/lib/cpp/transport/THeaderMap.h>
 #include <thrift/lib/cpp/util/THttpParser.h>
 
 #include <folly/io/IOBuf.h>
@@ -71,7 +73,7 @@ using apache::thrift::protocol::T_COMPACT_PROTOCOL;
  * Class that will take an IOBuf and wrap it in some thrift headers.
  * see thrift/doc/HeaderFormat.txt for details.
  *
- * Supports transforms: zlib snappy hmac qlz
+ * Supports transforms: zlib snappy hmac qlz zstd lz4
  * Supports headers: http-style key/value per request and per connection
  * other: Protocol Id and seq ID in header.
  *
@@ -93,6 +95,7 @@ class THeader {
     , seqId(0)
     , flags_(0)
     , identity(s_identity)
+    , readHeadersMapValid_(false)
     , minCompressBytes_(0)
   {
     setSupportedClients(nullptr);
@@ -107,6 +110,7 @@ class THeader {
     , seqId(0)
     , flags_(0)
     , identity(s_identity)
+    , readHeadersMapValid_(false)
     , minCompressBytes_(0)
   {
     setSupportedClients(clientTypes);
@@ -157,11 +161,15 @@ class THeader {
    * untransformed data.
    *
    * @param IOBuf input data section
+   * @param sizeHint expected size of the output, 0 if unknown
+   * @param zstdDict dictionary for ZSTD_TRANSFORM, if any
    * @return IOBuf output data section
    */
   static std::unique_ptr<folly::IOBuf> untransform(
     std::unique_ptr<folly::IOBuf>,
-    std::vector<uint16_t>& readTrans);
+    std::vector<uint16_t>& readTrans,
+    size_t sizeHint = 0,
+    const ZstdDictionary* zstdDict = nullptr);
 
   /**
    * Transform the data based on our write transform flags
@@ -169,12 +177,14 @@ class THeader {
    * transformed data.
    *
    * @param IOBuf to transform.  Returns transformed IOBuf (or chain)
+   * @param zstdDict dictionary for ZSTD_TRANSFORM, if any
    * @return transformed data IOBuf
    */
   static std::unique_ptr<folly::IOBuf> transform(
     std::unique_ptr<folly::IOBuf>,
     std::vector<uint16_t>& writeTrans,
-    uint32_t minCompressBytes);
+    uint32_t minCompressBytes,
+    const ZstdDictionary* zstdDict = nullptr);
 
   uint16_t getNumTransforms(std::vector<uint16_t>& transforms) const {
     int trans = transforms.size();
@@ -224,13 +234,25 @@ class THeader {
   }
 
   // these work with read headers
-  const StringToStringMap& getHeaders() const {
+  const THeaderMap& getHeaderMap() const {
     return readHeaders_;
   }
 
+  /**
+   * Compatibility accessor; prefer getHeaderMap(), which does not copy.
+   * The map is built on first use after each message is read.
+   */
+  const StringToStringMap& getHeaders() const {
+    if (!readHeadersMapValid_) {
+      readHeadersMap_ = readHeaders_.toMap();
+      readHeadersMapValid_ = true;
+    }
+    return readHeadersMap_;
+  }
+
   StringToStringMap releaseHeaders() {
-    StringToStringMap headers;
-    readHeaders_.swap(headers);
+    StringToStringMap headers = readHeaders_.toMap();
+    clearReadHeaders();
     return headers;
   }
 
@@ -251,8 +273,40 @@ class THeader {
     HMAC_TRANSFORM = 0x02,
     SNAPPY_TRANSFORM = 0x03,
     QLZ_TRANSFORM = 0x04,
+    ZSTD_TRANSFORM = 0x05,
+    LZ4_TRANSFORM = 0x06,
   };
 
+  // Carries the size of a compressed payload before compression, so the
+  // receiver can allocate its output in one go.
+  static const std::string UNCOMPRESSED_SIZE_HEADER;
+
+  // Persistent header listing the transforms a peer can read, as decimal
+  // ids separated by commas.  Sent by clients that pick transforms per
+  // message, which therefore may not have used all of them yet.
+  static const std::string ACCEPT_TRANSFORMS_HEADER;
+
+  /**
+   * Transforms the peer said it accepts with ACCEPT_TRANSFORMS_HEADER.
+   * Unlike the transforms it used, these are not applied to replies
+   * unless a compression policy picks them.
+   */
+  const std::vector<uint16_t>& getAcceptedTransforms() const {
+    return acceptedTrans_;
+  }
+
+  /**
+   * Dictionary used by ZSTD_TRANSFORM in both directions.  Both peers must
+   * use the same one.
+   */
+  void setZstdDictionary(std::shared_ptr<const ZstdDictionary> dict) {
+    zstdDict_ = std::move(dict);
+  }
+
+  const std::shared_ptr<const ZstdDictionary>& getZstdDictionary() const {
+    return zstdDict_;
+  }
+
   /**
    * Callbacks to get and verify a mac transform.
 
@@ -367,9 +421,19 @@ class THeader {
 
   std::vector<uint16_t> readTrans_;
   std::vector<uint16_t> writeTrans_;
+  std::vector<uint16_t> acceptedTrans_;
+
+  void clearReadHeaders() {
+    readHeaders_.clear();
+    readHeadersMap_.clear();
+    readHeadersMapValid_ = false;
+  }
 
   // Map to use for headers
-  StringToStringMap readHeaders_;
+  THeaderMap readHeaders_;
+  // getHeaders() copy of readHeaders_
+  mutable StringToStringMap readHeadersMap_;
+  mutable bool readHeadersMapValid_;
   StringToStringMap writeHeaders_;
 
   // Map to use for persistent headers
@@ -389,6 +453,11 @@ class THeader {
 
   uint32_t minCompressBytes_;
 
+  std::shared_ptr<const ZstdDictionary> zstdDict_;
+
+  // Parses ACCEPT_TRANSFORMS_HEADER from the persistent read headers
+  void updateAcceptedTransforms();
+
   /**
    * Returns the maximum number of bytes that write k/v headers can take
    */
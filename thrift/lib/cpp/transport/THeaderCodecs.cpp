@@ -0,0 +1,646 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/transport/THeaderCodecs.h>
+
+#include <thrift/lib/cpp/thrift_config.h>
+#include <thrift/lib/cpp/TApplicationException.h>
+#include <thrift/lib/cpp/transport/THeader.h>
+#include <thrift/lib/cpp/transport/TTransportException.h>
+#include <thrift/lib/cpp/util/VarintUtils.h>
+
+#include <folly/Conv.h>
+#include <folly/ThreadLocal.h>
+#include <folly/io/Cursor.h>
+#include "snappy.h"
+#include "snappy-sinksource.h"
+
+#ifdef HAVE_QUICKLZ
+extern "C" {
+#include "external/quicklz-1.5b/quicklz.h" // nolint
+}
+#endif
+
+#if THRIFT_HAVE_LIBLZ4
+#include <lz4.h>
+#endif
+
+#if THRIFT_HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <zlib.h>
+
+using folly::IOBuf;
+using folly::io::Cursor;
+using std::unique_ptr;
+
+namespace apache { namespace thrift { namespace transport {
+
+ZstdDictionary::ZstdDictionary(folly::ByteRange data, int level)
+    : cdict_(nullptr)
+    , ddict_(nullptr)
+    , id_(0) {
+#if THRIFT_HAVE_LIBZSTD
+  cdict_ = ZSTD_createCDict(data.data(), data.size(), level);
+  ddict_ = ZSTD_createDDict(data.data(), data.size());
+  if (!cdict_ || !ddict_) {
+    ZSTD_freeCDict(cdict_);
+    ZSTD_freeDDict(ddict_);
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Error while creating zstd dictionary");
+  }
+  id_ = ZSTD_getDictID_fromDDict(ddict_);
+#else
+  throw TTransportException(TTransportException::BAD_ARGS,
+                            "zstd support was not built in");
+#endif
+}
+
+ZstdDictionary::~ZstdDictionary() {
+#if THRIFT_HAVE_LIBZSTD
+  ZSTD_freeCDict(cdict_);
+  ZSTD_freeDDict(ddict_);
+#endif
+}
+
+namespace codec {
+
+namespace {
+
+// Output buffers for zlib grow from at least this size
+const size_t kMinZlibChunk = 1024;
+
+// zlib cannot expand its input by more than about this factor, so any
+// larger size hint is bogus
+const size_t kMaxZlibRatio = 1032;
+
+// Largest frame header zstd writes (ZSTD_FRAMEHEADERSIZE_MAX)
+const size_t kMaxZstdFrameHeader = 18;
+
+// How far the other codecs can expand their input.  Snappy copies at most 64
+// bytes per 3 byte tag, lz4 about 255 bytes per input byte, and a zstd RLE
+// block turns 4 bytes into 128KB.  Each is rounded up for slack.
+const size_t kMaxSnappyRatio = 32;
+const size_t kMaxLz4Ratio = 256;
+const size_t kMaxZstdRatio = 32768;
+
+const size_t kDefaultMaxUncompressedSize = 64 * 1024 * 1024;
+
+std::atomic<size_t> maxUncompressedSize(kDefaultMaxUncompressedSize);
+
+void checkUncompressedSize(uint64_t size, size_t compressedSize,
+                           size_t maxRatio, const char* codecName) {
+  if (size > maxUncompressedSize.load(std::memory_order_relaxed) ||
+      size > uint64_t(compressedSize) * maxRatio) {
+    throw TApplicationException(
+      TApplicationException::MISSING_RESULT,
+      folly::to<std::string>("Error in ", codecName, " decompress: size ",
+                             size, " is over the limit"));
+  }
+}
+
+/**
+ * Codec state for one thread.  Everything is created on first use and then
+ * reset, rather than re-created, for each message.
+ */
+class CodecContexts {
+ public:
+  CodecContexts()
+      : inflateReady_(false)
+      , deflateReady_(false) {
+  }
+
+  ~CodecContexts() {
+    if (inflateReady_) {
+      inflateEnd(&inflate_);
+    }
+    if (deflateReady_) {
+      deflateEnd(&deflate_);
+    }
+#if THRIFT_HAVE_LIBZSTD
+    ZSTD_freeCCtx(zstdCompress_);
+    ZSTD_freeDCtx(zstdUncompress_);
+#endif
+  }
+
+  z_stream* inflater() {
+    if (inflateReady_) {
+      if (inflateReset(&inflate_) == Z_OK) {
+        return &inflate_;
+      }
+      inflateEnd(&inflate_);
+      inflateReady_ = false;
+    }
+    initStream(&inflate_);
+    if (inflateInit(&inflate_) != Z_OK) {
+      throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                  "Error while zlib inflate Init");
+    }
+    inflateReady_ = true;
+    return &inflate_;
+  }
+
+  z_stream* deflater() {
+    if (deflateReady_) {
+      if (deflateReset(&deflate_) == Z_OK) {
+        return &deflate_;
+      }
+      deflateEnd(&deflate_);
+      deflateReady_ = false;
+    }
+    initStream(&deflate_);
+    if (deflateInit(&deflate_, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Error while zlib deflateInit");
+    }
+    deflateReady_ = true;
+    return &deflate_;
+  }
+
+#ifdef HAVE_QUICKLZ
+  qlz_state_compress* qlzCompressState() {
+    if (!qlzCompress_) {
+      qlzCompress_.reset(new qlz_state_compress);
+    }
+    return qlzCompress_.get();
+  }
+
+  qlz_state_decompress* qlzUncompressState() {
+    if (!qlzUncompress_) {
+      qlzUncompress_.reset(new qlz_state_decompress);
+    }
+    return qlzUncompress_.get();
+  }
+#endif
+
+#if THRIFT_HAVE_LIBLZ4
+  void* lz4State() {
+    if (!lz4State_) {
+      lz4State_.reset(new char[LZ4_sizeofState()]);
+    }
+    return lz4State_.get();
+  }
+#endif
+
+#if THRIFT_HAVE_LIBZSTD
+  ZSTD_CCtx* zstdCompressContext() {
+    if (!zstdCompress_) {
+      zstdCompress_ = ZSTD_createCCtx();
+    } else {
+      ZSTD_CCtx_reset(zstdCompress_, ZSTD_reset_session_and_parameters);
+    }
+    return zstdCompress_;
+  }
+
+  ZSTD_DCtx* zstdUncompressContext() {
+    if (!zstdUncompress_) {
+      zstdUncompress_ = ZSTD_createDCtx();
+    } else {
+      ZSTD_DCtx_reset(zstdUncompress_, ZSTD_reset_session_and_parameters);
+    }
+    return zstdUncompress_;
+  }
+#endif
+
+ private:
+  static void initStream(z_stream* stream) {
+    // Setting these to 0 means use the default free/alloc functions
+    stream->zalloc = (alloc_func)0;
+    stream->zfree = (free_func)0;
+    stream->opaque = (voidpf)0;
+    stream->next_in = nullptr;
+    stream->avail_in = 0;
+  }
+
+  z_stream inflate_;
+  z_stream deflate_;
+  bool inflateReady_;
+  bool deflateReady_;
+#ifdef HAVE_QUICKLZ
+  unique_ptr<qlz_state_compress> qlzCompress_;
+  unique_ptr<qlz_state_decompress> qlzUncompress_;
+#endif
+#if THRIFT_HAVE_LIBLZ4
+  unique_ptr<char[]> lz4State_;
+#endif
+#if THRIFT_HAVE_LIBZSTD
+  ZSTD_CCtx* zstdCompress_{nullptr};
+  ZSTD_DCtx* zstdUncompress_{nullptr};
+#endif
+};
+
+struct CodecContextsTag {};
+
+CodecContexts& contexts() {
+  // Leaked, like the contexts of threads still running at exit
+  static auto contexts = new folly::ThreadLocal<CodecContexts,
+                                                CodecContextsTag>();
+  return **contexts;
+}
+
+/**
+ * Returns a buffer at the end of out with room to write into, appending a
+ * new one of chunkSize bytes if the last one is full.
+ */
+IOBuf* writableTail(unique_ptr<IOBuf>& out, size_t chunkSize) {
+  if (out && out->prev()->tailroom() > 0) {
+    return out->prev();
+  }
+  unique_ptr<IOBuf> tmp(IOBuf::create(chunkSize));
+  IOBuf* tail = tmp.get();
+  if (out) {
+    // Add buffer to end (circular list, same as prepend)
+    out->prependChain(std::move(tmp));
+  } else {
+    out = std::move(tmp);
+  }
+  return tail;
+}
+
+/**
+ * Lets snappy read an IOBuf chain without coalescing it.
+ */
+class IOBufSnappySource : public snappy::Source {
+ public:
+  explicit IOBufSnappySource(const IOBuf* buf)
+      : cursor_(buf)
+      , available_(buf->computeChainDataLength()) {
+  }
+
+  size_t Available() const override {
+    return available_;
+  }
+
+  const char* Peek(size_t* len) override {
+    auto bytes = cursor_.peek();
+    *len = bytes.second;
+    return reinterpret_cast<const char*>(bytes.first);
+  }
+
+  void Skip(size_t n) override {
+    cursor_.skip(n);
+    available_ -= n;
+  }
+
+ private:
+  Cursor cursor_;
+  size_t available_;
+};
+
+} // anonymous namespace
+
+void setMaxUncompressedSize(size_t size) {
+  maxUncompressedSize.store(size, std::memory_order_relaxed);
+}
+
+size_t getMaxUncompressedSize() {
+  return maxUncompressedSize.load(std::memory_order_relaxed);
+}
+
+unique_ptr<IOBuf> zlibCompress(unique_ptr<IOBuf> buf) {
+  z_stream* stream = contexts().deflater();
+  size_t dataSize = buf->computeChainDataLength();
+  // Enough for all of the output unless zlib surprises us, in which case
+  // more chunks are added
+  size_t chunkSize = std::max<size_t>(deflateBound(stream, dataSize),
+                                      kMinZlibChunk);
+  unique_ptr<IOBuf> out;
+  int err = Z_OK;
+
+  IOBuf* current = buf.get();
+  do {
+    stream->next_in = const_cast<uint8_t*>(current->data());
+    stream->avail_in = current->length();
+    // When providing the last bit of input data, pass Z_FINISH to tell zlib
+    // it should flush out remaining compressed data and finish up with an
+    // end marker at the end of the output stream
+    bool last = current->next() == buf.get();
+    int flush = last ? Z_FINISH : Z_NO_FLUSH;
+    do {
+      IOBuf* tail = writableTail(out, chunkSize);
+      size_t room = tail->tailroom();
+      stream->next_out = tail->writableTail();
+      stream->avail_out = room;
+      err = deflate(stream, flush);
+      if (err == Z_STREAM_ERROR) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Error while zlib deflate");
+      }
+      tail->append(room - stream->avail_out);
+    } while (stream->avail_out == 0 && err != Z_STREAM_END);
+    current = current->next();
+  } while (current != buf.get());
+
+  if (err != Z_STREAM_END) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while zlib deflate");
+  }
+  return out;
+}
+
+unique_ptr<IOBuf> zlibUncompress(unique_ptr<IOBuf> buf, size_t sizeHint) {
+  z_stream* stream = contexts().inflater();
+  size_t compressedSize = buf->computeChainDataLength();
+  size_t chunkSize = sizeHint;
+  if (chunkSize == 0 || chunkSize > compressedSize * kMaxZlibRatio) {
+    // No (believable) hint; guess, and double as needed
+    chunkSize = compressedSize * 4;
+  }
+  chunkSize = std::max(chunkSize, kMinZlibChunk);
+  unique_ptr<IOBuf> out;
+  size_t produced = 0;
+  int err = Z_OK;
+
+  IOBuf* current = buf.get();
+  do {
+    stream->next_in = current->writableData();
+    stream->avail_in = current->length();
+    do {
+      IOBuf* tail = writableTail(out, std::max(chunkSize, produced));
+      size_t room = tail->tailroom();
+      stream->next_out = tail->writableTail();
+      stream->avail_out = room;
+      err = inflate(stream, Z_NO_FLUSH);
+      if (err == Z_STREAM_ERROR ||
+          err == Z_NEED_DICT ||
+          err == Z_DATA_ERROR ||
+          err == Z_MEM_ERROR) {
+        throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                    "Error while zlib inflate");
+      }
+      tail->append(room - stream->avail_out);
+      produced += room - stream->avail_out;
+    } while (stream->avail_out == 0 && err != Z_STREAM_END);
+    // try the next buffer
+    current = current->next();
+  } while (err != Z_STREAM_END && current != buf.get());
+
+  if (err != Z_STREAM_END) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Not enough zlib data in message");
+  }
+  if (!out) {
+    out = IOBuf::create(0);
+  }
+  return out;
+}
+
+unique_ptr<IOBuf> snappyCompress(unique_ptr<IOBuf> buf) {
+  size_t dataSize = buf->computeChainDataLength();
+  unique_ptr<IOBuf> out(IOBuf::create(snappy::MaxCompressedLength(dataSize)));
+  IOBufSnappySource source(buf.get());
+  snappy::UncheckedByteArraySink sink(
+    reinterpret_cast<char*>(out->writableData()));
+  size_t compressedSize = snappy::Compress(&source, &sink);
+  out->append(compressedSize);
+  return out;
+}
+
+unique_ptr<IOBuf> snappyUncompress(unique_ptr<IOBuf> buf) {
+  // The uncompressed length is a varint at the front of the data
+  char prefix[util::detail::kMaxVarintBytes];
+  size_t prefixSize = Cursor(buf.get()).pullAtMost(prefix, sizeof(prefix));
+  size_t uncompressedSize;
+  if (!snappy::GetUncompressedLength(prefix, prefixSize, &uncompressedSize)) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "snappy uncompress failure");
+  }
+  checkUncompressedSize(uncompressedSize, buf->computeChainDataLength(),
+                        kMaxSnappyRatio, "snappy");
+
+  unique_ptr<IOBuf> out(IOBuf::create(uncompressedSize));
+  out->append(uncompressedSize);
+  IOBufSnappySource source(buf.get());
+  if (!snappy::RawUncompress(&source,
+                             reinterpret_cast<char*>(out->writableData()))) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "snappy uncompress failure");
+  }
+  return out;
+}
+
+unique_ptr<IOBuf> qlzCompress(unique_ptr<IOBuf> buf) {
+  buf->coalesce(); // required by the QuickLZ format
+
+  // max is 400B greater than uncompressed size based on QuickLZ spec
+  size_t maxCompressedLength = buf->length() + 400;
+  unique_ptr<IOBuf> out(IOBuf::create(maxCompressedLength));
+
+#ifdef HAVE_QUICKLZ
+  const char *src = (const char *)buf->data();
+  char *dst = (char *)out->writableData();
+
+  size_t compressed_sz = qlz_compress(
+    src, dst, buf->length(), contexts().qlzCompressState());
+
+  if (compressed_sz > maxCompressedLength) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error in qlz compress");
+  }
+
+  out->append(compressed_sz);
+#endif
+  return out;
+}
+
+unique_ptr<IOBuf> qlzUncompress(unique_ptr<IOBuf> buf) {
+  buf->coalesce(); // required by the QuickLZ format
+#ifdef HAVE_QUICKLZ
+  const char *src = (const char *)buf->data();
+  size_t length = buf->length();
+  // according to QLZ spec, the size info is stored in first 9 bytes
+  if (length < 9 || qlz_size_compressed(src) != length) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Error in qlz decompress: bad size");
+  }
+
+  size_t uncompressed_sz = qlz_size_decompressed(src);
+
+  unique_ptr<IOBuf> out(IOBuf::create(uncompressed_sz));
+  out->append(uncompressed_sz);
+
+  bool success = (qlz_decompress(src,
+                                 out->writableData(),
+                                 contexts().qlzUncompressState())
+                  == uncompressed_sz);
+  if (!success) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Error in qlz decompress");
+  }
+  return out;
+#else
+  return buf;
+#endif
+}
+
+unique_ptr<IOBuf> lz4Compress(unique_ptr<IOBuf> buf) {
+#if THRIFT_HAVE_LIBLZ4
+  buf->coalesce(); // LZ4 blocks need contiguous input
+  if (buf->length() > LZ4_MAX_INPUT_SIZE) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Message too large for lz4");
+  }
+  int dataSize = buf->length();
+  int bound = LZ4_compressBound(dataSize);
+  unique_ptr<IOBuf> out(IOBuf::create(util::detail::kMaxVarintBytes + bound));
+  uint8_t* dst = out->writableData();
+  uint32_t prefixSize = util::writeVarint32(dataSize, dst);
+  int compressedSize = LZ4_compress_fast_extState(
+    contexts().lz4State(),
+    reinterpret_cast<const char*>(buf->data()),
+    reinterpret_cast<char*>(dst + prefixSize),
+    dataSize, bound, 1);
+  if (compressedSize <= 0) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error in lz4 compress");
+  }
+  out->append(prefixSize + compressedSize);
+  return out;
+#else
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            "lz4 support was not built in");
+#endif
+}
+
+unique_ptr<IOBuf> lz4Uncompress(unique_ptr<IOBuf> buf) {
+#if THRIFT_HAVE_LIBLZ4
+  buf->coalesce(); // LZ4 blocks need contiguous input
+  int32_t uncompressedSize;
+  uint32_t prefixSize = util::readVarint32(buf->data(), &uncompressedSize,
+                                           buf->tail());
+  if (uncompressedSize < 0) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Error in lz4 decompress: bad size");
+  }
+  checkUncompressedSize(uncompressedSize, buf->length() - prefixSize,
+                        kMaxLz4Ratio, "lz4");
+  unique_ptr<IOBuf> out(IOBuf::create(uncompressedSize));
+  int result = LZ4_decompress_safe(
+    reinterpret_cast<const char*>(buf->data() + prefixSize),
+    reinterpret_cast<char*>(out->writableData()),
+    buf->length() - prefixSize,
+    uncompressedSize);
+  if (result != uncompressedSize) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Error in lz4 decompress");
+  }
+  out->append(uncompressedSize);
+  return out;
+#else
+  throw TApplicationException(TApplicationException::MISSING_RESULT,
+                              "lz4 support was not built in");
+#endif
+}
+
+unique_ptr<IOBuf> zstdCompress(unique_ptr<IOBuf> buf,
+                               const ZstdDictionary* dict) {
+#if THRIFT_HAVE_LIBZSTD
+  ZSTD_CCtx* cctx = contexts().zstdCompressContext();
+  if (dict) {
+    ZSTD_CCtx_refCDict(cctx, dict->getCompressionDict());
+  } else {
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                           ZstdDictionary::kDefaultLevel);
+  }
+  size_t dataSize = buf->computeChainDataLength();
+  // Puts the size in the frame header, so the receiver can size its output
+  ZSTD_CCtx_setPledgedSrcSize(cctx, dataSize);
+
+  size_t bound = ZSTD_compressBound(dataSize);
+  unique_ptr<IOBuf> out(IOBuf::create(bound));
+  ZSTD_outBuffer output = {out->writableData(), bound, 0};
+
+  IOBuf* current = buf.get();
+  do {
+    bool last = current->next() == buf.get();
+    ZSTD_inBuffer input = {current->data(), current->length(), 0};
+    size_t remaining;
+    do {
+      remaining = ZSTD_compressStream2(cctx, &output, &input,
+                                       last ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError(remaining) ||
+          (remaining != 0 && output.pos == output.size)) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Error in zstd compress");
+      }
+    } while (last ? remaining != 0 : input.pos < input.size);
+    current = current->next();
+  } while (current != buf.get());
+
+  out->append(output.pos);
+  return out;
+#else
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            "zstd support was not built in");
+#endif
+}
+
+unique_ptr<IOBuf> zstdUncompress(unique_ptr<IOBuf> buf,
+                                 const ZstdDictionary* dict) {
+#if THRIFT_HAVE_LIBZSTD
+  uint8_t header[kMaxZstdFrameHeader];
+  size_t headerSize = Cursor(buf.get()).pullAtMost(header, sizeof(header));
+  unsigned long long uncompressedSize =
+    ZSTD_getFrameContentSize(header, headerSize);
+  if (uncompressedSize == ZSTD_CONTENTSIZE_ERROR ||
+      uncompressedSize == ZSTD_CONTENTSIZE_UNKNOWN) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Error in zstd decompress: bad size");
+  }
+  checkUncompressedSize(uncompressedSize, buf->computeChainDataLength(),
+                        kMaxZstdRatio, "zstd");
+
+  ZSTD_DCtx* dctx = contexts().zstdUncompressContext();
+  if (dict) {
+    ZSTD_DCtx_refDDict(dctx, dict->getDecompressionDict());
+  }
+  unique_ptr<IOBuf> out(IOBuf::create(uncompressedSize));
+  ZSTD_outBuffer output = {out->writableData(), uncompressedSize, 0};
+
+  size_t remaining = 1;
+  IOBuf* current = buf.get();
+  do {
+    ZSTD_inBuffer input = {current->data(), current->length(), 0};
+    while (input.pos < input.size && remaining != 0) {
+      remaining = ZSTD_decompressStream(dctx, &output, &input);
+      if (ZSTD_isError(remaining)) {
+        throw TApplicationException(
+          TApplicationException::MISSING_RESULT,
+          std::string("Error in zstd decompress: ") +
+            ZSTD_getErrorName(remaining));
+      }
+    }
+    current = current->next();
+  } while (remaining != 0 && current != buf.get());
+
+  if (remaining != 0 || output.pos != uncompressedSize) {
+    throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                "Not enough zstd data in message");
+  }
+  out->append(output.pos);
+  return out;
+#else
+  throw TApplicationException(TApplicationException::MISSING_RESULT,
+                              "zstd support was not built in");
+#endif
+}
+
+} // codec
+
+}}} // apache::thrift::transport
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_TRANSPORT_THEADERCODECS_H_
+#define THRIFT_TRANSPORT_THEADERCODECS_H_ 1
+
+#include <memory>
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace apache { namespace thrift { namespace transport {
+
+/**
+ * A zstd dictionary, usually trained offline (zstd --train) on samples of
+ * the messages a service sends.  Small, repetitive messages compress far
+ * better against a dictionary than on their own.
+ *
+ * Both peers must be configured with the same dictionary; zstd frames
+ * record the id of the dictionary they were compressed with, and
+ * uncompressing with a different one fails.
+ *
+ * Dictionaries are immutable and may be shared by any number of threads
+ * and connections.
+ */
+class ZstdDictionary {
+ public:
+  static const int kDefaultLevel = 3;
+
+  explicit ZstdDictionary(folly::ByteRange data, int level = kDefaultLevel);
+  ~ZstdDictionary();
+
+  ZstdDictionary(const ZstdDictionary&) = delete;
+  ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+
+  uint32_t getId() const {
+    return id_;
+  }
+
+  const ZSTD_CDict_s* getCompressionDict() const {
+    return cdict_;
+  }
+
+  const ZSTD_DDict_s* getDecompressionDict() const {
+    return ddict_;
+  }
+
+ private:
+  ZSTD_CDict_s* cdict_;
+  ZSTD_DDict_s* ddict_;
+  uint32_t id_;
+};
+
+/**
+ * The codecs behind THeader's compression transforms.
+ *
+ * Codec state (zlib streams, QuickLZ, LZ4 and zstd contexts) is kept per
+ * thread and reset between messages instead of being allocated and
+ * initialized for each one.
+ *
+ * Compressing throws TTransportException, uncompressing throws
+ * TApplicationException, as THeader always has.
+ */
+namespace codec {
+
+/**
+ * Snappy, LZ4 and zstd read the uncompressed size from the peer's data.
+ * Sizes above this limit, or more than each codec can expand its compressed
+ * input by, are rejected before anything is allocated, so a few bytes on the
+ * wire cannot force a huge allocation.  Defaults to 64MB.
+ */
+void setMaxUncompressedSize(size_t size);
+size_t getMaxUncompressedSize();
+
+std::unique_ptr<folly::IOBuf> zlibCompress(std::unique_ptr<folly::IOBuf> buf);
+
+/**
+ * sizeHint is the expected uncompressed size, or 0 if unknown.  With a
+ * correct hint the output is a single buffer.
+ */
+std::unique_ptr<folly::IOBuf> zlibUncompress(std::unique_ptr<folly::IOBuf> buf,
+                                             size_t sizeHint);
+
+// Snappy reads chained input in place; it is not coalesced first.
+std::unique_ptr<folly::IOBuf> snappyCompress(
+  std::unique_ptr<folly::IOBuf> buf);
+std::unique_ptr<folly::IOBuf> snappyUncompress(
+  std::unique_ptr<folly::IOBuf> buf);
+
+std::unique_ptr<folly::IOBuf> qlzCompress(std::unique_ptr<folly::IOBuf> buf);
+std::unique_ptr<folly::IOBuf> qlzUncompress(std::unique_ptr<folly::IOBuf> buf);
+
+// An LZ4 block, prefixed with its uncompressed size as a varint.
+std::unique_ptr<folly::IOBuf> lz4Compress(std::unique_ptr<folly::IOBuf> buf);
+std::unique_ptr<folly::IOBuf> lz4Uncompress(std::unique_ptr<folly::IOBuf> buf);
+
+// A single zstd frame that records its uncompressed size.  dict may be null.
+std::unique_ptr<folly::IOBuf> zstdCompress(std::unique_ptr<folly::IOBuf> buf,
+                                           const ZstdDictionary* dict);
+std::unique_ptr<folly::IOBuf> zstdUncompress(std::unique_ptr<folly::IOBuf> buf,
+                                             const ZstdDictionary* dict);
+
+} // codec
+
+}}} // apache::thrift::transport
+
+#endif // #ifndef THRIFT_TRANSPORT_THEADERCODECS_H_
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/transport/THeaderMap.h>
+
+#include <algorithm>
+#include <cstring>
+
+using folly::IOBuf;
+using folly::StringPiece;
+using std::map;
+using std::string;
+using std::unique_ptr;
+
+namespace apache { namespace thrift { namespace transport {
+
+namespace {
+
+// Indexed by THeaderMap::Key; these must match the names THeader and the
+// servers use.
+const StringPiece kKeyNames[] = {
+  StringPiece(),
+  StringPiece("load"),
+  StringPiece("thrift_priority"),
+  StringPiece("client_timeout"),
+  StringPiece("thrift_auth"),
+  StringPiece("identity"),
+  StringPiece("id_version"),
+  StringPiece("uncompressed_size"),
+};
+
+const size_t kNumKeys = sizeof(kKeyNames) / sizeof(kKeyNames[0]);
+
+// Copies are carved out of buffers of at least this size
+const size_t kArenaSize = 256;
+
+}
+
+THeaderMap::THeaderMap(const map<string, string>& headers)
+    : arena_(nullptr) {
+  for (const auto& it : headers) {
+    set(it.first, it.second);
+  }
+}
+
+THeaderMap::THeaderMap(const THeaderMap& other)
+    : entries_(other.entries_)
+    , storage_(other.storage_ ? other.storage_->clone() : nullptr)
+    , arena_(nullptr) {
+}
+
+THeaderMap& THeaderMap::operator=(const THeaderMap& other) {
+  if (this != &other) {
+    entries_ = other.entries_;
+    storage_ = other.storage_ ? other.storage_->clone() : nullptr;
+    arena_ = nullptr;
+  }
+  return *this;
+}
+
+THeaderMap::THeaderMap(THeaderMap&& other) noexcept
+    : entries_(std::move(other.entries_))
+    , storage_(std::move(other.storage_))
+    , arena_(other.arena_) {
+  other.entries_.clear();
+  other.arena_ = nullptr;
+}
+
+THeaderMap& THeaderMap::operator=(THeaderMap&& other) noexcept {
+  if (this != &other) {
+    entries_ = std::move(other.entries_);
+    storage_ = std::move(other.storage_);
+    arena_ = other.arena_;
+    other.entries_.clear();
+    other.arena_ = nullptr;
+  }
+  return *this;
+}
+
+THeaderMap::Key THeaderMap::lookupKey(StringPiece key) {
+  for (size_t i = 1; i < kNumKeys; ++i) {
+    if (key == kKeyNames[i]) {
+      return static_cast<Key>(i);
+    }
+  }
+  return Key::OTHER;
+}
+
+StringPiece THeaderMap::keyName(Key key) {
+  return kKeyNames[static_cast<size_t>(key)];
+}
+
+void THeaderMap::retain(unique_ptr<IOBuf> buf) {
+  if (storage_) {
+    storage_->prependChain(std::move(buf));
+  } else {
+    storage_ = std::move(buf);
+  }
+}
+
+THeaderMap::Entry* THeaderMap::findEntry(StringPiece key, Key known) {
+  for (auto& entry : entries_) {
+    if (known != Key::OTHER ? entry.known == known : entry.key == key) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void THeaderMap::addView(StringPiece key, StringPiece value) {
+  auto known = lookupKey(key);
+  auto entry = findEntry(key, known);
+  if (entry) {
+    entry->value = value;
+  } else {
+    entries_.push_back(Entry{key, value, known});
+  }
+}
+
+StringPiece THeaderMap::copy(StringPiece s) {
+  if (s.empty()) {
+    return StringPiece();
+  }
+  if (!arena_ || arena_->tailroom() < s.size()) {
+    auto buf = IOBuf::create(std::max(s.size(), kArenaSize));
+    arena_ = buf.get();
+    retain(std::move(buf));
+  }
+  auto p = arena_->writableTail();
+  memcpy(p, s.data(), s.size());
+  arena_->append(s.size());
+  return StringPiece(reinterpret_cast<const char*>(p), s.size());
+}
+
+void THeaderMap::set(StringPiece key, StringPiece value) {
+  auto known = lookupKey(key);
+  auto entry = findEntry(key, known);
+  if (entry) {
+    entry->value = copy(value);
+  } else {
+    auto k = known != Key::OTHER ? keyName(known) : copy(key);
+    entries_.push_back(Entry{k, copy(value), known});
+  }
+}
+
+void THeaderMap::setIfAbsent(StringPiece key, StringPiece value) {
+  if (!findEntry(key, lookupKey(key))) {
+    set(key, value);
+  }
+}
+
+const StringPiece* THeaderMap::find(StringPiece key) const {
+  auto entry = const_cast<THeaderMap*>(this)->findEntry(key, lookupKey(key));
+  return entry ? &entry->value : nullptr;
+}
+
+const StringPiece* THeaderMap::find(Key key) const {
+  auto entry = const_cast<THeaderMap*>(this)->findEntry(keyName(key), key);
+  return entry ? &entry->value : nullptr;
+}
+
+void THeaderMap::eraseAt(Entry* entry) {
+  entries_.erase(entries_.begin() + (entry - &entries_[0]));
+}
+
+bool THeaderMap::erase(StringPiece key) {
+  auto entry = findEntry(key, lookupKey(key));
+  if (entry) {
+    eraseAt(entry);
+  }
+  return entry != nullptr;
+}
+
+bool THeaderMap::erase(Key key) {
+  auto entry = findEntry(keyName(key), key);
+  if (entry) {
+    eraseAt(entry);
+  }
+  return entry != nullptr;
+}
+
+void THeaderMap::clear() {
+  entries_.clear();
+  storage_.reset();
+  arena_ = nullptr;
+}
+
+map<string, string> THeaderMap::toMap() const {
+  map<string, string> headers;
+  for (const auto& entry : entries_) {
+    headers[entry.key.str()] = entry.value.str();
+  }
+  return headers;
+}
+
+}}} // apache::thrift::transport
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_TRANSPORT_THEADERMAP_H_
+#define THRIFT_TRANSPORT_THEADERMAP_H_ 1
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <folly/small_vector.h>
+
+namespace apache { namespace thrift { namespace transport {
+
+/**
+ * THeaderMap holds the key/value info headers of a received message.
+ *
+ * Keys and values are StringPieces.  When possible they point directly
+ * into the frame the headers were parsed from, which the map keeps alive
+ * with a shared (refcounted) clone; otherwise they are copied into a small
+ * arena owned by the map.  Either way, parsing a frame costs at most a
+ * couple of allocations no matter how many headers it carries, and copying
+ * a map only copies the entry array and bumps the buffer refcounts.
+ *
+ * Keys that the library itself looks at are interned: looking them up by
+ * Key compares a single byte instead of the string.
+ *
+ * Entries keep insertion order.  Lookups are linear, which beats a tree for
+ * the handful of headers a request normally carries.
+ */
+class THeaderMap {
+ public:
+  enum class Key : uint8_t {
+    OTHER = 0,
+    LOAD,
+    PRIORITY,
+    CLIENT_TIMEOUT,
+    AUTH,
+    IDENTITY,
+    ID_VERSION,
+    UNCOMPRESSED_SIZE,
+  };
+
+  struct Entry {
+    folly::StringPiece key;
+    folly::StringPiece value;
+    Key known;
+  };
+
+  typedef folly::small_vector<Entry, 4> Entries;
+  typedef Entries::const_iterator const_iterator;
+
+  THeaderMap() : arena_(nullptr) {}
+  explicit THeaderMap(const std::map<std::string, std::string>& headers);
+
+  THeaderMap(const THeaderMap& other);
+  THeaderMap& operator=(const THeaderMap& other);
+  THeaderMap(THeaderMap&& other) noexcept;
+  THeaderMap& operator=(THeaderMap&& other) noexcept;
+
+  /**
+   * Returns the interned id of key, or Key::OTHER.
+   */
+  static Key lookupKey(folly::StringPiece key);
+
+  /**
+   * Returns the name of an interned key.
+   */
+  static folly::StringPiece keyName(Key key);
+
+  /**
+   * Keep buf (and anything chained to it) alive for as long as this map
+   * or any copy of it.  Entries added with addView() may point into it.
+   */
+  void retain(std::unique_ptr<folly::IOBuf> buf);
+
+  /**
+   * Add an entry whose key and value point into memory kept alive by
+   * retain().  Replaces any existing entry with the same key.
+   */
+  void addView(folly::StringPiece key, folly::StringPiece value);
+
+  /**
+   * Add an entry, copying key and value.  Replaces any existing entry with
+   * the same key.
+   */
+  void set(folly::StringPiece key, folly::StringPiece value);
+
+  /**
+   * Like set(), but leaves an existing entry alone.
+   */
+  void setIfAbsent(folly::StringPiece key, folly::StringPiece value);
+
+  /**
+   * Returns the value for key, or nullptr.  The pointer is invalidated by
+   * any modification of the map.
+   */
+  const folly::StringPiece* find(folly::StringPiece key) const;
+  const folly::StringPiece* find(Key key) const;
+
+  bool erase(folly::StringPiece key);
+  bool erase(Key key);
+
+  void clear();
+
+  bool empty() const {
+    return entries_.empty();
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  const_iterator begin() const {
+    return entries_.begin();
+  }
+
+  const_iterator end() const {
+    return entries_.end();
+  }
+
+  /**
+   * Compatibility accessor for code that wants a std::map.  This copies
+   * every header.
+   */
+  std::map<std::string, std::string> toMap() const;
+
+ private:
+  Entry* findEntry(folly::StringPiece key, Key known);
+  void eraseAt(Entry* entry);
+  folly::StringPiece copy(folly::StringPiece s);
+
+  Entries entries_;
+  // Every buffer entries may point into
+  std::unique_ptr<folly::IOBuf> storage_;
+  // Buffer in storage_ that copies are appended to, nullptr if none
+  folly::IOBuf* arena_;
+};
+
+}}} // apache::thrift::transport
+
+#endif // #ifndef THRIFT_TRANSPORT_THEADERMAP_H_
@@ -17,10 +17,13 @@
  * under the License.
  */
 
+#include <thrift/lib/cpp/thrift_config.h>
+#include <thrift/lib/cpp/TApplicationException.h>
 #include <thrift/lib/cpp/transport/THeader.h>
 
 #include <boost/test/unit_test.hpp>
 #include <memory>
+#include <vector>
 #include <folly/io/IOBuf.h>
 #include <folly/io/IOBufQueue.h>
 
@@ -67,6 +70,208 @@ BOOST_AUTO_TEST_CASE(http_clear_header) {
   BOOST_CHECK(!header.getPersistentWriteHeaders().empty());
 }
 
+BOOST_AUTO_TEST_CASE(read_header_map) {
+  THeader writer;
+  writer.setHeader("load", "cpu");
+  writer.setHeader("custom", "value");
+  writer.setCallPriority(concurrency::HIGH);
+
+  std::unique_ptr<IOBuf> buf(IOBuf::create(16));
+  buf->append(16);
+  buf = writer.addHeader(std::move(buf));
+  IOBufQueue queue;
+  queue.append(std::move(buf));
+
+  THeader reader;
+  size_t needed;
+  buf = reader.removeHeader(&queue, needed);
+  BOOST_REQUIRE(buf);
+
+  THeaderMap copy;
+  {
+    const auto& headers = reader.getHeaderMap();
+    BOOST_CHECK_EQUAL(3, headers.size());
+    auto load = headers.find(THeaderMap::Key::LOAD);
+    BOOST_REQUIRE(load);
+    BOOST_CHECK_EQUAL("cpu", load->str());
+    auto custom = headers.find("custom");
+    BOOST_REQUIRE(custom);
+    BOOST_CHECK_EQUAL("value", custom->str());
+    BOOST_CHECK(!headers.find("missing"));
+    copy = headers;
+  }
+  BOOST_CHECK_EQUAL(concurrency::HIGH, reader.getCallPriority());
+
+  // Compatibility accessor
+  const auto& map = reader.getHeaders();
+  BOOST_CHECK_EQUAL(3, map.size());
+  BOOST_CHECK_EQUAL("value", map.at("custom"));
+
+  // A copy stays valid after the frame and the reader are gone
+  buf.reset();
+  reader.releaseHeaders();
+  BOOST_CHECK(reader.getHeaderMap().empty());
+  BOOST_CHECK_EQUAL("cpu", copy.find("load")->str());
+}
+
+BOOST_AUTO_TEST_CASE(header_map_set) {
+  THeaderMap headers;
+  headers.set("a", "1");
+  headers.set("client_timeout", "100");
+  headers.set("a", "2");
+  headers.setIfAbsent("a", "3");
+  BOOST_CHECK_EQUAL(2, headers.size());
+  BOOST_CHECK_EQUAL("2", headers.find("a")->str());
+  BOOST_CHECK_EQUAL("100",
+                    headers.find(THeaderMap::Key::CLIENT_TIMEOUT)->str());
+
+  THeaderMap copy(headers);
+  headers.set("a", "4");
+  BOOST_CHECK(headers.erase(THeaderMap::Key::CLIENT_TIMEOUT));
+  BOOST_CHECK_EQUAL("2", copy.find("a")->str());
+  BOOST_CHECK_EQUAL(2, copy.size());
+
+  THeaderMap moved(std::move(headers));
+  BOOST_CHECK_EQUAL("4", moved.find("a")->str());
+  BOOST_CHECK_EQUAL(1, moved.toMap().size());
+}
+
+// A repetitive payload split over several buffers
+static std::unique_ptr<IOBuf> makeChainedPayload() {
+  std::string record = "{\"id\": 12345, \"status\": \"ok\", \"items\": []}";
+  std::unique_ptr<IOBuf> chain;
+  for (int i = 0; i < 8; ++i) {
+    std::string part;
+    for (int j = 0; j < 100; ++j) {
+      part += record;
+    }
+    auto buf = IOBuf::copyBuffer(part);
+    if (chain) {
+      chain->prependChain(std::move(buf));
+    } else {
+      chain = std::move(buf);
+    }
+  }
+  return chain;
+}
+
+static void checkRoundTrip(uint16_t transId,
+                           const ZstdDictionary* dict = nullptr) {
+  auto payload = makeChainedPayload();
+  auto expected = payload->clone();
+  expected->coalesce();
+  size_t size = payload->computeChainDataLength();
+
+  std::vector<uint16_t> trans{transId};
+  auto compressed = THeader::transform(std::move(payload), trans, 0, dict);
+  BOOST_CHECK_EQUAL(1, trans.size());
+  BOOST_CHECK_LT(compressed->computeChainDataLength(), size);
+
+  auto out = THeader::untransform(std::move(compressed), trans, size, dict);
+  out->coalesce();
+  BOOST_CHECK_EQUAL(expected->length(), out->length());
+  BOOST_CHECK(memcmp(expected->data(), out->data(), out->length()) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(transform_round_trip) {
+  checkRoundTrip(THeader::ZLIB_TRANSFORM);
+  checkRoundTrip(THeader::SNAPPY_TRANSFORM);
+#if THRIFT_HAVE_LIBLZ4
+  checkRoundTrip(THeader::LZ4_TRANSFORM);
+#endif
+#if THRIFT_HAVE_LIBZSTD
+  checkRoundTrip(THeader::ZSTD_TRANSFORM);
+#endif
+
+  // Contexts are reused, including after a failure
+  std::vector<uint16_t> trans{THeader::ZLIB_TRANSFORM};
+  BOOST_CHECK_THROW(THeader::untransform(IOBuf::copyBuffer("garbage"), trans),
+                    TApplicationException);
+  checkRoundTrip(THeader::ZLIB_TRANSFORM);
+}
+
+static void checkSizeLimit(uint16_t transId) {
+  auto payload = makeChainedPayload();
+  size_t size = payload->computeChainDataLength();
+  std::vector<uint16_t> trans{transId};
+  auto compressed = THeader::transform(std::move(payload), trans, 0, nullptr);
+
+  size_t oldLimit = codec::getMaxUncompressedSize();
+  codec::setMaxUncompressedSize(size - 1);
+  BOOST_CHECK_THROW(THeader::untransform(compressed->clone(), trans),
+                    TApplicationException);
+  codec::setMaxUncompressedSize(size);
+  BOOST_CHECK_EQUAL(size, THeader::untransform(compressed->clone(), trans)
+                          ->computeChainDataLength());
+  codec::setMaxUncompressedSize(oldLimit);
+}
+
+BOOST_AUTO_TEST_CASE(uncompressed_size_limit) {
+  BOOST_CHECK_EQUAL(size_t(64 * 1024 * 1024),
+                    codec::getMaxUncompressedSize());
+  checkSizeLimit(THeader::SNAPPY_TRANSFORM);
+
+  // A 32MB size prefix is under the limit, but far more than five bytes of
+  // snappy data can expand to
+  const uint8_t bogusSnappy[] = {0x80, 0x80, 0x80, 0x10, 0x00};
+  std::vector<uint16_t> snappyTrans{THeader::SNAPPY_TRANSFORM};
+  BOOST_CHECK_THROW(
+    THeader::untransform(IOBuf::copyBuffer(bogusSnappy, sizeof(bogusSnappy)),
+                         snappyTrans),
+    TApplicationException);
+#if THRIFT_HAVE_LIBLZ4
+  checkSizeLimit(THeader::LZ4_TRANSFORM);
+
+  // A 2GB size prefix with no data behind it is rejected before allocating
+  const uint8_t bogus[] = {0xff, 0xff, 0xff, 0xff, 0x07, 0x00};
+  std::vector<uint16_t> trans{THeader::LZ4_TRANSFORM};
+  BOOST_CHECK_THROW(
+    THeader::untransform(IOBuf::copyBuffer(bogus, sizeof(bogus)), trans),
+    TApplicationException);
+#endif
+#if THRIFT_HAVE_LIBZSTD
+  checkSizeLimit(THeader::ZSTD_TRANSFORM);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(zlib_size_hint) {
+  THeader writer;
+  writer.setTransform(THeader::ZLIB_TRANSFORM);
+  auto payload = makeChainedPayload();
+  size_t size = payload->computeChainDataLength();
+  auto buf = writer.addHeader(std::move(payload));
+  IOBufQueue queue;
+  queue.append(std::move(buf));
+
+  THeader reader;
+  size_t needed;
+  buf = reader.removeHeader(&queue, needed);
+  BOOST_REQUIRE(buf);
+  // The hint was used to size the output, and is not exposed as a header
+  BOOST_CHECK(!buf->isChained());
+  BOOST_CHECK_EQUAL(size, buf->length());
+  BOOST_CHECK(reader.getHeaderMap().empty());
+}
+
+#if THRIFT_HAVE_LIBZSTD
+BOOST_AUTO_TEST_CASE(zstd_dictionary) {
+  // Any content works as a dictionary; trained ones just work better
+  std::string content;
+  for (int i = 0; i < 100; ++i) {
+    content += "{\"id\": 12345, \"status\": \"ok\", \"items\": []}";
+  }
+  auto data = ByteRange(StringPiece(content));
+  ZstdDictionary dict(data);
+  checkRoundTrip(THeader::ZSTD_TRANSFORM, &dict);
+
+  std::vector<uint16_t> trans{THeader::ZSTD_TRANSFORM};
+  auto compressed = THeader::transform(makeChainedPayload(), trans, 0, &dict);
+  auto plain = THeader::transform(makeChainedPayload(), trans, 0);
+  BOOST_CHECK_LT(compressed->computeChainDataLength(),
+                 plain->computeChainDataLength());
+}
+#endif
+
 boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[]) {
   boost::unit_test::framework::master_test_suite().p_name.value =
     "THeaderTest";
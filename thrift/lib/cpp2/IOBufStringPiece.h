@@ -0,0 +1,198 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFT_IOBUF_STRING_PIECE_H_
+#define THRIFT_IOBUF_STRING_PIECE_H_
+
+#include <memory>
+#include <string>
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+
+namespace apache { namespace thrift {
+
+/**
+ * A read-only string that refers to bytes held by an IOBuf instead of owning
+ * a copy of them.
+ *
+ * cpp2 protocol readers fill an IOBufStringPiece by cloning the part of the
+ * input buffer that holds the string, so deserializing it copies no string
+ * bytes.  The string keeps a reference to the input buffer, so it stays
+ * valid for as long as the IOBufStringPiece does, provided the input buffer
+ * manages its own memory (as the buffers given to ThriftServer handlers do).
+ * A string that spans more than one buffer in the input chain is coalesced
+ * into a single buffer, which does copy it.
+ *
+ * Use it for string or binary fields with
+ *
+ *   typedef string (cpp2.type = "apache::thrift::IOBufStringPiece") StringPiece
+ *
+ * Since the whole input buffer is kept alive, holding on to a small piece of
+ * a large request for a long time wastes memory; call str() to make an owned
+ * copy instead.
+ */
+class IOBufStringPiece {
+ public:
+  typedef const char* const_iterator;
+  typedef const char* iterator;
+  typedef char value_type;
+
+  IOBufStringPiece() {}
+
+  /**
+   * Copy str into a new buffer.
+   */
+  /* implicit */ IOBufStringPiece(folly::StringPiece str) {
+    if (!str.empty()) {
+      reset(folly::IOBuf::copyBuffer(str.data(), str.size()));
+    }
+  }
+  /* implicit */ IOBufStringPiece(const std::string& str)
+    : IOBufStringPiece(folly::StringPiece(str)) {}
+  /* implicit */ IOBufStringPiece(const char* str)
+    : IOBufStringPiece(folly::StringPiece(str)) {}
+
+  /**
+   * Refer to the contents of buf, without copying them unless buf is a
+   * chain.
+   */
+  explicit IOBufStringPiece(std::unique_ptr<folly::IOBuf> buf) {
+    reset(std::move(buf));
+  }
+
+  // Copies share the underlying buffer
+  IOBufStringPiece(const IOBufStringPiece& other)
+    : buf_(other.buf_ ? other.buf_->clone() : nullptr)
+    , piece_(other.piece_) {}
+
+  IOBufStringPiece(IOBufStringPiece&& other) noexcept
+    : buf_(std::move(other.buf_))
+    , piece_(other.piece_) {
+    other.piece_.clear();
+  }
+
+  IOBufStringPiece& operator=(const IOBufStringPiece& other) {
+    if (this != &other) {
+      buf_ = other.buf_ ? other.buf_->clone() : nullptr;
+      piece_ = other.piece_;
+    }
+    return *this;
+  }
+
+  IOBufStringPiece& operator=(IOBufStringPiece&& other) noexcept {
+    buf_ = std::move(other.buf_);
+    piece_ = other.piece_;
+    other.piece_.clear();
+    return *this;
+  }
+
+  void reset(std::unique_ptr<folly::IOBuf> buf) {
+    buf_ = std::move(buf);
+    if (!buf_) {
+      piece_.clear();
+      return;
+    }
+    if (buf_->isChained()) {
+      buf_->coalesce();
+    }
+    piece_.reset(reinterpret_cast<const char*>(buf_->data()),
+                 buf_->length());
+  }
+
+  void clear() {
+    buf_.reset();
+    piece_.clear();
+  }
+
+  const char* data() const {
+    return piece_.data();
+  }
+
+  size_t size() const {
+    return piece_.size();
+  }
+
+  bool empty() const {
+    return piece_.empty();
+  }
+
+  const_iterator begin() const {
+    return piece_.begin();
+  }
+
+  const_iterator end() const {
+    return piece_.end();
+  }
+
+  folly::StringPiece piece() const {
+    return piece_;
+  }
+
+  /* implicit */ operator folly::StringPiece() const {
+    return piece_;
+  }
+
+  /**
+   * Return an owned copy of the string.
+   */
+  std::string str() const {
+    return piece_.str();
+  }
+
+  /**
+   * Return the buffer holding the string, or nullptr if the string is empty.
+   */
+  const folly::IOBuf* getIOBuf() const {
+    return buf_.get();
+  }
+
+ private:
+  std::unique_ptr<folly::IOBuf> buf_;
+  folly::StringPiece piece_;
+};
+
+inline bool operator==(const IOBufStringPiece& lhs,
+                       const IOBufStringPiece& rhs) {
+  return lhs.piece() == rhs.piece();
+}
+
+inline bool operator!=(const IOBufStringPiece& lhs,
+                       const IOBufStringPiece& rhs) {
+  return lhs.piece() != rhs.piece();
+}
+
+inline bool operator<(const IOBufStringPiece& lhs,
+                      const IOBufStringPiece& rhs) {
+  return lhs.piece() < rhs.piece();
+}
+
+}} // apache::thrift
+
+namespace std {
+
+template <>
+struct hash<apache::thrift::IOBufStringPiece> {
+  size_t operator()(const apache::thrift::IOBufStringPiece& str) const {
+    return folly::StringPieceHash()(str.piece());
+  }
+};
+
+}
+
+#endif // #ifndef THRIFT_IOBUF_STRING_PIECE_H_
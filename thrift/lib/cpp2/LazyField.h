@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFT_LAZY_FIELD_H_
+#define THRIFT_LAZY_FIELD_H_
+
+#include <memory>
+#include <utility>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <thrift/lib/cpp2/CloneableIOBuf.h>
+#include <thrift/lib/cpp2/protocol/Protocol.h>
+
+#include <glog/logging.h>
+
+namespace apache { namespace thrift {
+
+/**
+ * Storage for a struct or container field annotated with (cpp.lazy).
+ *
+ * When the enclosing struct is read, the field's value is not decoded;
+ * the reader only records the range of the input buffer that holds it
+ * (sharing the input IOBuf, so nothing is copied).  The value is decoded
+ * the first time it is accessed through the generated get_<field>() or
+ * mutable_<field>() accessor.  A field that was never decoded is written
+ * back by copying the recorded bytes through, as long as the output
+ * protocol is the one it was read with; otherwise it is decoded and
+ * serialized normally.
+ *
+ * Decoding from a const accessor modifies the field, so a struct with lazy
+ * fields must not be read from several threads at once unless each lazy
+ * field has already been accessed.
+ */
+template <class T>
+class LazyField {
+ public:
+  /**
+   * Decodes the recorded bytes, written with the given protocol, into the
+   * value.  Generated per field.
+   */
+  typedef void (*Loader)(ProtocolType, const folly::IOBuf*, T&);
+
+  LazyField() : protocol_(ProtocolType::T_BINARY_PROTOCOL) {}
+
+  /* implicit */ LazyField(T value)
+    : value_(std::move(value))
+    , protocol_(ProtocolType::T_BINARY_PROTOCOL) {}
+
+  LazyField& operator=(T value) {
+    value_ = std::move(value);
+    serialized_.reset();
+    return *this;
+  }
+
+  /**
+   * True if the field holds undecoded bytes.
+   */
+  bool isSerialized() const {
+    return serialized_ != nullptr;
+  }
+
+  ProtocolType getProtocolType() const {
+    return protocol_;
+  }
+
+  const std::unique_ptr<folly::IOBuf>& getSerialized() const {
+    return serialized_;
+  }
+
+  /**
+   * Skip over the field's value in iprot, recording the bytes skipped.
+   */
+  template <class Protocol_>
+  uint32_t readSerialized(Protocol_* iprot, protocol::TType ftype) {
+    folly::io::Cursor begin = iprot->getCurrentPosition();
+    uint32_t xfer = iprot->skip(ftype);
+    std::unique_ptr<folly::IOBuf> buf;
+    begin.clone(buf, iprot->getCurrentPosition() - begin);
+    value_ = T();
+    serialized_ = std::move(buf);
+    protocol_ = iprot->protocolType();
+    return xfer;
+  }
+
+  /**
+   * Decode the recorded bytes, if any, and release them.
+   */
+  void load(Loader loader) const {
+    if (serialized_) {
+      loader(protocol_, serialized_.get(), value_);
+      serialized_.reset();
+    }
+  }
+
+  /**
+   * The decoded value.  load() must have been called.
+   */
+  const T& value() const {
+    DCHECK(!serialized_);
+    return value_;
+  }
+
+  T& value() {
+    DCHECK(!serialized_);
+    return value_;
+  }
+
+  void clear() {
+    value_ = T();
+    serialized_.reset();
+  }
+
+  void swap(LazyField& other) {
+    using std::swap;
+    swap(value_, other.value_);
+    swap(serialized_, other.serialized_);
+    swap(protocol_, other.protocol_);
+  }
+
+ private:
+  mutable T value_;
+  mutable CloneableIOBuf serialized_;
+  ProtocolType protocol_;
+};
+
+template <class T>
+void swap(LazyField<T>& lhs, LazyField<T>& rhs) {
+  lhs.swap(rhs);
+}
+
+}} // apache::thrift
+
+#endif // #ifndef THRIFT_LAZY_FIELD_H_
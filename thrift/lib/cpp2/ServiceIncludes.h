@@ -12,10 +12,13 @@
 #include <thrift/lib/cpp2/async/HeaderClientChannel.h>
 #include <thrift/lib/cpp/async/TEventBaseManager.h>
 #include <thrift/lib/cpp2/server/Cpp2ConnContext.h>
+#include <folly/FBString.h>
+#include <folly/Range.h>
 #include <folly/ScopeGuard.h>
 #include <thrift/lib/cpp/TProcessor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/io/IOBufQueue.h>
+#include <cstring>
 #include <unordered_map>
 #include <unordered_set>
 
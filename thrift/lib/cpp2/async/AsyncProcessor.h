@@ -21,6 +21,7 @@
 #include <thrift/lib/cpp/async/TEventBase.h>
 #include <thrift/lib/cpp/transport/THeader.h>
 #include <thrift/lib/cpp/concurrency/Thread.h>
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 #include <thrift/lib/cpp/TApplicationException.h>
 #include <thrift/lib/cpp/protocol/TProtocolTypes.h>
@@ -267,7 +268,7 @@ class GeneratedAsyncProcessor : public AsyncProcessor {
  * .release() the unique_ptr on the HandlerCallback if you call the
  * *InThread() method.
  */
-class HandlerCallbackBase {
+class HandlerCallbackBase : public concurrency::PoolAllocated {
  protected:
   typedef void(*exn_ptr)(std::unique_ptr<ResponseChannel::Request>,
                          int32_t protoSeqId,
@@ -432,10 +433,7 @@ class HandlerCallbackBase {
   virtual void transform(folly::IOBufQueue& queue) {
     // Do any compression or other transforms in this thread, the same thread
     // that serialization happens on.
-    queue.append(
-      transport::THeader::transform(queue.move(),
-                                    reqCtx_->getTransforms(),
-                                    reqCtx_->getMinCompressBytes()));
+    reqCtx_->transformReply(queue);
   }
 
   virtual void doExceptionWrapped(folly::exception_wrapper ew) {
@@ -0,0 +1,172 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/lib/cpp2/async/CompressionPolicy.h>
+
+#include <folly/Bits.h>
+
+#include <algorithm>
+
+using apache::thrift::concurrency::SpinLockGuard;
+using apache::thrift::transport::THeader;
+using apache::thrift::transport::ZstdDictionary;
+using folly::IOBuf;
+using std::unique_ptr;
+
+namespace apache { namespace thrift {
+
+unique_ptr<IOBuf> CompressionPolicy::transform(
+    CompressionPolicy* policy,
+    unique_ptr<IOBuf> buf,
+    std::vector<uint16_t>& transforms,
+    uint32_t minCompressBytes,
+    const ZstdDictionary* zstdDict) {
+  if (!policy) {
+    return THeader::transform(std::move(buf), transforms, minCompressBytes,
+                              zstdDict);
+  }
+  if (transforms.empty()) {
+    return buf;
+  }
+  uint32_t size = buf->computeChainDataLength();
+  if (size < minCompressBytes) {
+    transforms.clear();
+    return buf;
+  }
+
+  uint16_t chosen = policy->choose(size, transforms);
+  if (chosen == THeader::NONE) {
+    transforms.clear();
+    return buf;
+  }
+  transforms.assign(1, chosen);
+  auto start = std::chrono::steady_clock::now();
+  buf = THeader::transform(std::move(buf), transforms, 0, zstdDict);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  policy->record(chosen, size, buf->computeChainDataLength(),
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed));
+  return buf;
+}
+
+AdaptiveCompressionPolicy::AdaptiveCompressionPolicy(const Options& options)
+    : options_(options) {
+  CHECK_GT(options_.networkBytesPerSec, 0);
+  CHECK_GT(options_.cpuCores, 0);
+}
+
+size_t AdaptiveCompressionPolicy::bucketFor(uint32_t size) {
+  // 0 and 1 share bucket 0, [2^k, 2^(k+1)) is bucket k otherwise
+  return size == 0 ? 0 : folly::findLastSet(size) - 1;
+}
+
+double AdaptiveCompressionPolicy::cost(uint32_t size,
+                                       const Estimate& e) const {
+  double cpu = size * e.nsecPerByte * 1e-9 / options_.cpuCores;
+  double network = size * e.ratio / options_.networkBytesPerSec;
+  return std::max(cpu, network);
+}
+
+uint16_t AdaptiveCompressionPolicy::choose(
+    uint32_t size,
+    const std::vector<uint16_t>& allowed) {
+  auto& bucket = buckets_[bucketFor(size)];
+  uint16_t chosen = THeader::NONE;
+  {
+    SpinLockGuard g(bucket.lock);
+    uint64_t message = bucket.messages++;
+
+    double best = cost(size, Estimate());
+    bool explore = options_.exploreEvery > 0 &&
+      message % options_.exploreEvery == options_.exploreEvery - 1;
+    size_t candidates = 0;
+    for (auto transform : allowed) {
+      if (transform >= kMaxTransforms) {
+        continue;
+      }
+      const auto& estimate = bucket.estimates[transform];
+      if (estimate.samples == 0) {
+        // Measure everything at least once
+        chosen = transform;
+        break;
+      }
+      ++candidates;
+      double c = cost(size, estimate);
+      if (c < best) {
+        best = c;
+        chosen = transform;
+      }
+    }
+    if (explore && candidates > 0) {
+      // Rotate through the allowed transforms
+      size_t pick = (message / options_.exploreEvery) % candidates;
+      for (auto transform : allowed) {
+        if (transform < kMaxTransforms && pick-- == 0) {
+          chosen = transform;
+          break;
+        }
+      }
+    }
+  }
+
+  if (options_.observer) {
+    options_.observer->compressionChosen(chosen, size);
+  }
+  return chosen;
+}
+
+void AdaptiveCompressionPolicy::record(uint16_t transform,
+                                       uint32_t size,
+                                       uint32_t compressedSize,
+                                       std::chrono::nanoseconds elapsed) {
+  if (options_.observer) {
+    options_.observer->compressionSampled(transform, size, compressedSize,
+                                          elapsed.count());
+  }
+  if (transform >= kMaxTransforms || size == 0) {
+    return;
+  }
+  double ratio = double(compressedSize) / size;
+  double nsecPerByte = double(elapsed.count()) / size;
+
+  auto& bucket = buckets_[bucketFor(size)];
+  SpinLockGuard g(bucket.lock);
+  auto& estimate = bucket.estimates[transform];
+  if (estimate.samples == 0) {
+    estimate.ratio = ratio;
+    estimate.nsecPerByte = nsecPerByte;
+  } else {
+    estimate.ratio += options_.decay * (ratio - estimate.ratio);
+    estimate.nsecPerByte +=
+      options_.decay * (nsecPerByte - estimate.nsecPerByte);
+  }
+  ++estimate.samples;
+}
+
+AdaptiveCompressionPolicy::Estimate AdaptiveCompressionPolicy::getEstimate(
+    uint32_t size,
+    uint16_t transform) const {
+  if (transform >= kMaxTransforms) {
+    return Estimate();
+  }
+  const auto& bucket = buckets_[bucketFor(size)];
+  SpinLockGuard g(bucket.lock);
+  return bucket.estimates[transform];
+}
+
+}} // apache::thrift
@@ -0,0 +1,166 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef THRIFT_ASYNC_COMPRESSIONPOLICY_H_
+#define THRIFT_ASYNC_COMPRESSIONPOLICY_H_ 1
+
+#include <thrift/lib/cpp/concurrency/SpinLock.h>
+#include <thrift/lib/cpp/server/TServerObserver.h>
+#include <thrift/lib/cpp/transport/THeader.h>
+
+#include <folly/io/IOBuf.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace apache { namespace thrift {
+
+/**
+ * A CompressionPolicy decides, message by message, whether to compress and
+ * with which of the transforms the peer accepts.
+ *
+ * Without a policy, channels apply every configured transform to every
+ * message of at least minCompressBytes.  With one, at most one transform
+ * is applied, chosen by choose(), and the outcome is fed back to
+ * record().  minCompressBytes still applies.
+ *
+ * Policies are shared by all connections of a server or channel and must
+ * be thread safe.
+ */
+class CompressionPolicy {
+ public:
+  virtual ~CompressionPolicy() {}
+
+  /**
+   * Returns one of allowed, or THeader::NONE to send a message of size
+   * bytes uncompressed.  allowed is never empty.
+   */
+  virtual uint16_t choose(uint32_t size,
+                          const std::vector<uint16_t>& allowed) = 0;
+
+  /**
+   * Called after a message of size bytes was compressed with transform.
+   */
+  virtual void record(uint16_t transform,
+                      uint32_t size,
+                      uint32_t compressedSize,
+                      std::chrono::nanoseconds elapsed) {}
+
+  /**
+   * Transforms buf the way THeader::transform() does, consulting policy if
+   * it is not null.  On entry transforms holds the allowed transforms; on
+   * return, the ones that were applied.
+   */
+  static std::unique_ptr<folly::IOBuf> transform(
+    CompressionPolicy* policy,
+    std::unique_ptr<folly::IOBuf> buf,
+    std::vector<uint16_t>& transforms,
+    uint32_t minCompressBytes,
+    const apache::thrift::transport::ZstdDictionary* zstdDict);
+};
+
+/**
+ * Picks the transform that maximizes throughput under a CPU and a network
+ * budget.
+ *
+ * For each payload size bucket (powers of two) and transform it keeps
+ * moving averages of the compression ratio and of the encoding time per
+ * byte.  Sending a message costs max(encode time / cpuCores,
+ * compressed size / networkBytesPerSec): whichever resource runs out first
+ * bounds the throughput.  The transform, or no compression, with the
+ * lowest expected cost wins.
+ *
+ * Transforms without samples in a bucket are tried first, and after that
+ * one in every exploreEvery messages of a bucket tries the next transform
+ * in turn, so the estimates follow changes in the payloads.
+ *
+ * Only the sender's cost is modelled; decompression on the peer is
+ * usually several times cheaper than compression.
+ */
+class AdaptiveCompressionPolicy : public CompressionPolicy {
+ public:
+  struct Options {
+    Options()
+      : networkBytesPerSec(125e6)
+      , cpuCores(1.0)
+      , exploreEvery(64)
+      , decay(0.05) {}
+
+    // Network throughput this process may use; the default is 1 Gbit/s
+    double networkBytesPerSec;
+    // CPU this process may spend compressing, in cores
+    double cpuCores;
+    // One in this many messages of a bucket re-measures another transform
+    uint32_t exploreEvery;
+    // Weight of each new sample in the moving averages
+    double decay;
+    // If set, gets compressionChosen() and compressionSampled() calls
+    std::shared_ptr<apache::thrift::server::TServerObserver> observer;
+  };
+
+  struct Estimate {
+    Estimate() : ratio(1.0), nsecPerByte(0.0), samples(0) {}
+
+    // Compressed size over uncompressed size
+    double ratio;
+    double nsecPerByte;
+    uint64_t samples;
+  };
+
+  explicit AdaptiveCompressionPolicy(const Options& options = Options());
+
+  uint16_t choose(uint32_t size,
+                  const std::vector<uint16_t>& allowed) override;
+
+  void record(uint16_t transform,
+              uint32_t size,
+              uint32_t compressedSize,
+              std::chrono::nanoseconds elapsed) override;
+
+  Estimate getEstimate(uint32_t size, uint16_t transform) const;
+
+  const Options& getOptions() const {
+    return options_;
+  }
+
+  // Transform ids this policy keeps statistics for are below this
+  static const uint16_t kMaxTransforms = 8;
+  static const size_t kNumBuckets = 32;
+
+ private:
+  struct Bucket {
+    Bucket() : messages(0) {}
+
+    mutable apache::thrift::concurrency::SpinLock lock;
+    Estimate estimates[kMaxTransforms];
+    uint64_t messages;
+  };
+
+  static size_t bucketFor(uint32_t size);
+
+  // Expected cost in seconds of sending size bytes with estimate e
+  double cost(uint32_t size, const Estimate& e) const;
+
+  Options options_;
+  Bucket buckets_[kNumBuckets];
+};
+
+}} // apache::thrift
+
+#endif // #ifndef THRIFT_ASYNC_COMPRESSIONPOLICY_H_
@@ -18,6 +18,7 @@
  */
 
 #include <thrift/lib/cpp2/async/Cpp2Channel.h>
+#include <thrift/lib/cpp2/async/WriteBatcher.h>
 #include <thrift/lib/cpp/transport/TTransportException.h>
 #include <thrift/lib/cpp/concurrency/Util.h>
 
@@ -53,6 +54,7 @@ Cpp2Channel::Cpp2Channel(
     , closing_(false)
     , eofInvoked_(false)
     , queueSends_(true)
+    , batcher_(nullptr)
     , protectionHandler_(std::move(protectionHandler))
     , framingHandler_(std::move(framingHandler)) {
   if (!protectionHandler_) {
@@ -83,6 +85,8 @@ void Cpp2Channel::attachEventBase(
 }
 
 void Cpp2Channel::detachEventBase() {
+  // The batcher belongs to the old TEventBase.
+  batcher_ = nullptr;
   if (transport_->getReadCallback() == this) {
     transport_->setReadCallback(nullptr);
   }
@@ -252,6 +256,10 @@ void Cpp2Channel::sendMessage(SendCallback* callback,
   buf = framingHandler_->addFrame(std::move(buf));
   buf = protectionHandler_->encrypt(std::move(buf));
 
+  if (batcher_) {
+    batcher_->recordMessage();
+  }
+
   if (!queueSends_) {
     // Send immediately.
     std::vector<SendCallback*> cbs;
@@ -259,6 +267,9 @@ void Cpp2Channel::sendMessage(SendCallback* callback,
       cbs.push_back(callback);
     }
     sendCallbacks_.push_back(std::move(cbs));
+    if (batcher_) {
+      batcher_->recordWrite();
+    }
     transport_->writeChain(this, std::move(buf));
   } else {
     // Delay sends to optimize for fewer syscalls
@@ -266,14 +277,19 @@ void Cpp2Channel::sendMessage(SendCallback* callback,
       DCHECK(!isLoopCallbackScheduled());
       // Buffer all the sends, and call writev once per event loop.
       sends_ = std::move(buf);
-      getEventBase()->runInLoop(this);
+      if (batcher_ && batcher_->getBatchSends()) {
+        batcher_->addPendingWrite(this);
+      } else {
+        getEventBase()->runInLoop(this);
+      }
       std::vector<SendCallback*> cbs;
       if (callback) {
         cbs.push_back(callback);
       }
       sendCallbacks_.push_back(std::move(cbs));
     } else {
-      DCHECK(isLoopCallbackScheduled());
+      DCHECK((batcher_ && batcher_->getBatchSends()) ||
+             isLoopCallbackScheduled());
       sends_->prependChain(std::move(buf));
       if (callback) {
         sendCallbacks_.back().push_back(callback);
@@ -287,6 +303,16 @@ void Cpp2Channel::sendMessage(SendCallback* callback,
 
 void Cpp2Channel::runLoopCallback() noexcept {
   assert(sends_);
+  flushSends();
+}
+
+void Cpp2Channel::flushSends() noexcept {
+  if (!sends_) {
+    return;
+  }
+  if (batcher_) {
+    batcher_->recordWrite();
+  }
   transport_->writeChain(this, std::move(sends_));
 }
 
@@ -33,6 +33,8 @@
 
 namespace apache { namespace thrift {
 
+class WriteBatcher;
+
 class ProtectionChannelHandler {
 public:
   enum class ProtectionState {
@@ -175,6 +177,10 @@ class Cpp2Channel
   // callback from TEventBase::LoopCallback.  Used for sends
   virtual void runLoopCallback() noexcept;
 
+  // Write out any queued sends.  Called by runLoopCallback(), or by the
+  // WriteBatcher when one is set.
+  void flushSends() noexcept;
+
   // Setter for queued sends mode.
   // Can only be set in quiescent state, otherwise
   // sendCallbacks_ would be called incorrectly.
@@ -183,6 +189,15 @@ class Cpp2Channel
     queueSends_ = queueSends;
   }
 
+  // Report sends to batcher and, if it batches, hand it queued sends
+  // instead of scheduling a loop callback per channel.  The batcher must
+  // run on this channel's TEventBase and outlive it.  Like setQueueSends,
+  // only valid in quiescent state.
+  void setWriteBatcher(WriteBatcher* batcher) {
+    CHECK(sends_ == nullptr);
+    batcher_ = batcher;
+  }
+
   ProtectionChannelHandler* getProtectionHandler() const {
     return protectionHandler_.get();
   }
@@ -219,6 +234,8 @@ private:
   // minor latency increase.
   bool queueSends_;
 
+  WriteBatcher* batcher_;
+
   std::unique_ptr<ProtectionChannelHandler> protectionHandler_;
   std::unique_ptr<FramingChannelHandler> framingHandler_;
 };
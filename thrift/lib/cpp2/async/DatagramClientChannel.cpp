@@ -0,0 +1,136 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp2/async/DatagramClientChannel.h>
+
+#include <thrift/lib/cpp2/async/ResponseChannel.h>
+#include <thrift/lib/cpp/transport/TTransportException.h>
+#include <folly/Random.h>
+
+#include <errno.h>
+
+using std::unique_ptr;
+using folly::IOBuf;
+using apache::thrift::async::TAsyncUDPSocket;
+using apache::thrift::async::TEventBase;
+using apache::thrift::transport::THeader;
+using apache::thrift::transport::TTransportException;
+
+namespace apache { namespace thrift {
+
+DatagramClientChannel::DatagramClientChannel(
+    TEventBase* eventBase,
+    const folly::SocketAddress& server,
+    const Options& options)
+    : eventBase_(eventBase)
+    , server_(server)
+    , options_(options)
+    , socket_(new TAsyncUDPSocket(eventBase))
+    , header_(new THeader)
+    , closeCallback_(nullptr)
+    , nextSeqId_(0) {
+  folly::SocketAddress local;
+  local.setFromIpPort(server.getFamily() == AF_INET6 ? "::" : "0.0.0.0", 0);
+  socket_->bind(local);
+
+  header_->setSupportedClients(nullptr);
+  header_->setClientType(THRIFT_HEADER_CLIENT_TYPE);
+}
+
+void DatagramClientChannel::destroy() {
+  socket_.reset();
+  if (closeCallback_) {
+    closeCallback_->channelClosed();
+    closeCallback_ = nullptr;
+  }
+  TDelayedDestruction::destroy();
+}
+
+uint32_t DatagramClientChannel::sendRequest(
+    const RpcOptions& rpcOptions,
+    unique_ptr<RequestCallback> cb,
+    unique_ptr<apache::thrift::ContextStack> ctx,
+    unique_ptr<IOBuf> buf) {
+  // cb is not allowed to be null.
+  DCHECK(cb);
+  fail(std::move(cb), std::move(ctx), TTransportException(
+    TTransportException::NOT_SUPPORTED,
+    "Datagram channels only send oneway requests"));
+  return 0;
+}
+
+uint32_t DatagramClientChannel::sendOnewayRequest(
+    const RpcOptions& rpcOptions,
+    unique_ptr<RequestCallback> cb,
+    unique_ptr<apache::thrift::ContextStack> ctx,
+    unique_ptr<IOBuf> buf) {
+  DestructorGuard dg(this);
+
+  if (options_.sampleRate < 1.0 &&
+      folly::Random::randDouble01() >= options_.sampleRate) {
+    // Not an error: the caller asked for it
+    ++stats_.sampledOut;
+    if (cb) {
+      cb->requestSent();
+    }
+    return ResponseChannel::ONEWAY_REQUEST_ID;
+  }
+
+  // The server counts the gaps in these
+  header_->setSequenceNumber(nextSeqId_);
+  unique_ptr<IOBuf> datagram;
+  try {
+    datagram = header_->addHeader(std::move(buf));
+  } catch (const TTransportException& ex) {
+    fail(std::move(cb), std::move(ctx), ex);
+    return ResponseChannel::ONEWAY_REQUEST_ID;
+  }
+
+  if (datagram->computeChainDataLength() > options_.maxDatagramSize) {
+    ++stats_.oversized;
+    fail(std::move(cb), std::move(ctx), TTransportException(
+      TTransportException::INVALID_FRAME_SIZE,
+      "Request larger than the maximum datagram size"));
+    return ResponseChannel::ONEWAY_REQUEST_ID;
+  }
+
+  if (socket_->write(server_, datagram) < 0) {
+    ++stats_.sendErrors;
+    fail(std::move(cb), std::move(ctx), TTransportException(
+      TTransportException::INTERNAL_ERROR, "Datagram send failed", errno));
+    return ResponseChannel::ONEWAY_REQUEST_ID;
+  }
+
+  ++nextSeqId_;
+  ++stats_.sent;
+  if (cb) {
+    cb->requestSent();
+  }
+  return ResponseChannel::ONEWAY_REQUEST_ID;
+}
+
+void DatagramClientChannel::fail(unique_ptr<RequestCallback> cb,
+                                 unique_ptr<apache::thrift::ContextStack> ctx,
+                                 const TTransportException& ex) {
+  if (cb) {
+    cb->requestError(ClientReceiveState(
+      folly::make_exception_wrapper<TTransportException>(ex),
+      std::move(ctx),
+      false));
+  }
+}
+
+}} // apache::thrift
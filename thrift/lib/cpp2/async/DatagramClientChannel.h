@@ -0,0 +1,145 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_ASYNC_DATAGRAMCLIENTCHANNEL_H_
+#define THRIFT_ASYNC_DATAGRAMCLIENTCHANNEL_H_ 1
+
+#include <thrift/lib/cpp2/async/RequestChannel.h>
+#include <thrift/lib/cpp/async/TAsyncUDPSocket.h>
+#include <thrift/lib/cpp/async/TDelayedDestruction.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+#include <thrift/lib/cpp/transport/THeader.h>
+#include <thrift/lib/cpp/transport/TSocketAddress.h>
+
+#include <memory>
+
+namespace apache { namespace thrift {
+
+/**
+ * A RequestChannel that sends oneway requests as UDP datagrams, one
+ * THeader-framed message per datagram, to a ThriftServer with a datagram
+ * address (see ThriftServer::setDatagramAddress()).
+ *
+ * Sending never blocks and nothing is acknowledged: a request is sent, or
+ * dropped and counted, before sendOnewayRequest() returns.  Requests larger
+ * than Options::maxDatagramSize once framed, or that find the socket buffer
+ * full, fail; with Options::sampleRate below 1 the others are sent at that
+ * rate and the rest dropped.  Two-way requests always fail.
+ *
+ * Each datagram carries a sequence number, so the server can count the ones
+ * lost on the way.
+ */
+class DatagramClientChannel : public RequestChannel {
+ public:
+  struct Options {
+    Options()
+      : maxDatagramSize(1452)
+      , sampleRate(1.0) {}
+
+    // The default fits an Ethernet frame over IPv6
+    size_t maxDatagramSize;
+    // Fraction of requests sent
+    double sampleRate;
+  };
+
+  struct Stats {
+    Stats() : sent(0), sampledOut(0), oversized(0), sendErrors(0) {}
+
+    uint64_t sent;
+    uint64_t sampledOut;
+    uint64_t oversized;
+    uint64_t sendErrors;
+  };
+
+  typedef
+    std::unique_ptr<DatagramClientChannel,
+                    apache::thrift::async::TDelayedDestruction::Destructor>
+    Ptr;
+
+  static Ptr newChannel(apache::thrift::async::TEventBase* eventBase,
+                        const folly::SocketAddress& server,
+                        const Options& options = Options()) {
+    return Ptr(new DatagramClientChannel(eventBase, server, options));
+  }
+
+  // Throws TTransportException if the socket cannot be created
+  DatagramClientChannel(apache::thrift::async::TEventBase* eventBase,
+                        const folly::SocketAddress& server,
+                        const Options& options = Options());
+
+  // TDelayedDestruction methods
+  void destroy();
+
+  // Client interface from RequestChannel
+  using RequestChannel::sendRequest;
+  uint32_t sendRequest(const RpcOptions&,
+                       std::unique_ptr<RequestCallback>,
+                       std::unique_ptr<apache::thrift::ContextStack>,
+                       std::unique_ptr<folly::IOBuf>);
+
+  using RequestChannel::sendOnewayRequest;
+  uint32_t sendOnewayRequest(const RpcOptions&,
+                             std::unique_ptr<RequestCallback>,
+                             std::unique_ptr<apache::thrift::ContextStack>,
+                             std::unique_ptr<folly::IOBuf>);
+
+  // Called when the channel is destroyed; datagram channels never close
+  // otherwise.
+  void setCloseCallback(CloseCallback* cb) {
+    closeCallback_ = cb;
+  }
+
+  apache::thrift::async::TEventBase* getEventBase() {
+    return eventBase_;
+  }
+
+  uint16_t getProtocolId() {
+    return header_->getProtocolId();
+  }
+
+  // Protocol, transforms and headers of every datagram
+  apache::thrift::transport::THeader* getHeader() {
+    return header_.get();
+  }
+
+  const folly::SocketAddress& getServerAddress() const {
+    return server_;
+  }
+
+  Stats getStats() const {
+    return stats_;
+  }
+
+ private:
+  ~DatagramClientChannel() {}
+
+  void fail(std::unique_ptr<RequestCallback> cb,
+            std::unique_ptr<apache::thrift::ContextStack> ctx,
+            const apache::thrift::transport::TTransportException& ex);
+
+  apache::thrift::async::TEventBase* eventBase_;
+  folly::SocketAddress server_;
+  Options options_;
+  std::unique_ptr<apache::thrift::async::TAsyncUDPSocket> socket_;
+  std::unique_ptr<apache::thrift::transport::THeader> header_;
+  CloseCallback* closeCallback_;
+  uint32_t nextSeqId_;
+  Stats stats_;
+};
+
+}} // apache::thrift
+
+#endif // THRIFT_ASYNC_DATAGRAMCLIENTCHANNEL_H_
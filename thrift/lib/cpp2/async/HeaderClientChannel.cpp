@@ -19,6 +19,9 @@
 #include <thrift/lib/cpp2/async/GssSaslClient.h>
 #include <thrift/lib/cpp/EventHandlerBase.h>
 #include <thrift/lib/cpp/transport/TTransportException.h>
+#include <folly/Conv.h>
+#include <folly/ScopeGuard.h>
+#include <folly/String.h>
 #include <folly/io/Cursor.h>
 
 #include <utility>
@@ -429,7 +432,37 @@ std::unique_ptr<folly::IOBuf>
 HeaderClientChannel::ClientFramingHandler::addFrame(unique_ptr<IOBuf> buf) {
   THeader* header = channel_.getHeader();
   header->setSequenceNumber(channel_.sendSeqId_);
-  return header->addHeader(std::move(buf));
+  auto clientType = header->getClientType();
+  if (!channel_.compressionPolicy_ ||
+      (clientType != THRIFT_HEADER_CLIENT_TYPE &&
+       clientType != THRIFT_HEADER_SASL_CLIENT_TYPE)) {
+    return header->addHeader(std::move(buf));
+  }
+
+  std::vector<uint16_t> configured = header->getWriteTransforms();
+  if (configured != channel_.advertisedTransforms_) {
+    header->setPersistentHeader(THeader::ACCEPT_TRANSFORMS_HEADER,
+                                folly::join(",", configured));
+    channel_.advertisedTransforms_ = configured;
+  }
+
+  size_t dataSize = buf->computeChainDataLength();
+  std::vector<uint16_t> chosen = configured;
+  buf = CompressionPolicy::transform(channel_.compressionPolicy_.get(),
+                                     std::move(buf),
+                                     chosen,
+                                     header->getMinCompressBytes(),
+                                     header->getZstdDictionary().get());
+  if (!chosen.empty()) {
+    header->setHeader(THeader::UNCOMPRESSED_SIZE_HEADER,
+                      folly::to<std::string>(dataSize));
+  }
+  // The header must name only the transform that was applied
+  header->setTransforms(chosen);
+  SCOPE_EXIT {
+    header->setTransforms(configured);
+  };
+  return header->addHeader(std::move(buf), false);
 }
 
 std::pair<std::unique_ptr<IOBuf>, size_t>
@@ -22,6 +22,7 @@
 #include <thrift/lib/cpp2/async/RequestChannel.h>
 #include <thrift/lib/cpp2/async/SaslClient.h>
 #include <thrift/lib/cpp2/async/Cpp2Channel.h>
+#include <thrift/lib/cpp2/async/CompressionPolicy.h>
 #include <thrift/lib/cpp/async/TDelayedDestruction.h>
 #include <thrift/lib/cpp/async/Request.h>
 #include <thrift/lib/cpp/transport/THeader.h>
@@ -152,6 +153,22 @@ class HeaderClientChannel : public RequestChannel,
     return header_->getProtocolId();
   }
 
+  // Dictionary for ZSTD_TRANSFORM; the server must use the same one.
+  void setZstdDictionary(
+      std::shared_ptr<const apache::thrift::transport::ZstdDictionary> dict) {
+    header_->setZstdDictionary(std::move(dict));
+  }
+
+  /**
+   * Let policy pick at most one of the configured transforms per request,
+   * instead of applying all of them.  The configured transforms are also
+   * advertised to the server, so that a server with a policy of its own may
+   * choose among them for its responses.
+   */
+  void setCompressionPolicy(std::shared_ptr<CompressionPolicy> policy) {
+    compressionPolicy_ = std::move(policy);
+  }
+
   bool expireCallback(uint32_t seqId);
 
   // If security negotiation has not yet started, begin.  Depending on
@@ -438,6 +455,10 @@ private:
   std::unordered_map<uint32_t, TwowayCallback*> recvCallbacks_;
   std::deque<uint32_t> recvCallbackOrder_;
   std::unique_ptr<apache::thrift::transport::THeader> header_;
+
+  std::shared_ptr<CompressionPolicy> compressionPolicy_;
+  // Transforms last sent in ACCEPT_TRANSFORMS_HEADER
+  std::vector<uint16_t> advertisedTransforms_;
   CloseCallback* closeCallback_;
 
   uint32_t timeout_;
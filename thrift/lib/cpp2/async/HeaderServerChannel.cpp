@@ -162,7 +162,7 @@ HeaderServerChannel::HeaderRequest::HeaderRequest(
       uint32_t seqId,
       HeaderServerChannel* channel,
       unique_ptr<IOBuf>&& buf,
-      const std::map<std::string, std::string>& headers,
+      const THeaderMap& headers,
       const std::vector<uint16_t>& trans,
       bool outOfOrder,
       unique_ptr<sample> sample)
@@ -266,9 +266,11 @@ void HeaderServerChannel::HeaderRequest::sendErrorWrapped(
           return;
         }
       }
-      exbuf = THeader::transform(std::move(exbuf),
-                                 transforms_,
-                                 channel_->header_->getMinCompressBytes());
+      exbuf = THeader::transform(
+        std::move(exbuf),
+        transforms_,
+        channel_->header_->getMinCompressBytes(),
+        channel_->header_->getZstdDictionary().get());
       sendReply(std::move(exbuf), cb, std::move(headers));
     });
 }
@@ -342,7 +344,7 @@ void HeaderServerChannel::messageReceived(unique_ptr<IOBuf>&& buf,
 
     unique_ptr<Request> request(
         new HeaderRequest(recvSeqId, this, std::move(buf),
-                          header_->getHeaders(),
+                          header_->getHeaderMap(),
                           header_->getWriteTransforms(),
                           outOfOrder,
                           std::move(sample)));
@@ -26,6 +26,7 @@
 #include <thrift/lib/cpp2/async/Cpp2Channel.h>
 #include <thrift/lib/cpp/async/TAsyncSocket.h>
 #include <thrift/lib/cpp/async/TDelayedDestruction.h>
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
 #include <thrift/lib/cpp/transport/THeader.h>
 #include <memory>
 
@@ -108,12 +109,13 @@ protected:
     std::vector<uint16_t> transforms,
     apache::thrift::transport::THeader::StringToStringMap&&);
 
-  class HeaderRequest : public Request {
+  class HeaderRequest : public Request
+                      , public concurrency::PoolAllocated {
    public:
     HeaderRequest(uint32_t seqId,
                   HeaderServerChannel* channel,
                   std::unique_ptr<folly::IOBuf>&& buf,
-                  const std::map<std::string, std::string>& headers,
+                  const apache::thrift::transport::THeaderMap& headers,
                   const std::vector<uint16_t>& trans,
                   bool outOfOrder,
                   std::unique_ptr<sample> sample);
@@ -123,6 +125,12 @@ protected:
 
     bool isOneway() {return seqId_ == ONEWAY_REQUEST_ID; }
 
+    // The transforms the reply was actually sent with; by default the
+    // ones in effect when the request arrived
+    void setTransforms(const std::vector<uint16_t>& trans) {
+      transforms_ = trans;
+    }
+
     void sendReply(std::unique_ptr<folly::IOBuf>&& buf,
                    MessageChannel::SendCallback* cb = nullptr) {
       apache::thrift::transport::THeader::StringToStringMap headers;
@@ -146,7 +154,7 @@ protected:
    private:
     HeaderServerChannel* channel_;
     uint32_t seqId_;
-    std::map<std::string, std::string> headers_;
+    apache::thrift::transport::THeaderMap headers_;
     std::vector<uint16_t> transforms_;
     bool outOfOrder_;
     std::atomic<bool> active_;
@@ -185,6 +193,10 @@ protected:
     cpp2Channel_->setQueueSends(queueSends);
   }
 
+  void setWriteBatcher(WriteBatcher* batcher) {
+    cpp2Channel_->setWriteBatcher(batcher);
+  }
+
   void closeNow() {
     cpp2Channel_->closeNow();
   }
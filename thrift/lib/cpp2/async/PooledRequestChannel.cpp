@@ -0,0 +1,597 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp2/async/PooledRequestChannel.h>
+
+#include <thrift/lib/cpp2/async/ResponseChannel.h>
+#include <thrift/lib/cpp/async/TAsyncSocket.h>
+#include <thrift/lib/cpp/transport/THeaderMap.h>
+#include <thrift/lib/cpp/transport/TTransportException.h>
+#include <folly/Conv.h>
+#include <folly/Memory.h>
+#include <folly/Random.h>
+
+#include <algorithm>
+#include <limits>
+
+using std::unique_ptr;
+using std::chrono::steady_clock;
+using folly::IOBuf;
+using folly::make_unique;
+using apache::thrift::async::HHWheelTimer;
+using apache::thrift::async::RequestContext;
+using apache::thrift::async::TAsyncSocket;
+using apache::thrift::async::TEventBase;
+using apache::thrift::transport::THeaderMap;
+using apache::thrift::transport::TTransportException;
+
+namespace apache { namespace thrift {
+
+/**
+ * Keeps the pool's bookkeeping for one request on a member.
+ */
+class PooledRequestChannel::MemberCallback : public RequestCallback {
+ public:
+  MemberCallback(PooledRequestChannel* pool,
+                 Member* member,
+                 unique_ptr<RequestCallback> cb,
+                 bool oneway)
+      : pool_(pool)
+      , member_(member)
+      , channel_(member->channel.get())
+      , destroyed_(pool->destroyed_)
+      , cb_(std::move(cb))
+      , oneway_(oneway)
+      , done_(false)
+      , start_(steady_clock::now()) {}
+
+  ~MemberCallback() {
+    // The channel may drop a request without calling back (see
+    // HeaderClientChannel::expireCallback())
+    done(false);
+  }
+
+  void requestSent() override {
+    if (oneway_) {
+      done(false);
+    }
+    if (cb_) {
+      cb_->requestSent();
+    }
+  }
+
+  void replyReceived(ClientReceiveState&& state) override {
+    done(true);
+    cb_->replyReceived(std::move(state));
+  }
+
+  void requestError(ClientReceiveState&& state) override {
+    done(false);
+    if (cb_) {
+      cb_->requestError(std::move(state));
+    }
+  }
+
+ private:
+  void done(bool reply) {
+    if (done_ || *destroyed_) {
+      return;
+    }
+    done_ = true;
+    pool_->requestDone(member_, channel_,
+                       oneway_ ? steady_clock::time_point() : start_, reply);
+  }
+
+  PooledRequestChannel* pool_;
+  Member* member_;
+  HeaderClientChannel* channel_;
+  std::shared_ptr<bool> destroyed_;
+  unique_ptr<RequestCallback> cb_;
+  bool oneway_;
+  bool done_;
+  steady_clock::time_point start_;
+};
+
+/**
+ * A request that may be sent twice.  Shared by the callbacks of both
+ * attempts, and kept alive by itself while its timer is scheduled.
+ */
+class PooledRequestChannel::HedgedRequest
+    : public HHWheelTimer::Callback
+    , public std::enable_shared_from_this<HedgedRequest> {
+ public:
+  HedgedRequest(PooledRequestChannel* pool,
+                const RpcOptions& rpcOptions,
+                unique_ptr<RequestCallback> cb,
+                unique_ptr<apache::thrift::ContextStack> ctx,
+                unique_ptr<IOBuf> buf)
+      : pool_(pool)
+      , destroyed_(pool->destroyed_)
+      , rpcOptions_(rpcOptions)
+      , cb_(std::move(cb))
+      , ctx_(std::move(ctx))
+      , buf_(std::move(buf))
+      , context_(RequestContext::saveContext())
+      , numAttempts_(0)
+      , done_(false)
+      , sentReported_(false) {}
+
+  uint32_t start(Member* m, std::chrono::milliseconds delay) {
+    uint32_t seqId = send(m);
+    if (!done_) {
+      self_ = shared_from_this();
+      pool_->hedging_.insert(this);
+      pool_->timer_->scheduleTimeout(this, delay);
+    }
+    return seqId;
+  }
+
+  void timeoutExpired() noexcept override {
+    auto self = release();
+    if (done_) {
+      return;
+    }
+    Member* m = pool_->pick(attempts_[0].member);
+    if (!m) {
+      return;
+    }
+    ++pool_->hedgesSent_;
+    auto oldContext = RequestContext::setContext(context_);
+    send(m);
+    RequestContext::setContext(oldContext);
+  }
+
+  // For PooledRequestChannel::destroy()
+  void abandon() {
+    cancelTimeout();
+    auto self = std::move(self_);
+  }
+
+  void sent() {
+    if (!sentReported_ && cb_) {
+      sentReported_ = true;
+      cb_->requestSent();
+    }
+  }
+
+  void replied(size_t attempt, ClientReceiveState&& state) {
+    attempts_[attempt].pending = false;
+    if (done_) {
+      return;
+    }
+    done_ = true;
+    if (attempt > 0 && !*destroyed_) {
+      ++pool_->hedgesWon_;
+    }
+    stop();
+    state.resetCtx(std::move(ctx_));
+    auto cb = std::move(cb_);
+    cb->replyReceived(std::move(state));
+  }
+
+  void failed(size_t attempt, ClientReceiveState&& state) {
+    attempts_[attempt].pending = false;
+    if (done_) {
+      return;
+    }
+    for (size_t i = 0; i < numAttempts_; ++i) {
+      if (attempts_[i].pending) {
+        // The other attempt may still succeed
+        return;
+      }
+    }
+    done_ = true;
+    stop();
+    state.resetCtx(std::move(ctx_));
+    auto cb = std::move(cb_);
+    cb->requestError(std::move(state));
+  }
+
+ private:
+  struct Attempt {
+    Member* member;
+    HeaderClientChannel* channel;
+    uint32_t seqId;
+    bool pending;
+  };
+
+  uint32_t send(Member* m);
+
+  std::shared_ptr<HedgedRequest> release() {
+    if (self_) {
+      pool_->hedging_.erase(this);
+    }
+    return std::move(self_);
+  }
+
+  // Forgets the attempts that are still outstanding
+  void stop() {
+    cancelTimeout();
+    release();
+    if (*destroyed_) {
+      return;
+    }
+    for (size_t i = 0; i < numAttempts_; ++i) {
+      auto& a = attempts_[i];
+      if (a.pending && a.member->channel.get() == a.channel) {
+        a.pending = false;
+        a.channel->expireCallback(a.seqId);
+      }
+    }
+  }
+
+  PooledRequestChannel* pool_;
+  std::shared_ptr<bool> destroyed_;
+  RpcOptions rpcOptions_;
+  unique_ptr<RequestCallback> cb_;
+  // The winning reply gets this; the attempts are sent without one
+  unique_ptr<apache::thrift::ContextStack> ctx_;
+  unique_ptr<IOBuf> buf_;
+  std::shared_ptr<RequestContext> context_;
+  std::shared_ptr<HedgedRequest> self_;
+  Attempt attempts_[2];
+  size_t numAttempts_;
+  bool done_;
+  bool sentReported_;
+};
+
+class PooledRequestChannel::HedgeCallback : public RequestCallback {
+ public:
+  HedgeCallback(std::shared_ptr<HedgedRequest> request, size_t attempt)
+      : request_(std::move(request))
+      , attempt_(attempt) {}
+
+  void requestSent() override {
+    request_->sent();
+  }
+
+  void replyReceived(ClientReceiveState&& state) override {
+    request_->replied(attempt_, std::move(state));
+  }
+
+  void requestError(ClientReceiveState&& state) override {
+    request_->failed(attempt_, std::move(state));
+  }
+
+ private:
+  std::shared_ptr<HedgedRequest> request_;
+  size_t attempt_;
+};
+
+uint32_t PooledRequestChannel::HedgedRequest::send(Member* m) {
+  size_t i = numAttempts_++;
+  attempts_[i].member = m;
+  attempts_[i].channel = m->channel.get();
+  attempts_[i].pending = true;
+  uint32_t seqId = pool_->send(
+    m, rpcOptions_, make_unique<HedgeCallback>(shared_from_this(), i),
+    nullptr, buf_->clone(), false);
+  attempts_[i].seqId = seqId;
+  return seqId;
+}
+
+PooledRequestChannel::PooledRequestChannel(
+    TEventBase* eventBase,
+    const std::vector<folly::SocketAddress>& endpoints,
+    const Options& options)
+    : eventBase_(eventBase)
+    , options_(options)
+    , rng_(folly::randomNumberSeed())
+    , protocolId_(0)
+    , closeCallback_(nullptr)
+    , destroyed_(std::make_shared<bool>(false))
+    , timer_(new HHWheelTimer(eventBase))
+    , hedgesSent_(0)
+    , hedgesWon_(0)
+    , latencies_(kLatencyWindow)
+    , latencyCount_(0)
+    , unsortedLatencies_(0) {
+  CHECK(!endpoints.empty());
+  CHECK_GT(options_.connectionsPerEndpoint, 0);
+  // Interleaved, so that neighbouring members are on different endpoints
+  for (size_t i = 0; i < options_.connectionsPerEndpoint; ++i) {
+    for (const auto& address : endpoints) {
+      members_.push_back(make_unique<Member>(this, address));
+      connect(members_.back().get());
+    }
+  }
+  protocolId_ = members_.front()->channel->getProtocolId();
+}
+
+void PooledRequestChannel::destroy() {
+  *destroyed_ = true;
+  auto hedging = std::move(hedging_);
+  hedging_.clear();
+  for (auto request : hedging) {
+    request->abandon();
+  }
+  for (auto& m : members_) {
+    if (m->channel) {
+      m->channel->setCloseCallback(nullptr);
+      m->channel.reset();
+    }
+  }
+  if (closeCallback_) {
+    closeCallback_->channelClosed();
+    closeCallback_ = nullptr;
+  }
+  TDelayedDestruction::destroy();
+}
+
+void PooledRequestChannel::connect(Member* m) {
+  if (m->channel) {
+    // Whatever is still outstanding on the old connection fails now
+    auto old = std::move(m->channel);
+    old->setCloseCallback(nullptr);
+    ++m->reconnects;
+  }
+
+  m->channel = HeaderClientChannel::newChannel(
+    TAsyncSocket::newSocket(eventBase_, m->address, options_.connectTimeout));
+  if (options_.configure) {
+    options_.configure(m->channel.get());
+  }
+  if (!options_.loadCounter.empty()) {
+    m->channel->getHeader()->setPersistentHeader(
+      THeaderMap::keyName(THeaderMap::Key::LOAD).str(), options_.loadCounter);
+  }
+  // Without this an idle pool would keep TEventBase::loop() running
+  m->channel->setKeepRegisteredForClose(false);
+  m->channel->setCloseCallback(m);
+  m->failed = false;
+  // The server may have been replaced; measure it again
+  m->latencyUsec = 0.0;
+  m->load = -1;
+}
+
+bool PooledRequestChannel::usable(const Member* m,
+                                  steady_clock::time_point now) const {
+  return m->healthy() || now >= m->retryAfter;
+}
+
+double PooledRequestChannel::cost(const Member* m) const {
+  double queue = m->outstanding + 1;
+  if (m->load > 0) {
+    queue += options_.loadWeight * m->load;
+  }
+  // Plus one, so that outstanding requests count before the first reply
+  return (m->latencyUsec + 1.0) * queue;
+}
+
+PooledRequestChannel::Member* PooledRequestChannel::pick(
+    const Member* avoid) {
+  auto now = steady_clock::now();
+  Member* best = pick(now, avoid, false);
+  if (!best && avoid) {
+    best = pick(now, avoid, true);
+  }
+  if (best && !best->healthy()) {
+    connect(best);
+  }
+  return best;
+}
+
+PooledRequestChannel::Member* PooledRequestChannel::pick(
+    steady_clock::time_point now,
+    const Member* avoid,
+    bool sameEndpoint) {
+  auto eligible = [&](const Member* m) {
+    if (!usable(m, now)) {
+      return false;
+    }
+    return !avoid ||
+      (m != avoid && (sameEndpoint || !(m->address == avoid->address)));
+  };
+
+  size_t n = members_.size();
+  size_t i = rng_() % n;
+  size_t j = i;
+  if (n > 1) {
+    j = rng_() % (n - 1);
+    if (j >= i) {
+      ++j;
+    }
+  }
+
+  Member* best = nullptr;
+  for (auto k : {i, j}) {
+    Member* m = members_[k].get();
+    if (eligible(m) && (!best || cost(m) < cost(best))) {
+      best = m;
+    }
+  }
+  if (!best) {
+    // Neither choice will do, take the next one that does
+    for (size_t k = 1; k < n && !best; ++k) {
+      Member* m = members_[(i + k) % n].get();
+      if (eligible(m)) {
+        best = m;
+      }
+    }
+  }
+  return best;
+}
+
+void PooledRequestChannel::requestDone(Member* m,
+                                       HeaderClientChannel* channel,
+                                       steady_clock::time_point start,
+                                       bool reply) {
+  DCHECK_GT(m->outstanding, 0);
+  --m->outstanding;
+  if (m->channel.get() != channel) {
+    // Sent on a connection that has since been replaced
+    return;
+  }
+
+  if (!m->healthy()) {
+    memberFailed(m);
+    return;
+  }
+  if (start == steady_clock::time_point()) {
+    return;
+  }
+  // Timeouts count too: a slow server should get fewer requests
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+    steady_clock::now() - start);
+  if (m->latencyUsec == 0.0) {
+    m->latencyUsec = elapsed.count();
+  } else {
+    m->latencyUsec +=
+      options_.latencyDecay * (elapsed.count() - m->latencyUsec);
+  }
+  if (reply) {
+    recordLatency(elapsed);
+  }
+
+  if (reply && !options_.loadCounter.empty()) {
+    auto load = channel->getHeader()->getHeaderMap().find(
+      THeaderMap::Key::LOAD);
+    if (load) {
+      try {
+        m->load = folly::to<int64_t>(*load);
+      } catch (const std::range_error&) {
+        // Not a number; keep the last one
+      }
+    }
+  }
+}
+
+void PooledRequestChannel::memberFailed(Member* m) {
+  // Only the first error of a failure delays the reconnect
+  if (!m->failed) {
+    m->failed = true;
+    m->retryAfter = steady_clock::now() + options_.reconnectDelay;
+  }
+}
+
+uint32_t PooledRequestChannel::sendRequest(
+    const RpcOptions& rpcOptions,
+    unique_ptr<RequestCallback> cb,
+    unique_ptr<apache::thrift::ContextStack> ctx,
+    unique_ptr<IOBuf> buf) {
+  // cb is not allowed to be null.
+  DCHECK(cb);
+  DestructorGuard dg(this);
+
+  Member* m = pick();
+  if (!m) {
+    cb->requestError(ClientReceiveState(
+      folly::make_exception_wrapper<TTransportException>(
+        TTransportException::NOT_OPEN, "No usable connection in the pool"),
+      std::move(ctx),
+      false));
+    return 0;
+  }
+
+  auto delay = hedgeDelay(rpcOptions);
+  if (delay > std::chrono::milliseconds(0)) {
+    auto request = std::make_shared<HedgedRequest>(
+      this, rpcOptions, std::move(cb), std::move(ctx), std::move(buf));
+    return request->start(m, delay);
+  }
+  return send(m, rpcOptions, std::move(cb), std::move(ctx), std::move(buf),
+              false);
+}
+
+uint32_t PooledRequestChannel::sendOnewayRequest(
+    const RpcOptions& rpcOptions,
+    unique_ptr<RequestCallback> cb,
+    unique_ptr<apache::thrift::ContextStack> ctx,
+    unique_ptr<IOBuf> buf) {
+  DestructorGuard dg(this);
+
+  Member* m = pick();
+  if (!m) {
+    if (cb) {
+      cb->requestError(ClientReceiveState(
+        folly::make_exception_wrapper<TTransportException>(
+          TTransportException::NOT_OPEN, "No usable connection in the pool"),
+        std::move(ctx),
+        false));
+    }
+    return ResponseChannel::ONEWAY_REQUEST_ID;
+  }
+
+  return send(m, rpcOptions, std::move(cb), std::move(ctx), std::move(buf),
+              true);
+}
+
+uint32_t PooledRequestChannel::send(
+    Member* m,
+    const RpcOptions& rpcOptions,
+    unique_ptr<RequestCallback> cb,
+    unique_ptr<apache::thrift::ContextStack> ctx,
+    unique_ptr<IOBuf> buf,
+    bool oneway) {
+  ++m->outstanding;
+  ++m->requests;
+  auto memberCallback = make_unique<MemberCallback>(
+    this, m, std::move(cb), oneway);
+  if (oneway) {
+    return m->channel->sendOnewayRequest(
+      rpcOptions, std::move(memberCallback), std::move(ctx), std::move(buf));
+  }
+  return m->channel->sendRequest(
+    rpcOptions, std::move(memberCallback), std::move(ctx), std::move(buf));
+}
+
+std::chrono::milliseconds PooledRequestChannel::hedgeDelay(
+    const RpcOptions& rpcOptions) {
+  if (members_.size() < 2) {
+    return std::chrono::milliseconds(0);
+  }
+  double percentile = rpcOptions.getHedgePercentile();
+  if (percentile <= 0 || latencyCount_ < kMinLatencySamples) {
+    return rpcOptions.getHedgeDelay();
+  }
+
+  if (sortedLatencies_.empty() || unsortedLatencies_ >= kLatencyWindow / 16) {
+    size_t n = std::min(latencyCount_, kLatencyWindow);
+    sortedLatencies_.assign(latencies_.begin(), latencies_.begin() + n);
+    std::sort(sortedLatencies_.begin(), sortedLatencies_.end());
+    unsortedLatencies_ = 0;
+  }
+  size_t index = std::min(percentile, 1.0) * (sortedLatencies_.size() - 1);
+  // Rounded up to the timer's milliseconds
+  return std::chrono::milliseconds((sortedLatencies_[index] + 999) / 1000);
+}
+
+void PooledRequestChannel::recordLatency(std::chrono::microseconds latency) {
+  latencies_[latencyCount_ % kLatencyWindow] = std::min<int64_t>(
+    latency.count(), std::numeric_limits<uint32_t>::max());
+  ++latencyCount_;
+  ++unsortedLatencies_;
+}
+
+std::vector<PooledRequestChannel::MemberStats>
+PooledRequestChannel::getMemberStats() const {
+  std::vector<MemberStats> stats;
+  for (const auto& m : members_) {
+    MemberStats s;
+    s.address = m->address;
+    s.connected = m->healthy();
+    s.outstanding = m->outstanding;
+    s.latency = std::chrono::microseconds(
+      static_cast<int64_t>(m->latencyUsec));
+    s.load = m->load;
+    s.requests = m->requests;
+    s.reconnects = m->reconnects;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+}} // apache::thrift
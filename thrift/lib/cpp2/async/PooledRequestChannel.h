@@ -0,0 +1,250 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_ASYNC_POOLEDREQUESTCHANNEL_H_
+#define THRIFT_ASYNC_POOLEDREQUESTCHANNEL_H_ 1
+
+#include <thrift/lib/cpp2/async/HeaderClientChannel.h>
+#include <thrift/lib/cpp2/async/RequestChannel.h>
+#include <thrift/lib/cpp/async/HHWheelTimer.h>
+#include <thrift/lib/cpp/async/TDelayedDestruction.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+#include <thrift/lib/cpp/transport/TSocketAddress.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace apache { namespace thrift {
+
+/**
+ * A RequestChannel that spreads requests over a pool of HeaderClientChannels
+ * to one or more endpoints, all on one TEventBase.
+ *
+ * Each request goes to the better of two randomly picked connections
+ * ("power of two choices"), where a connection's cost is its moving average
+ * latency times its outstanding requests plus one.  Connections without a
+ * latency sample yet cost nothing, so new connections are tried right away.
+ * If Options::loadCounter is set, the servers are asked to report that
+ * counter (see ThriftServer::getLoad(), by default a percentage) in every
+ * response, and each unit of reported load counts as loadWeight more
+ * outstanding requests.
+ *
+ * A connection that fails is left alone for reconnectDelay, then replaced by
+ * a new one the next time it is picked.  Idle connections are not watched,
+ * so a server going away is noticed by the next request sent to it.
+ * Requests are not retried: a request sent on a connection that fails gets
+ * the error.
+ *
+ * Requests with RpcOptions::setHedgeDelay() or setHedgePercentile() are
+ * sent again on a connection to another endpoint (if there is one) when no
+ * reply came within the delay, and get whichever reply comes first.  The
+ * other request is forgotten locally; the server still processes it.  The
+ * percentile is over the last kLatencyWindow replies of the whole pool.
+ *
+ * All members use the protocol, timeouts, transforms etc. set by
+ * Options::configure, which should configure every connection the same way.
+ */
+class PooledRequestChannel : public RequestChannel {
+ public:
+  struct Options {
+    Options()
+      : connectionsPerEndpoint(1)
+      , connectTimeout(0)
+      , reconnectDelay(1000)
+      , latencyDecay(0.2)
+      , loadWeight(0.1) {}
+
+    size_t connectionsPerEndpoint;
+    // In milliseconds, 0 for none
+    uint32_t connectTimeout;
+    std::chrono::milliseconds reconnectDelay;
+    // Weight of each new sample in the latency moving averages
+    double latencyDecay;
+    // If not empty, the load counter servers report in each response
+    std::string loadCounter;
+    double loadWeight;
+    // Called for each new connection
+    std::function<void(HeaderClientChannel*)> configure;
+  };
+
+  typedef
+    std::unique_ptr<PooledRequestChannel,
+                    apache::thrift::async::TDelayedDestruction::Destructor>
+    Ptr;
+
+  static Ptr newChannel(apache::thrift::async::TEventBase* eventBase,
+                        const std::vector<folly::SocketAddress>& endpoints,
+                        const Options& options = Options()) {
+    return Ptr(new PooledRequestChannel(eventBase, endpoints, options));
+  }
+
+  PooledRequestChannel(apache::thrift::async::TEventBase* eventBase,
+                       const std::vector<folly::SocketAddress>& endpoints,
+                       const Options& options = Options());
+
+  // TDelayedDestruction methods
+  void destroy();
+
+  // Client interface from RequestChannel
+  using RequestChannel::sendRequest;
+  uint32_t sendRequest(const RpcOptions&,
+                       std::unique_ptr<RequestCallback>,
+                       std::unique_ptr<apache::thrift::ContextStack>,
+                       std::unique_ptr<folly::IOBuf>);
+
+  using RequestChannel::sendOnewayRequest;
+  uint32_t sendOnewayRequest(const RpcOptions&,
+                             std::unique_ptr<RequestCallback>,
+                             std::unique_ptr<apache::thrift::ContextStack>,
+                             std::unique_ptr<folly::IOBuf>);
+
+  // Called when the pool is destroyed; failed members are replaced instead
+  // of closing the pool.
+  void setCloseCallback(CloseCallback* cb) {
+    closeCallback_ = cb;
+  }
+
+  apache::thrift::async::TEventBase* getEventBase() {
+    return eventBase_;
+  }
+
+  uint16_t getProtocolId() {
+    return protocolId_;
+  }
+
+  struct MemberStats {
+    folly::SocketAddress address;
+    bool connected;
+    uint32_t outstanding;
+    // Moving average, 0 before the first reply
+    std::chrono::microseconds latency;
+    // Last load the server reported, -1 if none
+    int64_t load;
+    uint64_t requests;
+    uint64_t reconnects;
+  };
+
+  std::vector<MemberStats> getMemberStats() const;
+
+  // Backup requests sent, and how many of them replied first
+  uint64_t getHedgesSent() const {
+    return hedgesSent_;
+  }
+
+  uint64_t getHedgesWon() const {
+    return hedgesWon_;
+  }
+
+  static const size_t kLatencyWindow = 1024;
+  // Percentiles need at least this many replies
+  static const size_t kMinLatencySamples = 100;
+
+ private:
+  struct Member : public CloseCallback {
+    Member(PooledRequestChannel* pool, const folly::SocketAddress& address)
+      : pool(pool)
+      , address(address)
+      , failed(false)
+      , outstanding(0)
+      , latencyUsec(0.0)
+      , load(-1)
+      , requests(0)
+      , reconnects(0) {}
+
+    void channelClosed() override {
+      pool->memberFailed(this);
+    }
+
+    bool healthy() const {
+      return channel && !failed && channel->getTransport()->good();
+    }
+
+    PooledRequestChannel* pool;
+    folly::SocketAddress address;
+    HeaderClientChannel::Ptr channel;
+    // The channel got EOF or an error
+    bool failed;
+    uint32_t outstanding;
+    double latencyUsec;
+    int64_t load;
+    uint64_t requests;
+    uint64_t reconnects;
+    std::chrono::steady_clock::time_point retryAfter;
+  };
+
+  class MemberCallback;
+  class HedgedRequest;
+  class HedgeCallback;
+
+  ~PooledRequestChannel() {}
+
+  void connect(Member* m);
+  bool usable(const Member* m,
+              std::chrono::steady_clock::time_point now) const;
+  double cost(const Member* m) const;
+  // Picks and, if needed, reconnects a member; null if none is usable.
+  // Members on avoid's endpoint are only picked if there is nothing else.
+  Member* pick(const Member* avoid = nullptr);
+  Member* pick(std::chrono::steady_clock::time_point now,
+               const Member* avoid,
+               bool sameEndpoint);
+  uint32_t send(Member* m,
+                const RpcOptions& rpcOptions,
+                std::unique_ptr<RequestCallback> cb,
+                std::unique_ptr<apache::thrift::ContextStack> ctx,
+                std::unique_ptr<folly::IOBuf> buf,
+                bool oneway);
+  // 0 if the request should not be hedged
+  std::chrono::milliseconds hedgeDelay(const RpcOptions& rpcOptions);
+  void recordLatency(std::chrono::microseconds latency);
+  // start is empty for oneway requests, which have no latency
+  void requestDone(Member* m,
+                   HeaderClientChannel* channel,
+                   std::chrono::steady_clock::time_point start,
+                   bool reply);
+  void memberFailed(Member* m);
+
+  apache::thrift::async::TEventBase* eventBase_;
+  Options options_;
+  std::vector<std::unique_ptr<Member>> members_;
+  std::mt19937 rng_;
+  uint16_t protocolId_;
+  CloseCallback* closeCallback_;
+  // Set by destroy(), for callbacks that complete after it
+  std::shared_ptr<bool> destroyed_;
+
+  apache::thrift::async::HHWheelTimer::UniquePtr timer_;
+  // Hedged requests waiting for their delay
+  std::unordered_set<HedgedRequest*> hedging_;
+  uint64_t hedgesSent_;
+  uint64_t hedgesWon_;
+
+  // Recent reply latencies in microseconds, a ring buffer
+  std::vector<uint32_t> latencies_;
+  size_t latencyCount_;
+  // Sorted copy of latencies_, refreshed every so many replies
+  std::vector<uint32_t> sortedLatencies_;
+  size_t unsortedLatencies_;
+};
+
+}} // apache::thrift
+
+#endif // THRIFT_ASYNC_POOLEDREQUESTCHANNEL_H_
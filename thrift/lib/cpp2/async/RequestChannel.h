@@ -194,7 +194,9 @@ class RpcOptions {
   typedef apache::thrift::concurrency::PriorityThreadManager::PRIORITY PRIORITY;
   RpcOptions()
    : timeout_(0),
-     priority_(apache::thrift::concurrency::N_PRIORITIES)
+     priority_(apache::thrift::concurrency::N_PRIORITIES),
+     hedgeDelay_(0),
+     hedgePercentile_(0.0)
   { }
 
   RpcOptions& setTimeout(std::chrono::milliseconds timeout) {
@@ -214,9 +216,41 @@ class RpcOptions {
   PRIORITY getPriority() const {
     return priority_;
   }
+
+  /**
+   * Hedged requests: if no reply has arrived after delay, send the request
+   * again on another connection and use whichever reply comes first.  The
+   * other one is dropped.  Only set this for idempotent methods.
+   *
+   * Channels with a single connection ignore it; see PooledRequestChannel.
+   */
+  RpcOptions& setHedgeDelay(std::chrono::milliseconds delay) {
+    hedgeDelay_ = delay;
+    return *this;
+  }
+
+  std::chrono::milliseconds getHedgeDelay() const {
+    return hedgeDelay_;
+  }
+
+  /**
+   * Hedge after this percentile (e.g. 0.99) of the channel's recent reply
+   * latency instead, once the channel has seen enough replies.  Until then
+   * getHedgeDelay() is used, if set.
+   */
+  RpcOptions& setHedgePercentile(double percentile) {
+    hedgePercentile_ = percentile;
+    return *this;
+  }
+
+  double getHedgePercentile() const {
+    return hedgePercentile_;
+  }
  private:
   std::chrono::milliseconds timeout_;
   PRIORITY priority_;
+  std::chrono::milliseconds hedgeDelay_;
+  double hedgePercentile_;
 };
 
 /**
@@ -0,0 +1,63 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/lib/cpp2/async/WriteBatcher.h>
+#include <thrift/lib/cpp2/async/Cpp2Channel.h>
+
+#include <glog/logging.h>
+
+namespace apache { namespace thrift {
+
+WriteBatcher::~WriteBatcher() {
+  // Anything still pending would otherwise be dropped silently.
+  if (!pending_.empty()) {
+    cancelLoopCallback();
+    runLoopCallback();
+  }
+}
+
+void WriteBatcher::addPendingWrite(Cpp2Channel* channel) {
+  DCHECK(eventBase_->isInEventBaseThread());
+  if (pending_.empty()) {
+    eventBase_->runInLoop(this);
+  }
+  pending_.emplace_back(channel, Guard(channel));
+}
+
+void WriteBatcher::runLoopCallback() noexcept {
+  // Flushing can complete writes synchronously, and send callbacks may
+  // queue new messages; those land in a fresh batch for the next loop.
+  std::vector<std::pair<Cpp2Channel*, Guard>> batch;
+  batch.swap(pending_);
+
+  for (auto& entry : batch) {
+    entry.first->flushSends();
+  }
+  increment(flushes_);
+}
+
+WriteBatcher::Stats WriteBatcher::getStats() const {
+  Stats stats;
+  stats.messages = messages_.load(std::memory_order_relaxed);
+  stats.writes = writes_.load(std::memory_order_relaxed);
+  stats.flushes = flushes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}} // apache::thrift
@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef THRIFT_ASYNC_WRITEBATCHER_H_
+#define THRIFT_ASYNC_WRITEBATCHER_H_ 1
+
+#include <thrift/lib/cpp/async/TDelayedDestruction.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace apache { namespace thrift {
+
+class Cpp2Channel;
+
+/**
+ * WriteBatcher collects the queued sends of every Cpp2Channel on one
+ * TEventBase and flushes them together from a single loop callback.
+ *
+ * Without a batcher, each channel in queued-sends mode schedules its own
+ * loop callback, so a worker serving many connections runs one callback
+ * per busy connection per loop.  With a batcher all of them are written
+ * back-to-back at the end of the loop iteration.  Channels are still
+ * written with one writev() each; sendmmsg() only batches datagrams on a
+ * single socket and cannot span TCP connections.  So the batcher saves
+ * loop callbacks, not write syscalls: those are saved by queued sends,
+ * which write all the responses of a connection in a loop at once.
+ *
+ * The batcher also keeps counters of messages sent and transport writes
+ * issued, so the number of write syscalls per response can be observed.
+ * Counters are updated only from the TEventBase thread but may be read
+ * from any thread.
+ */
+class WriteBatcher : private apache::thrift::async::TEventBase::LoopCallback {
+ public:
+  struct Stats {
+    Stats() : messages(0), writes(0), flushes(0) {}
+
+    Stats& operator+=(const Stats& other) {
+      messages += other.messages;
+      writes += other.writes;
+      flushes += other.flushes;
+      return *this;
+    }
+
+    /// Messages (responses) handed to the channels.
+    uint64_t messages;
+    /// Transport writes issued; each is at least one write syscall.
+    uint64_t writes;
+    /// Loop iterations in which the batcher flushed at least one channel.
+    uint64_t flushes;
+  };
+
+  /**
+   * @param batchSends if false, channels keep scheduling their own loop
+   *        callbacks and the batcher only maintains the counters.
+   */
+  explicit WriteBatcher(apache::thrift::async::TEventBase* eventBase,
+                        bool batchSends = true)
+    : eventBase_(eventBase)
+    , batchSends_(batchSends)
+    , messages_(0)
+    , writes_(0)
+    , flushes_(0) {}
+
+  ~WriteBatcher();
+
+  /**
+   * Schedule a flush of channel's queued sends at the end of this loop.
+   * Called once per channel, when the first message of the iteration is
+   * queued.  The channel is kept alive until it has been flushed.
+   */
+  void addPendingWrite(Cpp2Channel* channel);
+
+  void recordMessage() {
+    increment(messages_);
+  }
+
+  void recordWrite() {
+    increment(writes_);
+  }
+
+  Stats getStats() const;
+
+  apache::thrift::async::TEventBase* getEventBase() const {
+    return eventBase_;
+  }
+
+  bool getBatchSends() const {
+    return batchSends_;
+  }
+
+ private:
+  typedef apache::thrift::async::TDelayedDestruction::DestructorGuard Guard;
+
+  void runLoopCallback() noexcept override;
+
+  static void increment(std::atomic<uint64_t>& counter) {
+    // Single writer: avoid the cost of a locked read-modify-write.
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  apache::thrift::async::TEventBase* eventBase_;
+  const bool batchSends_;
+  std::vector<std::pair<Cpp2Channel*, Guard>> pending_;
+
+  std::atomic<uint64_t> messages_;
+  std::atomic<uint64_t> writes_;
+  std::atomic<uint64_t> flushes_;
+};
+
+}} // apache::thrift
+
+#endif // THRIFT_ASYNC_WRITEBATCHER_H_
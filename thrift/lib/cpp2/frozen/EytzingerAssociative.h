@@ -0,0 +1,52 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+#include <map>
+#include <set>
+
+#include <thrift/lib/cpp2/frozen/Traits.h>
+
+namespace apache { namespace thrift { namespace frozen {
+/*
+ * Ordered associative types which behave exactly like std::map and std::set
+ * when thawed, but freeze with EytzingerTableLayout instead of
+ * SortedTableLayout for faster lookups in large frozen tables. Use them
+ * through 'cpp.template' to select the layout for a field, e.g.
+ *
+ *   map<i64, string> (cpp.template = "apache::thrift::frozen::EytzingerMap")
+ */
+template <class K, class V>
+class EytzingerMap : public std::map<K, V> {
+  typedef std::map<K, V> Base;
+ public:
+  using Base::Base;
+  EytzingerMap() {}
+};
+
+template <class V>
+class EytzingerSet : public std::set<V> {
+  typedef std::set<V> Base;
+ public:
+  using Base::Base;
+  EytzingerSet() {}
+};
+
+}}}
+
+THRIFT_DECLARE_TRAIT_TEMPLATE(IsEytzingerMap,
+                              apache::thrift::frozen::EytzingerMap)
+THRIFT_DECLARE_TRAIT_TEMPLATE(IsEytzingerSet,
+                              apache::thrift::frozen::EytzingerSet)
@@ -18,6 +18,11 @@
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 namespace apache { namespace thrift { namespace frozen {
 
 std::ostream& operator<<(std::ostream& os, DebugLine dl) {
@@ -94,6 +99,83 @@ void LayoutBase::save(schema::MemorySchema& schema,
   layout.bits = bits;
 }
 
+void FreezeRoot::freezeChunks(
+    const std::vector<size_t>& offsets,
+    const std::function<void(FreezeRoot&, size_t)>& freezeChunk) {
+  folly::MutableByteRange range;
+  size_t dist;
+  appendBytes(base_ + offsets.front(),
+              offsets.back() - offsets.front(),
+              range,
+              dist);
+  if (!range.empty() && range.begin() != base_ + offsets.front()) {
+    throw LayoutException();
+  }
+
+  // Bit-packed fields are written with word-sized read-modify-writes, which
+  // may touch the first bytes after a chunk's items or data. Chunks are
+  // grouped until their data spans at least a word, and neighbors never run
+  // at the same time: first the even groups, then the odd ones, then the
+  // last, whose items end next to the first group's data.
+  size_t chunks = offsets.size() - 1;
+  std::vector<std::pair<size_t, size_t>> groups;
+  for (size_t begin = 0; begin < chunks;) {
+    size_t end = begin + 1;
+    while (end < chunks && offsets[end] - offsets[begin] < sizeof(uint64_t)) {
+      ++end;
+    }
+    groups.emplace_back(begin, end);
+    begin = end;
+  }
+
+  auto freezeGroup = [&](const std::pair<size_t, size_t>& group) {
+    ByteRangeFreezer root(folly::MutableByteRange(base_ + offsets[group.first],
+                                                  base_ + offsets[group.second]));
+    for (size_t chunk = group.first; chunk < group.second; ++chunk) {
+      freezeChunk(root, chunk);
+    }
+    if (!root.write_.empty()) {
+      throw LayoutException();
+    }
+  };
+
+  size_t last = groups.size() - 1;
+  for (size_t phase = 0; phase < 3; ++phase) {
+    std::vector<size_t> todo;
+    for (size_t g = 0; g < groups.size(); ++g) {
+      if (phase == 2 ? g == last : g != last && g % 2 == phase) {
+        todo.push_back(g);
+      }
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&] {
+      size_t i;
+      while ((i = next++) < todo.size()) {
+        try {
+          freezeGroup(groups[todo[i]]);
+        } catch (...) {
+          std::lock_guard<std::mutex> g(errorMutex);
+          error = std::current_exception();
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(threads_, todo.size()); ++t) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
 namespace detail {
 
 FieldPosition BlockLayout::layout(LayoutRoot& root,
@@ -134,6 +216,15 @@ void BufferHelpers<std::unique_ptr<folly::IOBuf>>::copyTo(
   folly::io::Cursor(src.get()).pull(dst.begin(), dst.size());
 }
 
+bool BufferHelpers<std::unique_ptr<folly::IOBuf>>::contiguous(
+    const std::unique_ptr<folly::IOBuf>& src, folly::ByteRange& bytes) {
+  if (src->isChained()) {
+    return false;
+  }
+  bytes.reset(src->data(), src->length());
+  return true;
+}
+
 void BufferHelpers<std::unique_ptr<folly::IOBuf>>::thawTo(
     folly::ByteRange src, std::unique_ptr<folly::IOBuf>& dst) {
   dst = folly::IOBuf::copyBuffer(src.begin(), src.size());
@@ -16,9 +16,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include <iosfwd>
 #include <iterator>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <string>
@@ -37,6 +40,7 @@
 #include <folly/Range.h>
 #include <folly/experimental/Bits.h>
 
+#include <thrift/lib/cpp/DistinctTable.h>
 #include <thrift/lib/cpp2/frozen/FrozenMacros.h>
 #include <thrift/lib/cpp2/frozen/Traits.h>
 #include <thrift/lib/cpp2/frozen/schema/MemorySchema.h>
@@ -418,12 +422,109 @@ T thaw(T value) {
   return value;
 };
 
+/**
+ * Opt-in behaviors for laying out and freezing. An object must be frozen with
+ * the same options its layout was computed with.
+ */
+struct FreezeOptions {
+  /**
+   * Store the bytes of identical strings (and binary fields) once, pointing
+   * every copy's 'distance' at them. The format is unchanged, so views and
+   * readers of older versions see no difference. Distances can't be
+   * negative, so bytes are only shared with objects laid out before them,
+   * which covers repeats within a collection and its elements' subtrees.
+   */
+  bool dedupStrings = false;
+  /**
+   * Freeze arrays and hash tables of at least 'parallelMinItems' items in
+   * chunks on this many threads. Layout stays single-threaded, but records
+   * where each chunk's out-of-line data starts, so the chunks can be written
+   * independently and the output is identical. Ignored with dedupStrings.
+   */
+  size_t threads = 1;
+  size_t parallelMinItems = 100000;
+};
+
+namespace detail {
+
+/**
+ * Where the out-of-line data of each chunk of a large array starts, as an
+ * offset from the root, followed by where the last chunk's ends. Keyed by
+ * the offset of the array's items and the number of arrays it is nested in:
+ * an array of zero-size items in its parent's first item starts where the
+ * parent's items do.
+ */
+typedef std::map<std::pair<size_t, size_t>, std::vector<size_t>>
+    ChunkOffsets;
+
+/**
+ * Items per chunk when freezing n items in parallel: a few chunks per thread,
+ * each starting on a whole byte even if items are bit-packed.
+ */
+inline size_t parallelChunkItems(size_t n, size_t threads) {
+  return std::max<size_t>(64, (n / (threads * 4) + 63) & ~size_t(63));
+}
+
+template <class T>
+const T& itemRef(const T& item) {
+  return item;
+}
+
+template <class T>
+const T& itemRef(const T* item) {
+  return *item;
+}
+
+template <class T>
+struct ByteRangeDistinctTablePolicy : BaseDistinctTablePolicy<T> {
+  struct Hash {
+    size_t operator()(folly::ByteRange bytes) const {
+      return folly::hash::fnv64_buf(bytes.begin(), bytes.size());
+    }
+  };
+};
+
+/**
+ * Remembers where the latest copy of each distinct byte string was placed,
+ * as an offset from the root during layout or as an address while freezing.
+ * The strings themselves must outlive this.
+ */
+template <class Position>
+class SharedBytes {
+ public:
+  SharedBytes() : table_(&values_) {}
+  SharedBytes(const SharedBytes&) = delete;
+  SharedBytes& operator=(const SharedBytes&) = delete;
+
+  /**
+   * Returns the position slot of 'bytes', setting 'seen' if it was filled in
+   * before. The slot is valid until the next call.
+   */
+  Position& find(folly::ByteRange bytes, bool& seen) {
+    size_t index = table_.add(bytes);
+    seen = index < positions_.size();
+    if (!seen) {
+      positions_.emplace_back();
+    }
+    return positions_[index];
+  }
+
+ private:
+  std::vector<folly::ByteRange> values_;
+  DistinctTable<folly::ByteRange, ByteRangeDistinctTablePolicy> table_;
+  std::vector<Position> positions_;
+};
+
+} // detail
+
 /**
  * LayoutRoot calculates the layout necessary to store a given object,
  * recursively. The logic of layout should closely match that of freezing.
  */
 class LayoutRoot {
-  LayoutRoot() {}
+ protected:
+  explicit LayoutRoot(const FreezeOptions& options = FreezeOptions())
+      : options_(options) {}
   /**
    * Lays out a given object from the root, repeatedly running layout until a
    * fixed point is reached.
@@ -433,6 +534,14 @@ class LayoutRoot {
     for (int t = 0; t < 1000; ++t) {
       resized_ = false;
       cursor_ = layout.size;
+      savedBytes_ = 0;
+      itemsDepth_ = 0;
+      if (options_.dedupStrings) {
+        // Positions change from one pass to the next
+        sharedBytes_.reset(new detail::SharedBytes<size_t>());
+      } else if (options_.threads > 1) {
+        chunks_.reset(new detail::ChunkOffsets());
+      }
       auto after = layout.layout(*this, root, {0, 0});
       if (!layout.resize(after, false) && !resized_) {
         return cursor_;
@@ -452,6 +561,28 @@ class LayoutRoot {
     return LayoutRoot().doLayout(root, layout);
   }
 
+  /**
+   * As above, with options. If 'savedBytes' is given, it receives the number
+   * of bytes deduplication saved. 'chunks' receives what freezing with
+   * FreezeOptions::threads needs.
+   */
+  template <class T>
+  static size_t layout(const T& root,
+                       Layout<T>& layout,
+                       const FreezeOptions& options,
+                       size_t* savedBytes = nullptr,
+                       detail::ChunkOffsets* chunks = nullptr) {
+    LayoutRoot layoutRoot(options);
+    size_t size = layoutRoot.doLayout(root, layout);
+    if (savedBytes) {
+      *savedBytes = layoutRoot.savedBytes_;
+    }
+    if (chunks && layoutRoot.chunks_) {
+      *chunks = std::move(*layoutRoot.chunks_);
+    }
+    return size;
+  }
+
   /**
    * Internal utility for recursing into child fields.
    *
@@ -490,6 +621,38 @@ class LayoutRoot {
     return nextPos;
   }
 
+  /**
+   * Internal utility for laying out the 'n' items of an array, starting at
+   * 'first', which may iterate over items or pointers to them.
+   */
+  template <class T, class Layout, class Iterator>
+  void layoutItems(LayoutPosition write,
+                   FieldPosition writeStep,
+                   Field<T, Layout>& field,
+                   size_t n,
+                   Iterator first) {
+    std::vector<size_t>* offsets = nullptr;
+    size_t chunkItems = 0;
+    if (chunks_ && n >= options_.parallelMinItems) {
+      offsets = &(*chunks_)[std::make_pair(write.start, itemsDepth_)];
+      offsets->clear();
+      chunkItems = detail::parallelChunkItems(n, options_.threads);
+    }
+    FieldPosition noField; // not really used
+    ++itemsDepth_;
+    for (size_t i = 0; i < n; ++i, ++first) {
+      if (offsets && i % chunkItems == 0) {
+        offsets->push_back(cursor_);
+      }
+      layoutField(write, noField, field, detail::itemRef(*first));
+      write = write(writeStep);
+    }
+    --itemsDepth_;
+    if (offsets) {
+      offsets->push_back(cursor_);
+    }
+  }
+
   template <class T, class Layout>
   FieldPosition layoutOptionalField(LayoutPosition self,
                                     FieldPosition fieldPos,
@@ -519,9 +682,38 @@ class LayoutRoot {
     return start - origin;
   }
 
+  /**
+   * Like layoutBytesDistance() for a copy of 'bytes', but with
+   * FreezeOptions::dedupStrings returns the offset of an identical copy
+   * placed earlier, if it lies after origin. Must match
+   * FreezeRoot::appendSharedBytes().
+   */
+  size_t layoutSharedBytesDistance(size_t origin, folly::ByteRange bytes) {
+    size_t* copy = nullptr;
+    if (sharedBytes_) {
+      bool seen;
+      copy = &sharedBytes_->find(bytes, seen);
+      if (seen && *copy >= origin) {
+        savedBytes_ += bytes.size();
+        return *copy - origin;
+      }
+    }
+    size_t distance = layoutBytesDistance(origin, bytes.size());
+    if (copy) {
+      *copy = origin + distance;
+    }
+    return distance;
+  }
+
  protected:
   bool resized_;
   size_t cursor_;
+  FreezeOptions options_;
+  std::unique_ptr<detail::SharedBytes<size_t>> sharedBytes_;
+  size_t savedBytes_ = 0;
+  std::unique_ptr<detail::ChunkOffsets> chunks_;
+  // Arrays whose items are being laid out
+  size_t itemsDepth_ = 0;
 };
 
 /**
@@ -553,11 +745,21 @@ class LayoutTypeMismatchException : public std::logic_error {
  */
 class FreezeRoot {
  protected:
+  explicit FreezeRoot(const FreezeOptions& options = FreezeOptions(),
+                      const detail::ChunkOffsets* chunks = nullptr)
+      : threads_(options.threads), chunks_(chunks) {
+    if (options.dedupStrings) {
+      sharedBytes_.reset(new detail::SharedBytes<byte*>());
+      chunks_ = nullptr;
+    }
+  }
+
   template <class T>
   typename Layout<T>::View doFreeze(const Layout<T>& layout, const T& root) {
     folly::MutableByteRange range;
     size_t dist;
     appendBytes(0, layout.size, range, dist);
+    base_ = range.begin();
     layout.freeze(*this, root, {range.begin(), 0});
     return layout.view({range.begin(), 0});
   }
@@ -579,6 +781,47 @@ class FreezeRoot {
     }
   }
 
+  /**
+   * Internal utility for freezing the 'n' items of an array, starting at
+   * 'first', which may iterate over items or pointers to them. Must match
+   * LayoutRoot::layoutItems().
+   */
+  template <class T, class Layout, class Iterator>
+  void freezeItems(FreezePosition write,
+                   FieldPosition writeStep,
+                   const Field<T, Layout>& field,
+                   size_t n,
+                   Iterator first) {
+    const std::vector<size_t>* offsets = chunkOffsets(write.start);
+    if (!offsets) {
+      ++itemsDepth_;
+      for (size_t i = 0; i < n; ++i, ++first) {
+        freezeField(write, field, detail::itemRef(*first));
+        write = write(writeStep);
+      }
+      --itemsDepth_;
+      return;
+    }
+
+    size_t chunkItems = detail::parallelChunkItems(n, threads_);
+    std::vector<Iterator> starts;
+    for (size_t i = 0; i < n; i += chunkItems) {
+      starts.push_back(first);
+      std::advance(first, std::min(chunkItems, n - i));
+    }
+    freezeChunks(*offsets, [&](FreezeRoot& root, size_t chunk) {
+      size_t begin = chunk * chunkItems;
+      size_t end = std::min(n, begin + chunkItems);
+      FreezePosition pos{write.start + begin * writeStep.offset,
+                         write.bitOffset + begin * writeStep.bitOffset};
+      auto it = starts[chunk];
+      for (size_t i = begin; i < end; ++i, ++it) {
+        root.freezeField(pos, field, detail::itemRef(*it));
+        pos = pos(writeStep);
+      }
+    });
+  }
+
   template <class T, class Layout>
   void freezeOptionalField(FreezePosition self,
                            const Field<folly::Optional<T>, Layout>& field,
@@ -602,19 +845,75 @@ class FreezeRoot {
     doAppendBytes(origin, n, range, distance);
   }
 
+  /**
+   * Appends a copy of 'bytes', setting its distance from origin. With
+   * FreezeOptions::dedupStrings, an identical copy appended earlier is reused
+   * instead if it lies after origin.
+   */
+  void appendSharedBytes(byte* origin,
+                         folly::ByteRange bytes,
+                         size_t& distance) {
+    byte** copy = nullptr;
+    if (sharedBytes_) {
+      bool seen;
+      copy = &sharedBytes_->find(bytes, seen);
+      if (seen && *copy >= origin) {
+        distance = *copy - origin;
+        return;
+      }
+    }
+    folly::MutableByteRange range;
+    doAppendBytes(origin, bytes.size(), range, distance);
+    std::copy(bytes.begin(), bytes.end(), range.begin());
+    if (copy) {
+      *copy = range.begin();
+    }
+  }
+
  private:
   virtual void doAppendBytes(byte* origin,
                              size_t n,
                              folly::MutableByteRange& range,
                              size_t& distance) = 0;
+
+  // The chunk offsets of the array with items at 'items', if it is parallel
+  const std::vector<size_t>* chunkOffsets(byte* items) const {
+    if (!chunks_ || !base_) {
+      return nullptr;
+    }
+    return folly::get_ptr(*chunks_,
+                          std::make_pair(size_t(items - base_), itemsDepth_));
+  }
+
+  /**
+   * Appends the out-of-line data of every chunk, calling freezeChunk(root,
+   * chunk) on threads_ threads with a FreezeRoot writing where 'offsets' says
+   * the chunk's data goes.
+   */
+  void freezeChunks(
+      const std::vector<size_t>& offsets,
+      const std::function<void(FreezeRoot&, size_t)>& freezeChunk);
+
+  std::unique_ptr<detail::SharedBytes<byte*>> sharedBytes_;
+  size_t threads_;
+  const detail::ChunkOffsets* chunks_;
+  // Where the root was frozen, and the arrays whose items are being frozen
+  // sequentially, for finding chunk offsets
+  byte* base_ = nullptr;
+  size_t itemsDepth_ = 0;
 };
 
 /**
  * A FreezeRoot that writes to a given ByteRange
  */
 class ByteRangeFreezer final : public FreezeRoot {
+  friend class FreezeRoot;
+
  protected:
-  explicit ByteRangeFreezer(folly::MutableByteRange write) : write_(write) {}
+  explicit ByteRangeFreezer(folly::MutableByteRange write,
+                            const FreezeOptions& options = FreezeOptions(),
+                            const detail::ChunkOffsets* chunks = nullptr)
+      : FreezeRoot(options, chunks), write_(write) {}
 
  public:
   template <class T>
@@ -624,6 +923,20 @@ class ByteRangeFreezer final : public FreezeRoot {
     return ByteRangeFreezer(write).doFreeze(layout, root);
   }
 
+  /**
+   * As above, for a layout computed with 'options', which also produced
+   * 'chunks'.
+   */
+  template <class T>
+  static typename Layout<T>::View freeze(
+      const Layout<T>& layout,
+      const T& root,
+      folly::MutableByteRange write,
+      const FreezeOptions& options,
+      const detail::ChunkOffsets* chunks = nullptr) {
+    return ByteRangeFreezer(write, options, chunks).doFreeze(layout, root);
+  }
+
  private:
   void doAppendBytes(byte* origin,
                      size_t n,
@@ -687,11 +1000,20 @@ template <class T,
               !folly::IsTriviallyCopyable<T>::value>::type,
           class Return = Bundled<typename Layout<T>::View>>
 Return freeze(const T& x, Frozen2 = Frozen2::Marker) {
+  return freeze<T, void, Return>(x, FreezeOptions());
+};
+
+template <class T,
+          class = typename std::enable_if<
+              !folly::IsTriviallyCopyable<T>::value>::type,
+          class Return = Bundled<typename Layout<T>::View>>
+Return freeze(const T& x, const FreezeOptions& options) {
   std::unique_ptr<Layout<T>> layout(new Layout<T>);
-  size_t size = LayoutRoot::layout(x, *layout);
+  detail::ChunkOffsets chunks;
+  size_t size = LayoutRoot::layout(x, *layout, options, nullptr, &chunks);
   std::unique_ptr<byte[]> storage(new byte[size]);
   folly::MutableByteRange write(storage.get(), size);
-  Return ret(ByteRangeFreezer::freeze(*layout, x, write));
+  Return ret(ByteRangeFreezer::freeze(*layout, x, write, options, &chunks));
   ret.hold(std::move(layout));
   ret.hold(std::move(storage));
   return ret;
@@ -735,6 +1057,7 @@ void thawField(ViewPosition self,
 #include <thrift/lib/cpp2/frozen/FrozenPair-inl.h>
 #include <thrift/lib/cpp2/frozen/FrozenRange-inl.h>
 #include <thrift/lib/cpp2/frozen/FrozenOrderedTable-inl.h>
+#include <thrift/lib/cpp2/frozen/FrozenEytzingerTable-inl.h>
 #include <thrift/lib/cpp2/frozen/FrozenHashTable-inl.h>
 #include <thrift/lib/cpp2/frozen/FrozenAssociative-inl.h>
 #include <thrift/lib/cpp2/frozen/FrozenEnum-inl.h> // depends on Integral
@@ -116,6 +116,19 @@ struct Layout<T, typename std::enable_if<IsHashSet<T>::value>::type>
     : public detail::SetTableLayout<T,
                                     typename T::value_type,
                                     detail::HashTableLayout> {};
+
+template <class T>
+struct Layout<T, typename std::enable_if<IsEytzingerMap<T>::value>::type>
+    : public detail::MapTableLayout<T,
+                                    typename T::key_type,
+                                    typename T::mapped_type,
+                                    detail::EytzingerTableLayout> {};
+
+template <class T>
+struct Layout<T, typename std::enable_if<IsEytzingerSet<T>::value>::type>
+    : public detail::SetTableLayout<T,
+                                    typename T::value_type,
+                                    detail::EytzingerTableLayout> {};
 }}}
 
 THRIFT_DECLARE_TRAIT_TEMPLATE(IsHashMap, std::unordered_map)
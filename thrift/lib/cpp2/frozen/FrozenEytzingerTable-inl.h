@@ -0,0 +1,277 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+namespace apache { namespace thrift { namespace frozen {
+namespace detail {
+
+/**
+ * Layout specialization for unique ordered range types, storing the items in
+ * Eytzinger (breadth-first) order: the root of an implicit balanced binary
+ * search tree first, then its children, and so on.  Item 'k' (1-based) has
+ * its children at '2k' and '2k + 1'.
+ *
+ * Compared to SortedTableLayout's binary search over sorted items, the items
+ * compared near the top of every search are packed into the same few cache
+ * lines, and the descendants 4 levels below the current item are contiguous,
+ * so they are prefetched while the levels in between are compared.
+ *
+ * Iteration, lower_bound() and upper_bound() still visit items in key order,
+ * but iterators are only bidirectional, and indexing with operator[] uses
+ * the storage order.
+ */
+template <class T, class Item, class KeyExtractor, class Key = T>
+struct EytzingerTableLayout : public ArrayLayout<T, Item> {
+  typedef ArrayLayout<T, Item> Base;
+  typedef EytzingerTableLayout LayoutSelf;
+
+  /**
+   * In-order successor of 1-based tree index k in a tree of n items, 0 after
+   * the last one.
+   */
+  static size_t next(size_t k, size_t n) {
+    if (2 * k + 1 <= n) {
+      k = 2 * k + 1;
+      while (2 * k <= n) {
+        k = 2 * k;
+      }
+    } else {
+      k >>= folly::findFirstSet(~k);
+    }
+    return k;
+  }
+
+  /**
+   * In-order predecessor of k, where the predecessor of 0 is the last item.
+   */
+  static size_t prev(size_t k, size_t n) {
+    if (k == 0) {
+      k = 1;
+      while (2 * k + 1 <= n) {
+        k = 2 * k + 1;
+      }
+    } else if (2 * k <= n) {
+      k = 2 * k;
+      while (2 * k + 1 <= n) {
+        k = 2 * k + 1;
+      }
+    } else {
+      k >>= folly::findFirstSet(k);
+    }
+    return k;
+  }
+
+  // Index of the smallest item, 0 if there are none
+  static size_t first(size_t n) {
+    size_t k = n ? 1 : 0;
+    while (k && 2 * k <= n) {
+      k = 2 * k;
+    }
+    return k;
+  }
+
+  /**
+   * Orders the items of coll, which iterates in key order, by tree index.
+   */
+  static void buildIndex(const T& coll, std::vector<const Item*>& index) {
+    size_t n = coll.size();
+    index.resize(n);
+    size_t k = first(n);
+    for (auto& item : coll) {
+      index[k - 1] = &item;
+      k = next(k, n);
+    }
+  }
+
+  FieldPosition layoutItems(LayoutRoot& root,
+                            const T& coll,
+                            LayoutPosition self,
+                            FieldPosition pos,
+                            LayoutPosition write,
+                            FieldPosition writeStep) final {
+    std::vector<const Item*> index;
+    buildIndex(coll, index);
+
+    root.layoutItems(write, writeStep, this->itemField, index.size(),
+                     index.begin());
+    return pos;
+  }
+
+  void freezeItems(FreezeRoot& root,
+                   const T& coll,
+                   FreezePosition self,
+                   FreezePosition write,
+                   FieldPosition writeStep) const final {
+    std::vector<const Item*> index;
+    buildIndex(coll, index);
+
+    root.freezeItems(write, writeStep, this->itemField, index.size(),
+                     index.begin());
+  }
+
+  void thaw(ViewPosition self, T& out) const {
+    out.clear();
+    auto v = view(self);
+    for (auto it = v.begin(); it != v.end(); ++it) {
+      out.insert(out.end(), it.thaw());
+    }
+  }
+
+  void print(std::ostream& os, int level) const override {
+    Base::print(os, level);
+    os << DebugLine(level) << "...in Eytzinger order";
+  }
+
+  class View : public Base::View {
+    typedef typename Layout<Key>::View KeyView;
+    typedef typename Layout<Item>::View ItemView;
+    typedef typename Base::View::iterator StorageIterator;
+    class Iterator;
+
+   public:
+    typedef Iterator iterator;
+    typedef Iterator const_iterator;
+
+    View() {}
+    View(const LayoutSelf* layout, ViewPosition position)
+        : Base::View(layout, position) {}
+
+    iterator begin() const {
+      return iterator(Base::View::begin(), first(this->size()), this->size());
+    }
+
+    iterator end() const {
+      return iterator(Base::View::begin(), 0, this->size());
+    }
+
+    iterator lower_bound(const KeyView& key) const {
+      auto items = Base::View::begin();
+      size_t n = this->size();
+      size_t k = 1;
+      while (k <= n) {
+        prefetch(items, std::min(16 * k, n));
+        k = 2 * k + (KeyExtractor::getViewKey(*(items + (k - 1))) < key);
+      }
+      // Climb back up to where the search last went left
+      k >>= folly::findFirstSet(~k);
+      return iterator(items, k, n);
+    }
+
+    iterator upper_bound(const KeyView& key) const {
+      auto items = Base::View::begin();
+      size_t n = this->size();
+      size_t k = 1;
+      while (k <= n) {
+        prefetch(items, std::min(16 * k, n));
+        k = 2 * k + !(key < KeyExtractor::getViewKey(*(items + (k - 1))));
+      }
+      k >>= folly::findFirstSet(~k);
+      return iterator(items, k, n);
+    }
+
+    std::pair<iterator, iterator> equal_range(const KeyView& key) const {
+      auto found = find(key);
+      if (found != end()) {
+        auto after = found;
+        return make_pair(found, ++after);
+      } else {
+        return make_pair(found, found);
+      }
+    }
+
+    iterator find(const KeyView& key) const {
+      auto found = lower_bound(key);
+      if (found != end() && KeyExtractor::getViewKey(*found) == key) {
+        return found;
+      } else {
+        return end();
+      }
+    }
+
+    size_t count(const KeyView& key) const {
+      return find(key) == end() ? 0 : 1;
+    }
+
+    T thaw() const {
+      T ret;
+      static_cast<const EytzingerTableLayout*>(this->layout_)
+          ->thaw(this->position_, ret);
+      return ret;
+    }
+
+   private:
+    // Hint the cache about the item at 1-based tree index k
+    static void prefetch(const StorageIterator& items, size_t k) {
+      auto position = (items + (k - 1)).position();
+      __builtin_prefetch(position.start + position.bitOffset / 8);
+    }
+
+    /**
+     * Iterator visiting the items in key order.
+     */
+    class Iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          ItemView,
+                                          std::ptrdiff_t,
+                                          void,
+                                          void> {
+     public:
+      Iterator(const StorageIterator& items, size_t index, size_t count)
+          : items_(items), index_(index), count_(count) {}
+
+      ViewPosition position() const {
+        return (items_ + (index_ - 1)).position();
+      }
+
+      ItemView operator*() const { return *(items_ + (index_ - 1)); }
+      ItemView operator->() const { return operator*(); }
+
+      Item thaw() const { return (items_ + (index_ - 1)).thaw(); }
+
+      Iterator& operator++() {
+        index_ = next(index_, count_);
+        return *this;
+      }
+      Iterator& operator--() {
+        index_ = prev(index_, count_);
+        return *this;
+      }
+      Iterator operator++(int) {
+        Iterator ret(*this);
+        ++*this;
+        return ret;
+      }
+      Iterator operator--(int) {
+        Iterator ret(*this);
+        --*this;
+        return ret;
+      }
+
+      bool operator==(const Iterator& other) const {
+        return index_ == other.index_ && items_ == other.items_;
+      }
+
+      bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+     private:
+      StorageIterator items_;
+      size_t index_;
+      size_t count_;
+    };
+  };
+
+  View view(ViewPosition self) const { return View(this, self); }
+};
+
+} // detail
+}}}
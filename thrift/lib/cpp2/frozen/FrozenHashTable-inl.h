@@ -144,14 +144,10 @@ struct HashTableLayout : public ArrayLayout<T, Item> {
 
     pos = root.layoutField(self, pos, this->sparseTableField, sparseTable);
 
-    FieldPosition noField; // not really used
-    for (auto& it : index) {
-      if (it) {
-        root.layoutField(write, noField, this->itemField, *it);
-        write = write(writeStep);
-      }
-    }
-
+    // Items are stored in bucket order, skipping empty buckets
+    index.erase(std::remove(index.begin(), index.end(), nullptr), index.end());
+    root.layoutItems(write, writeStep, this->itemField, index.size(),
+                     index.begin());
     return pos;
   }
 
@@ -167,13 +163,9 @@ struct HashTableLayout : public ArrayLayout<T, Item> {
     assert(index.empty() == sparseTable.empty());
     root.freezeField(self, this->sparseTableField, sparseTable);
 
-    FieldPosition noField; // not really used
-    for (auto& it : index) {
-      if (it) {
-        root.freezeField(write, this->itemField, *it);
-        write = write(writeStep);
-      }
-    }
+    index.erase(std::remove(index.begin(), index.end(), nullptr), index.end());
+    root.freezeItems(write, writeStep, this->itemField, index.size(),
+                     index.begin());
   }
 
   void thaw(ViewPosition self, T& out) const {
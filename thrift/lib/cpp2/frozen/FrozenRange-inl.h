@@ -62,12 +62,8 @@ struct ArrayLayout : public LayoutBase {
                                     FieldPosition pos,
                                     LayoutPosition write,
                                     FieldPosition writeStep) {
-    FieldPosition noField; // not really used
-    for (const auto& it : coll) {
-      root.layoutField(write, noField, this->itemField, it);
-      write = write(writeStep);
-    }
-
+    root.layoutItems(write, writeStep, this->itemField, coll.size(),
+                     coll.begin());
     return pos;
   }
 
@@ -95,10 +91,7 @@ struct ArrayLayout : public LayoutBase {
                            FreezePosition self,
                            FreezePosition write,
                            FieldPosition writeStep) const {
-    for (const auto& it : coll) {
-      root.freezeField(write, itemField, it);
-      write = write(writeStep);
-    }
+    root.freezeItems(write, writeStep, itemField, coll.size(), coll.begin());
   }
 
   void thaw(ViewPosition self, T& out) const {
@@ -28,6 +28,11 @@ struct BufferHelpers {
   static void copyTo(const T& src, folly::Range<Item*> dst) {
     std::copy(src.begin(), src.end(), reinterpret_cast<Item*>(dst.begin()));
   }
+  static bool contiguous(const T& src, folly::ByteRange& bytes) {
+    bytes.reset(reinterpret_cast<const uint8_t*>(src.data()),
+                src.size() * sizeof(Item));
+    return true;
+  }
   static void thawTo(folly::Range<const Item*> src, T& dst) {
     dst.assign(src.begin(), src.end());
   }
@@ -40,6 +45,9 @@ struct BufferHelpers<std::unique_ptr<folly::IOBuf>> {
 
   static void copyTo(const std::unique_ptr<folly::IOBuf>& src,
                      folly::MutableByteRange dst);
+  // Only unchained buffers can be deduplicated
+  static bool contiguous(const std::unique_ptr<folly::IOBuf>& src,
+                         folly::ByteRange& bytes);
   static void thawTo(folly::ByteRange src, std::unique_ptr<folly::IOBuf>& dst);
 };
 
@@ -65,7 +73,10 @@ struct StringLayout : public LayoutBase {
     if (!n) {
       return pos;
     }
-    size_t dist = root.layoutBytesDistance(self.start, n * sizeof(Item));
+    folly::ByteRange bytes;
+    size_t dist = Helper::contiguous(o, bytes)
+      ? root.layoutSharedBytesDistance(self.start, bytes)
+      : root.layoutBytesDistance(self.start, n * sizeof(Item));
     pos = root.layoutField(self, pos, distanceField, dist);
     pos = root.layoutField(self, pos, countField, n);
     return pos;
@@ -73,13 +84,18 @@ struct StringLayout : public LayoutBase {
 
   void freeze(FreezeRoot& root, const T& o, FreezePosition self) const {
     size_t n = Helper::size(o);
-    folly::MutableByteRange range;
+    folly::ByteRange bytes;
     size_t dist;
-    root.appendBytes(self.start, n * sizeof(Item), range, dist);
+    if (n && Helper::contiguous(o, bytes)) {
+      root.appendSharedBytes(self.start, bytes, dist);
+    } else {
+      folly::MutableByteRange range;
+      root.appendBytes(self.start, n * sizeof(Item), range, dist);
+      folly::Range<Item*> target(reinterpret_cast<Item*>(range.begin()), n);
+      Helper::copyTo(o, target);
+    }
     root.freezeField(self, distanceField, dist);
     root.freezeField(self, countField, n);
-    folly::Range<Item*> target(reinterpret_cast<Item*>(range.begin()),n);
-    Helper::copyTo(o, target);
   }
 
   void thaw(ViewPosition self, T& out) const {
@@ -16,6 +16,10 @@
 #include <thrift/lib/cpp2/frozen/FrozenUtil.h>
 
 #include <folly/Conv.h>
+#include <folly/Exception.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace apache { namespace thrift { namespace frozen {
 
@@ -28,4 +32,58 @@ FrozenFileForwardIncompatible::FrozenFileForwardIncompatible(int fileVersion)
           " are supported.")),
       fileVersion_(fileVersion) {}
 
+namespace detail {
+
+std::string serializeRootSchema(const LayoutBase& layout) {
+  std::string schemaStr;
+  schema::MemorySchema memSchema;
+  schema::Schema schema;
+  layout.saveRoot(memSchema);
+  schema::convert(memSchema, schema);
+
+  schema.fileVersion = schema::g_frozen_constants.kCurrentFrozenFileVersion;
+  util::ThriftSerializerCompact<>().serialize(schema, &schemaStr);
+  return schemaStr;
+}
+
+void throwItemsChanged() {
+  throw std::logic_error(
+      "freezeToFileStreaming: items differ from one pass to the next");
+}
+
+namespace {
+
+/**
+ * Writes back the whole pages of a shared file mapping within [begin, end)
+ * and drops them, returning the new start of the unreleased range.
+ */
+byte* releasePages(byte* begin, byte* end) {
+  static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  auto first = (reinterpret_cast<uintptr_t>(begin) + pageSize - 1) &
+               ~(pageSize - 1);
+  auto last = reinterpret_cast<uintptr_t>(end) & ~(pageSize - 1);
+  if (first >= last) {
+    return begin;
+  }
+  auto pages = reinterpret_cast<void*>(first);
+  folly::checkUnixError(msync(pages, last - first, MS_SYNC), "msync failed");
+  folly::checkUnixError(madvise(pages, last - first, MADV_DONTNEED),
+                        "madvise failed");
+  return reinterpret_cast<byte*>(last);
+}
+
+}
+
+void StreamingFreezer::release(byte* items) {
+  byte* tail = write_.begin();
+  if (size_t(items - itemsReleased_) + size_t(tail - tailReleased_) <
+      flushBytes_) {
+    return;
+  }
+  itemsReleased_ = releasePages(itemsReleased_, items);
+  tailReleased_ = releasePages(tailReleased_, tail);
+}
+
+} // detail
+
 }}}
@@ -38,27 +38,175 @@ class FrozenFileForwardIncompatible : public std::runtime_error {
   int fileVersion_;
 };
 
+namespace detail {
+
+// The schema header of a frozen file holding an object with 'layout'
+std::string serializeRootSchema(const LayoutBase& layout);
+
+[[noreturn]] void throwItemsChanged();
+
+/**
+ * Lays out a list, map or set given as a sequence of items, running the same
+ * passes LayoutRoot::layout() would on the materialized container.
+ */
+class StreamingLayoutRoot : public LayoutRoot {
+ public:
+  template <class T, class ForEach>
+  static size_t layout(ForEach& forEach, Layout<T>& layout, size_t& count) {
+    typedef typename T::value_type Item;
+    count = 0;
+    forEach([&](const Item&) { ++count; });
+
+    StreamingLayoutRoot root;
+    for (int t = 0; t < 1000; ++t) {
+      root.resized_ = false;
+      root.cursor_ = layout.size;
+      // Matches ArrayLayout::layout()
+      FieldPosition pos = layout.startFieldPosition();
+      if (count) {
+        size_t itemBytes = layout.itemField.layout.size;
+        size_t itemBits = itemBytes ? 0 : layout.itemField.layout.bits;
+        size_t dist = root.layoutBytesDistance(
+            0, itemBits ? (count * itemBits + 7) / 8 : count * itemBytes);
+        LayoutPosition self{0, 0};
+        pos = root.layoutField(self, pos, layout.distanceField, dist);
+        pos = root.layoutField(self, pos, layout.countField, count);
+
+        LayoutPosition write{dist, 0};
+        FieldPosition writeStep(itemBytes, itemBits);
+        FieldPosition noField; // not really used
+        size_t laidOut = 0;
+        forEach([&](const Item& item) {
+          root.layoutField(write, noField, layout.itemField, item);
+          write = write(writeStep);
+          ++laidOut;
+        });
+        if (laidOut != count) {
+          throwItemsChanged();
+        }
+      }
+      if (!layout.resize(pos, false) && !root.resized_) {
+        return root.cursor_;
+      }
+    }
+    assert(false); // layout should always reach a fixed point.
+    return 0;
+  }
+};
+
+/**
+ * Freezes a list, map or set given as a sequence of items into a writable
+ * file mapping, the same way ByteRangeFreezer would freeze the materialized
+ * container. Every 'flushBytes' written, the finished pages are written back
+ * and dropped from the mapping, so only the pages of recent items stay
+ * resident.
+ */
+class StreamingFreezer final : public FreezeRoot {
+ public:
+  template <class T, class ForEach>
+  static void freeze(const Layout<T>& layout,
+                     ForEach& forEach,
+                     size_t count,
+                     folly::MutableByteRange storage,
+                     size_t flushBytes) {
+    typedef typename T::value_type Item;
+    StreamingFreezer root(storage, flushBytes);
+
+    // Matches FreezeRoot::doFreeze() and ArrayLayout::freeze()
+    folly::MutableByteRange range;
+    size_t dist;
+    root.appendBytes(0, layout.size, range, dist);
+    FreezePosition self{range.begin(), 0};
+
+    size_t itemBytes = layout.itemField.layout.size;
+    size_t itemBits = itemBytes ? 0 : layout.itemField.layout.bits;
+    root.appendBytes(self.start,
+                     itemBits ? (count * itemBits + 7) / 8 : count * itemBytes,
+                     range,
+                     dist);
+    root.freezeField(self, layout.distanceField, dist);
+    root.freezeField(self, layout.countField, count);
+
+    FreezePosition write{self.start + dist, 0};
+    FieldPosition writeStep(itemBytes, itemBits);
+    size_t frozen = 0;
+    root.itemsReleased_ = self.start;
+    root.tailReleased_ = range.end();
+    forEach([&](const Item& item) {
+      if (++frozen > count) {
+        throwItemsChanged();
+      }
+      root.freezeField(write, layout.itemField, item);
+      write = write(writeStep);
+      root.release(write.start + write.bitOffset / 8);
+    });
+    if (frozen != count) {
+      throwItemsChanged();
+    }
+  }
+
+ private:
+  StreamingFreezer(folly::MutableByteRange write, size_t flushBytes)
+      : write_(write), flushBytes_(flushBytes) {}
+
+  void doAppendBytes(byte* origin,
+                     size_t n,
+                     folly::MutableByteRange& range,
+                     size_t& distance) override {
+    range.reset(write_.begin(), n);
+    if (n) {
+      if (n > write_.size() || origin > write_.begin()) {
+        throw LayoutException();
+      }
+      distance = write_.begin() - origin;
+      write_.advance(n);
+    } else {
+      distance = 0;
+    }
+  }
+
+  /**
+   * Releases the pages before the slot of the next item, 'items', and those
+   * appended so far, once at least flushBytes_ of them are resident.
+   */
+  void release(byte* items);
+
+  folly::MutableByteRange write_;
+  size_t flushBytes_;
+  // Pages before these were released
+  byte* itemsReleased_ = nullptr;
+  byte* tailReleased_ = nullptr;
+};
+
+} // detail
+
 template <class T>
 size_t frozenSize(const T& v) {
   Layout<T> layout;
   return LayoutRoot::layout(v, layout);
 }
 
+/**
+ * Size of 'v' frozen with 'options'. If 'savedBytes' is given, it receives
+ * the number of bytes FreezeOptions::dedupStrings saved.
+ */
+template <class T>
+size_t frozenSize(const T& v,
+                  const FreezeOptions& options,
+                  size_t* savedBytes = nullptr) {
+  Layout<T> layout;
+  return LayoutRoot::layout(v, layout, options, savedBytes);
+}
+
 template <class T, class Return = Bundled<typename Layout<T>::View>>
-Return freezeToFile(const T& x, folly::File file) {
+Return freezeToFile(const T& x,
+                    folly::File file,
+                    const FreezeOptions& options = FreezeOptions()) {
   auto layout = folly::make_unique<Layout<T>>();
-  auto size = LayoutRoot::layout(x, *layout);
-
-  std::string schemaStr;
-  {
-    schema::MemorySchema memSchema;
-    schema::Schema schema;
-    layout->saveRoot(memSchema);
-    schema::convert(memSchema, schema);
+  detail::ChunkOffsets chunks;
+  auto size = LayoutRoot::layout(x, *layout, options, nullptr, &chunks);
 
-    schema.fileVersion = schema::g_frozen_constants.kCurrentFrozenFileVersion;
-    util::ThriftSerializerCompact<>().serialize(schema, &schemaStr);
-  }
+  std::string schemaStr = detail::serializeRootSchema(*layout);
 
   folly::MemoryMapping mapping(std::move(file),
                                0,
@@ -70,12 +218,54 @@ Return freezeToFile(const T& x, folly::File file) {
   std::copy(schemaStr.begin(), schemaStr.end(), writeRange.begin());
   writeRange.advance(schemaStr.size());
 
-  Return ret(ByteRangeFreezer::freeze(*layout, x, writeRange));
+  Return ret(
+      ByteRangeFreezer::freeze(*layout, x, writeRange, options, &chunks));
   ret.hold(std::move(layout));
   ret.hold(std::move(mapping));
   return ret;
 }
 
+/**
+ * Freezes a list, map or set of type T to 'file' without materializing it, so
+ * files larger than memory can be built. The file is identical to what
+ * freezeToFile() writes for the container, and is read with mapFrozen<T>().
+ *
+ * 'forEach' is called several times, once per layout pass and once to freeze.
+ * Each call must invoke its argument, a callable taking
+ * 'const T::value_type&', on every item of the container in iteration order
+ * (ascending and unique keys for maps and sets), producing the same items
+ * every time, or std::logic_error is thrown. Only the item being frozen needs
+ * to be in memory.
+ *
+ * Pages of the output are written back and released every 'flushBytes'.
+ * Deduplicating strings needs all of them in memory, so FreezeOptions are not
+ * supported.
+ */
+template <class T, class ForEach>
+void freezeToFileStreaming(ForEach forEach,
+                           folly::File file,
+                           size_t flushBytes = 64 << 20) {
+  static_assert(IsList<T>::value || IsOrderedMap<T>::value ||
+                    IsOrderedSet<T>::value,
+                "Only lists and sorted maps and sets can be streamed");
+  Layout<T> layout;
+  size_t count;
+  size_t size = detail::StreamingLayoutRoot::layout<T>(forEach, layout, count);
+  std::string schemaStr = detail::serializeRootSchema(layout);
+
+  folly::MemoryMapping mapping(std::move(file),
+                               0,
+                               size + schemaStr.size(),
+                               folly::MemoryMapping::writable());
+
+  auto writeRange = mapping.writableRange();
+  std::copy(schemaStr.begin(), schemaStr.end(), writeRange.begin());
+  writeRange.advance(schemaStr.size());
+
+  detail::StreamingFreezer::freeze<T>(
+      layout, forEach, count, writeRange, flushBytes);
+}
+
 template <class T, class Return = Bundled<typename Layout<T>::View>>
 Return mapFrozen(folly::MemoryMapping mapping) {
   auto layout = folly::make_unique<Layout<T>>();
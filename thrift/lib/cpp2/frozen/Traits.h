@@ -23,6 +23,8 @@ template <class> struct IsHashMap : std::false_type {};
 template <class> struct IsHashSet : std::false_type {};
 template <class> struct IsOrderedMap : std::false_type {};
 template <class> struct IsOrderedSet : std::false_type {};
+template <class> struct IsEytzingerMap : std::false_type {};
+template <class> struct IsEytzingerSet : std::false_type {};
 template <class> struct IsList : std::false_type {};
 
 }}
@@ -18,6 +18,7 @@
 #include <folly/Benchmark.h>
 #include <folly/Optional.h>
 #include <folly/Conv.h>
+#include <thrift/lib/cpp2/frozen/EytzingerAssociative.h>
 #include <thrift/lib/cpp2/frozen/Frozen.h>
 #include <thrift/lib/cpp2/frozen/FrozenUtil.h>
 #include <thrift/lib/cpp2/frozen/test/gen-cpp2/Example_types.h>
@@ -178,6 +179,48 @@ TEST(FrozenSet, Full) {
   EXPECT_FALSE(fprimes.count(24));
 }
 
+TEST(FrozenEytzingerMap, Basic) {
+  EytzingerMap<int, int> map;
+  for (int i = 0; i < 100; ++i) {
+    map[i * 2] = i;
+  }
+  auto fmap = freeze(map);
+  EXPECT_EQ(map, fmap.thaw());
+  EXPECT_EQ(21, fmap.at(42));
+  EXPECT_EQ(0, fmap.count(43));
+  EXPECT_EQ(44, fmap.lower_bound(43)->first());
+  EXPECT_EQ(44, fmap.upper_bound(42)->first());
+  EXPECT_TRUE(fmap.lower_bound(199) == fmap.end());
+
+  int expected = 0;
+  for (auto entry : fmap) {
+    EXPECT_EQ(expected, entry.first());
+    expected += 2;
+  }
+  EXPECT_EQ(200, expected);
+  EXPECT_EQ(198, (--fmap.end())->first());
+}
+
+TEST(FrozenEytzingerSet, Full) {
+  for (int n = 0; n < 40; ++n) {
+    EytzingerSet<int> set;
+    for (int i = 0; i < n; ++i) {
+      set.insert(i * 3);
+    }
+    auto fset = freeze(set);
+    EXPECT_EQ(set, fset.thaw());
+    EXPECT_EQ(set.size(), (size_t)std::distance(fset.begin(), fset.end()));
+    for (int k = -1; k < n * 3 + 1; ++k) {
+      EXPECT_EQ(set.count(k), fset.count(k));
+      auto found = fset.lower_bound(k);
+      if (set.lower_bound(k) == set.end()) {
+        EXPECT_TRUE(found == fset.end());
+      } else {
+        EXPECT_EQ(*set.lower_bound(k), *found);
+      }
+    }
+  }
+}
 
 TEST(FrozenHashSet, Full) {
   std::unordered_set<uint32_t> primes{2};
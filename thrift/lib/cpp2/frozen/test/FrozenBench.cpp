@@ -15,6 +15,7 @@
  */
 
 #include <folly/Benchmark.h>
+#include <thrift/lib/cpp2/frozen/EytzingerAssociative.h>
 #include <thrift/lib/cpp2/frozen/test/gen-cpp2/Example_types.h>
 #include <thrift/lib/cpp2/frozen/test/gen-cpp2/Example_layouts.h>
 
@@ -99,13 +100,22 @@ auto frozenMap_f32 = freeze(map_f32);
 auto frozenMap_i16 = freeze(map_i16);
 auto frozenMap_i32 = freeze(map_i32);
 auto frozenMap_i64 = freeze(map_i64);
+auto frozenEytzingerMap_f32 = freeze(
+    EytzingerMap<float, int>(map_f32.begin(), map_f32.end()));
+auto frozenEytzingerMap_i16 = freeze(
+    EytzingerMap<int16_t, int>(map_i16.begin(), map_i16.end()));
+auto frozenEytzingerMap_i32 = freeze(
+    EytzingerMap<int32_t, int>(map_i32.begin(), map_i32.end()));
+auto frozenEytzingerMap_i64 = freeze(
+    EytzingerMap<int64_t, int>(map_i64.begin(), map_i64.end()));
 
 template <class Map>
 void benchmarkLookup(int iters, const Map& hist) {
   int s = 0;
   while (iters--) {
     for (int n = 0; n < 1000; ++n) {
-      auto found = hist.find(rand());
+      auto k = (rand() * 8192 + rand()) % entries;
+      auto found = hist.find(k);
       if (found != hist.end()) {
         s += found->second();
       }
@@ -157,6 +167,17 @@ BENCHMARK_RELATIVE_PARAM(benchmarkLookup, frozenMap_i64);
 
 BENCHMARK_DRAW_LINE();
 
+BENCHMARK_PARAM(benchmarkLookup, frozenMap_f32);
+BENCHMARK_RELATIVE_PARAM(benchmarkLookup, frozenEytzingerMap_f32);
+BENCHMARK_PARAM(benchmarkLookup, frozenMap_i16);
+BENCHMARK_RELATIVE_PARAM(benchmarkLookup, frozenEytzingerMap_i16);
+BENCHMARK_PARAM(benchmarkLookup, frozenMap_i32);
+BENCHMARK_RELATIVE_PARAM(benchmarkLookup, frozenEytzingerMap_i32);
+BENCHMARK_PARAM(benchmarkLookup, frozenMap_i64);
+BENCHMARK_RELATIVE_PARAM(benchmarkLookup, frozenEytzingerMap_i64);
+
+BENCHMARK_DRAW_LINE();
+
 BENCHMARK_PARAM(benchmarkLookup, hashMap_f32);
 BENCHMARK_RELATIVE_PARAM(benchmarkLookup, frozenHashMap_f32);
 BENCHMARK_PARAM(benchmarkLookup, hashMap_i16);
@@ -15,6 +15,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <folly/Conv.h>
 #include <thrift/lib/cpp/protocol/TCompactProtocol.h>
 #include <thrift/lib/cpp/protocol/TDebugProtocol.h>
 #include <thrift/lib/cpp/util/ThriftSerializer.h>
@@ -221,6 +222,99 @@ TEST(Frozen, VectorString) {
   std::vector<std::string> check;
 }
 
+TEST(Frozen, DedupStrings) {
+  std::vector<std::string> strs;
+  for (int i = 0; i < 100; ++i) {
+    strs.push_back(i % 2 ? "en_US" : "a longer category name");
+  }
+  FreezeOptions options;
+  options.dedupStrings = true;
+  size_t saved = 0;
+  size_t size = frozenSize(strs, options, &saved);
+  EXPECT_EQ(49 * 5 + 49 * 22, saved);
+  EXPECT_LE(size + saved, frozenSize(strs));
+
+  auto fstrs = freeze(strs, options);
+  EXPECT_EQ(strs, fstrs.thaw());
+  EXPECT_EQ(fstrs[0].begin(), fstrs[2].begin());
+  EXPECT_EQ(fstrs[1].begin(), fstrs[99].begin());
+  EXPECT_NE(fstrs[0].begin(), fstrs[1].begin());
+
+  // Nested strings share bytes too
+  example2::Person1 person;
+  person.name = "max";
+  person.pets.resize(10);
+  for (auto& pet : person.pets) {
+    pet.name = "max";
+  }
+  auto fperson = freeze(person, options);
+  EXPECT_EQ(person, fperson.thaw());
+  EXPECT_EQ(fperson.pets()[0].name().begin(),
+            fperson.pets()[9].name().begin());
+}
+
+template <class T>
+std::string frozenBytes(const T& x, const FreezeOptions& options) {
+  Layout<T> layout;
+  detail::ChunkOffsets chunks;
+  size_t size = LayoutRoot::layout(x, layout, options, nullptr, &chunks);
+  std::string bytes(size, '\0');
+  ByteRangeFreezer::freeze(
+      layout,
+      x,
+      folly::MutableByteRange(reinterpret_cast<byte*>(&bytes[0]), size),
+      options,
+      &chunks);
+  return bytes;
+}
+
+TEST(Frozen, ParallelFreeze) {
+  FreezeOptions options;
+  options.threads = 4;
+  options.parallelMinItems = 100;
+
+  std::vector<example2::Person1> people(3000);
+  std::unordered_map<int, std::string> names;
+  std::vector<int> bits;
+  for (int i = 0; i < 3000; ++i) {
+    auto& person = people[i];
+    person.name = folly::to<std::string>("person ", i);
+    person.height = i;
+    person.pets.resize(i % 3);
+    for (auto& pet : person.pets) {
+      pet.name = folly::to<std::string>("pet of ", i);
+    }
+    names[i * 11] = person.name;
+    bits.push_back(i % 5);
+  }
+
+  EXPECT_EQ(frozenBytes(people, FreezeOptions()),
+            frozenBytes(people, options));
+  EXPECT_EQ(frozenBytes(names, FreezeOptions()),
+            frozenBytes(names, options));
+  EXPECT_EQ(frozenBytes(bits, FreezeOptions()), frozenBytes(bits, options));
+
+  auto fpeople = freeze(people, options);
+  EXPECT_EQ(people, fpeople.thaw());
+}
+
+TEST(Frozen, ParallelFreezeNestedAtStart) {
+  FreezeOptions options;
+  options.threads = 4;
+  options.parallelMinItems = 100;
+
+  // All the ints are 0 and take no bits, so the items of the first inner
+  // vector start where the outer vector's items do
+  std::vector<std::vector<int>> vvi(1000);
+  vvi[0].resize(1000);
+  for (size_t i = 1; i < vvi.size(); ++i) {
+    vvi[i].resize(i % 3);
+  }
+
+  EXPECT_EQ(frozenBytes(vvi, FreezeOptions()), frozenBytes(vvi, options));
+  EXPECT_EQ(vvi, freeze(vvi, options).thaw());
+}
+
 TEST(Frozen, VectorVectorInt) {
   std::vector<std::vector<int>> vvi{{2, 3, 5, 7}, {11, 13, 17, 19}};
   auto fvvi = freeze(vvi);
@@ -19,6 +19,11 @@
 #include <thrift/lib/cpp2/frozen/FrozenTestUtil.h>
 #include <thrift/lib/cpp/util/ThriftSerializer.h>
 
+#include <folly/Conv.h>
+#include <folly/FileUtil.h>
+
+#include <functional>
+
 using namespace apache::thrift;
 using namespace frozen;
 using namespace util;
@@ -67,6 +72,62 @@ TEST(FrozenUtil, FileSize) {
   EXPECT_LT(stats.st_size, 500); // most of this is the schema
 }
 
+namespace {
+
+std::string readFile(int fd) {
+  std::string contents;
+  lseek(fd, 0, SEEK_SET);
+  EXPECT_TRUE(folly::readFile(fd, contents));
+  return contents;
+}
+
+}
+
+TEST(FrozenUtil, FreezeStreaming) {
+  std::map<int, std::string> original;
+  for (int i = 0; i < 10000; ++i) {
+    original[i * 7] = folly::to<std::string>("value ", i);
+  }
+  folly::test::TemporaryFile expected;
+  folly::test::TemporaryFile streamed;
+  freezeToFile(original, folly::File(expected.fd()));
+
+  int passes = 0;
+  // Tiny flushBytes to release pages while freezing
+  freezeToFileStreaming<std::map<int, std::string>>(
+      [&](const std::function<void(const std::pair<const int, std::string>&)>&
+              f) {
+        ++passes;
+        for (int i = 0; i < 10000; ++i) {
+          f(std::make_pair(i * 7, folly::to<std::string>("value ", i)));
+        }
+      },
+      folly::File(streamed.fd()),
+      4096);
+  EXPECT_GE(passes, 3);
+
+  EXPECT_EQ(readFile(expected.fd()), readFile(streamed.fd()));
+  auto mapped =
+      mapFrozen<std::map<int, std::string>>(folly::File(streamed.fd()));
+  EXPECT_EQ(original, mapped.thaw());
+  EXPECT_EQ("value 3", mapped.at(21));
+}
+
+TEST(FrozenUtil, FreezeStreamingMismatch) {
+  folly::test::TemporaryFile tmp;
+  int passes = 0;
+  EXPECT_THROW(
+      freezeToFileStreaming<std::vector<int>>(
+          [&](const std::function<void(const int&)>& f) {
+            for (int i = 0; i < 10 + passes; ++i) {
+              f(i);
+            }
+            ++passes;
+          },
+          folly::File(tmp.fd())),
+      std::logic_error);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   google::InitGoogleLogging(argv[0]);
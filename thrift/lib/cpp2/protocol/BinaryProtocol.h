@@ -207,7 +207,8 @@ class BinaryProtocolReader {
   /**
    * Reading functions
    */
-  inline uint32_t readMessageBegin(std::string& name,
+  template <typename StrType>
+  inline uint32_t readMessageBegin(StrType& name,
                                    MessageType& messageType,
                                    int32_t& seqid);
   inline uint32_t readMessageEnd();
@@ -231,6 +232,11 @@ class BinaryProtocolReader {
   inline uint32_t readI16(int16_t& i16);
   inline uint32_t readI32(int32_t& i32);
   inline uint32_t readI64(int64_t& i64);
+  /**
+   * Read the size elements of a list of integers with a single copy.
+   */
+  template <class T>
+  inline uint32_t readIntegralList(T* values, uint32_t size);
   inline uint32_t readDouble(double& dub);
   inline uint32_t readFloat(float& flt);
   template<typename StrType>
@@ -239,10 +245,18 @@ class BinaryProtocolReader {
   inline uint32_t readBinary(StrType& str);
   inline uint32_t readBinary(std::unique_ptr<folly::IOBuf>& str);
   inline uint32_t readBinary(folly::IOBuf& str);
+  /**
+   * Read a string without copying it; str refers to the input buffer.
+   */
+  inline uint32_t readString(IOBufStringPiece& str);
+  inline uint32_t readBinary(IOBufStringPiece& str);
 
-  uint32_t skip(TType type) {
-    return apache::thrift::skip(*this, type);
-  }
+  /**
+   * Skips over a value of the given type without materializing it.
+   * Strings are stepped over in place and containers of fixed-width
+   * elements are skipped in a single cursor move.
+   */
+  inline uint32_t skip(TType type);
 
   Cursor getCurrentPosition() const {
     return in_;
@@ -260,6 +274,12 @@ class BinaryProtocolReader {
   template<typename StrType>
   inline uint32_t readStringBody(StrType& str, int32_t sz);
 
+  /**
+   * Returns the encoded size of a value of the given type,
+   * or 0 if it is variable-length.
+   */
+  static inline uint32_t fixedSize(TType type);
+
   inline void checkStringSize(int32_t size);
 
   int32_t string_limit_;
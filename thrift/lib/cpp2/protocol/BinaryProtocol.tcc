@@ -309,7 +309,8 @@ uint32_t BinaryProtocolWriter::serializedSizeSerializedData(
  * Reading functions
  */
 
-uint32_t BinaryProtocolReader::readMessageBegin(std::string& name,
+template <typename StrType>
+uint32_t BinaryProtocolReader::readMessageBegin(StrType& name,
                                                 MessageType& messageType,
                                                 int32_t& seqid) {
   uint32_t result = 0;
@@ -477,6 +478,19 @@ uint32_t BinaryProtocolReader::readI64(int64_t& i64) {
   return 8;
 }
 
+template <class T>
+uint32_t BinaryProtocolReader::readIntegralList(T* values, uint32_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  size_t bytes = size_t(size) * sizeof(T);
+  in_.pull(values, bytes);
+  for (uint32_t i = 0; i < size; ++i) {
+    values[i] = folly::Endian::big(values[i]);
+  }
+  return bytes;
+}
+
 uint32_t BinaryProtocolReader::readDouble(double& dub) {
   BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
   BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
@@ -537,6 +551,22 @@ uint32_t BinaryProtocolReader::readBinary(folly::IOBuf& str) {
   return result + (uint32_t)size;
 }
 
+uint32_t BinaryProtocolReader::readString(IOBufStringPiece& str) {
+  uint32_t result;
+  int32_t size;
+  result = readI32(size);
+  checkStringSize(size);
+
+  std::unique_ptr<folly::IOBuf> buf;
+  in_.clone(buf, size);
+  str.reset(std::move(buf));
+  return result + (uint32_t)size;
+}
+
+uint32_t BinaryProtocolReader::readBinary(IOBufStringPiece& str) {
+  return readString(str);
+}
+
 template<typename StrType>
 uint32_t BinaryProtocolReader::readStringBody(StrType& str,
                                               int32_t size) {
@@ -568,6 +598,108 @@ uint32_t BinaryProtocolReader::readStringBody(StrType& str,
   return (uint32_t) size;
 }
 
+uint32_t BinaryProtocolReader::fixedSize(TType type) {
+  switch (type) {
+    case TType::T_BOOL:
+    case TType::T_BYTE:
+      return 1;
+    case TType::T_I16:
+      return 2;
+    case TType::T_I32:
+    case TType::T_FLOAT:
+      return 4;
+    case TType::T_I64:
+    case TType::T_DOUBLE:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+uint32_t BinaryProtocolReader::skip(TType type) {
+  switch (type) {
+    case TType::T_BOOL:
+    case TType::T_BYTE:
+    case TType::T_I16:
+    case TType::T_I32:
+    case TType::T_I64:
+    case TType::T_DOUBLE:
+    case TType::T_FLOAT:
+    {
+      uint32_t size = fixedSize(type);
+      in_.skip(size);
+      return size;
+    }
+    case TType::T_STRING:
+    {
+      int32_t size;
+      uint32_t result = readI32(size);
+      checkStringSize(size);
+      in_.skip(size);
+      return result + (uint32_t)size;
+    }
+    case TType::T_STRUCT:
+    {
+      uint32_t result = 0;
+      while (true) {
+        int8_t ftype = in_.read<int8_t>();
+        result += 1;
+        if (ftype == TType::T_STOP) {
+          break;
+        }
+        // field id
+        in_.skip(2);
+        result += 2;
+        result += skip((TType)ftype);
+      }
+      return result;
+    }
+    case TType::T_MAP:
+    {
+      uint32_t result = 0;
+      TType keyType;
+      TType valType;
+      uint32_t size;
+      result += readMapBegin(keyType, valType, size);
+      uint32_t keySize = fixedSize(keyType);
+      uint32_t valSize = fixedSize(valType);
+      if (keySize != 0 && valSize != 0) {
+        size_t skipped = (size_t)size * (keySize + valSize);
+        in_.skip(skipped);
+        result += (uint32_t)skipped;
+      } else {
+        for (uint32_t i = 0; i < size; i++) {
+          result += skip(keyType);
+          result += skip(valType);
+        }
+      }
+      return result;
+    }
+    case TType::T_SET:
+    case TType::T_LIST:
+    {
+      // Sets and lists share the same header encoding
+      uint32_t result = 0;
+      TType elemType;
+      uint32_t size;
+      result += readListBegin(elemType, size);
+      uint32_t elemSize = fixedSize(elemType);
+      if (elemSize != 0) {
+        size_t skipped = (size_t)size * elemSize;
+        in_.skip(skipped);
+        result += (uint32_t)skipped;
+      } else {
+        for (uint32_t i = 0; i < size; i++) {
+          result += skip(elemType);
+        }
+      }
+      return result;
+    }
+    default:
+      return 0;
+  }
+}
+
 uint32_t BinaryProtocolReader::readFromPositionAndAppend(
     Cursor& snapshot,
     std::unique_ptr<IOBuf>& ser) {
@@ -114,10 +114,7 @@ class CompactProtocolWriter {
   inline uint32_t writeBinary(const std::unique_ptr<IOBuf>& str);
   inline uint32_t writeBinary(const IOBuf& str);
   inline uint32_t writeSerializedData(
-    const std::unique_ptr<folly::IOBuf>& data) {
-    // TODO
-    return 0;
-  }
+    const std::unique_ptr<folly::IOBuf>& data);
 
   /**
    * Functions that return the serialized size
@@ -167,10 +164,7 @@ class CompactProtocolWriter {
     return serializedSizeI32();
   }
   inline uint32_t serializedSizeSerializedData(
-    const std::unique_ptr<folly::IOBuf>& data) {
-    // TODO
-    return 0;
-  }
+    const std::unique_ptr<folly::IOBuf>& data);
 
  protected:
   /**
@@ -232,7 +226,8 @@ class CompactProtocolReader {
   /**
    * Reading functions
    */
-  inline uint32_t readMessageBegin(std::string& name,
+  template <typename StrType>
+  inline uint32_t readMessageBegin(StrType& name,
                                    MessageType& messageType,
                                    int32_t& seqid);
   inline uint32_t readMessageEnd();
@@ -256,6 +251,13 @@ class CompactProtocolReader {
   inline uint32_t readI16(int16_t& i16);
   inline uint32_t readI32(int32_t& i32);
   inline uint32_t readI64(int64_t& i64);
+  /**
+   * Read the size elements of a list of integers.  Varints that lie
+   * entirely within the current buffer are decoded in bulk.
+   */
+  inline uint32_t readIntegralList(int16_t* values, uint32_t size);
+  inline uint32_t readIntegralList(int32_t* values, uint32_t size);
+  inline uint32_t readIntegralList(int64_t* values, uint32_t size);
   inline uint32_t readDouble(double& dub);
   inline uint32_t readFloat(float& flt);
   template<typename StrType>
@@ -264,9 +266,17 @@ class CompactProtocolReader {
   inline uint32_t readBinary(StrType& str);
   inline uint32_t readBinary(std::unique_ptr<IOBuf>& str);
   inline uint32_t readBinary(IOBuf& str);
-  uint32_t skip(TType type) {
-    return apache::thrift::skip(*this, type);
-  }
+  /**
+   * Read a string without copying it; str refers to the input buffer.
+   */
+  inline uint32_t readString(IOBufStringPiece& str);
+  inline uint32_t readBinary(IOBufStringPiece& str);
+  /**
+   * Skips over a value of the given type without materializing it.
+   * Strings are stepped over in place and containers of fixed-width
+   * elements are skipped in a single cursor move.
+   */
+  inline uint32_t skip(TType type);
 
   Cursor getCurrentPosition() const {
     return in_;
@@ -287,6 +297,15 @@ class CompactProtocolReader {
  protected:
   inline uint32_t readStringSize(int32_t& size);
 
+  template <class U, class T, class F>
+  inline uint32_t readVarintList(T* values, uint32_t size, F convert);
+
+  /**
+   * Returns the encoded size of a container element of the given type,
+   * or 0 if it is variable-length.
+   */
+  static inline uint32_t fixedElemSize(TType type);
+
   inline TType getType(int8_t type);
 
   int32_t string_limit_;
@@ -292,6 +292,15 @@ uint32_t CompactProtocolWriter::writeBinary(
   return result + size;
 }
 
+uint32_t CompactProtocolWriter::writeSerializedData(
+    const std::unique_ptr<IOBuf>& buf) {
+  if (!buf) {
+    return 0;
+  }
+  out_.insert(buf->clone());
+  return buf->computeChainDataLength();
+}
+
 /**
  * Functions that return the serialized size
  */
@@ -395,13 +404,21 @@ uint32_t CompactProtocolWriter::serializedSizeBinary(
   return serializedSizeI32() + size;
 }
 
+uint32_t CompactProtocolWriter::serializedSizeSerializedData(
+    const std::unique_ptr<IOBuf>& buf) {
+  // writeSerializedData chains the buffer in rather than copying it, so
+  // no space needs to be reserved for it.
+  return 0;
+}
+
 /**
  * Reading functions
  */
 
-uint32_t CompactProtocolReader::readMessageBegin(std::string& name,
-                                                MessageType& messageType,
-                                                int32_t& seqid) {
+template <typename StrType>
+uint32_t CompactProtocolReader::readMessageBegin(StrType& name,
+                                                 MessageType& messageType,
+                                                 int32_t& seqid) {
   uint32_t rsize = 0;
   int8_t protocolId;
   int8_t versionAndType;
@@ -603,6 +620,50 @@ uint32_t CompactProtocolReader::readI64(int64_t& i64) {
   return rsize;
 }
 
+template <class U, class T, class F>
+uint32_t CompactProtocolReader::readVarintList(T* values,
+                                               uint32_t size,
+                                               F convert) {
+  uint32_t rsize = 0;
+  uint32_t i = 0;
+  while (i < size) {
+    const uint8_t* start = in_.data();
+    const uint8_t* p = start;
+    i += apache::thrift::util::detail::decodeVarintArray<U>(
+      p, start + in_.length(), values + i, size - i, convert);
+    rsize += p - start;
+    in_.skip(p - start);
+    if (i < size) {
+      // The next varint may cross into the next buffer
+      U value;
+      rsize += apache::thrift::util::readVarint(in_, value);
+      values[i++] = convert(value);
+    }
+  }
+  return rsize;
+}
+
+uint32_t CompactProtocolReader::readIntegralList(int16_t* values,
+                                                 uint32_t size) {
+  return readVarintList<uint32_t>(values, size, [](uint32_t value) {
+    return (int16_t)apache::thrift::util::zigzagToI32(value);
+  });
+}
+
+uint32_t CompactProtocolReader::readIntegralList(int32_t* values,
+                                                 uint32_t size) {
+  return readVarintList<uint32_t>(values, size, [](uint32_t value) {
+    return apache::thrift::util::zigzagToI32(value);
+  });
+}
+
+uint32_t CompactProtocolReader::readIntegralList(int64_t* values,
+                                                 uint32_t size) {
+  return readVarintList<uint64_t>(values, size, [](uint64_t value) {
+    return apache::thrift::util::zigzagToI64(value);
+  });
+}
+
 uint32_t CompactProtocolReader::readDouble(double& dub) {
   BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
   BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
@@ -679,6 +740,131 @@ uint32_t CompactProtocolReader::readBinary(folly::IOBuf& str) {
   return rsize + (uint32_t) size;
 }
 
+uint32_t CompactProtocolReader::readString(IOBufStringPiece& str) {
+  int32_t size = 0;
+  uint32_t rsize = readStringSize(size);
+
+  std::unique_ptr<folly::IOBuf> buf;
+  in_.clone(buf, size);
+  str.reset(std::move(buf));
+  return rsize + (uint32_t) size;
+}
+
+uint32_t CompactProtocolReader::readBinary(IOBufStringPiece& str) {
+  return readString(str);
+}
+
+uint32_t CompactProtocolReader::fixedElemSize(TType type) {
+  switch (type) {
+    case TType::T_BOOL:
+    case TType::T_BYTE:
+      return 1;
+    case TType::T_FLOAT:
+      return 4;
+    case TType::T_DOUBLE:
+      return 8;
+    default:
+      // i16/i32/i64 are varints, everything else is length-prefixed
+      return 0;
+  }
+}
+
+uint32_t CompactProtocolReader::skip(TType type) {
+  switch (type) {
+    case TType::T_BOOL:
+    {
+      // Bool fields carry their value in the field header
+      bool boolv;
+      return readBool(boolv);
+    }
+    case TType::T_BYTE:
+    case TType::T_FLOAT:
+    case TType::T_DOUBLE:
+    {
+      uint32_t size = fixedElemSize(type);
+      in_.skip(size);
+      return size;
+    }
+    case TType::T_I16:
+    case TType::T_I32:
+    case TType::T_I64:
+    {
+      uint64_t value;
+      return apache::thrift::util::readVarint(in_, value);
+    }
+    case TType::T_STRING:
+    {
+      int32_t size = 0;
+      uint32_t rsize = readStringSize(size);
+      in_.skip(size);
+      return rsize + (uint32_t)size;
+    }
+    case TType::T_STRUCT:
+    {
+      uint32_t result = 0;
+      std::string name;
+      int16_t fid;
+      TType ftype;
+      result += readStructBegin(name);
+      while (true) {
+        result += readFieldBegin(name, ftype, fid);
+        if (ftype == TType::T_STOP) {
+          break;
+        }
+        result += skip(ftype);
+        result += readFieldEnd();
+      }
+      result += readStructEnd();
+      return result;
+    }
+    case TType::T_MAP:
+    {
+      uint32_t result = 0;
+      TType keyType;
+      TType valType;
+      uint32_t size;
+      result += readMapBegin(keyType, valType, size);
+      uint32_t keySize = fixedElemSize(keyType);
+      uint32_t valSize = fixedElemSize(valType);
+      if (keySize != 0 && valSize != 0) {
+        size_t skipped = (size_t)size * (keySize + valSize);
+        in_.skip(skipped);
+        result += (uint32_t)skipped;
+      } else {
+        for (uint32_t i = 0; i < size; i++) {
+          result += skip(keyType);
+          result += skip(valType);
+        }
+      }
+      result += readMapEnd();
+      return result;
+    }
+    case TType::T_SET:
+    case TType::T_LIST:
+    {
+      // Sets and lists share the same header encoding
+      uint32_t result = 0;
+      TType elemType;
+      uint32_t size;
+      result += readListBegin(elemType, size);
+      uint32_t elemSize = fixedElemSize(elemType);
+      if (elemSize != 0) {
+        size_t skipped = (size_t)size * elemSize;
+        in_.skip(skipped);
+        result += (uint32_t)skipped;
+      } else {
+        for (uint32_t i = 0; i < size; i++) {
+          result += skip(elemType);
+        }
+      }
+      result += readListEnd();
+      return result;
+    }
+    default:
+      return 0;
+  }
+}
+
 TType CompactProtocolReader::getType(int8_t type) {
   switch (type) {
     case TType::T_STOP:
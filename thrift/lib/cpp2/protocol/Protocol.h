@@ -28,6 +28,7 @@
 #include <thrift/lib/cpp/protocol/TProtocol.h>
 #include <thrift/lib/cpp/util/BitwiseCast.h>
 #include <thrift/lib/cpp2/CloneableIOBuf.h>
+#include <thrift/lib/cpp2/IOBufStringPiece.h>
 
 #include <map>
 #include <memory>
@@ -229,6 +230,23 @@ struct StringTraits<std::unique_ptr<folly::IOBuf>> {
   }
 };
 
+template <>
+struct StringTraits<IOBufStringPiece> {
+  // Use with string literals only!
+  static IOBufStringPiece fromStringLiteral(const char* str) {
+    return IOBufStringPiece(folly::IOBuf::wrapBuffer(str, strlen(str)));
+  }
+
+  static bool isEmpty(const IOBufStringPiece& str) {
+    return str.empty();
+  }
+
+  static bool isEqual(const IOBufStringPiece& lhs,
+                      const IOBufStringPiece& rhs) {
+    return lhs == rhs;
+  }
+};
+
 }} // apache::thrift
 
 #endif
@@ -67,6 +67,9 @@ class VirtualReaderBase {
   virtual uint32_t readI16(int16_t& i16) = 0;
   virtual uint32_t readI32(int32_t& i32) = 0;
   virtual uint32_t readI64(int64_t& i64) = 0;
+  virtual uint32_t readIntegralList(int16_t* values, uint32_t size) = 0;
+  virtual uint32_t readIntegralList(int32_t* values, uint32_t size) = 0;
+  virtual uint32_t readIntegralList(int64_t* values, uint32_t size) = 0;
   virtual uint32_t readDouble(double& dub) = 0;
   virtual uint32_t readFloat(float& flt) = 0;
   virtual uint32_t readString(std::string& str) = 0;
@@ -75,6 +78,8 @@ class VirtualReaderBase {
   virtual uint32_t readBinary(folly::fbstring& str) = 0;
   virtual uint32_t readBinary(std::unique_ptr<folly::IOBuf>& str) = 0;
   virtual uint32_t readBinary(folly::IOBuf& str) = 0;
+  virtual uint32_t readString(IOBufStringPiece& str) = 0;
+  virtual uint32_t readBinary(IOBufStringPiece& str) = 0;
   virtual uint32_t skip(TType type) = 0;
   virtual folly::io::Cursor getCurrentPosition() const = 0;
   virtual uint32_t readFromPositionAndAppend(
@@ -242,6 +247,15 @@ class VirtualReader : public VirtualReaderBase {
   uint32_t readI64(int64_t& i64) {
     return protocol_.readI64(i64);
   }
+  uint32_t readIntegralList(int16_t* values, uint32_t size) {
+    return protocol_.readIntegralList(values, size);
+  }
+  uint32_t readIntegralList(int32_t* values, uint32_t size) {
+    return protocol_.readIntegralList(values, size);
+  }
+  uint32_t readIntegralList(int64_t* values, uint32_t size) {
+    return protocol_.readIntegralList(values, size);
+  }
   uint32_t readDouble(double& dub) {
     return protocol_.readDouble(dub);
   }
@@ -266,6 +280,12 @@ class VirtualReader : public VirtualReaderBase {
   uint32_t readBinary(folly::IOBuf& str) {
     return protocol_.readBinary(str);
   }
+  uint32_t readString(IOBufStringPiece& str) {
+    return protocol_.readString(str);
+  }
+  uint32_t readBinary(IOBufStringPiece& str) {
+    return protocol_.readBinary(str);
+  }
   uint32_t skip(TType type) {
     return protocol_.skip(type);
   }
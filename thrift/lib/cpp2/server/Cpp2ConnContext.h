@@ -22,9 +22,14 @@
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 #include <thrift/lib/cpp/transport/THeader.h>
 #include <thrift/lib/cpp/transport/TSocketAddress.h>
+#include <thrift/lib/cpp2/async/CompressionPolicy.h>
 #include <thrift/lib/cpp2/async/SaslServer.h>
 #include <thrift/lib/cpp2/async/HeaderClientChannel.h>
 
+#include <folly/Conv.h>
+#include <folly/io/IOBufQueue.h>
+
+#include <algorithm>
 #include <memory>
 
 using apache::thrift::concurrency::PriorityThreadManager;
@@ -120,7 +125,8 @@ class Cpp2ConnContext : public apache::thrift::server::TConnectionContext {
 class Cpp2RequestContext : public apache::thrift::server::TConnectionContext {
  public:
   explicit Cpp2RequestContext(Cpp2ConnContext* ctx)
-      : ctx_(ctx) {
+      : ctx_(ctx)
+      , headersMapValid_(false) {
     setConnectionContext(ctx);
   }
 
@@ -129,9 +135,11 @@ class Cpp2RequestContext : public apache::thrift::server::TConnectionContext {
     if (ctx_) {
       auto header = ctx_->getHeader();
       if (header) {
-        headers_ = header->getHeaders();
+        headers_ = header->getHeaderMap();
+        headersMapValid_ = false;
         transforms_ = header->getWriteTransforms();
         minCompressBytes_ = header->getMinCompressBytes();
+        zstdDict_ = header->getZstdDictionary();
         callPriority_ = header->getCallPriority();
       }
     }
@@ -161,17 +169,28 @@ class Cpp2RequestContext : public apache::thrift::server::TConnectionContext {
     return ctx_->getOutputProtocol();
   }
 
-  // The following two header functions _are_ thread safe
-  virtual std::map<std::string, std::string> getHeaders() {
+  // The following header functions _are_ thread safe
+  const apache::thrift::transport::THeaderMap& getHeaderMap() const {
     return headers_;
   }
 
+  // Copies every header; prefer getHeaderMap()
+  virtual std::map<std::string, std::string> getHeaders() {
+    return headers_.toMap();
+  }
+
   virtual std::map<std::string, std::string> getWriteHeaders() {
     return std::move(writeHeaders_);
   }
 
-  std::map<std::string, std::string>* getHeadersPtr() {
-    return &headers_;
+  // Compatibility accessor: a std::map copy of the headers, built on first
+  // use.  It is read-only; use setHeader() for reply headers.
+  const std::map<std::string, std::string>* getHeadersPtr() {
+    if (!headersMapValid_) {
+      headersMap_ = headers_.toMap();
+      headersMapValid_ = true;
+    }
+    return &headersMap_;
   }
 
   virtual bool setHeader(const std::string& key, const std::string& value) {
@@ -191,6 +210,50 @@ class Cpp2RequestContext : public apache::thrift::server::TConnectionContext {
     return minCompressBytes_;
   }
 
+  const apache::thrift::transport::ZstdDictionary* getZstdDictionary() const {
+    return zstdDict_.get();
+  }
+
+  CompressionPolicy* getCompressionPolicy() const {
+    return compressionPolicy_.get();
+  }
+
+  /**
+   * Let policy pick the reply's transform.  It may also pick transforms
+   * the client accepts but did not use for this request.
+   */
+  void setCompressionPolicy(std::shared_ptr<CompressionPolicy> policy) {
+    compressionPolicy_ = std::move(policy);
+    if (compressionPolicy_ && ctx_ && ctx_->getHeader()) {
+      for (auto trans : ctx_->getHeader()->getAcceptedTransforms()) {
+        if (std::find(transforms_.begin(), transforms_.end(), trans) ==
+            transforms_.end()) {
+          transforms_.push_back(trans);
+        }
+      }
+    }
+  }
+
+  /**
+   * Compresses a serialized reply in place, the same way for normal and
+   * exception replies: through the compression policy if there is one,
+   * otherwise with every transform in getTransforms().
+   */
+  void transformReply(folly::IOBufQueue& queue) {
+    auto& transforms = getTransforms();
+    size_t dataSize = queue.chainLength();
+    queue.append(
+      CompressionPolicy::transform(getCompressionPolicy(),
+                                   queue.move(),
+                                   transforms,
+                                   getMinCompressBytes(),
+                                   getZstdDictionary()));
+    if (!transforms.empty()) {
+      setHeader(apache::thrift::transport::THeader::UNCOMPRESSED_SIZE_HEADER,
+                folly::to<std::string>(dataSize));
+    }
+  }
+
   PriorityThreadManager::PRIORITY getCallPriority() {
     return callPriority_;
   }
@@ -233,10 +296,14 @@ class Cpp2RequestContext : public apache::thrift::server::TConnectionContext {
   Cpp2ConnContext* ctx_;
 
   // Headers are per-request, not per-connection
-  std::map<std::string, std::string> headers_;
+  apache::thrift::transport::THeaderMap headers_;
+  std::map<std::string, std::string> headersMap_;
+  bool headersMapValid_;
   std::map<std::string, std::string> writeHeaders_;
   std::vector<uint16_t> transforms_;
   uint32_t minCompressBytes_;
+  std::shared_ptr<const apache::thrift::transport::ZstdDictionary> zstdDict_;
+  std::shared_ptr<CompressionPolicy> compressionPolicy_;
   PriorityThreadManager::PRIORITY callPriority_;
 };
 
@@ -63,8 +63,11 @@ Cpp2Connection::Cpp2Connection(
     , socket_(asyncSocket) {
 
   channel_->setQueueSends(worker->getServer()->getQueueSends());
+  channel_->setWriteBatcher(worker->getWriteBatcher());
   channel_->getHeader()->setMinCompressBytes(
     worker_->getServer()->getMinCompressBytes());
+  channel_->getHeader()->setZstdDictionary(
+    worker_->getServer()->getZstdDictionary());
   auto observer = worker->getServer()->getObserver();
   if (observer) {
     channel_->setSampleRate(observer->getSampleRate());
@@ -202,7 +205,7 @@ void Cpp2Connection::killRequest(
   // may end up here. No need to send error back for such requests
   if (!processor_->isOnewayMethod(req.getBuf(),
       channel_->getHeader())) {
-    auto recv_headers = channel_->getHeader()->getHeaders();
+    const auto& recv_headers = channel_->getHeader()->getHeaderMap();
 
     auto header_req = static_cast<HeaderServerChannel::HeaderRequest*>(&req);
     header_req->sendErrorWrapped(
@@ -218,13 +221,13 @@ void Cpp2Connection::killRequest(
 }
 
 THeader::StringToStringMap Cpp2Connection::setErrorHeaders(
-  const THeader::StringToStringMap& recv_headers) {
+  const THeaderMap& recv_headers) {
   THeader::StringToStringMap err_headers;
 
-  auto load_header = recv_headers.find(Cpp2Connection::loadHeader);
+  auto load_header = recv_headers.find(THeaderMap::Key::LOAD);
   std::string counter_name = "";
-  if (load_header != recv_headers.end()) {
-    counter_name = load_header->second;
+  if (load_header) {
+    counter_name = load_header->str();
   }
 
   err_headers[Cpp2Connection::loadHeader] = folly::to<std::string>(
@@ -344,13 +347,12 @@ void Cpp2Connection::requestReceived(
   }
   auto reqContext = t2r->getContext();
 
-  auto headers = reqContext->getHeaders();
-  auto load_header = headers.find(Cpp2Connection::loadHeader);
-  if (load_header != headers.end()) {
+  auto load_header = reqContext->getHeaderMap().find(THeaderMap::Key::LOAD);
+  if (load_header) {
     reqContext->setHeader(Cpp2Connection::loadHeader,
                           folly::to<std::string>(
                             getWorker()->getServer()->getLoad(
-                              load_header->second)));
+                              load_header->str())));
 
   }
 
@@ -394,6 +396,11 @@ Cpp2Connection::Cpp2Request::Cpp2Request(
   , reqContext_(&con->context_) {
   RequestContext::create();
 
+  const auto& policy = con->getWorker()->getServer()->getCompressionPolicy();
+  if (policy) {
+    reqContext_.setCompressionPolicy(policy);
+  }
+
   NumaThreadFactory::setNumaNode();
 }
 
@@ -423,6 +430,8 @@ void Cpp2Connection::Cpp2Request::sendReply(
     MessageChannel::SendCallback* sendCallback) {
   if (req_->isActive()) {
     auto observer = connection_->getWorker()->getServer()->getObserver().get();
+    // AsyncProcessor may have dropped some transforms for this reply
+    req_->setTransforms(reqContext_.getTransforms());
     req_->sendReply(
       std::move(buf),
       prepareSendCallback(sendCallback, observer),
@@ -439,7 +448,8 @@ void Cpp2Connection::Cpp2Request::sendErrorWrapped(
     std::string exCode,
     MessageChannel::SendCallback* sendCallback) {
   if (req_->isActive()) {
-    auto recv_headers = connection_->channel_->getHeader()->getHeaders();
+    const auto& recv_headers =
+      connection_->channel_->getHeader()->getHeaderMap();
 
     auto observer = connection_->getWorker()->getServer()->getObserver().get();
     req_->sendErrorWrapped(std::move(ew),
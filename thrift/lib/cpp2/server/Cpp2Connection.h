@@ -19,6 +19,7 @@
 
 #include <thrift/lib/cpp/async/HHWheelTimer.h>
 #include <thrift/lib/cpp/async/TEventConnection.h>
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
 #include <thrift/lib/cpp/concurrency/Util.h>
 #include <thrift/lib/cpp/transport/TSocketAddress.h>
 #include <thrift/lib/cpp/TApplicationException.h>
@@ -112,7 +113,8 @@ class Cpp2Connection
    */
   class Cpp2Request
       : public ResponseChannel::Request
-      , public apache::thrift::async::HHWheelTimer::Callback {
+      , public apache::thrift::async::HHWheelTimer::Callback
+      , public apache::thrift::concurrency::PoolAllocated {
    public:
     friend class Cpp2Connection;
 
@@ -186,7 +188,7 @@ class Cpp2Connection
 
   // Set any error headers necessary, based on the received headers
   apache::thrift::transport::THeader::StringToStringMap setErrorHeaders(
-    const apache::thrift::transport::THeader::StringToStringMap&
+    const apache::thrift::transport::THeaderMap&
     recv_headers);
 
   friend class Cpp2Request;
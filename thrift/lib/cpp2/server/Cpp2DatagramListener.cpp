@@ -0,0 +1,274 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp2/server/Cpp2DatagramListener.h>
+
+#include <thrift/lib/cpp2/server/Cpp2ConnContext.h>
+#include <thrift/lib/cpp2/server/Cpp2Worker.h>
+#include <thrift/lib/cpp2/server/ThriftServer.h>
+#include <thrift/lib/cpp/transport/THeader.h>
+
+#include <folly/ExceptionString.h>
+#include <folly/io/IOBufQueue.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+using std::unique_ptr;
+using folly::IOBuf;
+using apache::thrift::async::RequestContext;
+using apache::thrift::async::TAsyncTimeout;
+using apache::thrift::async::TAsyncUDPSocket;
+using apache::thrift::server::TServerObserver;
+using apache::thrift::transport::THeader;
+using apache::thrift::transport::TTransportException;
+
+namespace apache { namespace thrift {
+
+const uint32_t Cpp2DatagramListener::kMinRetryDelayMs;
+const uint32_t Cpp2DatagramListener::kMaxRetryDelayMs;
+
+/**
+ * A oneway request from a datagram.  Owns the header and contexts the
+ * request is processed with, and counts as active on the worker until the
+ * processor deletes it in the worker's TEventBase.
+ */
+class Cpp2DatagramListener::DatagramRequest : public ResponseChannel::Request {
+ public:
+  DatagramRequest(Cpp2Worker* worker,
+                  unique_ptr<THeader> header,
+                  const folly::SocketAddress& client,
+                  unique_ptr<IOBuf> buf)
+      : worker_(worker)
+      , header_(std::move(header))
+      , connContext_(&client, nullptr, header_.get(), nullptr,
+                     worker->getServer()->getEventBaseManager())
+      , reqContext_(&connContext_) {
+    buf_ = std::move(buf);
+    ++worker_->activeRequests_;
+    worker_->getServer()->incActiveRequests();
+  }
+
+  ~DatagramRequest() {
+    --worker_->activeRequests_;
+    worker_->getServer()->decActiveRequests();
+  }
+
+  bool isActive() {
+    return true;
+  }
+
+  void cancel() {}
+
+  bool isOneway() {
+    return true;
+  }
+
+  // Nobody to reply to
+  void sendReply(unique_ptr<IOBuf>&&, MessageChannel::SendCallback*) {}
+
+  void sendErrorWrapped(folly::exception_wrapper ew,
+                        std::string exCode,
+                        MessageChannel::SendCallback*) {
+    VLOG(4) << "Error in datagram request from "
+            << connContext_.getPeerAddress()->describe() << ": "
+            << ew.what();
+  }
+
+  Cpp2RequestContext* getContext() {
+    return &reqContext_;
+  }
+
+ private:
+  Cpp2Worker* worker_;
+  unique_ptr<THeader> header_;
+  Cpp2ConnContext connContext_;
+  Cpp2RequestContext reqContext_;
+};
+
+// Resumes reading after a read error
+class Cpp2DatagramListener::RetryTimeout : public TAsyncTimeout {
+ public:
+  explicit RetryTimeout(Cpp2DatagramListener* listener)
+      : TAsyncTimeout(listener->worker_->getEventBase())
+      , listener_(listener) {}
+
+  void timeoutExpired() noexcept {
+    listener_->socket_->resumeRead(listener_);
+  }
+
+ private:
+  Cpp2DatagramListener* listener_;
+};
+
+Cpp2DatagramListener::Cpp2DatagramListener(Cpp2Worker* worker,
+                                           const folly::SocketAddress& address)
+    : worker_(worker)
+    , processor_(worker->getServer()->getCpp2Processor())
+    , socket_(new TAsyncUDPSocket(worker->getEventBase()))
+    , retryTimeout_(new RetryTimeout(this))
+    , retryDelayMs_(0) {
+  socket_->setReusePort(true);
+  socket_->bind(address);
+  // One byte more than allowed, so that oversized datagrams are truncated
+  socket_->setReadBatch(kReadBatch,
+                        worker->getServer()->getMaxDatagramSize() + 1);
+}
+
+Cpp2DatagramListener::~Cpp2DatagramListener() {
+}
+
+void Cpp2DatagramListener::start() {
+  DCHECK(worker_->getEventBase()->isInEventBaseThread());
+  retryTimeout_->cancelTimeout();
+  socket_->resumeRead(this);
+}
+
+void Cpp2DatagramListener::pause() {
+  DCHECK(worker_->getEventBase()->isInEventBaseThread());
+  retryTimeout_->cancelTimeout();
+  socket_->pauseRead();
+}
+
+void Cpp2DatagramListener::getReadBuffer(void** buf, size_t* len) noexcept {
+  // Batched reads go to onDatagram() instead
+  *buf = nullptr;
+  *len = 0;
+}
+
+void Cpp2DatagramListener::onDataAvailable(const folly::SocketAddress& client,
+                                           size_t len,
+                                           bool truncated) noexcept {
+}
+
+bool Cpp2DatagramListener::onDatagram(const folly::SocketAddress& client,
+                                      folly::ByteRange data,
+                                      bool truncated) noexcept {
+  retryDelayMs_ = 0;
+  auto server = worker_->getServer();
+  auto observer = server->getObserver().get();
+
+  if (truncated || data.size() > server->getMaxDatagramSize()) {
+    if (observer) {
+      observer->datagramTruncated();
+    }
+    return true;
+  }
+
+  // A fresh header per datagram: clients must not see each other's
+  // persistent headers
+  unique_ptr<THeader> header(new THeader);
+  header->setZstdDictionary(server->getZstdDictionary());
+  unique_ptr<IOBuf> buf;
+  try {
+    folly::IOBufQueue queue;
+    queue.append(IOBuf::copyBuffer(data.data(), data.size()));
+    size_t needed;
+    buf = header->removeHeader(&queue, needed);
+    // Exactly one oneway THeader message
+    if (buf && (!queue.empty() ||
+                header->getClientType() != THRIFT_HEADER_CLIENT_TYPE ||
+                !processor_->isOnewayMethod(buf.get(), header.get()))) {
+      buf.reset();
+    }
+  } catch (const std::exception& ex) {
+    VLOG(4) << "Bad datagram from " << client.describe() << ": "
+            << folly::exceptionStr(ex);
+    buf.reset();
+  }
+  if (!buf) {
+    if (observer) {
+      observer->datagramMalformed();
+    }
+    return true;
+  }
+
+  countLosses(client, header->getSequenceNumber(), observer);
+
+  int activeRequests = worker_->activeRequests_;
+  activeRequests += worker_->pendingCount();
+  if (server->isOverloaded(activeRequests)) {
+    if (observer) {
+      observer->serverOverloaded();
+    }
+    return true;
+  }
+  if (observer) {
+    observer->receivedRequest();
+  }
+
+  RequestContext::create();
+  auto protType = static_cast<apache::thrift::protocol::PROTOCOL_TYPES>(
+    header->getProtocolId());
+  unique_ptr<DatagramRequest> req(
+    new DatagramRequest(worker_, std::move(header), client, buf->clone()));
+  auto reqContext = req->getContext();
+  try {
+    processor_->process(std::move(req),
+                        std::move(buf),
+                        protType,
+                        reqContext,
+                        worker_->getEventBase(),
+                        server->getThreadManager().get());
+  } catch (...) {
+    LOG(WARNING) << "Process exception: " <<
+      folly::exceptionStr(std::current_exception());
+  }
+  return true;
+}
+
+void Cpp2DatagramListener::onReadError(
+    const TTransportException& ex) noexcept {
+  // Reading a socket that failed once usually still works, but retrying
+  // at once would spin on an error that persists
+  retryDelayMs_ = retryDelayMs_ == 0
+    ? kMinRetryDelayMs
+    : std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+  LOG(ERROR) << "Datagram read error, retrying in " << retryDelayMs_
+             << "ms: " << ex.what();
+  retryTimeout_->scheduleTimeout(retryDelayMs_);
+}
+
+void Cpp2DatagramListener::onReadClosed() noexcept {
+}
+
+void Cpp2DatagramListener::countLosses(const folly::SocketAddress& client,
+                                       uint32_t seqId,
+                                       TServerObserver* observer) {
+  auto it = nextSeqIds_.find(client);
+  if (it == nextSeqIds_.end()) {
+    if (nextSeqIds_.size() >= kMaxClients) {
+      nextSeqIds_.clear();
+    }
+    nextSeqIds_.emplace(client, seqId + 1);
+    return;
+  }
+
+  // Modulo 2^32, as sequence numbers wrap
+  int32_t gap = static_cast<int32_t>(seqId - it->second);
+  if (gap >= 0) {
+    if (gap > 0 && observer) {
+      observer->datagramsLost(gap);
+    }
+    it->second = seqId + 1;
+  } else if (gap < -kReorderWindow) {
+    it->second = seqId + 1;
+  }
+  // Otherwise late or duplicated, and already counted as lost
+}
+
+}} // apache::thrift
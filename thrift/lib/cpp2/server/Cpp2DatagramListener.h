@@ -0,0 +1,106 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_SERVER_CPP2DATAGRAMLISTENER_H_
+#define THRIFT_SERVER_CPP2DATAGRAMLISTENER_H_ 1
+
+#include <thrift/lib/cpp2/async/AsyncProcessor.h>
+#include <thrift/lib/cpp/async/TAsyncTimeout.h>
+#include <thrift/lib/cpp/async/TAsyncUDPSocket.h>
+#include <thrift/lib/cpp/server/TServerObserver.h>
+#include <thrift/lib/cpp/transport/TSocketAddress.h>
+
+#include <memory>
+#include <unordered_map>
+
+namespace apache { namespace thrift {
+
+class Cpp2Worker;
+
+/**
+ * Serves the oneway requests that arrive as UDP datagrams (see
+ * DatagramClientChannel) on one Cpp2Worker's TEventBase.
+ *
+ * Each worker binds its own SO_REUSEPORT socket to the server's datagram
+ * address, so the kernel spreads clients over the workers and keeps each
+ * client on one of them.  Datagrams are read in batches and go to the
+ * server's AsyncProcessor like requests from a connection, minus the reply.
+ *
+ * Dropped datagrams, and those lost on the way, are reported to the
+ * server's TServerObserver.
+ */
+class Cpp2DatagramListener
+    : private apache::thrift::async::TAsyncUDPSocket::ReadCallback {
+ public:
+  // Throws TTransportException if address cannot be bound
+  Cpp2DatagramListener(Cpp2Worker* worker,
+                       const folly::SocketAddress& address);
+
+  ~Cpp2DatagramListener();
+
+  // Start / pause reading; must be called in the worker's TEventBase thread
+  void start();
+  void pause();
+
+  const folly::SocketAddress& getAddress() const {
+    return socket_->address();
+  }
+
+  // Datagrams read per system call
+  static const size_t kReadBatch = 32;
+  // Clients whose sequence numbers are tracked; all are forgotten when a
+  // new one would exceed this
+  static const size_t kMaxClients = 65536;
+  // A sequence number this far behind the expected one means the client
+  // started over
+  static const int32_t kReorderWindow = 1024;
+  // Reading resumes this long after an error, doubling while errors repeat
+  static const uint32_t kMinRetryDelayMs = 10;
+  static const uint32_t kMaxRetryDelayMs = 1000;
+
+ private:
+  class DatagramRequest;
+  class RetryTimeout;
+
+  // TAsyncUDPSocket::ReadCallback
+  void getReadBuffer(void** buf, size_t* len) noexcept;
+  void onDataAvailable(const folly::SocketAddress& client,
+                       size_t len,
+                       bool truncated) noexcept;
+  bool onDatagram(const folly::SocketAddress& client,
+                  folly::ByteRange data,
+                  bool truncated) noexcept;
+  void onReadError(
+    const apache::thrift::transport::TTransportException& ex) noexcept;
+  void onReadClosed() noexcept;
+
+  void countLosses(const folly::SocketAddress& client,
+                   uint32_t seqId,
+                   apache::thrift::server::TServerObserver* observer);
+
+  Cpp2Worker* worker_;
+  std::unique_ptr<AsyncProcessor> processor_;
+  std::unique_ptr<apache::thrift::async::TAsyncUDPSocket> socket_;
+  std::unique_ptr<RetryTimeout> retryTimeout_;
+  // 0 unless the last read failed
+  uint32_t retryDelayMs_;
+  // Next sequence number expected from each client
+  std::unordered_map<folly::SocketAddress, uint32_t> nextSeqIds_;
+};
+
+}} // apache::thrift
+
+#endif // THRIFT_SERVER_CPP2DATAGRAMLISTENER_H_
@@ -83,22 +83,35 @@ void Cpp2Worker::connectionAccepted(int fd, const folly::SocketAddress& clientAd
     return;
   }
 
-  if (server_->getSSLContext()) {
-    sslSock = new TAsyncSSLSocket(server_->getSSLContext(),
-                                  eventBase_.get(),
-                                  fd,
-                                  true);
-    asyncSock = sslSock;
+  auto handshakePool = server_->getSSLHandshakePool();
+  if (server_->getSSLContext() && handshakePool) {
+    // The pool brings the socket back to this worker after the handshake.
+    handshakePool->accept(fd,
+                          server_->getSSLContext(),
+                          server_->getIdleTimeout().count(),
+                          server_->shutdownSocketSet_.get(),
+                          eventBase_.get(),
+                          [this](TAsyncSSLSocket* sock) {
+                            finishConnectionAccepted(sock);
+                          });
   } else {
-    asyncSock = new TAsyncSocket(eventBase_.get(), fd);
-  }
-  asyncSock->setShutdownSocketSet(server_->shutdownSocketSet_.get());
+    if (server_->getSSLContext()) {
+      sslSock = new TAsyncSSLSocket(server_->getSSLContext(),
+                                    eventBase_.get(),
+                                    fd,
+                                    true);
+      asyncSock = sslSock;
+    } else {
+      asyncSock = new TAsyncSocket(eventBase_.get(), fd);
+    }
+    asyncSock->setShutdownSocketSet(server_->shutdownSocketSet_.get());
 
-  if (sslSock != nullptr) {
-    // The connection may be deleted in sslAccept().
-    sslSock->sslAccept(this, server_->getIdleTimeout().count());
-  } else {
-    finishConnectionAccepted(asyncSock);
+    if (sslSock != nullptr) {
+      // The connection may be deleted in sslAccept().
+      sslSock->sslAccept(this, server_->getIdleTimeout().count());
+    } else {
+      finishConnectionAccepted(asyncSock);
+    }
   }
 
   if (observer) {
@@ -172,6 +185,71 @@ void Cpp2Worker::acceptStopped() noexcept {
   }
 }
 
+void Cpp2Worker::useListenSocket(TAsyncServerSocket::UniquePtr socket) {
+  DCHECK(!listenSocket_);
+  listenSocket_ = std::move(socket);
+}
+
+void Cpp2Worker::startListening() {
+  if (!listenSocket_) {
+    return;
+  }
+  DCHECK(eventBase_->isInEventBaseThread());
+
+  if (!listenSocket_->getEventBase()) {
+    listenSocket_->attachEventBase(eventBase_.get());
+    listenSocket_->addAcceptCallback(this, eventBase_.get());
+  }
+  listenSocket_->startAccepting();
+}
+
+void Cpp2Worker::pauseListening() {
+  if (!listenSocket_) {
+    return;
+  }
+  DCHECK(eventBase_->isInEventBaseThread());
+
+  listenSocket_->pauseAccepting();
+}
+
+void Cpp2Worker::closeListenSocket() {
+  if (!listenSocket_) {
+    return;
+  }
+  DCHECK(eventBase_->isInEventBaseThread());
+
+  // Destroying the socket removes us as accept callback, which in turn
+  // calls acceptStopped() from our TEventBase.
+  listenSocket_.reset();
+}
+
+std::vector<int> Cpp2Worker::getListenSockets() const {
+  return listenSocket_ ? listenSocket_->getSockets() : std::vector<int>{};
+}
+
+uint64_t Cpp2Worker::getNumDroppedConnections() const {
+  return listenSocket_ ? listenSocket_->getNumDroppedConnections() : 0;
+}
+
+folly::SocketAddress Cpp2Worker::bindDatagramSocket(
+    const folly::SocketAddress& address) {
+  DCHECK(!datagramListener_);
+  datagramListener_.reset(new Cpp2DatagramListener(this, address));
+  return datagramListener_->getAddress();
+}
+
+void Cpp2Worker::startDatagrams() {
+  if (datagramListener_) {
+    datagramListener_->start();
+  }
+}
+
+void Cpp2Worker::pauseDatagrams() {
+  if (datagramListener_) {
+    datagramListener_->pause();
+  }
+}
+
 void Cpp2Worker::stopEventBase() noexcept {
   eventBase_->terminateLoopSoon();
 }
@@ -20,6 +20,8 @@
 #include <thrift/lib/cpp/async/TAsyncServerSocket.h>
 #include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
 #include <thrift/lib/cpp/async/HHWheelTimer.h>
+#include <thrift/lib/cpp2/async/WriteBatcher.h>
+#include <thrift/lib/cpp2/server/Cpp2DatagramListener.h>
 #include <thrift/lib/cpp2/server/ThriftServer.h>
 #include <thrift/lib/cpp/async/TEventBase.h>
 #include <thrift/lib/cpp/async/TEventHandler.h>
@@ -88,6 +90,8 @@ class Cpp2Worker :
     }
     manager_ = folly::wangle::ConnectionManager::makeUnique(
       eventBase_.get(), server->getIdleTimeout());
+    writeBatcher_.reset(
+      new WriteBatcher(eventBase_.get(), server_->getBatchSends()));
   }
 
   /**
@@ -147,6 +151,72 @@ class Cpp2Worker :
    */
   void serve();
 
+  /**
+   * Give this worker its own listening socket, so that it accepts
+   * connections directly on its TEventBase instead of having them handed
+   * over by ThriftServer.  Used when SO_REUSEPORT listeners are enabled.
+   *
+   * Must be called before the worker thread starts; accepting begins with
+   * startListening().
+   */
+  void useListenSocket(
+    apache::thrift::async::TAsyncServerSocket::UniquePtr socket);
+
+  /**
+   * Start / pause accepting on our own listening socket, if any.
+   * Must be called in the worker's TEventBase thread.
+   */
+  void startListening();
+  void pauseListening();
+
+  /**
+   * Close our own listening socket, if any.  acceptStopped() will be
+   * invoked once the socket is gone.  Must be called in the worker's
+   * TEventBase thread.
+   */
+  void closeListenSocket();
+
+  /**
+   * Return the file descriptor(s) of our own listening socket, if any.
+   */
+  std::vector<int> getListenSockets() const;
+
+  /**
+   * Get the number of connections dropped by our own listening socket.
+   */
+  uint64_t getNumDroppedConnections() const;
+
+  /**
+   * Also serve oneway requests sent as UDP datagrams to address, on a
+   * SO_REUSEPORT socket of our own (see Cpp2DatagramListener).  Returns the
+   * address bound, whose port the kernel picked if address's was 0.
+   *
+   * Must be called before the worker thread starts; reading begins with
+   * startDatagrams().
+   */
+  folly::SocketAddress bindDatagramSocket(const folly::SocketAddress& address);
+
+  /**
+   * Start / pause reading our datagram socket, if any.  Must be called in
+   * the worker's TEventBase thread.
+   */
+  void startDatagrams();
+  void pauseDatagrams();
+
+  /**
+   * Batcher shared by all connections on this worker.
+   */
+  WriteBatcher* getWriteBatcher() const {
+    return writeBatcher_.get();
+  }
+
+  /**
+   * Message / write counters for this worker's connections.  Thread-safe.
+   */
+  WriteBatcher::Stats getWriteStats() const {
+    return writeBatcher_->getStats();
+  }
+
   /**
    * Count the number of pending fds. Used for overload detection.
    * Not thread-safe.
@@ -168,6 +238,12 @@ class Cpp2Worker :
   /// Our ID in [0:nWorkers).
   uint32_t workerID_;
 
+  /// Listening socket owned by this worker (SO_REUSEPORT mode only).
+  apache::thrift::async::TAsyncServerSocket::UniquePtr listenSocket_;
+
+  /// Oneway requests over UDP, if the server has a datagram address.
+  std::unique_ptr<Cpp2DatagramListener> datagramListener_;
+
   /**
    * Called when the connection is fully accepted (after SSL accept if needed)
    */
@@ -201,9 +277,13 @@ class Cpp2Worker :
   std::chrono::steady_clock::time_point pendingTime_;
 
   friend class Cpp2Connection;
+  friend class Cpp2DatagramListener;
   friend class ThriftServer;
 
   folly::wangle::ConnectionManager::UniquePtr manager_;
+
+  /// Flushes queued sends of all connections once per loop.
+  std::unique_ptr<WriteBatcher> writeBatcher_;
 };
 
 }} // apache::thrift
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp2/server/SSLHandshakePool.h>
+
+#include <folly/Conv.h>
+#include <folly/ExceptionString.h>
+
+#include <glog/logging.h>
+
+#include <unistd.h>
+
+using apache::thrift::async::TAsyncSSLSocket;
+using apache::thrift::async::TEventBase;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::transport::SSLContext;
+using apache::thrift::transport::TTransportException;
+
+namespace apache { namespace thrift {
+
+class SSLHandshakePool::HandshakeThread : public Runnable {
+ public:
+  void run() override {
+    eventBase.loopForever();
+  }
+
+  // Moves a handshaken socket to its TEventBase, unless it has already
+  // been moved
+  void handOff(TAsyncSSLSocket* sock) {
+    auto it = handoffs.find(sock);
+    if (it == handoffs.end()) {
+      return;
+    }
+    auto eventBase = it->second.first;
+    auto callback = std::move(it->second.second);
+    handoffs.erase(it);
+    sock->detachEventBase();
+    eventBase->runInEventBaseThread([sock, eventBase, callback]() {
+      sock->attachEventBase(eventBase);
+      callback(sock);
+    });
+  }
+
+  TEventBase eventBase;
+  std::shared_ptr<Thread> thread;
+  // Only used in eventBase's thread
+  std::unordered_set<Handshake*> handshakes;
+  // Sockets that finished their handshake but are not yet handed off
+  std::unordered_map<TAsyncSSLSocket*, std::pair<TEventBase*, Callback>>
+    handoffs;
+};
+
+class SSLHandshakePool::Handshake
+    : public TAsyncSSLSocket::HandshakeCallback {
+ public:
+  Handshake(SSLHandshakePool* pool,
+            HandshakeThread* thread,
+            TAsyncSSLSocket* socket,
+            TEventBase* eventBase,
+            Callback&& callback)
+    : pool_(pool)
+    , thread_(thread)
+    , socket_(socket)
+    , eventBase_(eventBase)
+    , callback_(std::move(callback)) {
+    thread_->handshakes.insert(this);
+  }
+
+  ~Handshake() {
+    thread_->handshakes.erase(this);
+    --pool_->pending_;
+  }
+
+  void handshakeSuccess(TAsyncSSLSocket* sock) noexcept override {
+    ++pool_->completed_;
+    // TAsyncSSLSocket::handleAccept() still holds sock; move it once the
+    // current callback has unwound.  stop() hands it off instead if the
+    // loop ends first.
+    auto thread = thread_;
+    thread->handoffs.emplace(sock,
+                             std::make_pair(eventBase_, std::move(callback_)));
+    thread->eventBase.runInLoop([thread, sock]() {
+      thread->handOff(sock);
+    });
+    delete this;
+  }
+
+  void handshakeError(TAsyncSSLSocket* sock,
+                      const TTransportException& ex) noexcept override {
+    ++pool_->failed_;
+    VLOG(1) << "SSLHandshakePool: SSL handshake failed: "
+            << folly::exceptionStr(ex);
+    sock->destroy();
+    delete this;
+  }
+
+  TAsyncSSLSocket* getSocket() const {
+    return socket_;
+  }
+
+ private:
+  SSLHandshakePool* pool_;
+  HandshakeThread* thread_;
+  TAsyncSSLSocket* socket_;
+  TEventBase* eventBase_;
+  Callback callback_;
+};
+
+SSLHandshakePool::SSLHandshakePool(
+    size_t threads,
+    const std::shared_ptr<ThreadFactory>& threadFactory,
+    const std::string& namePrefix)
+    : next_(0)
+    , pending_(0)
+    , completed_(0)
+    , failed_(0)
+    , stopped_(false) {
+  CHECK_GT(threads, 0);
+  for (size_t i = 0; i < threads; ++i) {
+    auto t = std::make_shared<HandshakeThread>();
+    t->thread = threadFactory->newThread(t, ThreadFactory::ATTACHED);
+    t->thread->start();
+    t->thread->setName(folly::to<std::string>(namePrefix, i + 1));
+    threads_.push_back(t);
+  }
+}
+
+SSLHandshakePool::~SSLHandshakePool() {
+  stop();
+}
+
+void SSLHandshakePool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(stopMutex_);
+    if (stopped_.exchange(true)) {
+      return;
+    }
+  }
+  for (auto& t : threads_) {
+    auto thread = t.get();
+    thread->eventBase.runInEventBaseThread([thread]() {
+      // Each close deletes its Handshake
+      std::vector<Handshake*> handshakes(thread->handshakes.begin(),
+                                         thread->handshakes.end());
+      for (auto h : handshakes) {
+        h->getSocket()->closeNow();
+      }
+      // Finished handshakes still go to their TEventBase
+      while (!thread->handoffs.empty()) {
+        thread->handOff(thread->handoffs.begin()->first);
+      }
+      thread->eventBase.terminateLoopSoon();
+    });
+  }
+  for (auto& t : threads_) {
+    t->thread->join();
+  }
+}
+
+void SSLHandshakePool::accept(int fd,
+                              const std::shared_ptr<SSLContext>& ctx,
+                              uint32_t timeout,
+                              folly::ShutdownSocketSet* shutdownSocketSet,
+                              TEventBase* eventBase,
+                              Callback callback) {
+  // Holding the lock while queueing makes the work run before stop()'s,
+  // which ends the loop; anything queued after that would never run.
+  std::lock_guard<std::mutex> lock(stopMutex_);
+  if (stopped_) {
+    close(fd);
+    return;
+  }
+  ++pending_;
+  auto thread = threads_[next_++ % threads_.size()].get();
+  thread->eventBase.runInEventBaseThread(
+    [this, thread, fd, ctx, timeout, shutdownSocketSet, eventBase, callback]()
+      mutable {
+      if (stopped_) {
+        // stop() already closed this thread's handshakes
+        close(fd);
+        --pending_;
+        return;
+      }
+      auto sock = new TAsyncSSLSocket(ctx, &thread->eventBase, fd, true);
+      sock->setShutdownSocketSet(shutdownSocketSet);
+      auto handshake = new Handshake(this, thread, sock, eventBase,
+                                     std::move(callback));
+      // The handshake may be deleted in sslAccept().
+      sock->sslAccept(handshake, timeout);
+    });
+}
+
+}} // apache::thrift
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THRIFT_SERVER_SSLHANDSHAKEPOOL_H_
+#define THRIFT_SERVER_SSLHANDSHAKEPOOL_H_ 1
+
+#include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+#include <thrift/lib/cpp/concurrency/Thread.h>
+#include <thrift/lib/cpp/transport/TSSLSocket.h>
+
+#include <folly/io/ShutdownSocketSet.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace apache { namespace thrift {
+
+/**
+ * Threads that run server side TLS handshakes, so the handshake crypto of
+ * new connections does not delay requests on the I/O threads that serve
+ * established ones.
+ *
+ * accept() starts the handshake on one of the pool's TEventBases.  Once it
+ * succeeds the socket is detached and re-attached to the caller's
+ * TEventBase, where the callback gets it.  Failed handshakes are logged
+ * and closed in the pool; the callback is not called.
+ *
+ * Session resumption works regardless of which thread does the handshake
+ * if the SSLContext uses an apache::thrift::ssl::SSLSessionCache.
+ */
+class SSLHandshakePool {
+ public:
+  typedef std::function<void(apache::thrift::async::TAsyncSSLSocket*)>
+    Callback;
+
+  SSLHandshakePool(
+    size_t threads,
+    const std::shared_ptr<apache::thrift::concurrency::ThreadFactory>&
+      threadFactory,
+    const std::string& namePrefix = "thrift-ssl");
+
+  // Stops the pool if needed
+  ~SSLHandshakePool();
+
+  /**
+   * Closes the handshakes in progress and joins the threads.  Sockets
+   * whose handshake already succeeded are still handed to their TEventBase
+   * and get their callback.
+   */
+  void stop();
+
+  /**
+   * Runs the server side handshake of the accepted connection fd.
+   *
+   * @param timeout      handshake timeout in milliseconds, 0 for none
+   * @param eventBase    where the socket goes, and callback runs, afterwards
+   * @param callback     must stay valid until eventBase runs it
+   */
+  void accept(int fd,
+              const std::shared_ptr<apache::thrift::transport::SSLContext>& ctx,
+              uint32_t timeout,
+              folly::ShutdownSocketSet* shutdownSocketSet,
+              apache::thrift::async::TEventBase* eventBase,
+              Callback callback);
+
+  // Handshakes queued or in progress
+  uint64_t getPending() const {
+    return pending_;
+  }
+
+  uint64_t getCompleted() const {
+    return completed_;
+  }
+
+  uint64_t getFailed() const {
+    return failed_;
+  }
+
+  size_t getNumThreads() const {
+    return threads_.size();
+  }
+
+ private:
+  class Handshake;
+  class HandshakeThread;
+
+  std::vector<std::shared_ptr<HandshakeThread>> threads_;
+  std::atomic<size_t> next_;
+  std::atomic<uint64_t> pending_;
+  std::atomic<uint64_t> completed_;
+  std::atomic<uint64_t> failed_;
+  std::atomic<bool> stopped_;
+  // Orders accept() against stop(), so no handshake is queued behind the
+  // end of a loop
+  std::mutex stopMutex_;
+};
+
+}} // apache::thrift
+
+#endif // THRIFT_SERVER_SSLHANDSHAKEPOOL_H_
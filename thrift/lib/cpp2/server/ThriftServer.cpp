@@ -76,7 +76,9 @@ ThriftServer::ThriftServer() :
   apache::thrift::server::TServer(
     std::shared_ptr<apache::thrift::server::TProcessor>()),
   cpp2WorkerThreadName_("Cpp2Worker"),
+  nSSLHandshakeThreads_(0),
   port_(-1),
+  maxDatagramSize_(DEFAULT_MAX_DATAGRAM_SIZE),
   saslEnabled_(false),
   nonSaslEnabled_(true),
   shutdownSocketSet_(
@@ -101,7 +103,9 @@ ThriftServer::ThriftServer() :
   minCompressBytes_(0),
   isOverloaded_([]() { return false; }),
   queueSends_(true),
+  batchSends_(true),
   enableCodel_(false),
+  reusePortListeners_(false),
   stopWorkersOnStopListening_(true),
   isDuplex_(false) {
 
@@ -158,10 +162,27 @@ void ThriftServer::useExistingSocket(int socket) {
 }
 
 std::vector<int> ThriftServer::getListenSockets() const {
+  if (reusePortListeners_ && socket_ == nullptr) {
+    std::vector<int> sockets;
+    for (const auto& info : workers_) {
+      auto workerSockets = info.worker->getListenSockets();
+      sockets.insert(sockets.end(), workerSockets.begin(), workerSockets.end());
+    }
+    return sockets;
+  }
   return (socket_ != nullptr) ? socket_->getSockets() : std::vector<int>{};
 }
 
 int ThriftServer::getListenSocket() const {
+  if (reusePortListeners_ && socket_ == nullptr && !workers_.empty()) {
+    std::vector<int> sockets = workers_[0].worker->getListenSockets();
+    if (!sockets.empty()) {
+      CHECK(sockets.size() == 1);
+      return sockets[0];
+    }
+    return -1;
+  }
+
   if (socket_ != nullptr) {
     std::vector<int> sockets = socket_->getSockets();
     CHECK(sockets.size() == 1);
@@ -220,6 +241,7 @@ void ThriftServer::setup() {
       if (socket_ == nullptr) {
         socket_.reset(new TAsyncServerSocket());
         socket_->setShutdownSocketSet(shutdownSocketSet_.get());
+        socket_->setReusePortEnabled(reusePortListeners_);
         if (port_ != -1) {
           socket_->bind(port_);
         } else {
@@ -243,6 +265,16 @@ void ThriftServer::setup() {
       );
     }
 
+    if (sslContext_) {
+      if (sslSessionCache_) {
+        sslSessionCache_->attach(sslContext_->getSSLCtx());
+      }
+      if (nSSLHandshakeThreads_ > 0 && !sslHandshakePool_) {
+        sslHandshakePool_ = std::make_shared<SSLHandshakePool>(
+          nSSLHandshakeThreads_, threadFactory_, "thrift-ssl");
+      }
+    }
+
     if (FLAGS_sasl_policy == "required" || FLAGS_sasl_policy == "permitted") {
       if (!saslThreadManager_) {
         saslThreadManager_ = ThreadManager::newSimpleThreadManager(
@@ -328,6 +360,14 @@ void ThriftServer::setup() {
         socket_->getAddress(&address_);
       }
 
+      if (reusePortListeners_) {
+        setupWorkerListenSockets();
+      }
+
+      if (datagramAddress_.isInitialized()) {
+        setupWorkerDatagramSockets();
+      }
+
       for (auto& worker: workers_) {
         worker.thread->start();
         ++threadsStarted;
@@ -350,6 +390,17 @@ void ThriftServer::setup() {
       if (socket_) {
         socket_->startAccepting();
       }
+      if (reusePortListeners_) {
+        forEachWorkerListener([](Cpp2Worker* worker) {
+          worker->startListening();
+        });
+      }
+      for (auto& info : workers_) {
+        auto worker = info.worker.get();
+        worker->getEventBase()->runInEventBaseThread([worker]() {
+          worker->startDatagrams();
+        });
+      }
     } else {
       // duplex server
       // Create the Cpp2Worker
@@ -420,12 +471,27 @@ void ThriftServer::cleanUp() {
 }
 
 uint64_t ThriftServer::getNumDroppedConnections() const {
+  if (reusePortListeners_ && !socket_) {
+    uint64_t dropped = 0;
+    for (const auto& info : workers_) {
+      dropped += info.worker->getNumDroppedConnections();
+    }
+    return dropped;
+  }
   if (!socket_) {
     return 0;
   }
   return socket_->getNumDroppedConnections();
 }
 
+WriteBatcher::Stats ThriftServer::getWriteStats() const {
+  WriteBatcher::Stats stats;
+  for (const auto& info : workers_) {
+    stats += info.worker->getWriteStats();
+  }
+  return stats;
+}
+
 void ThriftServer::stop() {
   TEventBase* eventBase = serveEventBase_;
   if (eventBase) {
@@ -452,6 +518,88 @@ void ThriftServer::stopListening() {
 
     // Return now and don't wait for worker threads to stop
   }
+
+  if (datagramAddress_.isInitialized() && !serverChannel_) {
+    for (auto& info : workers_) {
+      auto worker = info.worker.get();
+      worker->getEventBase()->runInEventBaseThread([worker]() {
+        worker->pauseDatagrams();
+      });
+    }
+  }
+
+  // Only once, like the shared socket above: the sockets are gone after
+  // the first call
+  if (reusePortListeners_ && !serverChannel_ && !getListenSockets().empty()) {
+    // Stop accepting new connections on every worker first
+    forEachWorkerListener([](Cpp2Worker* worker) {
+      worker->pauseListening();
+    });
+
+    if (stopWorkersOnStopListening_ && threadManager_) {
+      threadManager_->join();
+    }
+
+    // Close the listening sockets. This will also cause the workers to stop.
+    forEachWorkerListener([](Cpp2Worker* worker) {
+      worker->closeListenSocket();
+    });
+  }
+}
+
+void ThriftServer::setupWorkerListenSockets() {
+  DCHECK(socket_);
+  std::vector<folly::SocketAddress> addresses = socket_->getAddresses();
+
+  for (size_t n = 0; n < workers_.size(); ++n) {
+    TAsyncServerSocket::UniquePtr socket;
+    if (n == 0) {
+      socket = std::move(socket_);
+    } else {
+      socket.reset(new TAsyncServerSocket());
+      socket->setShutdownSocketSet(shutdownSocketSet_.get());
+      socket->setReusePortEnabled(true);
+      socket->bind(addresses);
+      socket->listen(listenBacklog_);
+    }
+    socket->setMaxNumMessagesInQueue(maxNumMsgsInQueue_);
+    socket->setAcceptRateAdjustSpeed(acceptRateAdjustSpeed_);
+    workers_[n].worker->useListenSocket(std::move(socket));
+  }
+}
+
+void ThriftServer::setupWorkerDatagramSockets() {
+  for (auto& info : workers_) {
+    datagramAddress_ = info.worker->bindDatagramSocket(datagramAddress_);
+  }
+}
+
+void ThriftServer::forEachWorkerListener(
+    const std::function<void(Cpp2Worker*)>& func) {
+  std::vector<Cpp2Worker*> remote;
+  for (auto& info : workers_) {
+    auto worker = info.worker.get();
+    if (worker->getListenSockets().empty()) {
+      continue;
+    }
+    if (worker->getEventBase()->isInEventBaseThread()) {
+      func(worker);
+    } else {
+      remote.push_back(worker);
+    }
+  }
+  if (remote.empty()) {
+    return;
+  }
+
+  auto b = std::make_shared<boost::barrier>(remote.size() + 1);
+  for (auto worker : remote) {
+    worker->getEventBase()->runInEventBaseThread([worker, func, b]() {
+      func(worker);
+      b->wait();
+    });
+  }
+  b->wait();
 }
 
 void ThriftServer::addWorker() {
@@ -463,8 +611,8 @@ void ThriftServer::addWorker() {
   // Create the thread
   info.thread = threadFactory_->newThread(info.worker, ThreadFactory::ATTACHED);
 
-  // Add the worker as an accept callback
-  if (socket_) {
+  // Add the worker as an accept callback, unless it gets its own listener
+  if (socket_ && !reusePortListeners_) {
     socket_->addAcceptCallback(info.worker.get(), info.worker->getEventBase());
   }
 
@@ -475,6 +623,10 @@ void ThriftServer::stopWorkers() {
   if (serverChannel_) {
     return;
   }
+  // Handshakes finishing now would hand their sockets to stopped workers
+  if (sslHandshakePool_) {
+    sslHandshakePool_->stop();
+  }
   for (auto& info : workers_) {
     info.worker->stopEventBase();
     info.thread->join();
@@ -32,14 +32,18 @@
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 #include <thrift/lib/cpp/server/TServer.h>
 #include <thrift/lib/cpp/server/TServerObserver.h>
+#include <thrift/lib/cpp/ssl/SSLSessionCache.h>
 #include <thrift/lib/cpp/transport/THeader.h>
 #include <thrift/lib/cpp/transport/TSSLSocket.h>
 #include <thrift/lib/cpp/transport/TSocketAddress.h>
 #include <thrift/lib/cpp/transport/TTransportUtils.h>
 #include <thrift/lib/cpp2/Thrift.h>
 #include <thrift/lib/cpp2/async/AsyncProcessor.h>
+#include <thrift/lib/cpp2/async/CompressionPolicy.h>
 #include <thrift/lib/cpp2/async/SaslServer.h>
 #include <thrift/lib/cpp2/async/HeaderServerChannel.h>
+#include <thrift/lib/cpp2/async/WriteBatcher.h>
+#include <thrift/lib/cpp2/server/SSLHandshakePool.h>
 
 namespace apache { namespace thrift {
 
@@ -107,6 +111,9 @@ class ThriftServer : public apache::thrift::server::TServer {
   /// Listen backlog
   static const int DEFAULT_LISTEN_BACKLOG = 1024;
 
+  //! Largest datagram request served, by default
+  static const size_t DEFAULT_MAX_DATAGRAM_SIZE = 8192;
+
  private:
   struct WorkerInfo {
     std::shared_ptr<Cpp2Worker> worker;
@@ -122,6 +129,12 @@ class ThriftServer : public apache::thrift::server::TServer {
   //! SSL context
   std::shared_ptr<apache::thrift::transport::SSLContext> sslContext_;
 
+  //! Threads for SSL handshakes, 0 to run them on the I/O workers
+  size_t nSSLHandshakeThreads_;
+  std::shared_ptr<SSLHandshakePool> sslHandshakePool_;
+
+  std::shared_ptr<apache::thrift::ssl::SSLSessionCache> sslSessionCache_;
+
   // Cpp2 ProcessorFactory.
   std::shared_ptr<apache::thrift::AsyncProcessorFactory> cpp2Pfac_;
 
@@ -131,6 +144,10 @@ class ThriftServer : public apache::thrift::server::TServer {
   //! The server's listening port
   int port_;
 
+  //! Where oneway requests arrive as datagrams, if initialized
+  folly::SocketAddress datagramAddress_;
+  size_t maxDatagramSize_;
+
   // Security negotiation settings
   bool saslEnabled_;
   bool nonSaslEnabled_;
@@ -216,6 +233,24 @@ class ThriftServer : public apache::thrift::server::TServer {
 
   void addWorker();
 
+  /**
+   * Hand each worker its own SO_REUSEPORT listening socket.  Worker 0 takes
+   * over socket_, the other workers bind siblings to the same addresses.
+   */
+  void setupWorkerListenSockets();
+
+  /**
+   * Run func on each worker that owns a listening socket, in the worker's
+   * TEventBase thread, and wait for all of them to finish.
+   */
+  void forEachWorkerListener(const std::function<void(Cpp2Worker*)>& func);
+
+  /**
+   * Bind each worker's datagram socket to datagramAddress_, and update it
+   * with the port the first one got.
+   */
+  void setupWorkerDatagramSockets();
+
   void stopWorkers();
 
   // Notification of various server events
@@ -242,13 +277,24 @@ class ThriftServer : public apache::thrift::server::TServer {
   // request compression.
   uint32_t minCompressBytes_;
 
+  // Dictionary for zstd-compressed requests and responses, if any
+  std::shared_ptr<const apache::thrift::transport::ZstdDictionary> zstdDict_;
+
+  // Picks each response's transform, if set
+  std::shared_ptr<CompressionPolicy> compressionPolicy_;
+
   std::function<bool(void)> isOverloaded_;
   std::function<int64_t(const std::string&)> getLoad_;
 
   bool queueSends_;
 
+  bool batchSends_;
+
   bool enableCodel_;
 
+  // If true, each Cpp2Worker accepts on its own SO_REUSEPORT listening socket
+  bool reusePortListeners_;
+
   bool stopWorkersOnStopListening_;
 
   // HeaderServerChannel to use for a duplex server (used by client).
@@ -457,6 +503,44 @@ class ThriftServer : public apache::thrift::server::TServer {
     return sslContext_;
   }
 
+  /**
+   * Run SSL handshakes on this many dedicated threads, instead of on the
+   * I/O worker that accepted the connection, so that reconnect storms do
+   * not hold up requests on established connections.  Connections move to
+   * their worker once the handshake is done.  The default, 0, does the
+   * handshakes on the workers.
+   */
+  void setSSLHandshakeThreads(size_t threads) {
+    assert(workers_.size() == 0);
+    nSSLHandshakeThreads_ = threads;
+  }
+
+  size_t getSSLHandshakeThreads() const {
+    return nSSLHandshakeThreads_;
+  }
+
+  // Null unless setSSLHandshakeThreads() was called and setup() has run
+  const std::shared_ptr<SSLHandshakePool>& getSSLHandshakePool() const {
+    return sslHandshakePool_;
+  }
+
+  /**
+   * Keep SSL sessions and session ticket keys in cache, which setup()
+   * attaches to the SSL context, rather than in OpenSSL's internal cache.
+   * The cache can be shared with other servers, and its ticket keys
+   * rotated while the server runs.
+   */
+  void setSSLSessionCache(
+    std::shared_ptr<apache::thrift::ssl::SSLSessionCache> cache) {
+    assert(workers_.size() == 0);
+    sslSessionCache_ = std::move(cache);
+  }
+
+  const std::shared_ptr<apache::thrift::ssl::SSLSessionCache>&
+  getSSLSessionCache() const {
+    return sslSessionCache_;
+  }
+
   /**
    * Use the provided socket rather than binding to address_.  The caller must
    * call ::bind on this socket, but should not call ::listen.
@@ -471,7 +555,10 @@ class ThriftServer : public apache::thrift::server::TServer {
     apache::thrift::async::TAsyncServerSocket::UniquePtr socket);
 
   /**
-   * Return the file descriptor(s) associated with the listening socket
+   * Return the file descriptor(s) associated with the listening socket.
+   *
+   * With SO_REUSEPORT listeners enabled, getListenSockets() returns the
+   * sockets of every worker, and getListenSocket() the one of worker 0.
    */
   int getListenSocket() const;
   std::vector<int> getListenSockets() const;
@@ -555,6 +642,36 @@ class ThriftServer : public apache::thrift::server::TServer {
     port_ = port;
   }
 
+  /**
+   * Also serve oneway requests sent as UDP datagrams to address, one
+   * THeader-framed request per datagram, by DatagramClientChannel for
+   * example.  Every I/O worker reads its own SO_REUSEPORT socket.  There are
+   * no replies; two-way requests and datagrams larger than
+   * getMaxDatagramSize() are dropped, and counted by the TServerObserver,
+   * as are datagrams lost on the way.
+   */
+  void setDatagramAddress(const folly::SocketAddress& address) {
+    assert(workers_.size() == 0);
+    datagramAddress_ = address;
+  }
+
+  /**
+   * Get the address datagram requests arrive at, uninitialized if none.  Its
+   * port is only final after setup().
+   */
+  const folly::SocketAddress& getDatagramAddress() const {
+    return datagramAddress_;
+  }
+
+  void setMaxDatagramSize(size_t size) {
+    assert(workers_.size() == 0);
+    maxDatagramSize_ = size;
+  }
+
+  size_t getMaxDatagramSize() const {
+    return maxDatagramSize_;
+  }
+
   /**
    * Enable negotiation of SASL on received connections.  This
    * defaults to false.
@@ -863,6 +980,34 @@ class ThriftServer : public apache::thrift::server::TServer {
     minCompressBytes_ = bytes;
   }
 
+  /**
+   * Set the dictionary used for zstd compression.  Clients sending
+   * ZSTD_TRANSFORM must use the same one.  Only affects connections
+   * accepted afterwards.
+   */
+  void setZstdDictionary(
+      std::shared_ptr<const apache::thrift::transport::ZstdDictionary> dict) {
+    zstdDict_ = std::move(dict);
+  }
+
+  const std::shared_ptr<const apache::thrift::transport::ZstdDictionary>&
+  getZstdDictionary() const {
+    return zstdDict_;
+  }
+
+  /**
+   * Set a policy to decide per response whether and how to compress,
+   * instead of applying all of the client's transforms to every response
+   * of at least getMinCompressBytes() bytes.  See AdaptiveCompressionPolicy.
+   */
+  void setCompressionPolicy(std::shared_ptr<CompressionPolicy> policy) {
+    compressionPolicy_ = std::move(policy);
+  }
+
+  const std::shared_ptr<CompressionPolicy>& getCompressionPolicy() const {
+    return compressionPolicy_;
+  }
+
   /**
    * Call this to complete initialization
    */
@@ -948,6 +1093,29 @@ class ThriftServer : public apache::thrift::server::TServer {
     return queueSends_;
   }
 
+  /**
+   * Batch queued sends across connections - each worker flushes the
+   * queued sends of all its connections from one loop callback at the end
+   * of the loop, instead of one callback per connection.  Only has an
+   * effect with queued sends.  Each connection is still written with its
+   * own writev(), so this saves loop callbacks rather than syscalls.
+   * Defaults to true
+   */
+  void setBatchSends(bool batchSends) {
+    assert(workers_.size() == 0);
+    batchSends_ = batchSends;
+  }
+
+  bool getBatchSends() const {
+    return batchSends_;
+  }
+
+  /**
+   * Messages sent and transport writes issued, summed over all workers.
+   * writes / messages approximates write syscalls per response.
+   */
+  WriteBatcher::Stats getWriteStats() const;
+
   /**
    * Codel queuing timeout - limit queueing time before overload
    * http://en.wikipedia.org/wiki/CoDel
@@ -960,6 +1128,24 @@ class ThriftServer : public apache::thrift::server::TServer {
     return enableCodel_;
   }
 
+  /**
+   * Per-worker listeners - instead of one acceptor thread handing every new
+   * connection to the workers, each Cpp2Worker owns a SO_REUSEPORT listening
+   * socket on its own TEventBase and the kernel spreads connections across
+   * them.  Avoids the accept bottleneck during connection storms.
+   *
+   * Sockets passed to useExistingSocket() must have SO_REUSEPORT set before
+   * they were bound.  Defaults to false; must be called before serve().
+   */
+  void setReusePortListeners(bool reusePortListeners) {
+    assert(workers_.size() == 0);
+    reusePortListeners_ = reusePortListeners;
+  }
+
+  bool getReusePortListeners() const {
+    return reusePortListeners_;
+  }
+
   /**
    * Set failure injection parameters.
    */
@@ -57,6 +57,70 @@ Deep makeDeep(size_t triplesz) {
   return data;
 }
 
+ShallowWithUnknown makeShallowWithUnknown(size_t blobsz) {
+  ShallowWithUnknown data;
+  data.one = 750;
+  data.two = 750 << 23;
+  data.blob.assign(blobsz, 'x');
+  for (size_t i = 0; i < 256; ++i) {
+    data.doubles.push_back(i * 0.5);
+    data.names[i] = sformat("name{}", i);
+    data.nested.datas.push_back(sformat("omg[{}]", i));
+  }
+  return data;
+}
+
+// maxBits bounds the magnitude of the values: 6 bits fit in a single
+// byte varint after zigzag encoding, 62 bits need nine or ten.
+NumericLists makeNumericLists(size_t count, size_t maxBits) {
+  NumericLists data;
+  uint64_t seed = 88172645463325252ULL;
+  for (size_t i = 0; i < count; ++i) {
+    // xorshift, so the data doesn't compress to a pattern
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    int64_t value = int64_t(seed >> (64 - maxBits)) * (i % 2 ? -1 : 1);
+    data.i64s.push_back(value);
+    data.i32s.push_back(int32_t(value >> (maxBits > 30 ? maxBits - 30 : 0)));
+    data.i16s.push_back(int16_t(value >> (maxBits > 14 ? maxBits - 14 : 0)));
+  }
+  return data;
+}
+
+unique_ptr<IOBuf> serializeNumericLists(size_t maxBits) {
+  NumericLists data = makeNumericLists(4096, maxBits);
+  CompactSerializer ser;
+  IOBufQueue bufq;
+  ser.serialize(data, &bufq);
+  return bufq.move();
+}
+
+// Cut buf into pieces of chunk bytes, so that varints straddle buffers
+unique_ptr<IOBuf> chain(unique_ptr<IOBuf> buf, size_t chunk) {
+  buf->coalesce();
+  unique_ptr<IOBuf> result;
+  for (size_t off = 0; off < buf->length(); off += chunk) {
+    auto piece = IOBuf::copyBuffer(buf->data() + off,
+                                   std::min(chunk, buf->length() - off));
+    if (result) {
+      result->prependChain(move(piece));
+    } else {
+      result = move(piece);
+    }
+  }
+  return result;
+}
+
+void deserializeNumericLists(size_t kiters, unique_ptr<IOBuf> buf) {
+  size_t iters = kiters << kMultExp;
+  while (iters--) {
+    CompactSerializer ser;
+    NumericLists data;
+    ser.deserialize(buf.get(), data);
+  }
+}
+
 BENCHMARK(CompactProtocolReader_ctor, kiters) {
   BenchmarkSuspender braces;
   size_t iters = kiters << kMultExp;
@@ -197,6 +261,141 @@ BENCHMARK(CompactProtocolWriter_serialize_deep, kiters) {
   braces.rehire();
 }
 
+BENCHMARK(CompactProtocolReader_deserialize_skip_unknown, kiters) {
+  BenchmarkSuspender braces;
+  size_t iters = kiters << kMultExp;
+  ShallowWithUnknown data = makeShallowWithUnknown(1 << 16);
+  CompactSerializer ser;
+  IOBufQueue bufq;
+  ser.serialize(data, &bufq);
+  auto buf = bufq.move();
+  braces.dismiss();
+  while (iters--) {
+    CompactSerializer ser;
+    Shallow data;
+    ser.deserialize(buf.get(), data);
+  }
+  braces.rehire();
+}
+
+BENCHMARK(CompactProtocolReader_skip_unknown, kiters) {
+  BenchmarkSuspender braces;
+  size_t iters = kiters << kMultExp;
+  ShallowWithUnknown data = makeShallowWithUnknown(1 << 16);
+  CompactSerializer ser;
+  IOBufQueue bufq;
+  ser.serialize(data, &bufq);
+  auto buf = bufq.move();
+  braces.dismiss();
+  while (iters--) {
+    CompactProtocolReader reader;
+    reader.setInput(buf.get());
+    reader.skip(TType::T_STRUCT);
+  }
+  braces.rehire();
+}
+
+BENCHMARK(CompactProtocolReader_generic_skip_unknown, kiters) {
+  BenchmarkSuspender braces;
+  size_t iters = kiters << kMultExp;
+  ShallowWithUnknown data = makeShallowWithUnknown(1 << 16);
+  CompactSerializer ser;
+  IOBufQueue bufq;
+  ser.serialize(data, &bufq);
+  auto buf = bufq.move();
+  braces.dismiss();
+  while (iters--) {
+    CompactProtocolReader reader;
+    reader.setInput(buf.get());
+    apache::thrift::skip(reader, TType::T_STRUCT);
+  }
+  braces.rehire();
+}
+
+BENCHMARK(CompactProtocolReader_deserialize_numeric_small, kiters) {
+  unique_ptr<IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = serializeNumericLists(6);
+  }
+  deserializeNumericLists(kiters, move(buf));
+}
+
+BENCHMARK(CompactProtocolReader_deserialize_numeric_mixed, kiters) {
+  unique_ptr<IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = serializeNumericLists(20);
+  }
+  deserializeNumericLists(kiters, move(buf));
+}
+
+BENCHMARK(CompactProtocolReader_deserialize_numeric_large, kiters) {
+  unique_ptr<IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = serializeNumericLists(62);
+  }
+  deserializeNumericLists(kiters, move(buf));
+}
+
+// Same data spread over 64 byte buffers, where many varints take the
+// byte-at-a-time path
+BENCHMARK(CompactProtocolReader_deserialize_numeric_chained, kiters) {
+  unique_ptr<IOBuf> buf;
+  BENCHMARK_SUSPEND {
+    buf = chain(serializeNumericLists(20), 64);
+  }
+  deserializeNumericLists(kiters, move(buf));
+}
+
+BENCHMARK_DRAW_LINE();
+
+// Element by element, as before bulk list decoding
+BENCHMARK(CompactProtocolReader_readI64_loop, kiters) {
+  BenchmarkSuspender braces;
+  size_t iters = kiters << kMultExp;
+  auto data = makeNumericLists(4096, 20);
+  auto buf = serializeNumericLists(20);
+  vector<int64_t> values(data.i64s.size());
+  braces.dismiss();
+  while (iters--) {
+    CompactProtocolReader reader;
+    reader.setInput(buf.get());
+    // Skip the struct and field headers in front of the first list
+    string name;
+    TType type;
+    int16_t id;
+    uint32_t size;
+    reader.readStructBegin(name);
+    reader.readFieldBegin(name, type, id);
+    reader.readListBegin(type, size);
+    for (uint32_t i = 0; i < size; ++i) {
+      reader.readI64(values[i]);
+    }
+  }
+  braces.rehire();
+}
+
+BENCHMARK_RELATIVE(CompactProtocolReader_readIntegralList, kiters) {
+  BenchmarkSuspender braces;
+  size_t iters = kiters << kMultExp;
+  auto data = makeNumericLists(4096, 20);
+  auto buf = serializeNumericLists(20);
+  vector<int64_t> values(data.i64s.size());
+  braces.dismiss();
+  while (iters--) {
+    CompactProtocolReader reader;
+    reader.setInput(buf.get());
+    string name;
+    TType type;
+    int16_t id;
+    uint32_t size;
+    reader.readStructBegin(name);
+    reader.readFieldBegin(name, type, id);
+    reader.readListBegin(type, size);
+    reader.readIntegralList(values.data(), size);
+  }
+  braces.rehire();
+}
+
 int main(int argc, char** argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
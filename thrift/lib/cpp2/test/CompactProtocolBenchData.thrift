@@ -33,3 +33,19 @@ struct Deep1 {
 struct Deep {
   1: list<Deep1> deeps;
 }
+
+// Newer schema of Shallow, read back as Shallow to exercise skip()
+struct ShallowWithUnknown {
+  1: i64 one;
+  2: i64 two;
+  10: binary blob;
+  11: list<double> doubles;
+  12: map<i32, string> names;
+  13: Deep2 nested;
+}
+
+struct NumericLists {
+  1: list<i64> i64s;
+  2: list<i32> i32s;
+  3: list<i16> i16s;
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp2/async/PooledRequestChannel.h>
+#include <thrift/lib/cpp2/util/ScopedServerInterfaceThread.h>
+#include <thrift/lib/cpp2/test/util/gen-cpp2/SimpleService.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace apache::thrift;
+using namespace apache::thrift::async;
+using namespace apache::thrift::util::cpp2;
+
+class SimpleServiceImpl : public virtual SimpleServiceSvIf {
+ public:
+  explicit SimpleServiceImpl(
+      chrono::milliseconds delay = chrono::milliseconds(0))
+    : calls(0)
+    , delay_(delay) {}
+
+  void async_tm_add(unique_ptr<HandlerCallback<int64_t>> cb,
+                    int64_t a,
+                    int64_t b) override {
+    ++calls;
+    this_thread::sleep_for(delay_);
+    cb->result(a + b);
+  }
+
+  atomic<int> calls;
+
+ private:
+  chrono::milliseconds delay_;
+};
+
+/**
+ * Sends count adds, at most concurrency at a time; returns the failures.
+ */
+int sendAdds(TEventBase& eb, SimpleServiceAsyncClient& client,
+             int count, int concurrency) {
+  int failures = 0;
+  for (int sent = 0; sent < count; sent += concurrency) {
+    for (int i = sent; i < sent + concurrency && i < count; i++) {
+      client.add([i, &failures](ClientReceiveState&& state) {
+                   try {
+                     EXPECT_EQ(i + 1,
+                               SimpleServiceAsyncClient::recv_add(state));
+                   } catch (const std::exception&) {
+                     ++failures;
+                   }
+                 },
+                 i, 1);
+    }
+    eb.loop();
+  }
+  return failures;
+}
+
+TEST(PooledRequestChannel, SpreadsRequests) {
+  vector<shared_ptr<SimpleServiceImpl>> impls;
+  vector<unique_ptr<ScopedServerInterfaceThread>> servers;
+  vector<folly::SocketAddress> addresses;
+  for (int i = 0; i < 3; i++) {
+    impls.push_back(make_shared<SimpleServiceImpl>());
+    servers.emplace_back(new ScopedServerInterfaceThread(impls.back()));
+    addresses.push_back(servers.back()->getAddress());
+  }
+
+  TEventBase eb;
+  PooledRequestChannel::Options options;
+  options.connectionsPerEndpoint = 2;
+  auto channel = PooledRequestChannel::newChannel(&eb, addresses, options);
+  auto pool = channel.get();
+  SimpleServiceAsyncClient client(std::move(channel));
+
+  EXPECT_EQ(0, sendAdds(eb, client, 300, 30));
+  for (auto& impl : impls) {
+    EXPECT_GT(impl->calls, 0);
+  }
+
+  auto stats = pool->getMemberStats();
+  EXPECT_EQ(6, stats.size());
+  for (auto& s : stats) {
+    EXPECT_TRUE(s.connected);
+    EXPECT_EQ(0, s.outstanding);
+    EXPECT_EQ(0, s.reconnects);
+  }
+}
+
+TEST(PooledRequestChannel, AvoidsSlowServer) {
+  auto fast = make_shared<SimpleServiceImpl>();
+  auto slow = make_shared<SimpleServiceImpl>(chrono::milliseconds(20));
+  ScopedServerInterfaceThread fastServer(fast);
+  ScopedServerInterfaceThread slowServer(slow);
+
+  TEventBase eb;
+  SimpleServiceAsyncClient client(PooledRequestChannel::newChannel(
+    &eb, {fastServer.getAddress(), slowServer.getAddress()}));
+
+  EXPECT_EQ(0, sendAdds(eb, client, 200, 4));
+  EXPECT_GT(slow->calls, 0);
+  EXPECT_GT(fast->calls, 4 * slow->calls);
+}
+
+TEST(PooledRequestChannel, ReportsLoad) {
+  ScopedServerInterfaceThread server(make_shared<SimpleServiceImpl>());
+
+  TEventBase eb;
+  PooledRequestChannel::Options options;
+  options.loadCounter = "load";
+  auto channel = PooledRequestChannel::newChannel(
+    &eb, {server.getAddress()}, options);
+  auto pool = channel.get();
+  SimpleServiceAsyncClient client(std::move(channel));
+
+  EXPECT_EQ(-1, pool->getMemberStats()[0].load);
+  EXPECT_EQ(0, sendAdds(eb, client, 1, 1));
+  EXPECT_GE(pool->getMemberStats()[0].load, 0);
+}
+
+TEST(PooledRequestChannel, SkipsFailedServer) {
+  auto impl = make_shared<SimpleServiceImpl>();
+  ScopedServerInterfaceThread server(impl);
+  unique_ptr<ScopedServerInterfaceThread> doomed(
+    new ScopedServerInterfaceThread(make_shared<SimpleServiceImpl>()));
+
+  TEventBase eb;
+  PooledRequestChannel::Options options;
+  options.reconnectDelay = chrono::milliseconds(10000);
+  auto channel = PooledRequestChannel::newChannel(
+    &eb, {server.getAddress(), doomed->getAddress()}, options);
+  auto pool = channel.get();
+  SimpleServiceAsyncClient client(std::move(channel));
+
+  EXPECT_EQ(0, sendAdds(eb, client, 20, 1));
+  doomed.reset();
+
+  // Only the request that finds the dead connection fails
+  EXPECT_LE(sendAdds(eb, client, 20, 1), 1);
+  EXPECT_EQ(0, sendAdds(eb, client, 20, 1));
+
+  EXPECT_TRUE(pool->getMemberStats()[0].connected);
+}
+
+TEST(PooledRequestChannel, Reconnects) {
+  auto impl = make_shared<SimpleServiceImpl>();
+  ScopedServerInterfaceThread server(impl);
+
+  TEventBase eb;
+  vector<HeaderClientChannel*> connections;
+  PooledRequestChannel::Options options;
+  options.reconnectDelay = chrono::milliseconds(0);
+  options.configure = [&](HeaderClientChannel* c) {
+    connections.push_back(c);
+  };
+  auto channel = PooledRequestChannel::newChannel(
+    &eb, {server.getAddress()}, options);
+  auto pool = channel.get();
+  SimpleServiceAsyncClient client(std::move(channel));
+
+  EXPECT_EQ(0, sendAdds(eb, client, 1, 1));
+  ASSERT_EQ(1, connections.size());
+  connections[0]->getTransport()->closeNow();
+  EXPECT_FALSE(pool->getMemberStats()[0].connected);
+
+  EXPECT_EQ(0, sendAdds(eb, client, 10, 1));
+  EXPECT_EQ(2, connections.size());
+  auto stats = pool->getMemberStats();
+  EXPECT_TRUE(stats[0].connected);
+  EXPECT_EQ(1, stats[0].reconnects);
+  EXPECT_EQ(11, impl->calls);
+}
+
+/**
+ * The first call to any server sharing calls is slow.
+ */
+class FirstCallSlowImpl : public virtual SimpleServiceSvIf {
+ public:
+  explicit FirstCallSlowImpl(shared_ptr<atomic<int>> calls)
+    : calls_(calls) {}
+
+  void async_tm_add(unique_ptr<HandlerCallback<int64_t>> cb,
+                    int64_t a,
+                    int64_t b) override {
+    if ((*calls_)++ == 0) {
+      this_thread::sleep_for(chrono::milliseconds(500));
+    }
+    cb->result(a + b);
+  }
+
+ private:
+  shared_ptr<atomic<int>> calls_;
+};
+
+TEST(PooledRequestChannel, HedgedRequest) {
+  auto calls = make_shared<atomic<int>>(0);
+  ScopedServerInterfaceThread server1(make_shared<FirstCallSlowImpl>(calls));
+  ScopedServerInterfaceThread server2(make_shared<FirstCallSlowImpl>(calls));
+
+  TEventBase eb;
+  auto channel = PooledRequestChannel::newChannel(
+    &eb, {server1.getAddress(), server2.getAddress()});
+  auto pool = channel.get();
+  SimpleServiceAsyncClient client(std::move(channel));
+
+  RpcOptions options;
+  options.setHedgeDelay(chrono::milliseconds(50));
+  auto start = chrono::steady_clock::now();
+  EXPECT_EQ(3, client.sync_add(options, 1, 2));
+  EXPECT_LT(chrono::steady_clock::now() - start, chrono::milliseconds(400));
+  EXPECT_EQ(2, *calls);
+  EXPECT_EQ(1, pool->getHedgesSent());
+  EXPECT_EQ(1, pool->getHedgesWon());
+
+  // Fast replies are not hedged
+  EXPECT_EQ(7, client.sync_add(options, 3, 4));
+  EXPECT_EQ(3, *calls);
+  EXPECT_EQ(1, pool->getHedgesSent());
+}
@@ -18,6 +18,7 @@
  */
 
 
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -91,6 +92,59 @@ void writerBenchmark(const BenchmarkObject& obj, int iters) {
   }
 }
 
+// Serialize obj, then read it back from buf split into chunk byte pieces
+template <class Reader, class Writer>
+BenchmarkObject roundTrip(const BenchmarkObject& obj, size_t chunk) {
+  folly::IOBufQueue queue;
+  Writer writer;
+  writer.setOutput(&queue);
+  Cpp2Ops<BenchmarkObject>::write(&writer, &obj);
+  auto buf = queue.move();
+  buf->coalesce();
+
+  std::unique_ptr<folly::IOBuf> input;
+  for (size_t off = 0; off < buf->length(); off += chunk) {
+    auto piece = folly::IOBuf::copyBuffer(
+      buf->data() + off, std::min(chunk, buf->length() - off));
+    if (input) {
+      input->prependChain(std::move(piece));
+    } else {
+      input = std::move(piece);
+    }
+  }
+
+  BenchmarkObject result;
+  Reader reader;
+  reader.setInput(input.get());
+  Cpp2Ops<BenchmarkObject>::read(&reader, &result);
+  return result;
+}
+
+template <class Reader, class Writer>
+void testIntegralList() {
+  BenchmarkObject obj;
+  for (int32_t i = -1000; i < 1000; ++i) {
+    obj.ints.push_back(i);
+    obj.ints.push_back(i * 65537);
+  }
+  obj.ints.push_back(std::numeric_limits<int32_t>::min());
+  obj.ints.push_back(std::numeric_limits<int32_t>::max());
+
+  // Contiguous, and with varints straddling buffer boundaries
+  for (size_t chunk : {size_t(1) << 20, size_t(7), size_t(1)}) {
+    auto result = roundTrip<Reader, Writer>(obj, chunk);
+    EXPECT_EQ(obj.ints, result.ints) << "chunk " << chunk;
+  }
+}
+
+TEST(ProtocolTest, CompactIntegralList) {
+  testIntegralList<CompactProtocolReader, CompactProtocolWriter>();
+}
+
+TEST(ProtocolTest, BinaryIntegralList) {
+  testIntegralList<BinaryProtocolReader, BinaryProtocolWriter>();
+}
+
 #define X1(proto, kind) \
   BENCHMARK(proto##_##kind, n) { \
     writerBenchmark<proto##Writer>(kind, n); \
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2014 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thrift/lib/cpp/async/TAsyncSocket.h>
+#include <thrift/lib/cpp/async/TEventBase.h>
+#include <thrift/lib/cpp/concurrency/ThreadCachedPool.h>
+#include <thrift/lib/cpp2/async/HeaderClientChannel.h>
+#include <thrift/lib/cpp2/util/ScopedServerInterfaceThread.h>
+#include <thrift/perf/if/gen-cpp2/LoadTest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <folly/Benchmark.h>
+#include <folly/Format.h>
+
+DEFINE_int32(alloc_requests, 100000,
+             "Number of noop() calls used to count allocations");
+
+using namespace apache::thrift;
+using namespace apache::thrift::async;
+using apache::thrift::concurrency::ThreadCachedPool;
+
+/*
+ * Count every heap allocation in the process.  The client runs in the same
+ * process, so the counts include the client's allocations as well; the
+ * difference between the pooled and unpooled runs is the server-side
+ * saving.
+ */
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+class NoopHandler : public LoadTestSvIf {
+ public:
+  void noop() override {}
+};
+
+class NoopClient {
+ public:
+  NoopClient()
+      : server_(std::make_shared<NoopHandler>()) {
+    auto socket = TAsyncSocket::newSocket(
+      &eb_, "::1", server_.getPort());
+    client_.reset(new LoadTestAsyncClient(
+      HeaderClientChannel::newChannel(socket)));
+  }
+
+  void noop() {
+    client_->sync_noop();
+  }
+
+ private:
+  TEventBase eb_;
+  ScopedServerInterfaceThread server_;
+  std::unique_ptr<LoadTestAsyncClient> client_;
+};
+
+static NoopClient& getClient() {
+  static NoopClient client;
+  return client;
+}
+
+static void runNoop(int iters, bool pooled) {
+  NoopClient* client;
+  BENCHMARK_SUSPEND {
+    ThreadCachedPool::setEnabled(pooled);
+    client = &getClient();
+  }
+  for (int i = 0; i < iters; ++i) {
+    client->noop();
+  }
+}
+
+BENCHMARK(noop_unpooled, iters) {
+  runNoop(iters, false);
+}
+
+BENCHMARK_RELATIVE(noop_pooled, iters) {
+  runNoop(iters, true);
+}
+
+static double allocationsPerRequest(bool pooled) {
+  ThreadCachedPool::setEnabled(pooled);
+  auto& client = getClient();
+  // Warm up the thread caches and any lazily created state
+  for (int i = 0; i < 1000; ++i) {
+    client.noop();
+  }
+  auto before = allocations.load();
+  for (int i = 0; i < FLAGS_alloc_requests; ++i) {
+    client.noop();
+  }
+  auto after = allocations.load();
+  return double(after - before) / FLAGS_alloc_requests;
+}
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  folly::runBenchmarks();
+
+  auto unpooled = allocationsPerRequest(false);
+  auto pooled = allocationsPerRequest(true);
+  auto stats = ThreadCachedPool::getStats();
+  std::cout << folly::format(
+    "allocations per noop(): unpooled {:.2f}, pooled {:.2f}\n"
+    "pool hits {}, misses {}\n",
+    unpooled, pooled, stats.hits, stats.misses);
+  return 0;
+}
@@ -144,3 +144,31 @@ TEST(SerializationTest, RecursiveDeepBinarySerializerRoundtripPasses) {
 
   EXPECT_EQ(s, out);
 }
+
+TEST(SerializationTest, CompactSkipConsumesWholeStruct) {
+  auto s = makeTestStructRecursive(6);
+
+  folly::IOBufQueue q;
+  CompactSerializer::serialize(s, &q);
+
+  CompactProtocolReader reader;
+  reader.setInput(q.front());
+  auto size = reader.skip(TType::T_STRUCT);
+
+  EXPECT_EQ(q.front()->computeChainDataLength(), size);
+  EXPECT_TRUE(reader.getCurrentPosition().isAtEnd());
+}
+
+TEST(SerializationTest, BinarySkipConsumesWholeStruct) {
+  auto s = makeTestStructRecursive(6);
+
+  folly::IOBufQueue q;
+  BinarySerializer::serialize(s, &q);
+
+  BinaryProtocolReader reader;
+  reader.setInput(q.front());
+  auto size = reader.skip(TType::T_STRUCT);
+
+  EXPECT_EQ(q.front()->computeChainDataLength(), size);
+  EXPECT_TRUE(reader.getCurrentPosition().isAtEnd());
+}
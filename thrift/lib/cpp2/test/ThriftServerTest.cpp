@@ -18,13 +18,16 @@
 #include <thrift/lib/cpp2/test/gen-cpp/TestService.h>
 #include <thrift/lib/cpp2/test/gen-cpp2/TestService.h>
 #include <thrift/lib/cpp2/server/ThriftServer.h>
+#include <thrift/lib/cpp2/async/DatagramClientChannel.h>
 #include <thrift/lib/cpp2/async/HeaderClientChannel.h>
 #include <thrift/lib/cpp2/async/RequestChannel.h>
 
 #include <thrift/lib/cpp/util/ScopedServerThread.h>
 #include <thrift/lib/cpp/async/TEventBase.h>
 #include <thrift/lib/cpp/async/TAsyncSocket.h>
+#include <thrift/lib/cpp/async/TAsyncSSLSocket.h>
 #include <thrift/lib/cpp/async/TAsyncServerSocket.h>
+#include <thrift/lib/cpp/async/TAsyncUDPSocket.h>
 
 #include <thrift/lib/cpp2/async/StubSaslClient.h>
 #include <thrift/lib/cpp2/async/StubSaslServer.h>
@@ -32,6 +35,11 @@
 #include <boost/cast.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <sys/socket.h>
+#include <mutex>
+#include <set>
+#include <thread>
+
 using namespace apache::thrift;
 using namespace apache::thrift::test::cpp2;
 using namespace apache::thrift::util;
@@ -473,6 +481,124 @@ TEST(ThriftServer, CompressionClientTest) {
   }
 }
 
+TEST(ThriftServer, AdaptiveCompressionPolicyTest) {
+  AdaptiveCompressionPolicy::Options options;
+  options.exploreEvery = 0;
+  AdaptiveCompressionPolicy policy(options);
+  std::vector<uint16_t> allowed{THeader::ZLIB_TRANSFORM,
+                                THeader::SNAPPY_TRANSFORM};
+
+  // Each transform is measured before anything is compared
+  EXPECT_EQ(THeader::ZLIB_TRANSFORM, policy.choose(1000, allowed));
+  policy.record(THeader::ZLIB_TRANSFORM, 1000, 200,
+                std::chrono::microseconds(50));
+  EXPECT_EQ(THeader::SNAPPY_TRANSFORM, policy.choose(1000, allowed));
+  policy.record(THeader::SNAPPY_TRANSFORM, 1000, 500,
+                std::chrono::microseconds(2));
+
+  // 1 Gbit/s: zlib is CPU bound at 50us, snappy network bound at 4us
+  EXPECT_EQ(THeader::SNAPPY_TRANSFORM, policy.choose(1000, allowed));
+  EXPECT_EQ(1, policy.getEstimate(1000, THeader::SNAPPY_TRANSFORM).samples);
+  // Other size buckets are measured separately
+  EXPECT_EQ(THeader::ZLIB_TRANSFORM, policy.choose(100000, allowed));
+
+  // On a slow link zlib's ratio wins
+  options.networkBytesPerSec = 1e6;
+  AdaptiveCompressionPolicy slow(options);
+  slow.record(THeader::ZLIB_TRANSFORM, 1000, 200,
+              std::chrono::microseconds(50));
+  slow.record(THeader::SNAPPY_TRANSFORM, 1000, 500,
+              std::chrono::microseconds(2));
+  EXPECT_EQ(THeader::ZLIB_TRANSFORM, slow.choose(1000, allowed));
+
+  // Incompressible payloads are not worth compressing at all
+  AdaptiveCompressionPolicy random(options);
+  random.record(THeader::ZLIB_TRANSFORM, 1000, 1001,
+                std::chrono::microseconds(50));
+  random.record(THeader::SNAPPY_TRANSFORM, 1000, 1000,
+                std::chrono::microseconds(2));
+  EXPECT_EQ(THeader::NONE, random.choose(1000, allowed));
+}
+
+TEST(ThriftServer, AdaptiveCompressionTest) {
+  auto server = getServer();
+  server->setCompressionPolicy(
+    std::make_shared<AdaptiveCompressionPolicy>());
+  ScopedServerThread sst(server);
+  auto port = sst.getAddress()->getPort();
+
+  TEventBase base;
+
+  std::shared_ptr<TAsyncSocket> socket(
+    TAsyncSocket::newSocket(&base, "127.0.0.1", port));
+
+  TestServiceAsyncClient client(
+    std::unique_ptr<HeaderClientChannel,
+                    apache::thrift::async::TDelayedDestruction::Destructor>(
+                      new HeaderClientChannel(socket)));
+
+  auto channel = boost::polymorphic_downcast<HeaderClientChannel*>(
+    client.getChannel());
+  auto header = channel->getHeader();
+  header->setTransform(THeader::ZLIB_TRANSFORM);
+  header->setTransform(THeader::SNAPPY_TRANSFORM);
+  header->setMinCompressBytes(1);
+  channel->setCompressionPolicy(
+    std::make_shared<AdaptiveCompressionPolicy>());
+
+  std::string request(4096, 'a');
+  for (int i = 0; i < 10; i++) {
+    std::string response;
+    client.sync_echoRequest(response, request);
+    EXPECT_EQ(request + std::string(45, 'c'), response);
+    // At most one transform per message, and the configured ones are kept
+    EXPECT_LE(header->getTransforms().size(), 1);
+    EXPECT_EQ(2, header->getWriteTransforms().size());
+  }
+}
+
+// Exception replies go through the compression policy like normal
+// replies, instead of being compressed with every accepted transform.
+TEST(ThriftServer, AdaptiveCompressionExceptionTest) {
+  auto server = getServer();
+  server->setCompressionPolicy(
+    std::make_shared<AdaptiveCompressionPolicy>());
+  ScopedServerThread sst(server);
+  auto port = sst.getAddress()->getPort();
+
+  TEventBase base;
+
+  std::shared_ptr<TAsyncSocket> socket(
+    TAsyncSocket::newSocket(&base, "127.0.0.1", port));
+
+  TestServiceAsyncClient client(
+    std::unique_ptr<HeaderClientChannel,
+                    apache::thrift::async::TDelayedDestruction::Destructor>(
+                      new HeaderClientChannel(socket)));
+
+  auto channel = boost::polymorphic_downcast<HeaderClientChannel*>(
+    client.getChannel());
+  auto header = channel->getHeader();
+  header->setTransform(THeader::ZLIB_TRANSFORM);
+  header->setTransform(THeader::SNAPPY_TRANSFORM);
+  header->setMinCompressBytes(1);
+  channel->setCompressionPolicy(
+    std::make_shared<AdaptiveCompressionPolicy>());
+
+  for (int i = 0; i < 10; i++) {
+    // TestInterface does not implement voidResponse(), so the handler
+    // throws
+    try {
+      client.sync_voidResponse();
+      ADD_FAILURE() << "voidResponse() should have thrown";
+    } catch (const TApplicationException& ex) {
+      EXPECT_NE(std::string::npos,
+                std::string(ex.what()).find("unimplemented"));
+    }
+    EXPECT_LE(header->getTransforms().size(), 1);
+  }
+}
+
 TEST(ThriftServer, ClientTimeoutTest) {
 
   ScopedServerThread sst(getServer());
@@ -791,6 +917,111 @@ TEST(ThriftServer, useExistingSocketAndConnectionIdleTimeout) {
   base.loop();
 }
 
+TEST(ThriftServer, ReusePortListenersTest) {
+  // Records the worker threads that accepted connections
+  class AcceptObserver : public apache::thrift::server::TServerObserver {
+   public:
+    void connAccepted() override {
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.insert(std::this_thread::get_id());
+    }
+
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+  };
+
+  auto observer = std::make_shared<AcceptObserver>();
+  auto server = getServer();
+  server->setAddress("127.0.0.1", 0);
+  server->setNWorkerThreads(4);
+  server->setReusePortListeners(true);
+  server->setObserver(observer);
+  apache::thrift::util::ScopedServerThread st(server);
+  auto port = st.getAddress()->getPort();
+
+  EXPECT_EQ(4, server->getListenSockets().size());
+
+  // The kernel hashes each connection to one of the sockets; with 16 the
+  // chance that all land on the same one is negligible
+  TEventBase base;
+  for (int i = 0; i < 16; ++i) {
+    std::shared_ptr<TAsyncSocket> socket(
+      TAsyncSocket::newSocket(&base, "127.0.0.1", port));
+
+    TestServiceAsyncClient client(
+      std::unique_ptr<HeaderClientChannel,
+                      apache::thrift::async::TDelayedDestruction::Destructor>(
+                        new HeaderClientChannel(socket)));
+
+    std::string response;
+    client.sync_sendResponse(response, i);
+    EXPECT_EQ(response, "test" + boost::lexical_cast<std::string>(i));
+  }
+
+  std::lock_guard<std::mutex> lock(observer->mutex);
+  EXPECT_GT(observer->threads.size(), size_t(1));
+}
+
+namespace {
+
+// Pipelines requests from several connections to an event base handler,
+// which responds to all the requests of one read in the same loop
+WriteBatcher::Stats sendBatches(std::shared_ptr<ThriftServer> server) {
+  server->setNWorkerThreads(1);
+  apache::thrift::util::ScopedServerThread st(server);
+  auto port = st.getAddress()->getPort();
+
+  TEventBase base;
+  std::vector<std::unique_ptr<TestServiceAsyncClient>> clients;
+  for (int i = 0; i < 4; ++i) {
+    std::shared_ptr<TAsyncSocket> socket(
+      TAsyncSocket::newSocket(&base, "127.0.0.1", port));
+    clients.emplace_back(new TestServiceAsyncClient(
+      std::unique_ptr<HeaderClientChannel,
+                      apache::thrift::async::TDelayedDestruction::Destructor>(
+                        new HeaderClientChannel(socket))));
+  }
+
+  const uint64_t kRequests = 40;
+  const int kRequestsPerClient = kRequests / 4;
+  uint64_t responses = 0;
+  for (auto& client : clients) {
+    for (int i = 0; i < kRequestsPerClient; ++i) {
+      client->eventBaseAsync([&responses](ClientReceiveState&& state) {
+        std::string response;
+        TestServiceAsyncClient::recv_eventBaseAsync(response, state);
+        EXPECT_EQ("hello world", response);
+        ++responses;
+      });
+    }
+  }
+  base.loop();
+  EXPECT_EQ(kRequests, responses);
+
+  auto stats = server->getWriteStats();
+  EXPECT_EQ(kRequests, stats.messages);
+  return stats;
+}
+
+}
+
+TEST(ThriftServer, BatchSendsTest) {
+  // Every response is its own write without queued sends
+  auto unbatchedServer = getServer();
+  unbatchedServer->setQueueSends(false);
+  auto unbatched = sendBatches(unbatchedServer);
+  EXPECT_EQ(unbatched.messages, unbatched.writes);
+  EXPECT_EQ(0u, unbatched.flushes);
+
+  // With them, the responses of each connection share a write, and the
+  // worker flushes all its connections from one loop callback
+  auto batched = sendBatches(getServer());
+  EXPECT_GE(batched.writes, 1u);
+  EXPECT_LT(batched.writes, unbatched.writes);
+  EXPECT_GE(batched.flushes, 1u);
+  EXPECT_LE(batched.flushes, batched.writes);
+}
+
 TEST(ThriftServer, FreeCallbackTest) {
 
   ScopedServerThread sst(getServer());
@@ -940,6 +1171,168 @@ TEST(ThriftServer, ShutdownSocketSetTest) {
   EXPECT_EQ(cb.eof, true);
 }
 
+class SSLConnectCallback : public TAsyncSocket::ConnectCallback {
+ public:
+  virtual void connectSuccess() noexcept {
+    connected = true;
+  }
+
+  virtual void connectError(const TTransportException& ex) noexcept {
+    ADD_FAILURE() << "SSL connect failed: " << ex.what();
+  }
+
+  bool connected = false;
+};
+
+TEST(ThriftServer, SSLHandshakePoolTest) {
+  auto serverCtx = std::make_shared<SSLContext>();
+  serverCtx->loadPrivateKey("thrift/lib/cpp/test/ssl/tests-key.pem");
+  serverCtx->loadCertificate("thrift/lib/cpp/test/ssl/tests-cert.pem");
+  auto cache = std::make_shared<apache::thrift::ssl::SSLSessionCache>();
+
+  auto server = getServer();
+  server->setNWorkerThreads(2);
+  server->setSSLContext(serverCtx);
+  server->setSSLHandshakeThreads(2);
+  server->setSSLSessionCache(cache);
+  ScopedServerThread sst(server);
+  auto port = sst.getAddress()->getPort();
+
+  auto clientCtx = std::make_shared<SSLContext>();
+  SSL_SESSION* session = nullptr;
+  for (int i = 0; i < 2; i++) {
+    TEventBase base;
+    auto socket = TAsyncSSLSocket::newSocket(clientCtx, &base);
+    if (session) {
+      socket->setSSLSession(session, true);
+    }
+    SSLConnectCallback cb;
+    socket->connect(&cb, folly::SocketAddress("127.0.0.1", port));
+    base.loop();
+    ASSERT_TRUE(cb.connected);
+    // The second connection resumes the first one's session
+    EXPECT_EQ(i == 1, socket->getSSLSessionReused());
+    if (!session) {
+      session = socket->getSSLSession();
+    }
+
+    TestServiceAsyncClient client(HeaderClientChannel::newChannel(socket));
+    std::string response;
+    client.sync_sendResponse(response, 64);
+    EXPECT_EQ("test64", response);
+  }
+
+  auto pool = server->getSSLHandshakePool();
+  ASSERT_TRUE(pool != nullptr);
+  EXPECT_EQ(2, pool->getCompleted());
+  EXPECT_EQ(0, pool->getFailed());
+  auto stats = cache->getStats();
+  EXPECT_EQ(1, stats.hits + stats.ticketsAccepted);
+}
+
+TEST(ThriftServer, SSLHandshakePoolStopDuringAccept) {
+  auto ctx = std::make_shared<SSLContext>();
+  SSLHandshakePool pool(
+    1, std::make_shared<apache::thrift::concurrency::PosixThreadFactory>());
+  TEventBase base;
+
+  // Accepts race with stop(); every fd must still be closed, whether its
+  // handshake started or not
+  const int kConnections = 200;
+  std::vector<int> peers;
+  std::vector<int> fds;
+  for (int i = 0; i < kConnections; i++) {
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    fds.push_back(sv[0]);
+    peers.push_back(sv[1]);
+  }
+  std::thread acceptor([&]() {
+    for (int fd : fds) {
+      pool.accept(fd, ctx, 0, nullptr, &base, [](TAsyncSSLSocket*) {
+        ADD_FAILURE() << "no handshake can succeed";
+      });
+    }
+  });
+  pool.stop();
+  acceptor.join();
+
+  EXPECT_EQ(0, pool.getPending());
+  for (int peer : peers) {
+    char c;
+    EXPECT_EQ(0, recv(peer, &c, 1, MSG_DONTWAIT));
+    close(peer);
+  }
+}
+
+TEST(ThriftServer, DatagramOnewayTest) {
+  static std::atomic<int> calls(0);
+
+  class DatagramTestInterface : public TestServiceSvIf {
+    void noResponse(int64_t size) {
+      ++calls;
+    }
+  };
+
+  class DatagramObserver : public apache::thrift::server::TServerObserver {
+   public:
+    DatagramObserver() : truncated(0), malformed(0) {}
+
+    void datagramTruncated() override {
+      ++truncated;
+    }
+
+    void datagramMalformed() override {
+      ++malformed;
+    }
+
+    std::atomic<int> truncated;
+    std::atomic<int> malformed;
+  };
+
+  auto observer = std::make_shared<DatagramObserver>();
+  auto server = getServer();
+  server->setInterface(std::unique_ptr<DatagramTestInterface>(
+      new DatagramTestInterface));
+  server->setObserver(observer);
+  server->setNWorkerThreads(2);
+  server->setDatagramAddress(folly::SocketAddress("127.0.0.1", 0));
+  server->setMaxDatagramSize(1024);
+  ScopedServerThread sst(server);
+  auto address = server->getDatagramAddress();
+  ASSERT_NE(0, address.getPort());
+
+  TEventBase base;
+  auto channel = DatagramClientChannel::newChannel(&base, address);
+  auto datagrams = channel.get();
+  TestServiceAsyncClient client(std::move(channel));
+
+  for (int i = 0; i < 10; i++) {
+    client.noResponse([](ClientReceiveState&& state) {}, i);
+  }
+  EXPECT_EQ(10, datagrams->getStats().sent);
+
+  // Only oneway requests go over datagrams
+  bool failed = false;
+  client.sendResponse([&](ClientReceiveState&& state) {
+                        failed = state.isException();
+                      }, 1);
+  EXPECT_TRUE(failed);
+
+  TAsyncUDPSocket raw(&base);
+  raw.bind(folly::SocketAddress("127.0.0.1", 0));
+  raw.write(address, folly::IOBuf::copyBuffer("not a thrift request"));
+  raw.write(address, folly::IOBuf::copyBuffer(std::string(2000, 'x')));
+
+  for (int i = 0; i < 100 && (calls < 10 || observer->truncated < 1 ||
+                              observer->malformed < 1); i++) {
+    usleep(10000);
+  }
+  EXPECT_EQ(10, calls);
+  EXPECT_EQ(1, observer->truncated);
+  EXPECT_EQ(1, observer->malformed);
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   google::InitGoogleLogging(argv[0]);
@@ -19,6 +19,8 @@
 #include "thrift/perf/cpp/AsyncClientWorker2.h"
 
 #include <thrift/lib/cpp/ClientUtil.h>
+#include <thrift/lib/cpp/async/TAsyncTimeout.h>
+#include <thrift/lib/cpp/concurrency/Util.h>
 #include <thrift/lib/cpp/test/loadgen/RNG.h>
 #include "thrift//perf/cpp/ClientLoadConfig.h"
 #include <thrift/lib/cpp/protocol/THeaderProtocol.h>
@@ -37,6 +39,7 @@ using namespace apache::thrift::protocol;
 using namespace apache::thrift::transport;
 using namespace apache::thrift::async;
 using namespace apache::thrift;
+using apache::thrift::concurrency::Util;
 using apache::thrift::loadgen::ScoreBoard;
 
 namespace apache { namespace thrift {
@@ -53,13 +56,16 @@ public:
       : opType_(0),
         a(0),
         b(0),
-        code(0)
+        code(0),
+        intendedStartUsec_(0)
     {}
 
   uint32_t opType_;
   int64_t a;
   int64_t b;
   int32_t code;
+  // Set for open-loop operations only
+  int64_t intendedStartUsec_;
 };
 
 class LoadCallback;
@@ -117,6 +123,19 @@ public:
     }
   }
 
+  /**
+   * Send a single operation on behalf of an OpenLoopDriver.  Completion of
+   * the operation does not trigger any further operations.
+   */
+  void startOpenLoopOperation(int64_t intendedStartUsec) {
+    terminator_.incr();
+    performAsyncOperation(intendedStartUsec);
+  }
+
+  bool isExhausted() const {
+    return ctr_ <= 0;
+  }
+
   LoopTerminator& terminator_;
 
 private:
@@ -124,7 +143,7 @@ private:
                   ClientReceiveState&& rstate,
                   OpData* opData);
 
-  void performAsyncOperation();
+  void performAsyncOperation(int64_t intendedStartUsec = 0);
 
   const std::shared_ptr<apache::thrift::test::ClientLoadConfig>& config_;
   const std::shared_ptr<ScoreBoard>& scoreboard_;
@@ -172,6 +191,68 @@ class LoadCallback :
   bool oneway_;
 };
 
+/*
+ * Sends operations across a set of AsyncRunner2s at the times given by an
+ * ArrivalSchedule, regardless of how many operations are still outstanding.
+ *
+ * The timeout only has millisecond granularity, so at high rates operations
+ * are sent in small bursts; every operation still records its latency from
+ * its own intended start time.
+ */
+class OpenLoopDriver : public TAsyncTimeout {
+ public:
+  OpenLoopDriver(TEventBase* base,
+                 ArrivalSchedule* schedule,
+                 LoopTerminator& terminator,
+                 const std::list<AsyncRunner2*>& runners)
+    : TAsyncTimeout(base),
+      schedule_(schedule),
+      terminator_(terminator),
+      runners_(runners.begin(), runners.end()),
+      nextRunner_(0) {}
+
+  void start() {
+    if (runners_.empty()) {
+      return;
+    }
+    // Keep the loop running for as long as there are arrivals left to send
+    terminator_.incr();
+    timeoutExpired();
+  }
+
+  virtual void timeoutExpired() noexcept {
+    int64_t now = Util::currentTimeUsec();
+    while (schedule_->peek() <= now) {
+      AsyncRunner2* runner = pickRunner();
+      if (!runner) {
+        terminator_.decr();
+        return;
+      }
+      runner->startOpenLoopOperation(schedule_->next());
+    }
+
+    int64_t delayUsec = schedule_->peek() - now;
+    scheduleTimeout((delayUsec + Util::US_PER_MS - 1) / Util::US_PER_MS);
+  }
+
+ private:
+  AsyncRunner2* pickRunner() {
+    for (size_t n = 0; n < runners_.size(); ++n) {
+      AsyncRunner2* runner = runners_[nextRunner_];
+      nextRunner_ = (nextRunner_ + 1) % runners_.size();
+      if (!runner->isExhausted()) {
+        return runner;
+      }
+    }
+    return nullptr;
+  }
+
+  ArrivalSchedule* schedule_;
+  LoopTerminator& terminator_;
+  std::vector<AsyncRunner2*> runners_;
+  size_t nextRunner_;
+};
+
 LoadTestClientPtr AsyncClientWorker2::createConnection() {
   const std::shared_ptr<apache::thrift::test::ClientLoadConfig>& config =
     getConfig();
@@ -260,6 +341,18 @@ AsyncClientWorker2::run() {
   std::list<AsyncRunner2 *> clients;
   std::list<AsyncRunner2 *>::iterator it;
   LoopTerminator loopTerminator(&eb_);
+
+  const std::shared_ptr<ClientLoadConfig>& config = getConfig();
+  if (config->useOpenLoop() && config->getDesiredQPS() > 0) {
+    double rate = static_cast<double>(config->getDesiredQPS()) /
+      config->getNumWorkerThreads();
+    schedule_.reset(new ArrivalSchedule(
+        rate,
+        config->usePoissonArrivals() ? ArrivalSchedule::POISSON
+                                     : ArrivalSchedule::FIXED));
+    schedule_->start();
+  }
+
   do {
     // Create a new connection
     int n_clients = getConfig()->getAsyncClients();
@@ -295,8 +388,13 @@ AsyncClientWorker2::run() {
         }
       }
     }
-    for (auto r : clients) {
-      r->startRun();
+    OpenLoopDriver driver(&eb_, schedule_.get(), loopTerminator, clients);
+    if (schedule_) {
+      driver.start();
+    } else {
+      for (auto r : clients) {
+        r->startRun();
+      }
     }
 
     eb_.loopForever();
@@ -312,19 +410,22 @@ AsyncClientWorker2::run() {
   stopWorker();
 }
 
-void AsyncRunner2::performAsyncOperation() {
-  // We don't support throttled QPS right now.  The right way to do
-  // this requires an AsyncIntervalTimer
+void AsyncRunner2::performAsyncOperation(int64_t intendedStartUsec) {
+  // Closed-loop operation doesn't support throttled QPS; use --open_loop
+  // to send at a fixed rate.
 
   LoadCallback* cb =     new LoadCallback(this, client_.get());
   std::unique_ptr<RequestCallback> recvCob(cb);
 
   uint32_t opType = config_->pickOpType();
-  scoreboard_->opStarted(opType);
+  if (intendedStartUsec == 0) {
+    scoreboard_->opStarted(opType);
+  }
 
   OpData *d = &cb->data_;
 
   d->opType_ = opType;
+  d->intendedStartUsec_ = intendedStartUsec;
   n_outstanding_++;
   ctr_--;
 
@@ -493,6 +594,14 @@ void AsyncRunner2::genericCob(LoadTestAsyncClient *client,
     return;
   }
 
+  if (opData->intendedStartUsec_ != 0) {
+    // Open-loop: the OpenLoopDriver decides when to send the next operation
+    scoreboard_->opSucceededWithLatency(
+      opData->opType_, Util::currentTimeUsec() - opData->intendedStartUsec_);
+    terminator_.decr();
+    return;
+  }
+
   scoreboard_->opSucceeded(opData->opType_);
 
   if (ctr_ > 0) {
@@ -21,6 +21,7 @@
 
 #include "thrift/perf/cpp/ClientLoadConfig.h"
 #include "thrift/perf/if/gen-cpp2/LoadTest.h"
+#include <thrift/lib/cpp/test/loadgen/ArrivalSchedule.h>
 #include <thrift/lib/cpp/test/loadgen/Worker.h>
 #include <thrift/lib/cpp/async/TEventBase.h>
 #include <thrift/lib/cpp/protocol/TBinaryProtocol.h>
@@ -29,6 +30,7 @@
 #include "servicerouter/client/cpp2/ClientFactory.h"
 
 using apache::thrift::test::ClientLoadConfig;
+using apache::thrift::loadgen::ArrivalSchedule;
 using apache::thrift::loadgen::Worker;
 using apache::thrift::protocol::TBinaryProtocolFactory;
 using apache::thrift::protocol::THeaderProtocolFactory;
@@ -68,6 +70,9 @@ class AsyncClientWorker2 : public Worker<
  private:
 
   apache::thrift::async::TEventBase eb_;
+  // Only set when running open-loop; kept across connections so that time
+  // spent reconnecting still counts against the schedule
+  std::unique_ptr<ArrivalSchedule> schedule_;
   TBinaryProtocolFactory binProtoFactory_;
   THeaderProtocolFactory duplexProtoFactory_;
 
@@ -43,6 +43,11 @@ DEFINE_string(sasl_service_tier, "",
 DEFINE_int32(num_threads, 5, "number of threads");
 DEFINE_int64(qps, 0,
              "desired # of queries per second (0 for infinite)");
+DEFINE_bool(open_loop, false,
+            "send requests at --qps regardless of response times, and measure "
+            "latency from the intended send time (async cpp2 client only)");
+DEFINE_bool(poisson, false,
+            "use Poisson rather than evenly spaced arrivals with --open_loop");
 DEFINE_int32(ops_per_conn, 1000,
              "number of operations to issue before opening a new connection");
 DEFINE_int32(async_clients, 1,
@@ -152,6 +157,14 @@ uint64_t ClientLoadConfig::getDesiredQPS() const {
   }
 }
 
+bool ClientLoadConfig::useOpenLoop() const {
+  return FLAGS_open_loop;
+}
+
+bool ClientLoadConfig::usePoissonArrivals() const {
+  return FLAGS_poisson;
+}
+
 uint32_t ClientLoadConfig::pickSleepUsec() {
   return pickLogNormal(FLAGS_sleep_avg, FLAGS_sleep_sigma);
 }
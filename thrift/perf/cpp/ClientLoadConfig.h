@@ -53,6 +53,8 @@ class ClientLoadConfig : public loadgen::WeightedLoadConfig {
   virtual uint32_t pickOpsPerConnection();
   virtual uint32_t getNumWorkerThreads() const;
   virtual uint64_t getDesiredQPS() const;
+  virtual bool useOpenLoop() const;
+  virtual bool usePoissonArrivals() const;
 
   virtual uint32_t getAsyncClients() const;
   virtual uint32_t getAsyncOpsPerClient() const;
@@ -21,6 +21,7 @@
 
 #include <thrift/lib/cpp2/server/ThriftServer.h>
 
+#include <thrift/lib/cpp/async/TAsyncSignalHandler.h>
 #include <thrift/lib/cpp/async/TSyncToAsyncProcessor.h>
 #include <thrift/lib/cpp/concurrency/ThreadManager.h>
 #include <thrift/lib/cpp/concurrency/PosixThreadFactory.h>
@@ -56,6 +57,8 @@ DEFINE_int32(max_requests, 0, "max active requests");
 DEFINE_string(cert, "", "SSL certificate file");
 DEFINE_string(key, "", "SSL private key file");
 DEFINE_bool(queue_sends, true, "Queue sends for better throughput");
+DEFINE_bool(batch_sends, true,
+            "Flush queued sends of all connections on a worker together");
 
 void setTunables(ThriftServer* server) {
   if (FLAGS_idle_timeout > 0) {
@@ -66,13 +69,35 @@ void setTunables(ThriftServer* server) {
   }
 }
 
-ThriftServer *g_server = nullptr;
-
-void sigHandler(int signo) {
-  g_server->stop();
-  exit(0);
+void printWriteStats(ThriftServer* server) {
+  auto stats = server->getWriteStats();
+  cout << "responses: " << stats.messages
+       << " writes: " << stats.writes
+       << " flushes: " << stats.flushes;
+  if (stats.messages > 0) {
+    cout << " writes/response: "
+         << static_cast<double>(stats.writes) / stats.messages;
+  }
+  cout << std::endl;
 }
 
+// Prints the write stats and stops the server on SIGINT.  The stats are
+// printed from the serve event loop, not from the signal handler itself.
+class StopSignalHandler : public TAsyncSignalHandler {
+ public:
+  StopSignalHandler(TEventBase* eventBase, ThriftServer* server)
+    : TAsyncSignalHandler(eventBase)
+    , server_(server) {}
+
+  void signalReceived(int signum) noexcept {
+    printWriteStats(server_);
+    server_->stop();
+  }
+
+ private:
+  ThriftServer* server_;
+};
+
 int main(int argc, char* argv[]) {
   facebook::initFacebook(&argc, &argv);
 
@@ -106,6 +131,7 @@ int main(int argc, char* argv[]) {
   server->setMaxConnections(FLAGS_max_connections);
   server->setMaxRequests(FLAGS_max_requests);
   server->setQueueSends(FLAGS_queue_sends);
+  server->setBatchSends(FLAGS_batch_sends);
 
   if (FLAGS_cert.length() > 0 && FLAGS_key.length() > 0) {
     std::shared_ptr<SSLContext> sslContext(new SSLContext());
@@ -117,8 +143,9 @@ int main(int argc, char* argv[]) {
   // Set tunable server parameters
   setTunables(server.get());
 
-  g_server = server.get();
-  signal(SIGINT, sigHandler);
+  StopSignalHandler sigHandler(server->getEventBaseManager()->getEventBase(),
+                               server.get());
+  sigHandler.registerSignalHandler(SIGINT);
 
   cout << "Serving requests on port " << FLAGS_port << "...\n";
   if (FLAGS_enable_service_framework) {
@@ -131,7 +158,9 @@ int main(int argc, char* argv[]) {
   }
 
   cout << "Exiting normally" << std::endl;
-  fwk->stop();
+  if (fwk) {
+    fwk->stop();
+  }
 
   return 0;
 }
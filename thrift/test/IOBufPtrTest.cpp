@@ -24,6 +24,7 @@
 #include <folly/Memory.h>
 #include <folly/io/IOBufQueue.h>
 #include <thrift/lib/cpp/async/TAsyncSocket.h>
+#include <thrift/lib/cpp2/protocol/Serializer.h>
 #include <thrift/lib/cpp2/server/ThriftServer.h>
 #include "thrift/test/gen-cpp2/IOBufPtrTestService.h"
 
@@ -139,6 +140,59 @@ TEST_F(IOBufPtrTest, Simple) {
   }
 }
 
+namespace {
+
+template <class Serializer>
+void checkZeroCopyRead() {
+  Record rec;
+  rec.name = "a string long enough to be worth not copying";
+  rec.payload = std::string("\x00\x01\x02\x03", 4);
+  EXPECT_EQ("none", rec.tag.str());
+
+  folly::IOBufQueue queue;
+  Serializer::serialize(rec, &queue);
+  auto buf = queue.move();
+  buf->coalesce();
+  auto begin = reinterpret_cast<const char*>(buf->data());
+  auto end = begin + buf->length();
+
+  Record out;
+  Serializer::deserialize(buf.get(), out);
+  EXPECT_EQ(rec.name, out.name);
+  EXPECT_EQ(rec.payload, out.payload);
+  EXPECT_EQ(rec.tag, out.tag);
+
+  // The decoded strings must reference the source buffer, not a copy.
+  EXPECT_GE(out.name.data(), begin);
+  EXPECT_LE(out.name.data() + out.name.size(), end);
+  EXPECT_GE(out.payload.data(), begin);
+  EXPECT_LE(out.payload.data() + out.payload.size(), end);
+
+  // And they keep it alive once the caller drops its reference.
+  buf.reset();
+  EXPECT_EQ(rec.name, out.name);
+  EXPECT_EQ(rec.payload, out.payload);
+}
+
+}  // namespace
+
+TEST(IOBufStringPieceTest, CompactZeroCopy) {
+  checkZeroCopyRead<apache::thrift::CompactSerializer>();
+}
+
+TEST(IOBufStringPieceTest, BinaryZeroCopy) {
+  checkZeroCopyRead<apache::thrift::BinarySerializer>();
+}
+
+TEST(IOBufStringPieceTest, CopyIsIndependent) {
+  Record rec;
+  rec.name = "copied";
+  Record copy = rec;
+  rec.name.clear();
+  EXPECT_TRUE(rec.name.empty());
+  EXPECT_EQ("copied", copy.name.str());
+}
+
 }}}  // namespaces
 
 int main(int argc, char *argv[]) {
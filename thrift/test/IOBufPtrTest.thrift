@@ -2,6 +2,7 @@ namespace cpp2 thrift.test.iobufptr
 
 typedef binary (cpp2.type = "std::unique_ptr<folly::IOBuf>") IOBufPtr
 typedef binary (cpp2.type = "folly::IOBuf") IOBufBinary
+typedef string (cpp2.type = "apache::thrift::IOBufStringPiece") StringPiece
 
 struct Request {
   1: IOBufPtr one,
@@ -9,6 +10,12 @@ struct Request {
   3: IOBufBinary three,
 }
 
+struct Record {
+  1: StringPiece name,
+  2: binary (cpp2.type = "apache::thrift::IOBufStringPiece") payload,
+  3: StringPiece tag = "none",
+}
+
 service IOBufPtrTestService {
   IOBufPtr combine(1: Request req),
 }
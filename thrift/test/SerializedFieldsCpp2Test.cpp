@@ -19,6 +19,7 @@
 
 
 #include <thrift/lib/cpp2/protocol/BinaryProtocol.h>
+#include <thrift/lib/cpp2/protocol/CompactProtocol.h>
 
 #include "thrift/test/gen-cpp2/SerializedFieldsTest_types.h"
 #include "thrift/test/gen-cpp2/SerializedFieldsTest_constants.h"
@@ -34,9 +35,9 @@ const MetaStruct& kTestMetaStruct =
 const ProxyUnknownStruct& kTestProxyUnknownStruct =
     g_SerializedFieldsTest_constants.kTestProxyUnknownStruct;
 
-template<typename T>
+template<typename T, typename Writer = BinaryProtocolWriter>
 string easySerialize(const T& a) {
-  BinaryProtocolWriter prot;
+  Writer prot;
 
   size_t bufSize = a.serializedSize(&prot);
   folly::IOBufQueue queue;
@@ -49,10 +50,10 @@ string easySerialize(const T& a) {
   return string(buf->data(), buf->tail());
 }
 
-template<typename T>
+template<typename T, typename Reader = BinaryProtocolReader>
 T easyDeserialize(const string& s) {
   auto buf = IOBuf::copyBuffer(s);
-  BinaryProtocolReader prot;
+  Reader prot;
   prot.setInput(buf.get());
   T u;
   u.read(&prot);
@@ -163,3 +164,73 @@ TEST(SerializedFields, ChangeProtocolThrow) {
   proxyDeserialized.__serialized_protocol = ProtocolType::T_COMPACT_PROTOCOL;
   EXPECT_THROW({ easySerialize(proxyDeserialized); }, TProtocolException);
 }
+
+TEST(SerializedFields, LazyFieldsPassThrough) {
+  string metaSerialized = easySerialize(kTestMetaStruct);
+
+  auto lazy = easyDeserialize<LazyFieldsStruct>(metaSerialized);
+  EXPECT_EQ(kTestMetaStruct.a_bite, lazy.a_bite);
+  EXPECT_EQ(kTestMetaStruct.str, lazy.str);
+  EXPECT_TRUE(lazy.i64_list.isSerialized());
+  EXPECT_TRUE(lazy.mapping.isSerialized());
+  EXPECT_TRUE(lazy.substruct.isSerialized());
+  EXPECT_TRUE(lazy.substructs.isSerialized());
+
+  // Writing with the same protocol copies the bytes without decoding them.
+  auto lazySerialized = easySerialize(lazy);
+  EXPECT_TRUE(lazy.substruct.isSerialized());
+
+  auto metaDeserialized = easyDeserialize<MetaStruct>(lazySerialized);
+  EXPECT_EQ(kTestMetaStruct.a_bite, metaDeserialized.a_bite);
+  EXPECT_EQ(kTestMetaStruct.str, metaDeserialized.str);
+  EXPECT_EQ(kTestMetaStruct.i64_list, metaDeserialized.i64_list);
+  EXPECT_EQ(kTestMetaStruct.mapping, metaDeserialized.mapping);
+  EXPECT_EQ(kTestMetaStruct.substruct, metaDeserialized.substruct);
+  EXPECT_EQ(kTestMetaStruct.substructs, metaDeserialized.substructs);
+}
+
+TEST(SerializedFields, LazyFieldsDecodeOnAccess) {
+  string metaSerialized = easySerialize(kTestMetaStruct);
+
+  auto lazy = easyDeserialize<LazyFieldsStruct>(metaSerialized);
+  EXPECT_EQ(kTestMetaStruct.substruct, lazy.get_substruct());
+  EXPECT_FALSE(lazy.substruct.isSerialized());
+  EXPECT_TRUE(lazy.substructs.isSerialized());
+  EXPECT_EQ(kTestMetaStruct.substructs, lazy.get_substructs());
+  EXPECT_EQ(kTestMetaStruct.i64_list, lazy.get_i64_list());
+  EXPECT_EQ(kTestMetaStruct.mapping, lazy.get_mapping());
+
+  lazy.mutable_i64_list().push_back(42);
+  lazy.substruct = SubStruct();
+
+  auto metaDeserialized =
+    easyDeserialize<MetaStruct>(easySerialize(lazy));
+  auto expected = kTestMetaStruct.i64_list;
+  expected.push_back(42);
+  EXPECT_EQ(expected, metaDeserialized.i64_list);
+  EXPECT_EQ(SubStruct(), metaDeserialized.substruct);
+  EXPECT_EQ(kTestMetaStruct.substructs, metaDeserialized.substructs);
+}
+
+TEST(SerializedFields, LazyFieldsCompact) {
+  string metaSerialized = easySerialize<MetaStruct, CompactProtocolWriter>(
+    kTestMetaStruct);
+
+  auto lazy = easyDeserialize<LazyFieldsStruct, CompactProtocolReader>(
+    metaSerialized);
+  EXPECT_TRUE(lazy.substructs.isSerialized());
+
+  auto compactSerialized =
+    easySerialize<LazyFieldsStruct, CompactProtocolWriter>(lazy);
+  auto metaDeserialized =
+    easyDeserialize<MetaStruct, CompactProtocolReader>(compactSerialized);
+  EXPECT_EQ(kTestMetaStruct.substructs, metaDeserialized.substructs);
+  EXPECT_EQ(kTestMetaStruct.mapping, metaDeserialized.mapping);
+
+  // A different output protocol has to decode the field.
+  auto binarySerialized = easySerialize(lazy);
+  EXPECT_FALSE(lazy.substructs.isSerialized());
+  metaDeserialized = easyDeserialize<MetaStruct>(binarySerialized);
+  EXPECT_EQ(kTestMetaStruct.substructs, metaDeserialized.substructs);
+  EXPECT_EQ(kTestMetaStruct.substruct, metaDeserialized.substruct);
+}
@@ -55,6 +55,15 @@ view ProxyUnknownStruct : MetaStruct {
   keep_unknown_fields = 1
 )
 
+view LazyFieldsStruct : MetaStruct {
+  a_bite,
+  str,
+  i64_list (cpp.lazy = "1"),
+  mapping (cpp.lazy = "1"),
+  substruct (cpp.lazy = "1"),
+  substructs (cpp.lazy = "1"),
+}
+
 const MetaStruct kTestMetaStruct = {
   'a_bite': 123,
   'integer64': 4567890,
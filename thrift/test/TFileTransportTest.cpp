@@ -21,24 +21,47 @@
 #endif
 
 #include <sys/time.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <boost/test/unit_test.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <atomic>
 #include <deque>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <thrift/lib/cpp/concurrency/Mutex.h>
 #include <thrift/lib/cpp/concurrency/Util.h>
+#include <thrift/lib/cpp/TProcessor.h>
+#include <thrift/lib/cpp/protocol/TBinaryProtocol.h>
+#include <thrift/lib/cpp/transport/TBufferTransports.h>
 #include <thrift/lib/cpp/transport/TFileTransport.h>
 #include <thrift/lib/cpp/test/TimeUtil.h>
 
 using apache::thrift::concurrency::Guard;
 using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::Util;
+using apache::thrift::TProcessor;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::server::TConnectionContext;
+using apache::thrift::transport::TFileProcessor;
 using apache::thrift::transport::TFileTransport;
+using apache::thrift::transport::TMappedFileReader;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
 using apache::thrift::test::TimePoint;
 using boost::scoped_ptr;
 using boost::test_tools::predicate_result;
 using std::deque;
+using std::shared_ptr;
+using std::string;
+using std::vector;
 
 /**************************************************************************
  * Global state
@@ -197,6 +220,150 @@ class TempFile {
   int fd_;
 };
 
+/**
+ * Returns the content of event seq written by thread id, with a length that
+ * varies from one event to the next.
+ */
+string makeEvent(uint32_t id, uint32_t seq) {
+  std::ostringstream event;
+  event << "t" << id << ":" << seq << ":" << string((seq * 7) % 97, 'x');
+  return event.str();
+}
+
+void writeEvent(TFileTransport* transport, const string& event) {
+  transport->write(reinterpret_cast<const uint8_t*>(event.data()),
+                   event.size());
+}
+
+/**
+ * Reads back every event of the file at path with a TFileTransport.
+ */
+vector<string> readEvents(const char* path, uint32_t chunkSize) {
+  TFileTransport reader(path, true);
+  reader.setChunkSize(chunkSize);
+  reader.setReadTimeout(TFileTransport::NO_TAIL_READ_TIMEOUT);
+
+  vector<string> events;
+  uint8_t buf[64 * 1024];
+  uint32_t len;
+  while ((len = reader.read(buf, sizeof(buf))) > 0) {
+    events.emplace_back(reinterpret_cast<char*>(buf), len);
+  }
+  return events;
+}
+
+string readFile(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  std::ostringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+/**
+ * Writes events with a default mode TFileTransport, one per write().
+ */
+void writeDefault(const char* path, uint32_t chunkSize,
+                  const vector<string>& events) {
+  TFileTransport transport(path);
+  transport.setChunkSize(chunkSize);
+  for (const auto& event : events) {
+    writeEvent(&transport, event);
+  }
+}
+
+/**
+ * Returns value as TBinaryProtocol would write it as a string, so that
+ * RecordingProcessor can read it back.
+ */
+string frame(const string& value) {
+  uint32_t size = htonl(value.size());
+  return string(reinterpret_cast<char*>(&size), 4) + value;
+}
+
+/**
+ * Returns the key of an event written by writeKeyedEvents().
+ */
+uint64_t keyOf(const uint8_t* event, uint32_t size) {
+  uint32_t key = 0;
+  sscanf(string(reinterpret_cast<const char*>(event) + 4, size - 4).c_str(),
+         "k%u:", &key);
+  return key;
+}
+
+/**
+ * Writes events for NUM_KEYS keys to path in chunks of chunkSize, and
+ * returns them in file order.
+ */
+vector<string> writeKeyedEvents(const char* path, uint32_t chunkSize,
+                                uint32_t numEvents) {
+  uint32_t const NUM_KEYS = 7;
+
+  vector<string> events;
+  vector<uint32_t> next(NUM_KEYS, 0);
+  for (uint32_t n = 0; n < numEvents; ++n) {
+    uint32_t key = (n * 5) % NUM_KEYS;
+    std::ostringstream event;
+    event << "k" << key << ":" << next[key]++ << ":" << string(n % 101, 'x');
+    events.push_back(frame(event.str()));
+  }
+  writeDefault(path, chunkSize, events);
+  return events;
+}
+
+/**
+ * Records the string read from each event it processes, in the order the
+ * events were processed.
+ */
+class RecordingProcessor : public TProcessor {
+ public:
+  using TProcessor::process;
+
+  bool process(shared_ptr<TProtocol> in,
+               shared_ptr<TProtocol> /*out*/,
+               TConnectionContext* /*connectionContext*/) override {
+    string event;
+    in->readString(event);
+    Guard g(mutex_);
+    events_.push_back(event);
+    return true;
+  }
+
+  vector<string> getEvents() {
+    Guard g(mutex_);
+    return events_;
+  }
+
+ private:
+  Mutex mutex_;
+  vector<string> events_;
+};
+
+shared_ptr<TFileProcessor> makeFileProcessor(
+    const shared_ptr<RecordingProcessor>& processor, const char* path,
+    uint32_t chunkSize) {
+  auto input = std::make_shared<TFileTransport>(path, true);
+  input->setChunkSize(chunkSize);
+  input->setReadTimeout(TFileTransport::NO_TAIL_READ_TIMEOUT);
+  return std::make_shared<TFileProcessor>(
+    processor, std::make_shared<TBinaryProtocolFactory>(), input);
+}
+
+/**
+ * Returns the events of every chunk of reader, and whether each chunk was
+ * read in full.
+ */
+vector<string> mappedEvents(const TMappedFileReader& reader,
+                            vector<bool>* complete) {
+  vector<string> events;
+  for (uint32_t chunk = 0; chunk < reader.getNumChunks(); ++chunk) {
+    complete->push_back(reader.forEachEvent(chunk, [&](const uint8_t* event,
+                                                       uint32_t size) {
+      events.emplace_back(reinterpret_cast<const char*>(event), size);
+    }));
+  }
+  return events;
+}
+
 // Use our own version of fsync() for testing.
 // This returns immediately, so timing in test_destructor() isn't affected by
 // waiting on the actual filesystem.
@@ -367,6 +534,415 @@ BOOST_AUTO_TEST_CASE(test_noop_flush) {
   }
 }
 
+/**
+ * Write from many threads with group commit, and make sure every event is
+ * read back and the events of each thread keep their order.
+ *
+ * The second round of threads reuses the rings of the first one.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit_threads) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const NUM_THREADS = 8;
+  uint32_t const NUM_ROUNDS = 2;
+  uint32_t const NUM_EVENTS = 2000;
+  uint32_t const CHUNK_SIZE = 16 * 1024;
+
+  scoped_ptr<TFileTransport> transport(new TFileTransport(f.getPath()));
+  transport->setChunkSize(CHUNK_SIZE);
+  transport->setGroupCommit(true);
+  // small rings so that writers have to wait for the writer thread
+  transport->setRingSize(4096);
+
+  for (uint32_t round = 0; round < NUM_ROUNDS; ++round) {
+    vector<std::thread> threads;
+    for (uint32_t n = 0; n < NUM_THREADS; ++n) {
+      uint32_t id = round * NUM_THREADS + n;
+      threads.emplace_back([&transport, id] {
+        for (uint32_t seq = 0; seq < NUM_EVENTS; ++seq) {
+          writeEvent(transport.get(), makeEvent(id, seq));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  transport.reset();
+
+  vector<uint32_t> next(NUM_ROUNDS * NUM_THREADS, 0);
+  for (const auto& event : readEvents(f.getPath(), CHUNK_SIZE)) {
+    uint32_t id;
+    uint32_t seq;
+    BOOST_REQUIRE_EQUAL(sscanf(event.c_str(), "t%u:%u:", &id, &seq), 2);
+    BOOST_REQUIRE_LT(id, next.size());
+    BOOST_REQUIRE_EQUAL(seq, next[id]);
+    BOOST_REQUIRE_EQUAL(event, makeEvent(id, seq));
+    ++next[id];
+  }
+  for (uint32_t id = 0; id < next.size(); ++id) {
+    BOOST_CHECK_EQUAL(next[id], NUM_EVENTS);
+  }
+}
+
+/**
+ * Make sure group commit pads events straddling a chunk boundary exactly as
+ * the default mode does, so that both write the same file.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit_padding) {
+  TempFile expected(tmp_dir, "thrift.TFileTransportTest.");
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+
+  vector<string> events;
+  for (uint32_t seq = 0; seq < 500; ++seq) {
+    events.push_back(makeEvent(0, seq));
+  }
+  writeDefault(expected.getPath(), CHUNK_SIZE, events);
+
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(CHUNK_SIZE);
+    transport.setGroupCommit(true);
+    for (const auto& event : events) {
+      writeEvent(&transport, event);
+    }
+  }
+
+  string content = readFile(f.getPath());
+  BOOST_CHECK_GT(content.size(), 4 * CHUNK_SIZE);
+  BOOST_CHECK(content == readFile(expected.getPath()));
+  BOOST_CHECK(readEvents(f.getPath(), CHUNK_SIZE) == events);
+}
+
+/**
+ * Make sure an event larger than half the ring is dropped without affecting
+ * the events around it.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit_oversized_event) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024 * 1024;
+
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(CHUNK_SIZE);
+    transport.setGroupCommit(true);
+    transport.setRingSize(4096);
+    writeEvent(&transport, "before");
+    writeEvent(&transport, string(3000, 'x'));
+    writeEvent(&transport, "after");
+  }
+
+  vector<string> events = readEvents(f.getPath(), CHUNK_SIZE);
+  BOOST_REQUIRE_EQUAL(events.size(), size_t(2));
+  BOOST_CHECK_EQUAL(events[0], "before");
+  BOOST_CHECK_EQUAL(events[1], "after");
+}
+
+/**
+ * Make sure flush() writes out the events of every ring before returning,
+ * and the destructor those of threads that have exited since.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit_flush_and_destructor) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const NUM_EVENTS = 100;
+  uint32_t const CHUNK_SIZE = 1024 * 1024;
+
+  scoped_ptr<TFileTransport> transport(new TFileTransport(f.getPath()));
+  transport->setChunkSize(CHUNK_SIZE);
+  transport->setGroupCommit(true);
+
+  vector<string> events;
+  for (uint32_t seq = 0; seq < NUM_EVENTS; ++seq) {
+    events.push_back(makeEvent(0, seq));
+    writeEvent(transport.get(), events.back());
+  }
+  transport->flush();
+  BOOST_CHECK(readEvents(f.getPath(), CHUNK_SIZE) == events);
+
+  std::thread thread([&] {
+    for (uint32_t seq = 0; seq < NUM_EVENTS; ++seq) {
+      writeEvent(transport.get(), makeEvent(1, seq));
+    }
+  });
+  thread.join();
+  for (uint32_t seq = 0; seq < NUM_EVENTS; ++seq) {
+    events.push_back(makeEvent(1, seq));
+  }
+
+  transport.reset();
+  BOOST_CHECK(readEvents(f.getPath(), CHUNK_SIZE) == events);
+}
+
+/**
+ * Make sure writer threads can exit while the transport is being destroyed.
+ *
+ * Exiting marks the thread's ring as unowned, which must not touch the
+ * rings once the transport has freed them.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit_thread_exit_during_destructor) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const NUM_ITERATIONS = 100;
+  uint32_t const NUM_THREADS = 4;
+  uint32_t const CHUNK_SIZE = 1024 * 1024;
+
+  for (uint32_t n = 0; n < NUM_ITERATIONS; ++n) {
+    ftruncate(f.getFD(), 0);
+
+    scoped_ptr<TFileTransport> transport(new TFileTransport(f.getPath()));
+    transport->setChunkSize(CHUNK_SIZE);
+    transport->setGroupCommit(true);
+
+    std::atomic<uint32_t> written(0);
+    std::atomic<bool> done(false);
+    vector<std::thread> threads;
+    for (uint32_t id = 0; id < NUM_THREADS; ++id) {
+      threads.emplace_back([&, id] {
+        writeEvent(transport.get(), makeEvent(id, 0));
+        ++written;
+        while (!done) {
+        }
+      });
+    }
+    while (written < NUM_THREADS) {
+    }
+
+    // let the threads exit while the destructor runs
+    done = true;
+    transport.reset();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(readEvents(f.getPath(), CHUNK_SIZE).size(),
+                      NUM_THREADS);
+  }
+}
+
+/**
+ * Make sure group commit with O_DIRECT writes the same file as the default
+ * mode, including the last partial block, when the file system supports it.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit_direct_io) {
+#ifdef O_DIRECT
+  // /dev/shm does not support O_DIRECT
+  TempFile expected("/tmp", "thrift.TFileTransportTest.");
+  TempFile f("/tmp", "thrift.TFileTransportTest.");
+
+  int fd = ::open(f.getPath(), O_WRONLY | O_DIRECT);
+  if (fd < 0) {
+    BOOST_TEST_MESSAGE("O_DIRECT is not supported in /tmp, skipping");
+    return;
+  }
+  ::close(fd);
+
+  uint32_t const NUM_BATCHES = 5;
+  uint32_t const NUM_EVENTS = 300;
+  uint32_t const CHUNK_SIZE = 4 * 4096;
+
+  vector<string> events;
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(CHUNK_SIZE);
+    transport.setGroupCommit(true);
+    transport.setDirectIO(true);
+    for (uint32_t batch = 0; batch < NUM_BATCHES; ++batch) {
+      for (uint32_t seq = 0; seq < NUM_EVENTS; ++seq) {
+        events.push_back(makeEvent(batch, seq));
+        writeEvent(&transport, events.back());
+      }
+      // each flush leaves a partial block to rewrite with the next batch
+      transport.flush();
+    }
+  }
+  writeDefault(expected.getPath(), CHUNK_SIZE, events);
+
+  BOOST_CHECK(readFile(f.getPath()) == readFile(expected.getPath()));
+  BOOST_CHECK(readEvents(f.getPath(), CHUNK_SIZE) == events);
+#else
+  BOOST_TEST_MESSAGE("O_DIRECT is not supported, skipping");
+#endif
+}
+
+/**
+ * Make sure TMappedFileReader skips chunk padding and returns every event in
+ * file order.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_reader_padding) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+  vector<string> events = writeKeyedEvents(f.getPath(), CHUNK_SIZE, 500);
+
+  TMappedFileReader reader(f.getPath(), CHUNK_SIZE);
+  BOOST_CHECK_EQUAL(reader.getSize(), readFile(f.getPath()).size());
+  BOOST_CHECK_GT(reader.getNumChunks(), 4u);
+
+  vector<bool> complete;
+  BOOST_CHECK(mappedEvents(reader, &complete) == events);
+  BOOST_CHECK(complete == vector<bool>(reader.getNumChunks(), true));
+}
+
+/**
+ * Make sure an event cut short by the end of the file stops its chunk
+ * without being returned.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_reader_truncated) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+  vector<string> events = writeKeyedEvents(f.getPath(), CHUNK_SIZE, 500);
+
+  // cut the last event in the middle
+  BOOST_REQUIRE_EQUAL(ftruncate(f.getFD(),
+                                readFile(f.getPath()).size() - 3), 0);
+  events.pop_back();
+
+  TMappedFileReader reader(f.getPath(), CHUNK_SIZE);
+  vector<bool> complete;
+  BOOST_CHECK(mappedEvents(reader, &complete) == events);
+  BOOST_REQUIRE_EQUAL(complete.size(), reader.getNumChunks());
+  BOOST_CHECK(!complete.back());
+  complete.pop_back();
+  BOOST_CHECK(complete == vector<bool>(complete.size(), true));
+}
+
+/**
+ * Make sure a corrupted event size running past the end of its chunk stops
+ * that chunk only.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_reader_corrupted_size) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+  writeKeyedEvents(f.getPath(), CHUNK_SIZE, 500);
+
+  TMappedFileReader before(f.getPath(), CHUNK_SIZE);
+  vector<bool> complete;
+  vector<string> events = mappedEvents(before, &complete);
+
+  // the second chunk starts with the size of its first event
+  uint32_t size = 2 * CHUNK_SIZE;
+  BOOST_REQUIRE_EQUAL(pwrite(f.getFD(), &size, 4, CHUNK_SIZE), 4);
+
+  TMappedFileReader reader(f.getPath(), CHUNK_SIZE);
+  vector<string> first;
+  BOOST_CHECK(reader.forEachEvent(0, [&](const uint8_t* event,
+                                         uint32_t eventSize) {
+    first.emplace_back(reinterpret_cast<const char*>(event), eventSize);
+  }));
+  uint32_t count = 0;
+  BOOST_CHECK(!reader.forEachEvent(1, [&](const uint8_t*, uint32_t) {
+    ++count;
+  }));
+  BOOST_CHECK_EQUAL(count, 0u);
+
+  vector<string> rest;
+  for (uint32_t chunk = 2; chunk < reader.getNumChunks(); ++chunk) {
+    BOOST_CHECK(reader.forEachEvent(chunk, [&](const uint8_t* event,
+                                               uint32_t eventSize) {
+      rest.emplace_back(reinterpret_cast<const char*>(event), eventSize);
+    }));
+  }
+  BOOST_REQUIRE_GT(first.size() + rest.size(), 0u);
+  BOOST_CHECK(vector<string>(events.begin(), events.begin() + first.size()) ==
+              first);
+  BOOST_CHECK(vector<string>(events.end() - rest.size(), events.end()) ==
+              rest);
+}
+
+/**
+ * Make sure processParallel() without a key processes as many events as
+ * process() does.
+ */
+BOOST_AUTO_TEST_CASE(test_process_parallel) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+  uint32_t const NUM_EVENTS = 2000;
+  writeKeyedEvents(f.getPath(), CHUNK_SIZE, NUM_EVENTS);
+
+  auto sequential = std::make_shared<RecordingProcessor>();
+  makeFileProcessor(sequential, f.getPath(), CHUNK_SIZE)->process(0, false);
+  BOOST_CHECK_EQUAL(sequential->getEvents().size(), NUM_EVENTS);
+
+  auto parallel = std::make_shared<RecordingProcessor>();
+  TFileProcessor::ParallelOptions options;
+  options.chunkSize = CHUNK_SIZE;
+  uint64_t processed = makeFileProcessor(parallel, f.getPath(), CHUNK_SIZE)
+    ->processParallel(f.getPath(), options);
+  BOOST_CHECK_EQUAL(processed, sequential->getEvents().size());
+
+  vector<string> expected = sequential->getEvents();
+  vector<string> events = parallel->getEvents();
+  std::sort(expected.begin(), expected.end());
+  std::sort(events.begin(), events.end());
+  BOOST_CHECK(events == expected);
+}
+
+/**
+ * Make sure processParallel() with a key processes the events of each key in
+ * file order, across several windows of chunks.
+ */
+BOOST_AUTO_TEST_CASE(test_process_parallel_keyed) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+  uint32_t const NUM_EVENTS = 2000;
+  writeKeyedEvents(f.getPath(), CHUNK_SIZE, NUM_EVENTS);
+
+  TFileProcessor::ParallelOptions options;
+  options.numThreads = 4;
+  options.chunkSize = CHUNK_SIZE;
+  options.key = keyOf;
+  // several windows of numThreads * 2 chunks
+  BOOST_REQUIRE_GT(TMappedFileReader(f.getPath(), CHUNK_SIZE).getNumChunks(),
+                   4 * options.numThreads * 2);
+
+  auto processor = std::make_shared<RecordingProcessor>();
+  uint64_t processed = makeFileProcessor(processor, f.getPath(), CHUNK_SIZE)
+    ->processParallel(f.getPath(), options);
+  BOOST_CHECK_EQUAL(processed, NUM_EVENTS);
+
+  vector<uint32_t> next;
+  for (const auto& event : processor->getEvents()) {
+    uint32_t key;
+    uint32_t seq;
+    BOOST_REQUIRE_EQUAL(sscanf(event.c_str(), "k%u:%u:", &key, &seq), 2);
+    if (key >= next.size()) {
+      next.resize(key + 1, 0);
+    }
+    BOOST_REQUIRE_EQUAL(seq, next[key]);
+    ++next[key];
+  }
+  BOOST_CHECK_EQUAL(processor->getEvents().size(), NUM_EVENTS);
+}
+
+/**
+ * Make sure processParallel() refuses an output transport it would have to
+ * share between its threads.
+ */
+BOOST_AUTO_TEST_CASE(test_process_parallel_output_transport) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  uint32_t const CHUNK_SIZE = 1024;
+  writeKeyedEvents(f.getPath(), CHUNK_SIZE, 100);
+
+  auto input = std::make_shared<TFileTransport>(f.getPath(), true);
+  TFileProcessor fileProcessor(std::make_shared<RecordingProcessor>(),
+                               std::make_shared<TBinaryProtocolFactory>(),
+                               input,
+                               std::make_shared<TMemoryBuffer>());
+  TFileProcessor::ParallelOptions options;
+  options.chunkSize = CHUNK_SIZE;
+  BOOST_CHECK_THROW(fileProcessor.processParallel(f.getPath(), options),
+                    TTransportException);
+}
+
 /**************************************************************************
  * General Initialization
  **************************************************************************/